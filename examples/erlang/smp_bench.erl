@@ -0,0 +1,68 @@
+-module(smp_bench).
+
+-export([start/0]).
+
+-define(WORKERS_PER_SCHEDULER, 4).
+-define(FIB, 24).
+-define(PING_PONGS, 20000).
+
+start() ->
+    Schedulers = erlang:system_info(schedulers),
+    Workers = Schedulers * ?WORKERS_PER_SCHEDULER,
+    console:puts("schedulers: "), erlang:display(Schedulers),
+
+    console:puts("fib ms: "),
+    erlang:display(measure(fun() -> run(Workers, fun() -> fib(?FIB) end) end)),
+
+    console:puts("ping pong ms: "),
+    erlang:display(measure(fun() -> run(Workers div 2, fun() -> ping_pong(?PING_PONGS) end) end)),
+    ok.
+
+measure(Fun) ->
+    Start = erlang:system_time(millisecond),
+    Fun(),
+    erlang:system_time(millisecond) - Start.
+
+run(N, Fun) ->
+    Self = self(),
+    spawn_workers(N, Self, Fun),
+    wait_workers(N).
+
+spawn_workers(0, _Parent, _Fun) ->
+    ok;
+spawn_workers(N, Parent, Fun) ->
+    spawn(fun() -> Fun(), Parent ! done end),
+    spawn_workers(N - 1, Parent, Fun).
+
+wait_workers(0) ->
+    ok;
+wait_workers(N) ->
+    receive
+        done -> wait_workers(N - 1)
+    end.
+
+fib(0) -> 0;
+fib(1) -> 1;
+fib(N) -> fib(N - 1) + fib(N - 2).
+
+ping_pong(N) ->
+    Pong = spawn(fun pong/0),
+    ping(N, Pong).
+
+ping(0, Pong) ->
+    Pong ! stop,
+    ok;
+ping(N, Pong) ->
+    Pong ! {ping, self()},
+    receive
+        pong -> ping(N - 1, Pong)
+    end.
+
+pong() ->
+    receive
+        {ping, From} ->
+            From ! pong,
+            pong();
+        stop ->
+            ok
+    end.
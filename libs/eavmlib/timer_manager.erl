@@ -19,27 +19,14 @@
 
 %%-----------------------------------------------------------------------------
 %% @hidden
+%% @doc     Timers are implemented by the VM scheduler, this module only
+%%          delegates to the erlang timer functions and it is kept for
+%%          compatibility.
+%% @end
 %%-----------------------------------------------------------------------------
 -module(timer_manager).
 
--export([start/0, start_timer/3, cancel_timer/1, get_timer_refs/0, send_after/3]).
--export([init/1, handle_call/3, handle_cast/2, handle_info/2, terminate/2]).
--export([run_timer/5, send_after_timer/3]).
-
--include("estdlib.hrl").
-
--record(state, {
-    timers = [] :: [{reference(), pid()}]
-}).
-
--include("logger.hrl").
-
--define(SERVER_NAME, ?MODULE).
-
--spec start() -> {ok, Pid::pid()} | {error, Reason::term()}.
-start() ->
-    ?LOG_DEBUG(start),
-    ?GEN_SERVER:start({local, ?SERVER_NAME}, ?MODULE, [], []).
+-export([start_timer/3, cancel_timer/1, read_timer/1, send_after/3]).
 
 %%-----------------------------------------------------------------------------
 %% @param   Time time in milliseconds after which to send the timeout message.
@@ -50,35 +37,31 @@ start() ->
 %%          Time ms, where TimerRef is the reference returned from this function.
 %% @end
 %%-----------------------------------------------------------------------------
--spec start_timer(Time::non_neg_integer(), Dest::pid(), Msg::term()) -> TimerRef::reference().
+-spec start_timer(Time::non_neg_integer(), Dest::pid() | atom(), Msg::term()) -> TimerRef::reference().
 start_timer(Time, Dest, Msg) ->
-    ?LOG_DEBUG({start_timer, Time, Dest, Msg}),
-    start(),
-    ?GEN_SERVER:call(?SERVER_NAME, {Time, Dest, Msg}).
+    erlang:start_timer(Time, Dest, Msg).
 
 %%-----------------------------------------------------------------------------
-%% @hidden
-%% @param   Time time in milliseconds after which to send the timeout message.
-%% @param   Dest Pid or server name to which to send the timeout message.
-%% @param   Msg Message to send to Dest after Time ms.
-%% @param   Options options
-%% @returns a reference that can be used to cancel the timer, if desired.
-%% @doc     Start a timer, and send {timeout, TimerRef, Msg} to Dest after
-%%          Time ms, where TimerRef is the reference returned from this function.
-%%
-%%          <em><b>Note.</b>  The Options argument is currently ignored.</em>
+%% @param   TimerRef a reference returned by start_timer/3 or send_after/3.
+%% @returns the time in milliseconds that was left before the timer expiry, or
+%%          false if the timer has already expired or it has been cancelled.
+%% @doc     Cancel a timer.
+%% @end
 %%-----------------------------------------------------------------------------
--spec cancel_timer(TimerRef::reference()) -> ok.
+-spec cancel_timer(TimerRef::reference()) -> non_neg_integer() | false.
 cancel_timer(TimerRef) ->
-    ?LOG_DEBUG({cancel_timer, TimerRef}),
-    start(),
-    ?GEN_SERVER:call(?SERVER_NAME, {cancel, TimerRef}).
+    erlang:cancel_timer(TimerRef).
 
--spec get_timer_refs() -> [reference()].
-get_timer_refs() ->
-    ?LOG_DEBUG(get_timer_refs),
-    start(),
-    ?GEN_SERVER:call(?SERVER_NAME, get_timer_refs).
+%%-----------------------------------------------------------------------------
+%% @param   TimerRef a reference returned by start_timer/3 or send_after/3.
+%% @returns the time in milliseconds that is left before the timer expiry, or
+%%          false if the timer has already expired or it has been cancelled.
+%% @doc     Read the time left before a timer expires.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec read_timer(TimerRef::reference()) -> non_neg_integer() | false.
+read_timer(TimerRef) ->
+    erlang:read_timer(TimerRef).
 
 %%-----------------------------------------------------------------------------
 %% @param   Time time in milliseconds after which to send the message.
@@ -90,78 +73,4 @@ get_timer_refs() ->
 %%-----------------------------------------------------------------------------
 -spec send_after(non_neg_integer(), pid() | atom(), term()) -> reference().
 send_after(Time, Dest, Msg) ->
-    TimerRef = erlang:make_ref(),
-    spawn(?MODULE, send_after_timer, [Time, Dest, Msg]),
-    TimerRef.
-
-
-%%
-%% ?GEN_SERVER callbacks
-%%
-
-%% @hidden
-init([]) ->
-    {ok, #state{}}.
-
-%% @hidden
-handle_call(get_timer_refs, _From, #state{timers=Timers} = State) ->
-    ?LOG_DEBUG({handle_call, get_timer_refs, State}),
-    {reply, [TimerRef || {TimerRef, _Pid} <- Timers], State};
-handle_call({cancel, TimerRef}, From, #state{timers=Timers} = State) ->
-    ?LOG_DEBUG({handle_call, cancel, State}),
-    case ?LISTS:keyfind(TimerRef, 1, Timers) of
-        false ->
-            {reply, false, State};
-        {TimerRef, Pid} ->
-            Pid ! {cancel, From},
-            {noreply, State}
-    end;
-handle_call({Time, Dest, Msg}, _From, #state{timers=Timers} = State) ->
-    ?LOG_DEBUG({handle_call, start_timer, State}),
-    {TimerRef, Pid} = do_start_timer(Time, Dest, Msg),
-    {reply, TimerRef, State#state{timers=[{TimerRef, Pid} | Timers]}}.
-
-%% @hidden
-handle_cast(_Request, State) ->
-    {noreply, State}.
-
-%% @hidden
-handle_info({finished, TimerRef}, #state{timers=Timers} = State) ->
-    ?LOG_DEBUG({handle_info, finished, State}),
-    {noreply, State#state{timers=?LISTS:keydelete(TimerRef, 1, Timers)}}.
-
-%% @hidden
-terminate(_Reason, _State) ->
-    ok.
-
-
-%%=============================================================================
-%% internal functions
-
-%% @private
-do_start_timer(Time, Dest, Msg) ->
-    TimerRef = erlang:make_ref(),
-    Pid = spawn(?MODULE, run_timer, [self(), Time, TimerRef, Dest, Msg]),
-    {TimerRef, Pid}.
-
-%% @private
-run_timer(MgrPid, Time, TimerRef, Dest, Msg) ->
-    ?LOG_DEBUG({run_timer, [MgrPid, Time, TimerRef, Dest, Msg]}),
-    Start = erlang:timestamp(),
-    receive
-        {cancel, From} ->
-            ?LOG_DEBUG({run_timer, received_cancel, From}),
-            ?GEN_SERVER:reply(From, Time - timestamp_util:delta_ms(erlang:timestamp(), Start))
-    after Time ->
-        ?LOG_DEBUG({run_timer, timed_out, Time}),
-        Dest ! {timeout, TimerRef, Msg}
-    end,
-    MgrPid ! {finished, TimerRef}.
-
-%% @private
-send_after_timer(Time, Dest, Msg) ->
-    TimerRef = start_timer(Time, self(), Msg),
-    receive
-        {timeout, TimerRef, Msg} ->
-            Dest ! Msg
-    end.
+    erlang:send_after(Time, Dest, Msg).
@@ -0,0 +1,235 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%   Copyright 2018 by Fred Dushin <fred@dushin.net>                       %
+%                                                                         %
+%   This program is free software; you can redistribute it and/or modify  %
+%   it under the terms of the GNU Lesser General Public License as        %
+%   published by the Free Software Foundation; either version 2 of the    %
+%   License, or (at your option) any later version.                       %
+%                                                                         %
+%   This program is distributed in the hope that it will be useful,       %
+%   but WITHOUT ANY WARRANTY; without even the implied warranty of        %
+%   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         %
+%   GNU General Public License for more details.                          %
+%                                                                         %
+%   You should have received a copy of the GNU General Public License     %
+%   along with this program; if not, write to the                         %
+%   Free Software Foundation, Inc.,                                       %
+%   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+%%-----------------------------------------------------------------------------
+%% @doc An implementation of the Erlang/OTP gen_tcp interface.
+%%
+%% This module provides an implementation of the Erlang/OTP gen_tcp interface.
+%% It is designed to be API-compatible with gen_tcp, with exceptions noted
+%% below.
+%%
+%% Sockets are the pids of the underlying ports, so that messages delivered
+%% in active mode can be matched on the socket, as in `{tcp, Socket, Data}'.
+%%
+%% Caveats:
+%% <ul>
+%%     <li>Currently no support for IPv6 or host names</li>
+%%     <li>Only the active, packet, packet_size, buffer and recbuf socket options are supported</li>
+%%     <li>Received data is always delivered as binaries</li>
+%%     <li>Timeouts are ignored</li>
+%% </ul>
+%%
+%% <em><b>Note.</b>  Port drivers for this interface are not supported
+%% on all AtomVM platforms.</em>
+%% @end
+%%-----------------------------------------------------------------------------
+-module(avm_gen_tcp).
+
+-export([connect/3, listen/2, accept/1, accept/2, send/2, recv/2, recv/3, setopts/2, close/1]).
+
+-type port_num() :: 0..65535.
+-type socket() :: pid().
+-type proplist() :: [{atom(), any()}].
+-type address() :: ipv4_address().
+-type ipv4_address() :: {octet(), octet(), octet(), octet()}.
+-type octet() :: 0..255.
+-type packet() :: string() | binary().
+-type reason() :: term().
+
+-export_type([socket/0]).
+
+%%-----------------------------------------------------------------------------
+%% @param   Address the address of the host to connect to
+%% @param   Port the port number on the host to connect to
+%% @param   Options A list of configuration parameters.
+%% @returns {ok, Socket} | {error, Reason}
+%% @doc     Connect to a TCP server.  The calling process becomes the owner
+%%          of the socket and receives its messages in active mode.
+%%
+%%          The following options are supported:
+%%          <ul>
+%%              <li>`{active, true | false | once | N}' delivers received
+%%              data to the owner as `{tcp, Socket, Data}' messages; after N
+%%              messages the socket goes back to passive mode and
+%%              `{tcp_passive, Socket}' is sent.  `{tcp_closed, Socket}' is
+%%              sent when the connection is closed by the peer</li>
+%%              <li>`{packet, 0 | 1 | 2 | 4}' each message is prefixed by a big
+%%              endian length header of the given size, 0 means no framing</li>
+%%              <li>`{packet_size, Size}' the maximum length of a message
+%%              body when the packet option is set, 1 MiB by default and 0
+%%              for no limit.  A message with a longer length header is
+%%              refused with `{error, emsgsize}', or `{tcp_error, Socket,
+%%              emsgsize}' in active mode, and the socket is closed</li>
+%%              <li>`{buffer, Size}' the size of the receive buffer, when there
+%%              is no framing received data is delivered in chunks up to this
+%%              size</li>
+%%              <li>`{recbuf, Size}' the size of the kernel receive buffer</li>
+%%          </ul>
+%%
+%%          <em><b>Note.</b> Currently only ipv4 addresses are supported.</em>
+%% @end
+%%-----------------------------------------------------------------------------
+-spec connect(address(), port_num(), proplist()) -> {ok, socket()} | {error, reason()}.
+connect(Address, Port, Options) ->
+    Socket = open_port({spawn, "socket"}, []),
+    case call(Socket, {init, [{proto, tcp} | Options]}) of
+        ok ->
+            case call(Socket, {connect, Address, Port}) of
+                ok ->
+                    {ok, Socket};
+                Error ->
+                    close(Socket),
+                    Error
+            end;
+        Error ->
+            Error
+    end.
+
+%%-----------------------------------------------------------------------------
+%% @param   Port the port number to listen on.  Specify 0 to use an
+%%          OS-assigned port number.
+%% @param   Options A list of configuration parameters.
+%% @returns {ok, Socket} | {error, Reason}
+%% @doc     Create a TCP socket listening for connections.  The options
+%%          supported by connect/3 are inherited by accepted sockets, in
+%%          addition `{backlog, N}' sets the length of the queue of pending
+%%          connections (5 by default).
+%% @end
+%%-----------------------------------------------------------------------------
+-spec listen(port_num(), proplist()) -> {ok, socket()} | {error, reason()}.
+listen(Port, Options) ->
+    Backlog = avm_proplists:get_value(backlog, Options, 5),
+    Socket = open_port({spawn, "socket"}, []),
+    case call(Socket, {init, [{proto, tcp} | Options]}) of
+        ok ->
+            case call(Socket, {bind, {0, 0, 0, 0}, Port}) of
+                {ok, _ActualPort} ->
+                    case call(Socket, {listen, Backlog}) of
+                        ok ->
+                            {ok, Socket};
+                        Error ->
+                            close(Socket),
+                            Error
+                    end;
+                Error ->
+                    close(Socket),
+                    Error
+            end;
+        Error ->
+            Error
+    end.
+
+%%-----------------------------------------------------------------------------
+%% @equiv   accept(ListenSocket, infinity)
+%% @doc     Accept a connection on a listening socket.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec accept(socket()) -> {ok, socket()} | {error, reason()}.
+accept(ListenSocket) ->
+    accept(ListenSocket, infinity).
+
+%%-----------------------------------------------------------------------------
+%% @param   ListenSocket the socket returned by listen/2
+%% @param   Timeout the amount of time to wait for a connection
+%% @returns {ok, Socket} | {error, Reason}
+%% @doc     Accept a connection on a listening socket.  This call will block
+%%          until a connection is available, the calling process becomes the
+%%          owner of the new socket.
+%%
+%%          <em><b>Note.</b> Currently the Timeout parameter is ignored.</em>
+%% @end
+%%-----------------------------------------------------------------------------
+-spec accept(socket(), timeout()) -> {ok, socket()} | {error, reason()}.
+accept(ListenSocket, _Timeout) ->
+    call(ListenSocket, {accept}).
+
+%%-----------------------------------------------------------------------------
+%% @param   Socket the socket over which to send data
+%% @param   Packet the data to send
+%% @returns ok | {error, Reason}
+%% @doc     Send data over a connected TCP socket.  This call does not wait
+%%          for the data to be written: data that cannot be written right
+%%          away is queued by the socket and written in order.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec send(socket(), packet()) -> ok | {error, reason()}.
+send(Socket, Packet) ->
+    call(Socket, {send, Packet}).
+
+%%-----------------------------------------------------------------------------
+%% @equiv   recv(Socket, Length, infinity)
+%% @doc     Receive data over a TCP socket in passive mode.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec recv(socket(), non_neg_integer()) -> {ok, binary()} | {error, reason()}.
+recv(Socket, Length) ->
+    recv(Socket, Length, infinity).
+
+%%-----------------------------------------------------------------------------
+%% @param   Socket the socket over which to receive data
+%% @param   Length the number of bytes to receive, 0 for any available data
+%% @param   Timeout the amount of time to wait for data to arrive
+%% @returns {ok, Packet} | {error, Reason}
+%% @doc     Receive data over a TCP socket in passive mode.  This call will
+%%          block until data is received or the connection is closed.
+%%          Length must be 0 when the packet option is set, in that case a
+%%          whole message is returned.
+%%
+%%          <em><b>Note.</b> Currently the Timeout parameter is ignored.</em>
+%%
+%%          {error, einval} is returned if the socket is in active mode.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec recv(socket(), non_neg_integer(), timeout()) -> {ok, binary()} | {error, reason()}.
+recv(Socket, Length, Timeout) ->
+    call(Socket, {recv, Length, Timeout}).
+
+%%-----------------------------------------------------------------------------
+%% @param   Socket the socket to configure
+%% @param   Options the options to set, see connect/3 for supported options
+%% @returns ok | {error, Reason}
+%% @doc     Set options on a TCP socket.  Setting `{active, N}' adds N to the
+%%          number of messages that are still going to be delivered.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec setopts(socket(), proplist()) -> ok | {error, reason()}.
+setopts(Socket, Options) ->
+    call(Socket, {setopts, Options}).
+
+%%-----------------------------------------------------------------------------
+%% @param   Socket the socket to close
+%% @returns ok
+%% @doc     Close a TCP socket.  Processes waiting in recv/3 or accept/2 on
+%%          the socket get `{error, closed}'.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec close(socket()) -> ok.
+close(Socket) ->
+    call(Socket, {close}).
+
+%% internal operations
+
+%% @private
+call(Pid, Msg) ->
+    Ref = erlang:make_ref(),
+    Pid ! {self(),  Ref, Msg},
+    receive
+        {Ref, Ret} ->
+            Ret
+    end.
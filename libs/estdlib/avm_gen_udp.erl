@@ -27,8 +27,8 @@
 %% Caveats:
 %% <ul>
 %%     <li>Currently no support for IPv6</li>
-%%     <li>Currently no support for socket tuning parameters</li>
-%%     <li>Receive packet size limited to 128 bytes</li>
+%%     <li>Only the active, buffer and recbuf socket options are supported</li>
+%%     <li>Receive packet size limited by the buffer option (1500 bytes by default)</li>
 %% </ul>
 %%
 %% <em><b>Note.</b>  Port drivers for this interface are not supported
@@ -37,7 +37,7 @@
 %%-----------------------------------------------------------------------------
 -module(avm_gen_udp).
 
--export([open/1, open/2, send/4, recv/2, recv/3]).
+-export([open/1, open/2, send/4, recv/2, recv/3, setopts/2]).
 -export([get_port_num/1]).
 
 -record(
@@ -83,13 +83,22 @@ open(Port) ->
 %%          This function will raise an exception with the bad_arg atom if
 %%          there is no socket driver supported for the target platform.
 %%
-%%          <em><b>Note.</b>  The Params argument is currently ignored.</em>
+%%          The following parameters are supported:
+%%          <ul>
+%%              <li>`{active, true | false | once | N}' delivers received
+%%              packets to the calling process as `{udp, Pid, Address, Port, Packet}'
+%%              messages; after N packets the socket goes back to passive mode
+%%              and `{udp_passive, Pid}' is sent</li>
+%%              <li>`{buffer, Size}' the maximum size of a received packet,
+%%              longer packets are truncated</li>
+%%              <li>`{recbuf, Size}' the size of the kernel receive buffer</li>
+%%          </ul>
 %% @end
 %%-----------------------------------------------------------------------------
 -spec open(port_num(), proplist()) -> socket().
-open(Port, _Params) ->
+open(Port, Params) ->
     Pid = open_port({spawn, "socket"}, []),
-    ok = init(Pid, [{proto, udp}]),
+    ok = init(Pid, [{proto, udp} | Params]),
     {ok, ActualPort} = bind(Pid, {127, 0, 0, 1}, Port),
     #socket{pid=Pid, port=ActualPort}.
 
@@ -136,7 +145,9 @@ recv(Socket, Length) ->
 %%          ignored.</em>
 %%
 %%          <em><b>Note.</b> Currently the length of the received packet
-%%          is limited to 128 bytes.</em>
+%%          is limited by the buffer option.</em>
+%%
+%%          {error, einval} is returned if the socket is in active mode.
 %% @end
 %%-----------------------------------------------------------------------------
 -spec recv(socket(), non_neg_integer(), non_neg_integer()) ->
@@ -145,6 +156,18 @@ recv(#socket{pid=Pid} = _Socket, Length, Timeout) ->
     call(Pid, {recvfrom, Length, Timeout}).
 
 
+%%-----------------------------------------------------------------------------
+%% @param   Socket the socket to configure
+%% @param   Options the options to set, see open/2 for supported options
+%% @returns ok | {error, Reason}
+%% @doc     Set options on a UDP socket.  Setting `{active, N}' adds N to the
+%%          number of packets that are still going to be delivered.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec setopts(socket(), proplist()) -> ok | {error, reason()}.
+setopts(#socket{pid=Pid} = _Socket, Options) ->
+    call(Pid, {setopts, Options}).
+
 %%-----------------------------------------------------------------------------
 %% @param   Socket the socket from which to obtain the bound port number
 %% @returns the port number to which the socket is bound
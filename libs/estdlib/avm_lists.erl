@@ -26,7 +26,7 @@
 %%-----------------------------------------------------------------------------
 -module(avm_lists).
 
--export([nth/2, member/2, delete/2, reverse/1, keydelete/3, keyfind/3, foldl/3, foldr/3, all/2, any/2]).
+-export([nth/2, member/2, delete/2, reverse/1, keydelete/3, keyfind/3, keysort/2, sort/1, sort/2, usort/1, foldl/3, foldr/3, all/2, any/2]).
 
 %%-----------------------------------------------------------------------------
 %% @param   N the index in the list to get
@@ -136,22 +136,82 @@ keydelete(K, I, [H|T], L2) ->
 %% @end
 %%-----------------------------------------------------------------------------
 -spec keyfind(K::term(), I::pos_integer(), L::list(tuple())) -> tuple() | false.
-keyfind(_K, _I, []) ->
-    false;
-keyfind(K, I, [H|T]) when is_tuple(H) ->
-    case I =< tuple_size(H) of
+keyfind(K, I, L) ->
+    lists:keyfind(K, I, L).
+
+%%-----------------------------------------------------------------------------
+%% @param   I the position in the tuples to compare (1..tuple_size)
+%% @param   L the list of tuples to sort
+%% @returns the tuples in L sorted by their Ith element
+%% @doc     Sort a list of tuples by their Ith element.  The sort is stable,
+%%          tuples with equal keys keep their order.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec keysort(I::pos_integer(), L::list(tuple())) -> list(tuple()).
+keysort(I, L) ->
+    lists:keysort(I, L).
+
+%%-----------------------------------------------------------------------------
+%% @param   L the list to sort
+%% @returns the elements of L in Erlang term order
+%% @doc     Sort the elements of L.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec sort(L::list()) -> list().
+sort(L) ->
+    lists:sort(L).
+
+%%-----------------------------------------------------------------------------
+%% @param   Fun the ordering function
+%% @param   L the list to sort
+%% @returns the elements of L sorted according to Fun
+%% @doc     Sort the elements of L, Fun(A, B) returns true if A comes
+%%          before B or they are equal.  The sort is stable.
+%%
+%%          Unlike sort/1 this sort is not native, since Fun has to be
+%%          called for each comparison.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec sort(Fun::fun((A::term(), B::term()) -> boolean()), L::list()) -> list().
+sort(Fun, L) ->
+    merge_runs(Fun, [[E] || E <- L]).
+
+%% @private
+merge_runs(_Fun, []) ->
+    [];
+merge_runs(_Fun, [Run]) ->
+    Run;
+merge_runs(Fun, Runs) ->
+    merge_runs(Fun, merge_pairs(Fun, Runs)).
+
+%% @private
+merge_pairs(Fun, [A, B | T]) ->
+    [merge(Fun, A, B, []) | merge_pairs(Fun, T)];
+merge_pairs(_Fun, Runs) ->
+    Runs.
+
+%% @private
+merge(_Fun, [], B, Accum) ->
+    reverse(Accum, B);
+merge(_Fun, A, [], Accum) ->
+    reverse(Accum, A);
+merge(Fun, [HA | TA] = A, [HB | TB] = B, Accum) ->
+    case Fun(HA, HB) of
         true ->
-            case element(I, H) of
-                K ->
-                    H;
-                _ ->
-                    keyfind(K, I, T)
-            end;
+            merge(Fun, TA, B, [HA | Accum]);
         false ->
-            keyfind(K, I, T)
-    end;
-keyfind(K, I, [_H|T]) ->
-    keyfind(K, I, T).
+            merge(Fun, A, TB, [HB | Accum])
+    end.
+
+%%-----------------------------------------------------------------------------
+%% @param   L the list to sort
+%% @returns the elements of L in Erlang term order, without duplicates
+%% @doc     Sort the elements of L, keeping only the first of equal elements.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec usort(L::list()) -> list().
+usort(L) ->
+    lists:usort(L).
 
 %%-----------------------------------------------------------------------------
 %% @param   Fun the function to apply
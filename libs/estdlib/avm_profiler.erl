@@ -0,0 +1,81 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%   Copyright 2018 by Fred Dushin <fred@dushin.net>                       %
+%                                                                         %
+%   This program is free software; you can redistribute it and/or modify  %
+%   it under the terms of the GNU Lesser General Public License as        %
+%   published by the Free Software Foundation; either version 2 of the    %
+%   License, or (at your option) any later version.                       %
+%                                                                         %
+%   This program is distributed in the hope that it will be useful,       %
+%   but WITHOUT ANY WARRANTY; without even the implied warranty of        %
+%   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         %
+%   GNU General Public License for more details.                          %
+%                                                                         %
+%   You should have received a copy of the GNU General Public License     %
+%   along with this program; if not, write to the                         %
+%   Free Software Foundation, Inc.,                                       %
+%   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+%%-----------------------------------------------------------------------------
+%% @doc Sampling profiler of the AtomVM interpreter.
+%%
+%% Each time a process is scheduled out, the function it was running and
+%% the functions on its call stack are recorded, weighted by the
+%% reductions executed in its time slice. The most recent samples are
+%% kept, and they can be retrieved as folded stacks, one line for each
+%% distinct stack, such as `mod:outer/0;mod:inner/1 2048', which can be
+%% rendered by flame graph tools.
+%%
+%% The generic_unix AtomVM binary also accepts `--profile File' to
+%% profile the whole run and write the folded stacks to File on exit.
+%% @end
+%%-----------------------------------------------------------------------------
+-module(avm_profiler).
+
+-export([start/0, start/1, stop/0, folded_stacks/0]).
+
+%%-----------------------------------------------------------------------------
+%% @returns ok
+%% @doc     Start collecting samples, retaining the default number of them.
+%%
+%% Samples collected so far are discarded.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec start() -> ok.
+start() ->
+    throw(nif_error).
+
+%%-----------------------------------------------------------------------------
+%% @param   Samples how many of the most recent samples are retained.
+%% @returns ok
+%% @doc     Start collecting samples, retaining the given number of them.
+%%
+%% Samples collected so far are discarded.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec start(Samples::pos_integer()) -> ok.
+start(_Samples) ->
+    throw(nif_error).
+
+%%-----------------------------------------------------------------------------
+%% @returns ok
+%% @doc     Stop collecting samples.
+%%
+%% Collected samples are retained until the profiler is started again.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec stop() -> ok.
+stop() ->
+    throw(nif_error).
+
+%%-----------------------------------------------------------------------------
+%% @returns the collected samples as folded stacks.
+%% @doc     Return the collected samples, one line for each distinct stack.
+%%
+%% The binary can be written to a file and passed to flamegraph.pl.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec folded_stacks() -> binary().
+folded_stacks() ->
+    throw(nif_error).
@@ -1,9 +1,25 @@
 -module(avm_timer).
 
--export([sleep/1]).
+-export([sleep/1, send_after/3, start_timer/3, cancel_timer/1, read_timer/1]).
 
 -spec sleep(non_neg_integer()) -> ok.
 sleep(MSecs) ->
     receive
         after MSecs -> ok
     end.
+
+-spec send_after(non_neg_integer(), pid() | atom(), term()) -> reference().
+send_after(Time, Dest, Msg) ->
+    erlang:send_after(Time, Dest, Msg).
+
+-spec start_timer(non_neg_integer(), pid() | atom(), term()) -> reference().
+start_timer(Time, Dest, Msg) ->
+    erlang:start_timer(Time, Dest, Msg).
+
+-spec cancel_timer(reference()) -> non_neg_integer() | false.
+cancel_timer(TimerRef) ->
+    erlang:cancel_timer(TimerRef).
+
+-spec read_timer(reference()) -> non_neg_integer() | false.
+read_timer(TimerRef) ->
+    erlang:read_timer(TimerRef).
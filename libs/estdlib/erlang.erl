@@ -24,7 +24,7 @@
 %%-----------------------------------------------------------------------------
 -module(erlang).
 
--export([start_timer/3, start_timer/4, cancel_timer/1, send_after/3, process_info/2, system_info/1]).
+-export([start_timer/3, start_timer/4, cancel_timer/1, read_timer/1, send_after/3, process_info/1, process_info/2, system_info/1, statistics/1, garbage_collect/0]).
 
 
 %%-----------------------------------------------------------------------------
@@ -37,8 +37,8 @@
 %% @end
 %%-----------------------------------------------------------------------------
 -spec start_timer(non_neg_integer(), pid() | atom(), term()) -> reference().
-start_timer(Time, Dest, Msg) ->
-    start_timer(Time, Dest, Msg, []).
+start_timer(_Time, _Dest, _Msg) ->
+    throw(nif_error).
 
 
 %%-----------------------------------------------------------------------------
@@ -55,24 +55,30 @@ start_timer(Time, Dest, Msg) ->
 %%-----------------------------------------------------------------------------
 -spec start_timer(non_neg_integer(), pid() | atom(), term(), list()) -> reference().
 start_timer(Time, Dest, Msg, _Options) ->
-    timer_manager:start_timer(Time, Dest, Msg).
+    erlang:start_timer(Time, Dest, Msg).
 
 
 %%-----------------------------------------------------------------------------
-%% @hidden
-%% @param   Time time in milliseconds after which to send the timeout message.
-%% @param   Dest Pid or server name to which to send the timeout message.
-%% @param   Msg Message to send to Dest after Time ms.
-%% @param   Options options
-%% @returns a reference that can be used to cancel the timer, if desired.
-%% @doc     Start a timer, and send {timeout, TimerRef, Msg} to Dest after
-%%          Time ms, where TimerRef is the reference returned from this function.
-%%
-%%          <em><b>Note.</b>  The Options argument is currently ignored.</em>
+%% @param   TimerRef a reference returned by start_timer/3 or send_after/3.
+%% @returns the time in milliseconds that was left before the timer expiry, or
+%%          false if the timer has already expired or it has been cancelled.
+%% @doc     Cancel a timer, the message will not be sent.
+%% @end
 %%-----------------------------------------------------------------------------
--spec cancel_timer(TimerRef::reference()) -> ok.
-cancel_timer(TimerRef) ->
-    timer_manager:cancel_timer(TimerRef).
+-spec cancel_timer(TimerRef::reference()) -> non_neg_integer() | false.
+cancel_timer(_TimerRef) ->
+    throw(nif_error).
+
+%%-----------------------------------------------------------------------------
+%% @param   TimerRef a reference returned by start_timer/3 or send_after/3.
+%% @returns the time in milliseconds that is left before the timer expiry, or
+%%          false if the timer has already expired or it has been cancelled.
+%% @doc     Read the time left before a timer expires.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec read_timer(TimerRef::reference()) -> non_neg_integer() | false.
+read_timer(_TimerRef) ->
+    throw(nif_error).
 
 %%-----------------------------------------------------------------------------
 %% @param   Time time in milliseconds after which to send the message.
@@ -83,12 +89,28 @@ cancel_timer(TimerRef) ->
 %% @end
 %%-----------------------------------------------------------------------------
 -spec send_after(non_neg_integer(), pid() | atom(), term()) -> reference().
-send_after(Time, Dest, Msg) ->
-    timer_manager:send_after(Time, Dest, Msg).
+send_after(_Time, _Dest, _Msg) ->
+    throw(nif_error).
+
+%%-----------------------------------------------------------------------------
+%% @param   Pid the process pid.
+%% @returns a list of {Key, Value} tuples, or undefined if the process is not alive.
+%% @doc     Return process information.
+%%
+%% This function returns the value of current_function, status,
+%% message_queue_len, heap_size, stack_size, reductions, memory,
+%% garbage_collection, messages_sent, messages_received and run_time,
+%% as described in process_info/2.
+%%
+%% @end
+%%-----------------------------------------------------------------------------
+-spec process_info(Pid::pid()) -> [{atom(), term()}] | undefined.
+process_info(_Pid) ->
+    throw(nif_error).
 
 %%-----------------------------------------------------------------------------
 %% @param   Pid the process pid.
-%% @param   Key key used to find process information.
+%% @param   Key key used to find process information, or a list of keys.
 %% @returns process information for the specified pid defined by the specified key.
 %% @doc     Return process information.
 %%
@@ -101,12 +123,20 @@ send_after(Time, Dest, Msg) ->
 %%      <li><b>stack_size</b> the number of words used in the stack (integer)</li>
 %%      <li><b>message_queue_len</b> the number of messages enqueued for the process (integer)</li>
 %%      <li><b>memory</b> the estimated total number of bytes in use by the process (integer)</li>
+%%      <li><b>garbage_collection</b> the number of minor and major collections, the bytes copied by them and the heap growth strategy (list)</li>
+%%      <li><b>reductions</b> the number of reductions executed by the process (integer)</li>
+%%      <li><b>messages_sent</b> the number of messages sent by the process (integer)</li>
+%%      <li><b>messages_received</b> the number of messages taken from the mailbox of the process (integer)</li>
+%%      <li><b>run_time</b> the time spent running by the process, in microseconds (integer)</li>
+%%      <li><b>status</b> running, runnable or waiting (atom)</li>
+%%      <li><b>current_function</b> the function the process was running when it was last scheduled out ({Module, Function, Arity}, or undefined)</li>
 %% </ul>
+%% If Key is a list of keys, a list of {Key, Value} tuples is returned in the same order.
 %% Specifying an unsupported term or atom raises a bad_arg error.
 %%
 %% @end
 %%-----------------------------------------------------------------------------
--spec process_info(Pid::pid(), Key::atom()) -> term().
+-spec process_info(Pid::pid(), Key::atom() | [atom()]) -> term().
 process_info(_Pid, _Key) ->
     throw(nif_error).
 
@@ -143,3 +173,35 @@ process_info(_Pid, _Key) ->
 -spec system_info(Key::atom()) -> term().
 system_info(_Key) ->
     throw(nif_error).
+
+%%-----------------------------------------------------------------------------
+%% @param   Key key used to find the statistic.
+%% @returns the statistic defined by the specified key.
+%% @doc     Return system statistics.
+%%
+%% The following keys are supported:
+%% <ul>
+%%      <li><b>reductions</b> {Total, SinceLastCall} reductions executed by all processes</li>
+%%      <li><b>runtime</b> {Total, SinceLastCall} milliseconds spent running processes</li>
+%%      <li><b>wall_clock</b> {Total, SinceLastCall} milliseconds elapsed since the virtual machine started</li>
+%%      <li><b>run_queue</b> the number of processes ready to run (integer)</li>
+%% </ul>
+%% Specifying any other term raises a bad_arg error.
+%%
+%% @end
+%%-----------------------------------------------------------------------------
+-spec statistics(Key::atom()) -> term().
+statistics(_Key) ->
+    throw(nif_error).
+
+%%-----------------------------------------------------------------------------
+%% @returns true
+%% @doc     Run a major garbage collection of the calling process.
+%%
+%% Both the young and the old generation are collected, so terms that
+%% are not referenced anymore are freed even if they have been promoted.
+%% @end
+%%-----------------------------------------------------------------------------
+-spec garbage_collect() -> true.
+garbage_collect() ->
+    throw(nif_error).
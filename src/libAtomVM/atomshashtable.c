@@ -19,6 +19,7 @@
 
 #include "atomshashtable.h"
 
+#include "smp.h"
 #include "utils.h"
 
 #include <stdlib.h>
@@ -95,10 +96,11 @@ int atomshashtable_insert(struct AtomsHashTable *hash_table, AtomString string,
     new_node->key = string;
     new_node->value = value;
 
+    // the node is published only when it is fully initialized: in SMP builds lookups don't take any lock
     if (node) {
-        node->next = new_node;
+        SMP_ATOMIC_STORE(&node->next, new_node);
     } else {
-        hash_table->buckets[index] = new_node;
+        SMP_ATOMIC_STORE(&hash_table->buckets[index], new_node);
     }
 
     hash_table->count++;
@@ -110,13 +112,13 @@ unsigned long atomshashtable_get_value(const struct AtomsHashTable *hash_table,
     unsigned long hash = sdbm_hash(string, atom_string_len(string));
     long index = hash % hash_table->capacity;
 
-    const struct HNode *node = hash_table->buckets[index];
+    const struct HNode *node = SMP_ATOMIC_LOAD(&hash_table->buckets[index]);
     while (node) {
         if (atom_are_equals(string, node->key)) {
             return node->value;
         }
 
-        node = node->next;
+        node = SMP_ATOMIC_LOAD(&node->next);
     }
 
     return default_value;
@@ -127,13 +129,13 @@ int atomshashtable_has_key(const struct AtomsHashTable *hash_table, const AtomSt
     unsigned long hash = sdbm_hash(string, atom_string_len(string));
     long index = hash % hash_table->capacity;
 
-    const struct HNode *node = hash_table->buckets[index];
+    const struct HNode *node = SMP_ATOMIC_LOAD(&hash_table->buckets[index]);
     while (node) {
         if (atom_are_equals(string, node->key)) {
             return 1;
         }
 
-        node = node->next;
+        node = SMP_ATOMIC_LOAD(&node->next);
     }
 
     return 0;
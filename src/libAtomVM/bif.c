@@ -23,6 +23,7 @@
 
 #include "atom.h"
 #include "defaultatoms.h"
+#include "map.h"
 #include "trace.h"
 #include "utils.h"
 
@@ -88,7 +89,7 @@ term bif_erlang_is_integer_1(Context *ctx, term arg1)
 {
     UNUSED(ctx);
 
-    return term_is_integer(arg1) ? TRUE_ATOM : FALSE_ATOM;
+    return term_is_any_integer(arg1) ? TRUE_ATOM : FALSE_ATOM;
 }
 
 term bif_erlang_is_list_1(Context *ctx, term arg1)
@@ -103,7 +104,7 @@ term bif_erlang_is_number_1(Context *ctx, term arg1)
     UNUSED(ctx);
 
     //TODO: change to term_is_number
-    return term_is_integer(arg1) ? TRUE_ATOM : FALSE_ATOM;
+    return term_is_any_integer(arg1) ? TRUE_ATOM : FALSE_ATOM;
 }
 
 term bif_erlang_is_pid_1(Context *ctx, term arg1)
@@ -172,19 +173,74 @@ term bif_erlang_tuple_size_1(Context *ctx, term arg1)
     return term_from_int32(term_get_tuple_arity(arg1));
 }
 
+term bif_erlang_is_map_1(Context *ctx, term arg1)
+{
+    UNUSED(ctx);
+
+    return term_is_map(arg1) ? TRUE_ATOM : FALSE_ATOM;
+}
+
+term bif_erlang_map_size_1(Context *ctx, int live, term arg1)
+{
+    UNUSED(live);
+
+    if (UNLIKELY(!term_is_map(arg1))) {
+        RAISE_ERROR(BADMAP_ATOM);
+    }
+
+    return term_from_int32(map_size(arg1));
+}
+
+term bif_erlang_map_get_2(Context *ctx, term arg1, term arg2)
+{
+    if (UNLIKELY(!term_is_map(arg2))) {
+        RAISE_ERROR(BADMAP_ATOM);
+    }
+
+    term value = map_get_value(arg2, arg1, ctx->global);
+    if (UNLIKELY(term_is_invalid_term(value))) {
+        RAISE_ERROR(BADKEY_ATOM);
+    }
+
+    return value;
+}
+
+term bif_erlang_is_map_key_2(Context *ctx, term arg1, term arg2)
+{
+    if (UNLIKELY(!term_is_map(arg2))) {
+        RAISE_ERROR(BADMAP_ATOM);
+    }
+
+    return term_is_invalid_term(map_get_value(arg2, arg1, ctx->global)) ? FALSE_ATOM : TRUE_ATOM;
+}
+
+// result must be computed before calling this, since garbage collection might move arguments
+static term make_maybe_boxed_int64(Context *ctx, int64_t value)
+{
+    size_t heap_size = term_int64_heap_size(value);
+    if (UNLIKELY(heap_size && (memory_ensure_free(ctx, heap_size) != MEMORY_GC_OK))) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return term_make_maybe_boxed_int64(value, ctx);
+}
+
 term bif_erlang_add_2(Context *ctx, int live, term arg1, term arg2)
 {
     UNUSED(live);
 
     if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
-        //TODO: use long integer instead, and term_to_longint
-        int32_t res;
-        if (!BUILTIN_ADD_OVERFLOW((int32_t) (arg1 & ~TERM_INTEGER_TAG), (int32_t) (arg2 & ~TERM_INTEGER_TAG), &res)) {
-            return res | TERM_INTEGER_TAG;
-        } else {
+        // sum of two small integers always fits an int64
+        return make_maybe_boxed_int64(ctx, term_to_int64(arg1) + term_to_int64(arg2));
+
+    } else if (term_is_any_integer(arg1) && term_is_any_integer(arg2)) {
+        int64_t res;
+        if (UNLIKELY(BUILTIN_ADD_OVERFLOW(term_maybe_unbox_int64(arg1), term_maybe_unbox_int64(arg2), &res))) {
             TRACE("overflow: arg1: %lx, arg2: %lx\n", arg1, arg2);
             RAISE_ERROR(OVERFLOW_ATOM);
         }
+        return make_maybe_boxed_int64(ctx, res);
+
     } else {
         TRACE("error: arg1: %lx, arg2: %lx\n", arg1, arg2);
         RAISE_ERROR(BADARITH_ATOM);
@@ -196,14 +252,16 @@ term bif_erlang_sub_2(Context *ctx, int live, term arg1, term arg2)
     UNUSED(live);
 
     if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
-        //TODO: use long integer instead, and term_to_longint
-        int32_t res;
-        if (!BUILTIN_SUB_OVERFLOW((int32_t) (arg1 & ~TERM_INTEGER_TAG), (int32_t) (arg2 & ~TERM_INTEGER_TAG), &res)) {
-            return res | TERM_INTEGER_TAG;
-        } else {
+        return make_maybe_boxed_int64(ctx, term_to_int64(arg1) - term_to_int64(arg2));
+
+    } else if (term_is_any_integer(arg1) && term_is_any_integer(arg2)) {
+        int64_t res;
+        if (UNLIKELY(BUILTIN_SUB_OVERFLOW(term_maybe_unbox_int64(arg1), term_maybe_unbox_int64(arg2), &res))) {
             TRACE("overflow: arg1: %lx, arg2: %lx\n", arg1, arg2);
             RAISE_ERROR(OVERFLOW_ATOM);
         }
+        return make_maybe_boxed_int64(ctx, res);
+
     } else {
         TRACE("error: arg1: %lx, arg2: %lx\n", arg1, arg2);
         RAISE_ERROR(BADARITH_ATOM);
@@ -214,17 +272,14 @@ term bif_erlang_mul_2(Context *ctx, int live, term arg1, term arg2)
 {
     UNUSED(live);
 
-    if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
-        //TODO: use long integer instead, and term_to_longint
-        int32_t res;
-        int32_t a = ((int32_t) (arg1 & ~TERM_INTEGER_TAG)) >> 2;
-        int32_t b = ((int32_t) (arg2 & ~TERM_INTEGER_TAG)) >> 2;
-        if (!BUILTIN_MUL_OVERFLOW(a, b, &res)) {
-            return res | TERM_INTEGER_TAG;
-        } else {
+    if (LIKELY(term_is_any_integer(arg1) && term_is_any_integer(arg2))) {
+        int64_t res;
+        if (UNLIKELY(BUILTIN_MUL_OVERFLOW(term_maybe_unbox_int64(arg1), term_maybe_unbox_int64(arg2), &res))) {
             TRACE("overflow: arg1: %lx, arg2: %lx\n", arg1, arg2);
             RAISE_ERROR(OVERFLOW_ATOM);
         }
+        return make_maybe_boxed_int64(ctx, res);
+
     } else {
         TRACE("error: arg1: %lx, arg2: %lx\n", arg1, arg2);
         RAISE_ERROR(BADARITH_ATOM);
@@ -235,19 +290,18 @@ term bif_erlang_div_2(Context *ctx, int live, term arg1, term arg2)
 {
     UNUSED(live);
 
-    if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
-        int32_t operand_b = term_to_int32(arg2);
-        if (operand_b != 0) {
-            int32_t res = term_to_int32(arg1) / operand_b;
-            if (UNLIKELY(res > 134217727)) {
-                TRACE("overflow: arg1: %lx, arg2: %lx\n", arg1, arg2);
-                RAISE_ERROR(OVERFLOW_ATOM);
+    if (LIKELY(term_is_any_integer(arg1) && term_is_any_integer(arg2))) {
+        int64_t operand_a = term_maybe_unbox_int64(arg1);
+        int64_t operand_b = term_maybe_unbox_int64(arg2);
+        if (UNLIKELY(operand_b == 0)) {
+            RAISE_ERROR(BADARITH_ATOM);
+
+        } else if (UNLIKELY((operand_a == INT64_MIN) && (operand_b == -1))) {
+            TRACE("overflow: arg1: %lx, arg2: %lx\n", arg1, arg2);
+            RAISE_ERROR(OVERFLOW_ATOM);
 
-            } else {
-                return term_from_int32(res);
-            }
         } else {
-            RAISE_ERROR(BADARITH_ATOM);
+            return make_maybe_boxed_int64(ctx, operand_a / operand_b);
         }
 
     } else {
@@ -260,12 +314,12 @@ term bif_erlang_neg_1(Context *ctx, int live, term arg1)
 {
     UNUSED(live);
 
-    if (LIKELY(term_is_integer(arg1))) {
-        int32_t int_val = term_to_int32(arg1);
-        if (UNLIKELY(int_val < -134217727)) {
+    if (LIKELY(term_is_any_integer(arg1))) {
+        int64_t int_val = term_maybe_unbox_int64(arg1);
+        if (UNLIKELY(int_val == INT64_MIN)) {
             RAISE_ERROR(OVERFLOW_ATOM);
         } else {
-            return term_from_int32(-int_val);
+            return make_maybe_boxed_int64(ctx, -int_val);
         }
     } else {
         TRACE("error: arg1: %lx\n", arg1);
@@ -277,14 +331,14 @@ term bif_erlang_abs_1(Context *ctx, int live, term arg1)
 {
     UNUSED(live);
 
-    if (LIKELY(term_is_integer(arg1))) {
-        int32_t int_val = term_to_int32(arg1);
+    if (LIKELY(term_is_any_integer(arg1))) {
+        int64_t int_val = term_maybe_unbox_int64(arg1);
 
         if  (int_val < 0) {
-            if (UNLIKELY(int_val < -134217727)) {
+            if (UNLIKELY(int_val == INT64_MIN)) {
                 RAISE_ERROR(OVERFLOW_ATOM);
             } else {
-                return term_from_int32(-int_val);
+                return make_maybe_boxed_int64(ctx, -int_val);
             }
         } else {
             return arg1;
@@ -300,13 +354,17 @@ term bif_erlang_rem_2(Context *ctx, int live, term arg1, term arg2)
 {
     UNUSED(live);
 
-    if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
-        int32_t operand_b = term_to_int32(arg2);
-        if (LIKELY(operand_b != 0)) {
-            return term_from_int32(term_to_int32(arg1) % operand_b);
+    if (LIKELY(term_is_any_integer(arg1) && term_is_any_integer(arg2))) {
+        int64_t operand_b = term_maybe_unbox_int64(arg2);
+        if (UNLIKELY(operand_b == 0)) {
+            RAISE_ERROR(BADARITH_ATOM);
+
+        } else if (UNLIKELY(operand_b == -1)) {
+            // INT64_MIN % -1 is undefined behaviour
+            return term_from_int4(0);
 
         } else {
-            RAISE_ERROR(BADARITH_ATOM);
+            return make_maybe_boxed_int64(ctx, term_maybe_unbox_int64(arg1) % operand_b);
         }
 
     } else {
@@ -322,6 +380,9 @@ term bif_erlang_bor_2(Context *ctx, int live, term arg1, term arg2)
     if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
         return arg1 | arg2;
 
+    } else if (term_is_any_integer(arg1) && term_is_any_integer(arg2)) {
+        return make_maybe_boxed_int64(ctx, term_maybe_unbox_int64(arg1) | term_maybe_unbox_int64(arg2));
+
     } else {
         RAISE_ERROR(BADARITH_ATOM);
     }
@@ -334,6 +395,9 @@ term bif_erlang_band_2(Context *ctx, int live, term arg1, term arg2)
     if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
         return arg1 & arg2;
 
+    } else if (term_is_any_integer(arg1) && term_is_any_integer(arg2)) {
+        return make_maybe_boxed_int64(ctx, term_maybe_unbox_int64(arg1) & term_maybe_unbox_int64(arg2));
+
     } else {
         RAISE_ERROR(BADARITH_ATOM);
     }
@@ -346,17 +410,50 @@ term bif_erlang_bxor_2(Context *ctx, int live, term arg1, term arg2)
     if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
         return (arg1 ^ arg2) | TERM_INTEGER_TAG;
 
+    } else if (term_is_any_integer(arg1) && term_is_any_integer(arg2)) {
+        return make_maybe_boxed_int64(ctx, term_maybe_unbox_int64(arg1) ^ term_maybe_unbox_int64(arg2));
+
     } else {
         RAISE_ERROR(BADARITH_ATOM);
     }
 }
 
+static term shift_left(Context *ctx, int64_t value, int64_t shift)
+{
+    if ((value == 0) || (shift == 0)) {
+        return make_maybe_boxed_int64(ctx, value);
+    }
+
+    if (shift < 64) {
+        int64_t res = (int64_t) (((uint64_t) value) << shift);
+        // arithmetic shift right gives back value only when no significant bit has been lost
+        if ((res >> shift) == value) {
+            return make_maybe_boxed_int64(ctx, res);
+        }
+    }
+
+    RAISE_ERROR(OVERFLOW_ATOM);
+}
+
+static term shift_right(Context *ctx, int64_t value, int64_t shift)
+{
+    if (shift >= 64) {
+        return term_from_int4((value < 0) ? -1 : 0);
+    }
+
+    return make_maybe_boxed_int64(ctx, value >> shift);
+}
+
 term bif_erlang_bsl_2(Context *ctx, int live, term arg1, term arg2)
 {
     UNUSED(live);
 
-    if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
-        return term_from_int32(term_to_int32(arg1) << term_to_int32(arg2));
+    if (LIKELY(term_is_any_integer(arg1) && term_is_integer(arg2))) {
+        int64_t shift = term_to_int64(arg2);
+        if (shift < 0) {
+            return shift_right(ctx, term_maybe_unbox_int64(arg1), -shift);
+        }
+        return shift_left(ctx, term_maybe_unbox_int64(arg1), shift);
 
     } else {
         RAISE_ERROR(BADARITH_ATOM);
@@ -367,8 +464,12 @@ term bif_erlang_bsr_2(Context *ctx, int live, term arg1, term arg2)
 {
     UNUSED(live);
 
-    if (LIKELY(term_is_integer(arg1) && term_is_integer(arg2))) {
-        return term_from_int32(term_to_int32(arg1) >> term_to_int32(arg2));
+    if (LIKELY(term_is_any_integer(arg1) && term_is_integer(arg2))) {
+        int64_t shift = term_to_int64(arg2);
+        if (shift < 0) {
+            return shift_left(ctx, term_maybe_unbox_int64(arg1), -shift);
+        }
+        return shift_right(ctx, term_maybe_unbox_int64(arg1), shift);
 
     } else {
         RAISE_ERROR(BADARITH_ATOM);
@@ -382,6 +483,9 @@ term bif_erlang_bnot_1(Context *ctx, int live, term arg1)
     if (LIKELY(term_is_integer(arg1))) {
         return ~arg1 | TERM_INTEGER_TAG;
 
+    } else if (term_is_boxed_integer(arg1)) {
+        return make_maybe_boxed_int64(ctx, ~term_unbox_int64(arg1));
+
     } else {
         RAISE_ERROR(BADARITH_ATOM);
     }
@@ -461,9 +565,8 @@ term bif_erlang_equal_to_2(Context *ctx, term arg1, term arg2)
 {
     UNUSED(ctx);
 
-    //TODO: fix this implementation
-    //it should compare any kind of type, and 5.0 == 5
-    if (arg1 == arg2) {
+    //TODO: 5.0 == 5 when floats are supported
+    if (term_equals(arg1, arg2)) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
@@ -474,9 +577,7 @@ term bif_erlang_not_equal_to_2(Context *ctx, term arg1, term arg2)
 {
     UNUSED(ctx);
 
-    //TODO: fix this implementation
-    //it should compare any kind of type, and 5.0 != 5 is false
-    if (arg1 != arg2) {
+    if (!term_equals(arg1, arg2)) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
@@ -487,8 +588,7 @@ term bif_erlang_exactly_equal_to_2(Context *ctx, term arg1, term arg2)
 {
     UNUSED(ctx);
 
-    //TODO: fix this implementation, it needs to cover more types
-    if (arg1 == arg2) {
+    if (term_exactly_equals(arg1, arg2)) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
@@ -499,8 +599,7 @@ term bif_erlang_exactly_not_equal_to_2(Context *ctx, term arg1, term arg2)
 {
     UNUSED(ctx);
 
-    //TODO: fix this implementation, it needs to cover more types
-    if (arg1 != arg2) {
+    if (!term_exactly_equals(arg1, arg2)) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
@@ -510,15 +609,7 @@ term bif_erlang_exactly_not_equal_to_2(Context *ctx, term arg1, term arg2)
 
 term bif_erlang_greater_than_2(Context *ctx, term arg1, term arg2)
 {
-    UNUSED(ctx);
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (UNLIKELY(!(term_is_integer(arg1) && term_is_integer(arg2)))) {
-        abort();
-    }
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (term_to_int32(arg1) > term_to_int32(arg2)) {
+    if (term_compare(arg1, arg2, ctx->global) > 0) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
@@ -527,15 +618,7 @@ term bif_erlang_greater_than_2(Context *ctx, term arg1, term arg2)
 
 term bif_erlang_less_than_2(Context *ctx, term arg1, term arg2)
 {
-    UNUSED(ctx);
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (UNLIKELY(!(term_is_integer(arg1) && term_is_integer(arg2)))) {
-        abort();
-    }
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (term_to_int32(arg1) < term_to_int32(arg2)) {
+    if (term_compare(arg1, arg2, ctx->global) < 0) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
@@ -544,15 +627,7 @@ term bif_erlang_less_than_2(Context *ctx, term arg1, term arg2)
 
 term bif_erlang_less_than_or_equal_2(Context *ctx, term arg1, term arg2)
 {
-    UNUSED(ctx);
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (UNLIKELY(!(term_is_integer(arg1) && term_is_integer(arg2)))) {
-        abort();
-    }
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (term_to_int32(arg1) <= term_to_int32(arg2)) {
+    if (term_compare(arg1, arg2, ctx->global) <= 0) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
@@ -561,15 +636,7 @@ term bif_erlang_less_than_or_equal_2(Context *ctx, term arg1, term arg2)
 
 term bif_erlang_greater_than_or_equal_2(Context *ctx, term arg1, term arg2)
 {
-    UNUSED(ctx);
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (UNLIKELY(!(term_is_integer(arg1) && term_is_integer(arg2)))) {
-        abort();
-    }
-
-    //TODO: fix this implementation, it needs to cover more types
-    if (term_to_int32(arg1) >= term_to_int32(arg2)) {
+    if (term_compare(arg1, arg2, ctx->global) >= 0) {
         return TRUE_ATOM;
     } else {
         return FALSE_ATOM;
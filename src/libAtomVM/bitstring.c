@@ -0,0 +1,206 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+#include "bitstring.h"
+
+#include <string.h>
+
+#include "utils.h"
+
+static inline uint8_t bitstring_read_byte(const uint8_t *data, size_t offset)
+{
+    size_t byte_offset = offset >> 3;
+    unsigned int bit_offset = offset & 0x7;
+
+    if (bit_offset == 0) {
+        return data[byte_offset];
+    }
+
+    return (data[byte_offset] << bit_offset) | (data[byte_offset + 1] >> (8 - bit_offset));
+}
+
+static inline int bitstring_read_bit(const uint8_t *data, size_t offset)
+{
+    return (data[offset >> 3] >> (7 - (offset & 0x7))) & 0x1;
+}
+
+static int bitstring_is_little_endian(int flags)
+{
+    if (flags & BitstringFlagsNativeEndian) {
+        #ifdef __ORDER_LITTLE_ENDIAN__
+            return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+        #else
+            return 0;
+        #endif
+    }
+
+    return (flags & BitstringFlagsLittleEndian) != 0;
+}
+
+int bitstring_extract_integer(const uint8_t *data, size_t offset, size_t n, int flags, int64_t *dst)
+{
+    if (UNLIKELY(n > 64)) {
+        return 0;
+    }
+
+    uint64_t value = 0;
+
+    if ((n & 0x7) == 0) {
+        size_t bytes = n >> 3;
+
+        if ((offset & 0x7) == 0) {
+            const uint8_t *src = data + (offset >> 3);
+            if (bitstring_is_little_endian(flags)) {
+                for (size_t i = bytes; i > 0; i--) {
+                    value = (value << 8) | src[i - 1];
+                }
+            } else {
+                for (size_t i = 0; i < bytes; i++) {
+                    value = (value << 8) | src[i];
+                }
+            }
+        } else {
+            if (bitstring_is_little_endian(flags)) {
+                for (size_t i = bytes; i > 0; i--) {
+                    value = (value << 8) | bitstring_read_byte(data, offset + ((i - 1) << 3));
+                }
+            } else {
+                for (size_t i = 0; i < bytes; i++) {
+                    value = (value << 8) | bitstring_read_byte(data, offset + (i << 3));
+                }
+            }
+        }
+
+    } else {
+        // little endian fields that are not made of whole bytes are not supported
+        if (UNLIKELY(bitstring_is_little_endian(flags) && n > 8)) {
+            return 0;
+        }
+        for (size_t i = 0; i < n; i++) {
+            value = (value << 1) | bitstring_read_bit(data, offset + i);
+        }
+    }
+
+    if ((flags & BitstringFlagsSigned) && (n > 0) && (n < 64) && (value & ((uint64_t) 1 << (n - 1)))) {
+        value |= ~(uint64_t) 0 << n;
+    }
+
+    *dst = (int64_t) value;
+    return 1;
+}
+
+int bitstring_match_bits(const uint8_t *data, size_t offset, const uint8_t *expected, size_t n)
+{
+    size_t bytes = n >> 3;
+
+    if ((offset & 0x7) == 0) {
+        if (memcmp(data + (offset >> 3), expected, bytes) != 0) {
+            return 0;
+        }
+    } else {
+        for (size_t i = 0; i < bytes; i++) {
+            if (bitstring_read_byte(data, offset + (i << 3)) != expected[i]) {
+                return 0;
+            }
+        }
+    }
+
+    for (size_t i = bytes << 3; i < n; i++) {
+        if (bitstring_read_bit(data, offset + i) != bitstring_read_bit(expected, i)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static inline void bitstring_write_bit(uint8_t *data, size_t offset, int bit)
+{
+    uint8_t mask = 0x80 >> (offset & 0x7);
+    if (bit) {
+        data[offset >> 3] |= mask;
+    } else {
+        data[offset >> 3] &= ~mask;
+    }
+}
+
+static inline void bitstring_write_byte(uint8_t *data, size_t offset, uint8_t byte)
+{
+    size_t byte_offset = offset >> 3;
+    unsigned int bit_offset = offset & 0x7;
+
+    if (bit_offset == 0) {
+        data[byte_offset] = byte;
+        return;
+    }
+
+    data[byte_offset] = (data[byte_offset] & (0xFF << (8 - bit_offset))) | (byte >> bit_offset);
+    data[byte_offset + 1] = (data[byte_offset + 1] & (0xFF >> bit_offset)) | (byte << (8 - bit_offset));
+}
+
+int bitstring_insert_integer(uint8_t *data, size_t offset, int64_t value, size_t n, int flags)
+{
+    if (UNLIKELY(n > 64)) {
+        return 0;
+    }
+
+    uint64_t unsigned_value = (uint64_t) value;
+
+    if ((n & 0x7) == 0) {
+        size_t bytes = n >> 3;
+
+        if (bitstring_is_little_endian(flags)) {
+            for (size_t i = 0; i < bytes; i++) {
+                bitstring_write_byte(data, offset + (i << 3), unsigned_value >> (i << 3));
+            }
+        } else {
+            for (size_t i = 0; i < bytes; i++) {
+                bitstring_write_byte(data, offset + (i << 3), unsigned_value >> ((bytes - 1 - i) << 3));
+            }
+        }
+
+    } else {
+        // little endian fields that are not made of whole bytes are not supported
+        if (UNLIKELY(bitstring_is_little_endian(flags) && n > 8)) {
+            return 0;
+        }
+        for (size_t i = 0; i < n; i++) {
+            bitstring_write_bit(data, offset + i, (unsigned_value >> (n - 1 - i)) & 0x1);
+        }
+    }
+
+    return 1;
+}
+
+void bitstring_copy_bits(uint8_t *data, size_t offset, const uint8_t *src, size_t n)
+{
+    size_t bytes = n >> 3;
+
+    if ((offset & 0x7) == 0) {
+        memcpy(data + (offset >> 3), src, bytes);
+    } else {
+        for (size_t i = 0; i < bytes; i++) {
+            bitstring_write_byte(data, offset + (i << 3), src[i]);
+        }
+    }
+
+    for (size_t i = bytes << 3; i < n; i++) {
+        bitstring_write_bit(data, offset + i, bitstring_read_bit(src, i));
+    }
+}
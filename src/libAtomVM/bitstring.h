@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+/**
+ * @file bitstring.h
+ * @brief Bit level access to binary data
+ *
+ * @details Helpers used by binary matching and construction instructions to read and write fields that are not
+ * necessarily byte aligned. Offsets and sizes are always expressed in bits, byte aligned fields take a fast path.
+ */
+
+#ifndef _BITSTRING_H_
+#define _BITSTRING_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// segment flags, as they are encoded by the compiler
+enum BitstringFlags
+{
+    BitstringFlagsAligned = 0x1,
+    BitstringFlagsLittleEndian = 0x2,
+    BitstringFlagsSigned = 0x4,
+    BitstringFlagsNativeEndian = 0x10
+};
+
+/**
+ * @brief Reads an integer field
+ *
+ * @details Reads n bits starting from given bit offset, bytes are read according to flags endianness and the value is
+ * sign extended when BitstringFlagsSigned is set. Fields bigger than 64 bits are not supported.
+ * @param data the binary data.
+ * @param offset field offset in bits.
+ * @param n field size in bits.
+ * @param flags a combination of BitstringFlags.
+ * @param dst where the read value will be stored.
+ * @return 1 on success, 0 if the field is too big.
+ */
+int bitstring_extract_integer(const uint8_t *data, size_t offset, size_t n, int flags, int64_t *dst);
+
+/**
+ * @brief Compares a bit field with some bytes
+ *
+ * @details Compares n bits starting from given bit offset with the first n bits of expected.
+ * @param data the binary data.
+ * @param offset field offset in bits.
+ * @param expected the bytes that the field is compared to.
+ * @param n field size in bits.
+ * @return 1 if they are equal, 0 otherwise.
+ */
+int bitstring_match_bits(const uint8_t *data, size_t offset, const uint8_t *expected, size_t n);
+
+/**
+ * @brief Writes an integer field
+ *
+ * @details Writes the n least significant bits of value starting from given bit offset, bytes are written according to
+ * flags endianness. Fields bigger than 64 bits are not supported.
+ * @param data the binary data that will be written.
+ * @param offset field offset in bits.
+ * @param value the value that will be written.
+ * @param n field size in bits.
+ * @param flags a combination of BitstringFlags.
+ * @return 1 on success, 0 if the field is too big.
+ */
+int bitstring_insert_integer(uint8_t *data, size_t offset, int64_t value, size_t n, int flags);
+
+/**
+ * @brief Copies bits
+ *
+ * @details Copies the first n bits of src to the given bit offset.
+ * @param data the binary data that will be written.
+ * @param offset destination offset in bits.
+ * @param src the bytes that will be copied.
+ * @param n number of bits that will be copied.
+ */
+void bitstring_copy_bits(uint8_t *data, size_t offset, const uint8_t *src, size_t n);
+
+#endif
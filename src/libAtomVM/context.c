@@ -22,6 +22,7 @@
 #include "globalcontext.h"
 #include "list.h"
 #include "mailbox.h"
+#include "scheduler.h"
 
 #define IMPL_EXECUTE_LOOP
 #include "opcodesswitch.h"
@@ -48,33 +49,59 @@ Context *context_new(GlobalContext *glb)
     ctx->stack_base = ctx->heap_start + DEFAULT_STACK_SIZE;
     ctx->e = ctx->stack_base;
     ctx->heap_ptr = ctx->heap_start;
+    ctx->heap_high_water_mark = ctx->heap_start;
+
+    ctx->old_heap_start = NULL;
+    ctx->old_heap_ptr = NULL;
+    ctx->old_heap_end = NULL;
+
+    ctx->off_heap_binaries = NULL;
+    ctx->old_off_heap_binaries = NULL;
+
+    ctx->heap_fragments = NULL;
+    ctx->heap_fragments_size = 0;
+
+    memset(&ctx->stats, 0, sizeof(struct ContextStats));
+    ctx->minor_gcs_since_major = 0;
+
+    ctx->heap_growth = HEAP_GROWTH_FIBONACCI;
+    ctx->heap_shrink_candidates = 0;
 
     ctx->avail_registers = 16;
     context_clean_registers(ctx, 0);
 
+    ctx->bs = term_invalid_term();
+    ctx->bs_offset = 0;
+
     ctx->min_heap_size = 0;
     ctx->max_heap_size = 0;
     ctx->has_min_heap_size = 0;
     ctx->has_max_heap_size = 0;
 
-    list_append(&glb->ready_processes, &ctx->processes_list_head);
+    list_init(&ctx->processes_list_head);
+    ctx->scheduling_state = CONTEXT_RUNNING;
 
+    ctx->outer_messages = NULL;
     ctx->mailbox = NULL;
+    ctx->mailbox_heap_messages = 0;
+    ctx->mailbox_save = NULL;
+    ctx->mailbox_mark = NULL;
+    ctx->mailbox_mark_label = NULL;
+    ctx->messages_count = 0;
+    ctx->messages_size = 0;
 
     ctx->global = glb;
 
-    ctx->process_id = globalcontext_get_new_process_id(glb);
-    linkedlist_append(&glb->processes_table, &ctx->processes_table_head);
-
     ctx->native_handler = NULL;
 
     ctx->saved_ip = NULL;
     ctx->jump_to_on_restore = NULL;
 
     ctx->leader = 0;
+    ctx->has_registered_name = 0;
 
-    ctx->timeout_at.tv_sec = 0;
-    ctx->timeout_at.tv_nsec = 0;
+    timer_wheel_item_init(&ctx->timer);
+    ctx->waiting_timeout = 0;
 
     #ifdef ENABLE_ADVANCED_TRACE
         ctx->trace_calls = 0;
@@ -86,55 +113,46 @@ Context *context_new(GlobalContext *glb)
 
     ctx->platform_data = NULL;
 
+    // messages can be sent as soon as the context is in the processes table, so it must be fully initialized
+    if (UNLIKELY(globalcontext_insert_process(glb, ctx) < 0)) {
+        fprintf(stderr, "Process table is full: %s:%i.\n", __FILE__, __LINE__);
+        free(ctx->heap_start);
+        free(ctx);
+        return NULL;
+    }
+
     return ctx;
 }
 
 void context_destroy(Context *ctx)
 {
-    linkedlist_remove(&ctx->global->processes_table, &ctx->processes_table_head);
+    globalcontext_remove_process(ctx->global, ctx);
 
-    free(ctx->heap_start);
-    free(ctx);
-}
-
-typedef void *(*maibox_iterator)(Message *msg, void *accum);
-
-static void *context_num_messages(Message *msg, void *accum)
-{
-    UNUSED(msg);
+    scheduler_cancel_timeout(ctx);
 
-    return (void *) ((size_t) accum + 1);
-}
+    // fragments of messages that are still in the mailbox are retained, they are freed with the messages
+    memory_release_heap_fragments(ctx->heap_fragments);
+    while (!mailbox_is_empty(ctx)) {
+        mailbox_destroy_message(mailbox_dequeue(ctx));
+    }
 
-static void *context_message_size(Message *msg, void *accum)
-{
-    return (void *) (sizeof(Message) + msg->msg_memory_size + (size_t) accum);
-}
+    memory_release_off_heap_binaries(ctx->off_heap_binaries);
+    memory_release_off_heap_binaries(ctx->old_off_heap_binaries);
 
-static void *context_mailbox_iterator(Context *ctx, maibox_iterator fun, void *initial)
-{
-    if (ctx->mailbox == NULL) {
-        return initial;
-    }
-    Message *messages = GET_LIST_ENTRY(ctx->mailbox, Message, mailbox_list_head);
-    Message *m = messages;
-    void *accum = initial;
-    do {
-        accum = fun(m, accum);
-        m = GET_LIST_ENTRY(m->mailbox_list_head.next, Message, mailbox_list_head);
-    } while (messages != m);
-    return accum;
+    free(ctx->heap_start);
+    free(ctx->old_heap_start);
+    free(ctx);
 }
 
 size_t context_message_queue_len(Context *ctx)
 {
-    return (size_t) context_mailbox_iterator(ctx, context_num_messages, NULL);
+    return (size_t) SMP_ATOMIC_LOAD(&ctx->messages_count);
 }
 
 size_t context_size(Context *ctx)
 {
     // TODO include ctx->platform_data
     return sizeof(Context)
-        + (size_t) context_mailbox_iterator(ctx, context_message_size, NULL)
-        + context_memory_size(ctx) * BYTES_PER_TERM;
+        + (size_t) SMP_ATOMIC_LOAD(&ctx->messages_size)
+        + (context_memory_size(ctx) + context_old_heap_memory_size(ctx) + ctx->heap_fragments_size) * BYTES_PER_TERM;
 }
@@ -31,9 +31,13 @@
 
 #include "linkedlist.h"
 #include "globalcontext.h"
+#include "memory.h"
+#include "smp.h"
 #include "term.h"
+#include "timer_wheel.h"
 
 struct Module;
+struct Message;
 
 #ifndef TYPEDEF_MODULE
 #define TYPEDEF_MODULE
@@ -42,9 +46,44 @@ typedef struct Module Module;
 
 typedef void (*native_handler)(Context *ctx);
 
+enum ContextSchedulingState
+{
+    CONTEXT_WAITING = 0,
+    CONTEXT_READY = 1,
+    CONTEXT_RUNNING = 2,
+    // flag set when a running process is made ready, so it will not wait
+    CONTEXT_SIGNALED = 4
+};
+
+/**
+ * @brief Counters of a process
+ *
+ * @details Counters are updated by the process itself, cheaply on the hot paths: reductions and running time are
+ * accounted when the process is scheduled out. Other processes read them without any lock, so they might be
+ * slightly behind.
+ */
+struct ContextStats
+{
+    uint64_t reductions;
+
+    unsigned long minor_gcs;
+    unsigned long major_gcs;
+    unsigned long copied_words;
+
+    unsigned long messages_sent;
+    unsigned long messages_received;
+
+    // time spent running in microseconds, up to the start of the current time slice
+    uint64_t run_time_us;
+    uint64_t running_since_us;
+};
+
 struct Context
 {
+    // ready queue head, used only while the process is ready
     struct ListHead processes_list_head;
+    // any scheduler can make a process ready, so it is changed atomically
+    int scheduling_state;
 
     struct ListHead processes_table_head;
     int32_t process_id;
@@ -57,6 +96,33 @@ struct Context
     term *heap_ptr;
     term *e;
 
+    // terms below the high water mark survived the last collection
+    term *heap_high_water_mark;
+
+    // old generation, it holds terms promoted from the heap
+    term *old_heap_start;
+    term *old_heap_ptr;
+    term *old_heap_end;
+
+    // handles to reference counted binaries stored in the heap and in the old heap
+    term *off_heap_binaries;
+    term *old_off_heap_binaries;
+
+    // memory blocks that are part of the heap until next collection, such as received messages
+    HeapFragment *heap_fragments;
+    unsigned long heap_fragments_size;
+
+    struct ContextStats stats;
+    unsigned int minor_gcs_since_major;
+
+    enum HeapGrowthStrategy heap_growth;
+    // number of collections in a row that left the heap mostly unused
+    unsigned int heap_shrink_candidates;
+
+    // binary that is being built by bs_put_* instructions and the offset in bits where next field is written
+    term bs;
+    size_t bs_offset;
+
     int min_heap_size;
     int max_heap_size;
 
@@ -67,19 +133,37 @@ struct Context
     const void *saved_ip;
     const void *jump_to_on_restore;
 
+    // senders push messages to the outer list without any lock, it is in reverse order and only the process
+    // itself moves them to the mailbox, that is the inner queue walked by receive
+    struct Message *outer_messages;
     struct ListHead *mailbox;
+    // messages in the mailbox that are part of the heap since receive examined them, they are collection roots
+    int mailbox_heap_messages;
+    // last message examined by the receive that is running, so loop_rec continues from the next one
+    struct ListHead *mailbox_save;
+    // last message that was in the mailbox when recv_mark has been executed, it is valid only for the receive
+    // at mailbox_mark_label
+    struct ListHead *mailbox_mark;
+    const void *mailbox_mark_label;
+    // updated atomically, so other processes can read them
+    int messages_count;
+    unsigned long messages_size;
 
     GlobalContext *global;
 
     //Ports support
     native_handler native_handler;
 
-    uint64_t reductions;
-    struct timespec timeout_at;
+    struct TimerWheelItem timer;
+
+    // atom index of the name the process is registered with, valid only when has_registered_name is set
+    int registered_name;
 
     unsigned int leader : 1;
+    unsigned int waiting_timeout : 1;
     unsigned int has_min_heap_size : 1;
     unsigned int has_max_heap_size : 1;
+    unsigned int has_registered_name : 1;
 
     #ifdef ENABLE_ADVANCED_TRACE
         unsigned int trace_calls : 1;
@@ -101,6 +185,8 @@ typedef struct Context Context;
  * @brief Creates a new context
  *
  * @details Allocates a new Context struct and initialize it, the newly created context is also inserted into the processes table.
+ * It is running on behalf of its creator, that must either run it or use scheduler_init_ready or
+ * scheduler_make_waiting once it has been initialized.
  * @param glb The global context of this virtual machine instance.
  * @returns created context.
  */
@@ -178,12 +264,25 @@ static inline unsigned long context_memory_size(const Context *ctx)
 /**
  * @brief Returns context heap size in term units
  *
+ * @details Returns the used heap size, including terms that have been promoted to the old heap.
  * @param ctx a valid context.
  * @returns context heap size in term units
  */
 static inline unsigned long context_heap_size(const Context *ctx)
 {
-    return ctx->heap_ptr - ctx->heap_start;
+    return (ctx->heap_ptr - ctx->heap_start) + (ctx->old_heap_ptr - ctx->old_heap_start);
+}
+
+/**
+ * @brief Returns context old heap size in term units
+ *
+ * @details Returns the memory reserved for the old generation in term units.
+ * @param ctx a valid context.
+ * @returns old heap size in term units.
+ */
+static inline unsigned long context_old_heap_memory_size(const Context *ctx)
+{
+    return ctx->old_heap_end - ctx->old_heap_start;
 }
 
 /**
@@ -200,13 +299,13 @@ static inline unsigned long context_stack_size(const Context *ctx)
 /**
  * @brief Checks if a contex is waiting a timeout.
  *
- * @details Check if given context has a timeout timestamp set, regardless current timestamp.
+ * @details Check if given context has a timeout set, regardless current timestamp and regardless if it has already expired.
  * @param ctx a valid context.
  * @returns 1 if context has a timeout, otherwise 0.
  */
 static inline int context_is_waiting_timeout(const Context *ctx)
 {
-    return ctx->timeout_at.tv_sec || ctx->timeout_at.tv_nsec;
+    return ctx->waiting_timeout;
 }
 
 /**
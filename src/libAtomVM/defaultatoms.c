@@ -33,6 +33,35 @@ static const char *const atom_count_atom = "\xA" "atom_count";
 static const char *const system_architecture_atom = "\x13" "system_architecture";
 static const char *const wordsize_atom = "\x8" "wordsize";
 
+static const char *const garbage_collection_atom = "\x12" "garbage_collection";
+static const char *const minor_gcs_atom = "\x9" "minor_gcs";
+static const char *const major_gcs_atom = "\x9" "major_gcs";
+static const char *const bytes_copied_atom = "\xC" "bytes_copied";
+static const char *const heap_growth_atom = "\xB" "heap_growth";
+static const char *const fibonacci_atom = "\x9" "fibonacci";
+static const char *const doubling_atom = "\x8" "doubling";
+static const char *const minimum_atom = "\x7" "minimum";
+
+static const char *const badmap_atom = "\x6" "badmap";
+static const char *const badkey_atom = "\x6" "badkey";
+
+static const char *const timeout_atom = "\x7" "timeout";
+
+static const char *const schedulers_atom = "\xA" "schedulers";
+
+static const char *const reductions_atom = "\xA" "reductions";
+static const char *const current_function_atom = "\x10" "current_function";
+static const char *const status_atom = "\x6" "status";
+static const char *const running_atom = "\x7" "running";
+static const char *const runnable_atom = "\x8" "runnable";
+static const char *const waiting_atom = "\x7" "waiting";
+static const char *const messages_sent_atom = "\xD" "messages_sent";
+static const char *const messages_received_atom = "\x11" "messages_received";
+static const char *const run_time_atom = "\x8" "run_time";
+static const char *const runtime_atom = "\x7" "runtime";
+static const char *const wall_clock_atom = "\xA" "wall_clock";
+static const char *const run_queue_atom = "\x9" "run_queue";
+
 void defaultatoms_init(GlobalContext *glb)
 {
     int ok = 1;
@@ -69,6 +98,35 @@ void defaultatoms_init(GlobalContext *glb)
     ok &= globalcontext_insert_atom(glb, system_architecture_atom) == SYSTEM_ARCHITECTURE_ATOM_INDEX;
     ok &= globalcontext_insert_atom(glb, wordsize_atom) == WORDSIZE_ATOM_INDEX;
 
+    ok &= globalcontext_insert_atom(glb, garbage_collection_atom) == GARBAGE_COLLECTION_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, minor_gcs_atom) == MINOR_GCS_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, major_gcs_atom) == MAJOR_GCS_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, bytes_copied_atom) == BYTES_COPIED_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, heap_growth_atom) == HEAP_GROWTH_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, fibonacci_atom) == FIBONACCI_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, doubling_atom) == DOUBLING_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, minimum_atom) == MINIMUM_ATOM_INDEX;
+
+    ok &= globalcontext_insert_atom(glb, badmap_atom) == BADMAP_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, badkey_atom) == BADKEY_ATOM_INDEX;
+
+    ok &= globalcontext_insert_atom(glb, timeout_atom) == TIMEOUT_ATOM_INDEX;
+
+    ok &= globalcontext_insert_atom(glb, schedulers_atom) == SCHEDULERS_ATOM_INDEX;
+
+    ok &= globalcontext_insert_atom(glb, reductions_atom) == REDUCTIONS_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, current_function_atom) == CURRENT_FUNCTION_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, status_atom) == STATUS_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, running_atom) == RUNNING_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, runnable_atom) == RUNNABLE_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, waiting_atom) == WAITING_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, messages_sent_atom) == MESSAGES_SENT_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, messages_received_atom) == MESSAGES_RECEIVED_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, run_time_atom) == RUN_TIME_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, runtime_atom) == RUNTIME_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, wall_clock_atom) == WALL_CLOCK_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, run_queue_atom) == RUN_QUEUE_ATOM_INDEX;
+
     if (!ok) {
         abort();
     }
@@ -55,7 +55,36 @@
 #define SYSTEM_ARCHITECTURE_ATOM_INDEX 25
 #define WORDSIZE_ATOM_INDEX 26
 
-#define PLATFORM_ATOMS_BASE_INDEX 27
+#define GARBAGE_COLLECTION_ATOM_INDEX 27
+#define MINOR_GCS_ATOM_INDEX 28
+#define MAJOR_GCS_ATOM_INDEX 29
+#define BYTES_COPIED_ATOM_INDEX 30
+#define HEAP_GROWTH_ATOM_INDEX 31
+#define FIBONACCI_ATOM_INDEX 32
+#define DOUBLING_ATOM_INDEX 33
+#define MINIMUM_ATOM_INDEX 34
+
+#define BADMAP_ATOM_INDEX 35
+#define BADKEY_ATOM_INDEX 36
+
+#define TIMEOUT_ATOM_INDEX 37
+
+#define SCHEDULERS_ATOM_INDEX 38
+
+#define REDUCTIONS_ATOM_INDEX 39
+#define CURRENT_FUNCTION_ATOM_INDEX 40
+#define STATUS_ATOM_INDEX 41
+#define RUNNING_ATOM_INDEX 42
+#define RUNNABLE_ATOM_INDEX 43
+#define WAITING_ATOM_INDEX 44
+#define MESSAGES_SENT_ATOM_INDEX 45
+#define MESSAGES_RECEIVED_ATOM_INDEX 46
+#define RUN_TIME_ATOM_INDEX 47
+#define RUNTIME_ATOM_INDEX 48
+#define WALL_CLOCK_ATOM_INDEX 49
+#define RUN_QUEUE_ATOM_INDEX 50
+
+#define PLATFORM_ATOMS_BASE_INDEX 51
 
 #define FALSE_ATOM term_from_atom_index(FALSE_ATOM_INDEX)
 #define TRUE_ATOM term_from_atom_index(TRUE_ATOM_INDEX)
@@ -90,6 +119,35 @@
 #define SYSTEM_ARCHITECTURE_ATOM term_from_atom_index(SYSTEM_ARCHITECTURE_ATOM_INDEX)
 #define WORDSIZE_ATOM term_from_atom_index(WORDSIZE_ATOM_INDEX)
 
+#define GARBAGE_COLLECTION_ATOM term_from_atom_index(GARBAGE_COLLECTION_ATOM_INDEX)
+#define MINOR_GCS_ATOM term_from_atom_index(MINOR_GCS_ATOM_INDEX)
+#define MAJOR_GCS_ATOM term_from_atom_index(MAJOR_GCS_ATOM_INDEX)
+#define BYTES_COPIED_ATOM term_from_atom_index(BYTES_COPIED_ATOM_INDEX)
+#define HEAP_GROWTH_ATOM term_from_atom_index(HEAP_GROWTH_ATOM_INDEX)
+#define FIBONACCI_ATOM term_from_atom_index(FIBONACCI_ATOM_INDEX)
+#define DOUBLING_ATOM term_from_atom_index(DOUBLING_ATOM_INDEX)
+#define MINIMUM_ATOM term_from_atom_index(MINIMUM_ATOM_INDEX)
+
+#define BADMAP_ATOM term_from_atom_index(BADMAP_ATOM_INDEX)
+#define BADKEY_ATOM term_from_atom_index(BADKEY_ATOM_INDEX)
+
+#define TIMEOUT_ATOM term_from_atom_index(TIMEOUT_ATOM_INDEX)
+
+#define SCHEDULERS_ATOM term_from_atom_index(SCHEDULERS_ATOM_INDEX)
+
+#define REDUCTIONS_ATOM term_from_atom_index(REDUCTIONS_ATOM_INDEX)
+#define CURRENT_FUNCTION_ATOM term_from_atom_index(CURRENT_FUNCTION_ATOM_INDEX)
+#define STATUS_ATOM term_from_atom_index(STATUS_ATOM_INDEX)
+#define RUNNING_ATOM term_from_atom_index(RUNNING_ATOM_INDEX)
+#define RUNNABLE_ATOM term_from_atom_index(RUNNABLE_ATOM_INDEX)
+#define WAITING_ATOM term_from_atom_index(WAITING_ATOM_INDEX)
+#define MESSAGES_SENT_ATOM term_from_atom_index(MESSAGES_SENT_ATOM_INDEX)
+#define MESSAGES_RECEIVED_ATOM term_from_atom_index(MESSAGES_RECEIVED_ATOM_INDEX)
+#define RUN_TIME_ATOM term_from_atom_index(RUN_TIME_ATOM_INDEX)
+#define RUNTIME_ATOM term_from_atom_index(RUNTIME_ATOM_INDEX)
+#define WALL_CLOCK_ATOM term_from_atom_index(WALL_CLOCK_ATOM_INDEX)
+#define RUN_QUEUE_ATOM term_from_atom_index(RUN_QUEUE_ATOM_INDEX)
+
 void defaultatoms_init(GlobalContext *glb);
 
 void platform_defaultatoms_init(GlobalContext *glb);
@@ -19,246 +19,1209 @@
 
 #include "externalterm.h"
 
+#include "atomshashtable.h"
 #include "context.h"
+#include "map.h"
+#include "memory.h"
+#include "module.h"
 
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "utils.h"
 
 #define EXTERNAL_TERM_TAG 131
+#define NEW_PID_EXT 88
+#define NEWER_REFERENCE_EXT 90
 #define SMALL_INTEGER_EXT 97
 #define INTEGER_EXT 98
 #define ATOM_EXT 100
+#define PID_EXT 103
 #define SMALL_TUPLE_EXT 104
+#define LARGE_TUPLE_EXT 105
 #define NIL_EXT 106
 #define STRING_EXT 107
 #define LIST_EXT 108
 #define BINARY_EXT 109
+#define SMALL_BIG_EXT 110
+#define LARGE_BIG_EXT 111
+#define NEW_FUN_EXT 112
+#define NEW_REFERENCE_EXT 114
+#define SMALL_ATOM_EXT 115
+#define MAP_EXT 116
+#define ATOM_UTF8_EXT 118
+#define SMALL_ATOM_UTF8_EXT 119
 
-static term parse_external_terms(const uint8_t *external_term_buf, int *eterm_size, Context *ctx);
-static int calculate_heap_usage(const uint8_t *external_term_buf, int *eterm_size, Context *ctx);
+// there is no distribution, so pids and refs are always encoded with this node name
+#define NODE_NAME "\xD" "nonode@nohost"
 
-term externalterm_to_term(const void *external_term, Context *ctx)
-{
-    const uint8_t *external_term_buf = (const uint8_t *) external_term;
+#define WALK_STACK_INITIAL_SIZE 16
 
-    if (UNLIKELY(external_term_buf[0] != EXTERNAL_TERM_TAG)) {
-        fprintf(stderr, "External term format not supported\n");
+// nested terms are walked using an explicit stack of frames, so deeply nested terms cannot overflow the C stack
+static void *walk_stack_grow(void *frames, void *initial_frames, int *capacity, size_t frame_size)
+{
+    int new_capacity = *capacity * 2;
+    void *new_frames = malloc(new_capacity * frame_size);
+    if (IS_NULL_PTR(new_frames)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
         abort();
     }
+    memcpy(new_frames, frames, *capacity * frame_size);
+    if (frames != initial_frames) {
+        free(frames);
+    }
+    *capacity = new_capacity;
 
-    int eterm_size;
-    int heap_usage = calculate_heap_usage(external_term_buf + 1, &eterm_size, ctx);
-    switch (memory_ensure_free(ctx, heap_usage)) {
-        case MEMORY_GC_OK:
+    return new_frames;
+}
+
+//
+// Decoding
+//
+
+// integers are supported as long as they fit an int64
+static int decode_integer(const uint8_t *buf, size_t available, int64_t *value, size_t *size)
+{
+    switch (buf[0]) {
+        case SMALL_INTEGER_EXT:
+            if (available < 2) {
+                return 0;
+            }
+            *value = buf[1];
+            *size = 2;
+            return 1;
+
+        case INTEGER_EXT:
+            if (available < 5) {
+                return 0;
+            }
+            *value = (int32_t) READ_32_UNALIGNED(buf + 1);
+            *size = 5;
+            return 1;
+
+        default: {
+            size_t header_size = (buf[0] == SMALL_BIG_EXT) ? 3 : 6;
+            if (available < header_size) {
+                return 0;
+            }
+            size_t num_bytes = (buf[0] == SMALL_BIG_EXT) ? buf[1] : READ_32_UNALIGNED(buf + 1);
+            uint8_t sign = buf[header_size - 1];
+            if (available - header_size < num_bytes) {
+                return 0;
+            }
+
+            uint64_t magnitude = 0;
+            for (int i = num_bytes - 1; i >= 0; i--) {
+                if (UNLIKELY(magnitude >> 56)) {
+                    return 0;
+                }
+                magnitude = (magnitude << 8) | buf[header_size + i];
+            }
+            if (UNLIKELY(magnitude > (sign ? ((uint64_t) INT64_MAX) + 1 : (uint64_t) INT64_MAX))) {
+                return 0;
+            }
+
+            *value = sign ? (int64_t) (0 - magnitude) : (int64_t) magnitude;
+            *size = header_size + num_bytes;
+            return 1;
+        }
+    }
+}
+
+// atom names are returned as an AtomString that points into the buffer
+static int decode_atom(const uint8_t *buf, size_t available, AtomString *atom, size_t *size)
+{
+    switch (buf[0]) {
+        case ATOM_EXT:
+        case ATOM_UTF8_EXT: {
+            if ((available < 3) || buf[1]) {
+                // longer atoms are not supported
+                return 0;
+            }
+            *atom = (AtomString) (buf + 2);
+            *size = 3 + buf[2];
             break;
-        case MEMORY_GC_ERROR_FAILED_ALLOCATION:
-            // TODO Improve error handling
-            fprintf(stderr, "Failed to allocate additional heap storage: [%s:%i]\n", __FILE__, __LINE__);
-            abort();
-        case MEMORY_GC_DENIED_ALLOCATION:
-            // TODO Improve error handling
-            fprintf(stderr, "Not permitted to allocate additional heap storage: [%s:%i]\n", __FILE__, __LINE__);
-            abort();
+        }
+
+        case SMALL_ATOM_EXT:
+        case SMALL_ATOM_UTF8_EXT: {
+            if (available < 2) {
+                return 0;
+            }
+            *atom = (AtomString) (buf + 1);
+            *size = 2 + buf[1];
+            break;
+        }
+
+        default:
+            return 0;
     }
 
-    return parse_external_terms(external_term_buf + 1, &eterm_size, ctx);
+    return *size <= available;
 }
 
-static term parse_external_terms(const uint8_t *external_term_buf, int *eterm_size, Context *ctx)
+static int decode_pid(const uint8_t *buf, size_t available, int32_t *process_id, size_t *size)
 {
-    switch (external_term_buf[0]) {
-        case SMALL_INTEGER_EXT: {
-            *eterm_size = 2;
-            return term_from_int11(external_term_buf[1]);
-        }
+    AtomString node;
+    size_t node_size;
+    if ((available < 1) || !decode_atom(buf + 1, available - 1, &node, &node_size)) {
+        return 0;
+    }
+    size_t pid_size = 1 + node_size + ((buf[0] == NEW_PID_EXT) ? 12 : 9);
+    if (available < pid_size) {
+        return 0;
+    }
+
+    *process_id = READ_32_UNALIGNED(buf + 1 + node_size);
+    *size = pid_size;
+    return 1;
+}
+
+static int decode_ref(const uint8_t *buf, size_t available, uint64_t *ref_ticks, size_t *size)
+{
+    AtomString node;
+    size_t node_size;
+    if ((available < 3) || !decode_atom(buf + 3, available - 3, &node, &node_size)) {
+        return 0;
+    }
+    uint16_t ids_count = READ_16_UNALIGNED(buf + 1);
+    size_t ids_offset = 3 + node_size + ((buf[0] == NEWER_REFERENCE_EXT) ? 4 : 1);
+    size_t ref_size = ids_offset + ids_count * 4;
+    if ((ids_count == 0) || (available < ref_size)) {
+        return 0;
+    }
 
-        case INTEGER_EXT: {
-            int32_t value = READ_32_UNALIGNED(external_term_buf + 1);
+    *ref_ticks = READ_32_UNALIGNED(buf + ids_offset);
+    if (ids_count > 1) {
+        *ref_ticks |= ((uint64_t) READ_32_UNALIGNED(buf + ids_offset + 4)) << 32;
+    }
+    *size = ref_size;
+    return 1;
+}
+
+// funs can be decoded only if the same module is available and it has a fun with the same index and free variables
+static int decode_fun_header(const uint8_t *buf, size_t available, GlobalContext *glb, Module **fun_module,
+    uint32_t *fun_index, uint32_t *num_free, size_t *size)
+{
+    // tag, size, arity, uniq, index, num_free
+    size_t pos = 30;
+    if (!glb || (available < pos)) {
+        return 0;
+    }
+    uint32_t index = READ_32_UNALIGNED(buf + 22);
+    uint32_t n_free = READ_32_UNALIGNED(buf + 26);
 
-            *eterm_size = 5;
-            return term_from_int32(value);
+    AtomString module_name;
+    size_t item_size;
+    if (!decode_atom(buf + pos, available - pos, &module_name, &item_size)) {
+        return 0;
+    }
+    pos += item_size;
+    // old index and old uniq
+    for (int i = 0; i < 2; i++) {
+        int64_t value;
+        if ((available == pos) || !decode_integer(buf + pos, available - pos, &value, &item_size)) {
+            return 0;
         }
+        pos += item_size;
+    }
+    int32_t pid;
+    if ((available == pos) || !decode_pid(buf + pos, available - pos, &pid, &item_size)) {
+        return 0;
+    }
+    pos += item_size;
+
+    Module *mod = globalcontext_get_module(glb, module_name);
+    if (!mod || (index >= module_get_funs_count(mod)) || (module_get_fun_freeze(mod, index) != n_free)) {
+        return 0;
+    }
 
-        case ATOM_EXT: {
-            uint16_t atom_len = READ_16_UNALIGNED(external_term_buf + 1);
+    *fun_module = mod;
+    *fun_index = index;
+    *num_free = n_free;
+    *size = pos;
+    return 1;
+}
+
+static size_t decode_binary_heap_size(uint32_t size, int refc_binaries)
+{
+    if (refc_binaries) {
+        return term_binary_heap_size(size);
+    }
 
-            int global_atom_id = globalcontext_insert_atom(ctx->global, (AtomString) (external_term_buf + 2));
+    return term_binary_data_size_in_terms(size) + 1;
+}
 
-            *eterm_size = 3 + atom_len;
-            return term_from_atom_index(global_atom_id);
+// validates the buffer and computes the heap size needed to decode it: instead of visiting nested terms, the number of
+// terms that still have to be read is counted
+static int decode_heap_size(const uint8_t *buf, size_t len, int refc_binaries, GlobalContext *glb,
+    size_t *heap_size, size_t *eterm_size)
+{
+    size_t pos = 0;
+    size_t pending = 1;
+    size_t heap = 0;
+
+    while (pending) {
+        pending--;
+        if (pos >= len) {
+            return 0;
         }
 
-        case SMALL_TUPLE_EXT: {
-            uint8_t arity = external_term_buf[1];
-            term tuple = term_alloc_tuple(arity, ctx);
+        const uint8_t *item = buf + pos;
+        size_t available = len - pos;
+        size_t item_size;
+
+        switch (item[0]) {
+            case SMALL_INTEGER_EXT:
+            case INTEGER_EXT:
+            case SMALL_BIG_EXT:
+            case LARGE_BIG_EXT: {
+                int64_t value;
+                if (!decode_integer(item, available, &value, &item_size)) {
+                    return 0;
+                }
+                heap += term_int64_heap_size(value);
+                break;
+            }
+
+            case ATOM_EXT:
+            case ATOM_UTF8_EXT:
+            case SMALL_ATOM_EXT:
+            case SMALL_ATOM_UTF8_EXT: {
+                AtomString atom;
+                if (!decode_atom(item, available, &atom, &item_size)) {
+                    return 0;
+                }
+                break;
+            }
 
-            int buf_pos = 2;
+            case NEW_PID_EXT:
+            case PID_EXT: {
+                int32_t process_id;
+                if (!decode_pid(item, available, &process_id, &item_size)) {
+                    return 0;
+                }
+                break;
+            }
 
-            for (int i = 0; i < arity; i++) {
-                int element_size;
-                term put_value = parse_external_terms(external_term_buf + buf_pos, &element_size, ctx);
-                term_put_tuple_element(tuple, i, put_value);
+            case NEWER_REFERENCE_EXT:
+            case NEW_REFERENCE_EXT: {
+                uint64_t ref_ticks;
+                if (!decode_ref(item, available, &ref_ticks, &item_size)) {
+                    return 0;
+                }
+                heap += REF_SIZE;
+                break;
+            }
 
-                buf_pos += element_size;
+            case SMALL_TUPLE_EXT:
+            case LARGE_TUPLE_EXT: {
+                size_t header_size = (item[0] == SMALL_TUPLE_EXT) ? 2 : 5;
+                if (available < header_size) {
+                    return 0;
+                }
+                size_t arity = (item[0] == SMALL_TUPLE_EXT) ? item[1] : READ_32_UNALIGNED(item + 1);
+                item_size = header_size;
+                heap += 1 + arity;
+                pending += arity;
+                break;
             }
 
-            *eterm_size = buf_pos;
-            return tuple;
+            case NIL_EXT:
+                item_size = 1;
+                break;
+
+            case STRING_EXT: {
+                if (available < 3) {
+                    return 0;
+                }
+                uint16_t string_size = READ_16_UNALIGNED(item + 1);
+                item_size = 3 + string_size;
+                heap += string_size * 2;
+                break;
+            }
+
+            case LIST_EXT: {
+                if (available < 5) {
+                    return 0;
+                }
+                uint32_t list_len = READ_32_UNALIGNED(item + 1);
+                item_size = 5;
+                heap += list_len * 2;
+                // elements and tail
+                pending += (size_t) list_len + 1;
+                break;
+            }
+
+            case BINARY_EXT: {
+                if (available < 5) {
+                    return 0;
+                }
+                uint32_t binary_size = READ_32_UNALIGNED(item + 1);
+                item_size = 5 + (size_t) binary_size;
+                heap += decode_binary_heap_size(binary_size, refc_binaries);
+                break;
+            }
+
+            case MAP_EXT: {
+                if (available < 5) {
+                    return 0;
+                }
+                uint32_t size = READ_32_UNALIGNED(item + 1);
+                item_size = 5;
+                // entries are decoded into a flat map, that is rebuilt as a hash map when it is too big
+                heap += map_flat_heap_size(size);
+                if (size > MAP_FLAT_MAX_SIZE) {
+                    heap += map_max_heap_size(size);
+                }
+                pending += (size_t) size * 2;
+                break;
+            }
+
+            case NEW_FUN_EXT: {
+                Module *fun_module;
+                uint32_t fun_index;
+                uint32_t num_free;
+                if (!decode_fun_header(item, available, glb, &fun_module, &fun_index, &num_free, &item_size)) {
+                    return 0;
+                }
+                heap += 3 + num_free;
+                pending += num_free;
+                break;
+            }
+
+            default:
+                return 0;
         }
 
-        case NIL_EXT: {
-            *eterm_size = 1;
-            return term_nil();
+        if (item_size > available) {
+            return 0;
         }
+        pos += item_size;
 
-        case STRING_EXT: {
-            uint16_t string_size = READ_16_UNALIGNED(external_term_buf + 1);
-            *eterm_size = 3 + string_size;
-            return term_from_string((uint8_t *) external_term_buf + 3, string_size, ctx);
+        // every term is at least one byte long
+        if (pending > len - pos) {
+            return 0;
         }
+    }
 
-        case LIST_EXT: {
-            uint32_t list_len = READ_32_UNALIGNED(external_term_buf + 1);
+    *heap_size = heap;
+    *eterm_size = pos;
+    return 1;
+}
+
+enum DecodeFrameType
+{
+    DecodeSlots,
+    DecodeListHeads,
+    DecodeMapEntries
+};
 
-            term list_begin = term_nil();
-            term *prev_term = NULL;
+// slots of an already allocated term that are filled with the next decoded terms
+struct DecodeFrame
+{
+    enum DecodeFrameType type;
+    term *slots;
+    // map values, keys are stored in slots
+    term *values;
+    // where the map is stored, so it can be replaced when it is done
+    term *map;
+    uint32_t index;
+    uint32_t count;
+};
 
-            int buf_pos = 5;
+struct DecodeState
+{
+    const uint8_t *buf;
+    size_t pos;
+    // heap memory is taken from the context heap when set, so big binaries can be stored off-heap
+    Context *ctx;
+    term *heap_ptr;
+    GlobalContext *global;
 
-            for (unsigned int i = 0; i < list_len; i++) {
-                int item_size;
-                term head = parse_external_terms(external_term_buf + buf_pos, &item_size, ctx);
+    struct DecodeFrame *frames;
+    int frames_count;
+    int frames_capacity;
+    struct DecodeFrame initial_frames[WALK_STACK_INITIAL_SIZE];
+};
 
-                term *new_list_item = term_list_alloc(ctx);
+static inline term *decode_alloc(struct DecodeState *state, size_t size)
+{
+    if (state->ctx) {
+        return memory_heap_alloc(state->ctx, size);
+    }
 
-                if (prev_term) {
-                    prev_term[0] = term_list_from_list_ptr(new_list_item);
-                } else {
-                    list_begin = term_list_from_list_ptr(new_list_item);
-                }
+    term *allocated = state->heap_ptr;
+    state->heap_ptr += size;
+
+    return allocated;
+}
+
+static struct DecodeFrame *decode_push(struct DecodeState *state, enum DecodeFrameType type, term *slots, term *values, uint32_t count)
+{
+    if (state->frames_count == state->frames_capacity) {
+        state->frames = walk_stack_grow(state->frames, state->initial_frames, &state->frames_capacity, sizeof(struct DecodeFrame));
+    }
 
-                prev_term = new_list_item;
-                new_list_item[1] = head;
+    struct DecodeFrame *frame = &state->frames[state->frames_count++];
+    frame->type = type;
+    frame->slots = slots;
+    frame->values = values;
+    frame->index = 0;
+    frame->count = count;
+
+    return frame;
+}
+
+// the atoms table keeps a pointer to the atom string: literals can point into the module, but a process buffer
+// might be freed or moved, so new atoms are copied
+static term decode_atom_term(struct DecodeState *state, AtomString atom)
+{
+    unsigned long atom_index = atomshashtable_get_value(state->global->atoms_table, atom, ULONG_MAX);
+    if (atom_index != ULONG_MAX) {
+        return term_from_atom_index(atom_index);
+    }
+    if (!state->ctx) {
+        return term_from_atom_index(globalcontext_insert_atom(state->global, atom));
+    }
+
+    size_t atom_size = atom_string_len(atom) + 1;
+    uint8_t *atom_copy = malloc(atom_size);
+    if (IS_NULL_PTR(atom_copy)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        abort();
+    }
+    memcpy(atom_copy, atom, atom_size);
+
+    term atom_term = term_from_atom_index(globalcontext_insert_atom(state->global, (AtomString) atom_copy));
+    if (globalcontext_atomstring_from_term(state->global, atom_term) != (AtomString) atom_copy) {
+        // another scheduler inserted it meanwhile
+        free(atom_copy);
+    }
 
-                buf_pos += item_size;
+    return atom_term;
+}
+
+// decodes the term at the current position into slot, nested terms are decoded later by the caller loop
+static void decode_item(struct DecodeState *state, term *slot)
+{
+    const uint8_t *item = state->buf + state->pos;
+    // the buffer has been already validated by decode_heap_size
+    size_t available = SIZE_MAX;
+    size_t item_size;
+
+    switch (item[0]) {
+        case SMALL_INTEGER_EXT:
+        case INTEGER_EXT:
+        case SMALL_BIG_EXT:
+        case LARGE_BIG_EXT: {
+            int64_t value;
+            decode_integer(item, available, &value, &item_size);
+            if (term_int64_heap_size(value)) {
+                *slot = term_init_boxed_int64(decode_alloc(state, BOXED_INT64_SIZE), value);
+            } else {
+                *slot = term_from_int64(value);
             }
+            break;
+        }
 
-            if (prev_term) {
-                int tail_size;
-                term tail = parse_external_terms(external_term_buf + buf_pos, &tail_size, ctx);
-                if (tail != term_nil()) {
-                    //TODO: add support for imporper lists
-                    abort();
-                }
+        case ATOM_EXT:
+        case ATOM_UTF8_EXT:
+        case SMALL_ATOM_EXT:
+        case SMALL_ATOM_UTF8_EXT: {
+            AtomString atom;
+            decode_atom(item, available, &atom, &item_size);
+            *slot = decode_atom_term(state, atom);
+            break;
+        }
+
+        case NEW_PID_EXT:
+        case PID_EXT: {
+            int32_t process_id;
+            decode_pid(item, available, &process_id, &item_size);
+            *slot = term_from_local_process_id(process_id);
+            break;
+        }
+
+        case NEWER_REFERENCE_EXT:
+        case NEW_REFERENCE_EXT: {
+            uint64_t ref_ticks;
+            decode_ref(item, available, &ref_ticks, &item_size);
+            *slot = term_init_ref(decode_alloc(state, REF_SIZE), ref_ticks);
+            break;
+        }
 
-                prev_term[0] = term_nil();
-                buf_pos += tail_size;
+        case SMALL_TUPLE_EXT:
+        case LARGE_TUPLE_EXT: {
+            uint32_t arity = (item[0] == SMALL_TUPLE_EXT) ? item[1] : READ_32_UNALIGNED(item + 1);
+            item_size = (item[0] == SMALL_TUPLE_EXT) ? 2 : 5;
+            term *boxed_value = decode_alloc(state, 1 + arity);
+            boxed_value[0] = (arity << 6) | TERM_BOXED_TUPLE;
+            *slot = ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+            if (arity) {
+                decode_push(state, DecodeSlots, boxed_value + 1, NULL, arity);
+            }
+            break;
+        }
+
+        case NIL_EXT:
+            item_size = 1;
+            *slot = term_nil();
+            break;
+
+        case STRING_EXT: {
+            uint16_t string_size = READ_16_UNALIGNED(item + 1);
+            item_size = 3 + string_size;
+            if (string_size == 0) {
+                *slot = term_nil();
+                break;
             }
 
-             *eterm_size = buf_pos;
-             return list_begin;
+            term *list_cells = decode_alloc(state, string_size * 2);
+            for (int i = 0; i < string_size; i++) {
+                list_cells[i * 2] = term_list_from_list_ptr(&list_cells[(i + 1) * 2]);
+                list_cells[i * 2 + 1] = term_from_int11(item[3 + i]);
+            }
+            list_cells[string_size * 2 - 2] = term_nil();
+            *slot = term_list_from_list_ptr(list_cells);
+            break;
+        }
+
+        case LIST_EXT: {
+            uint32_t list_len = READ_32_UNALIGNED(item + 1);
+            item_size = 5;
+            if (list_len == 0) {
+                // just the tail
+                decode_push(state, DecodeSlots, slot, NULL, 1);
+                break;
+            }
+
+            term *list_cells = decode_alloc(state, list_len * 2);
+            for (uint32_t i = 0; i + 1 < list_len; i++) {
+                list_cells[i * 2] = term_list_from_list_ptr(&list_cells[(i + 1) * 2]);
+            }
+            *slot = term_list_from_list_ptr(list_cells);
+            // heads are decoded first, the tail (that might be improper) later
+            decode_push(state, DecodeSlots, &list_cells[(list_len - 1) * 2], NULL, 1);
+            decode_push(state, DecodeListHeads, list_cells, NULL, list_len);
+            break;
         }
 
         case BINARY_EXT: {
-            uint32_t binary_size = READ_32_UNALIGNED(external_term_buf + 1);
-            *eterm_size = 5 + binary_size;
-            return term_from_literal_binary((uint8_t *) external_term_buf + 5, binary_size, ctx);
+            uint32_t binary_size = READ_32_UNALIGNED(item + 1);
+            item_size = 5 + binary_size;
+
+            if (state->ctx && (binary_size >= REFC_BINARY_MIN)) {
+                struct RefcBinary *refc = refc_binary_create(item + 5, binary_size);
+                if (LIKELY(refc != NULL)) {
+                    *slot = memory_alloc_refc_binary(state->ctx, refc);
+                    break;
+                }
+                // TODO Improve error handling
+                fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+                abort();
+            }
+
+            int size_in_terms = term_binary_data_size_in_terms(binary_size);
+            term *boxed_value = decode_alloc(state, size_in_terms + 1);
+            boxed_value[0] = (size_in_terms << 6) | TERM_BOXED_HEAP_BINARY;
+            boxed_value[1] = binary_size;
+            memcpy(boxed_value + 2, item + 5, binary_size);
+            *slot = ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+            break;
+        }
+
+        case MAP_EXT: {
+            uint32_t size = READ_32_UNALIGNED(item + 1);
+            item_size = 5;
+
+            term *keys = decode_alloc(state, size + 1);
+            keys[0] = (size << 6) | TERM_BOXED_TUPLE;
+            term *boxed_value = decode_alloc(state, size + 2);
+            boxed_value[0] = ((size + 1) << 6) | TERM_BOXED_MAP;
+            boxed_value[TERM_MAP_KEYS_INDEX] = ((term) keys) | TERM_BOXED_VALUE_TAG;
+            *slot = ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+            // the frame is kept also for empty maps, keys are sorted when it is done
+            struct DecodeFrame *frame = decode_push(state, DecodeMapEntries, keys + 1, boxed_value + TERM_MAP_VALUES_INDEX, size * 2);
+            frame->map = slot;
+            break;
+        }
+
+        case NEW_FUN_EXT: {
+            Module *fun_module;
+            uint32_t fun_index;
+            uint32_t num_free;
+            decode_fun_header(item, available, state->global, &fun_module, &fun_index, &num_free, &item_size);
+
+            term *boxed_func = decode_alloc(state, 3 + num_free);
+            boxed_func[0] = ((2 + num_free) << 6) | TERM_BOXED_FUN;
+            boxed_func[1] = (term) fun_module;
+            boxed_func[2] = fun_index;
+            *slot = ((term) boxed_func) | TERM_BOXED_VALUE_TAG;
+            if (num_free) {
+                decode_push(state, DecodeSlots, boxed_func + 3, NULL, num_free);
+            }
+            break;
         }
 
         default:
-            fprintf(stderr, "Unknown term type: %i\n", (int) external_term_buf[0]);
+            fprintf(stderr, "Unknown term type: %i\n", (int) item[0]);
             abort();
     }
+
+    state->pos += item_size;
 }
 
-static int calculate_heap_usage(const uint8_t *external_term_buf, int *eterm_size, Context *ctx)
+// sorts the keys of a decoded flat map, or builds a hash map from them when there are too many of them
+static int decode_map_done(struct DecodeState *state, struct DecodeFrame *frame)
 {
-    switch (external_term_buf[0]) {
-        case SMALL_INTEGER_EXT: {
-            *eterm_size = 2;
-            return 0;
-        }
+    size_t size = frame->count / 2;
 
-        case INTEGER_EXT: {
-            *eterm_size = 5;
-            return 0;
+    if (size <= MAP_FLAT_MAX_SIZE) {
+        map_flat_sort(frame->slots, frame->values, size, state->global);
+        for (size_t i = 1; i < size; i++) {
+            if (term_exactly_equals(frame->slots[i - 1], frame->slots[i])) {
+                return 0;
+            }
         }
+        return 1;
+    }
 
-        case ATOM_EXT: {
-            uint16_t atom_len = READ_16_UNALIGNED(external_term_buf + 1);
-            *eterm_size = 3 + atom_len;
-            return 0;
+    struct MapEntry *entries = malloc(size * sizeof(struct MapEntry));
+    if (IS_NULL_PTR(entries)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        abort();
+    }
+    for (size_t i = 0; i < size; i++) {
+        entries[i].hash = map_hash_key(frame->slots[i]);
+        entries[i].order = i;
+        entries[i].key = frame->slots[i];
+        entries[i].value = frame->values[i];
+    }
+
+    int unique = map_entries_prepare(entries, size, state->global) == size;
+    if (unique) {
+        // the flat map becomes garbage, map_max_heap_size has been reserved for the hash map
+        if (state->ctx) {
+            *frame->map = map_from_entries(entries, size, state->ctx);
+        } else {
+            *frame->map = map_from_entries_in_heap(entries, size, &state->heap_ptr, state->global);
         }
+    }
+    free(entries);
 
-        case SMALL_TUPLE_EXT: {
-            uint8_t arity = external_term_buf[1];
+    return unique;
+}
 
-            int heap_usage = 1;
-            int buf_pos = 2;
+// returns an invalid term when a map has duplicated keys, that cannot be found by decode_heap_size
+static term decode_term(struct DecodeState *state)
+{
+    state->frames = state->initial_frames;
+    state->frames_count = 0;
+    state->frames_capacity = WALK_STACK_INITIAL_SIZE;
 
-            for (int i = 0; i < arity; i++) {
-                int element_size;
-                heap_usage += calculate_heap_usage(external_term_buf + buf_pos, &element_size, ctx) + 1;
+    term result;
+    decode_push(state, DecodeSlots, &result, NULL, 1);
 
-                buf_pos += element_size;
+    while (state->frames_count) {
+        struct DecodeFrame *frame = &state->frames[state->frames_count - 1];
+        if (frame->index == frame->count) {
+            if ((frame->type == DecodeMapEntries) && !decode_map_done(state, frame)) {
+                result = term_invalid_term();
+                break;
             }
+            state->frames_count--;
+            continue;
+        }
 
-            *eterm_size = buf_pos;
-            return heap_usage;
+        uint32_t i = frame->index++;
+        term *slot;
+        switch (frame->type) {
+            case DecodeSlots:
+                slot = &frame->slots[i];
+                break;
+            case DecodeListHeads:
+                slot = &frame->slots[i * 2 + 1];
+                break;
+            default:
+                // keys and values are interleaved
+                slot = (i & 1) ? &frame->values[i / 2] : &frame->slots[i / 2];
+                break;
         }
+        decode_item(state, slot);
+    }
 
-        case NIL_EXT: {
-            *eterm_size = 1;
-            return 0;
+    if (state->frames != state->initial_frames) {
+        free(state->frames);
+    }
+
+    return result;
+}
+
+term externalterm_to_term(const void *external_term, Context *ctx)
+{
+    const uint8_t *external_term_buf = (const uint8_t *) external_term;
+
+    size_t heap_usage;
+    size_t eterm_size;
+    if (UNLIKELY((external_term_buf[0] != EXTERNAL_TERM_TAG)
+            || !decode_heap_size(external_term_buf + 1, SIZE_MAX, 1, ctx->global, &heap_usage, &eterm_size))) {
+        fprintf(stderr, "External term format not supported\n");
+        abort();
+    }
+
+    switch (memory_ensure_free(ctx, heap_usage)) {
+        case MEMORY_GC_OK:
+            break;
+        case MEMORY_GC_ERROR_FAILED_ALLOCATION:
+            // TODO Improve error handling
+            fprintf(stderr, "Failed to allocate additional heap storage: [%s:%i]\n", __FILE__, __LINE__);
+            abort();
+        case MEMORY_GC_DENIED_ALLOCATION:
+            // TODO Improve error handling
+            fprintf(stderr, "Not permitted to allocate additional heap storage: [%s:%i]\n", __FILE__, __LINE__);
+            abort();
+    }
+
+    struct DecodeState state;
+    state.buf = external_term_buf + 1;
+    state.pos = 0;
+    state.ctx = ctx;
+    state.global = ctx->global;
+    term t = decode_term(&state);
+    if (UNLIKELY(term_is_invalid_term(t))) {
+        fprintf(stderr, "External term format not supported\n");
+        abort();
+    }
+
+    return t;
+}
+
+int externalterm_heap_usage(const void *external_term)
+{
+    const uint8_t *external_term_buf = (const uint8_t *) external_term;
+
+    size_t heap_usage;
+    size_t eterm_size;
+    if (UNLIKELY((external_term_buf[0] != EXTERNAL_TERM_TAG)
+            || !decode_heap_size(external_term_buf + 1, SIZE_MAX, 0, NULL, &heap_usage, &eterm_size))) {
+        fprintf(stderr, "External term format not supported\n");
+        abort();
+    }
+
+    return heap_usage;
+}
+
+term externalterm_to_term_in_heap(const void *external_term, term **heap_ptr, GlobalContext *glb)
+{
+    const uint8_t *external_term_buf = (const uint8_t *) external_term;
+
+    if (UNLIKELY(external_term_buf[0] != EXTERNAL_TERM_TAG)) {
+        fprintf(stderr, "External term format not supported\n");
+        abort();
+    }
+
+    struct DecodeState state;
+    state.buf = external_term_buf + 1;
+    state.pos = 0;
+    state.ctx = NULL;
+    state.heap_ptr = *heap_ptr;
+    state.global = glb;
+    term t = decode_term(&state);
+    if (UNLIKELY(term_is_invalid_term(t))) {
+        fprintf(stderr, "External term format not supported\n");
+        abort();
+    }
+    *heap_ptr = state.heap_ptr;
+
+    return t;
+}
+
+int externalterm_buffer_heap_usage(const void *buf, size_t len, GlobalContext *glb)
+{
+    const uint8_t *external_term_buf = (const uint8_t *) buf;
+
+    size_t heap_usage;
+    size_t eterm_size;
+    if ((len < 1) || (external_term_buf[0] != EXTERNAL_TERM_TAG)
+            || !decode_heap_size(external_term_buf + 1, len - 1, 1, glb, &heap_usage, &eterm_size)
+            || (heap_usage > INT32_MAX)) {
+        return -1;
+    }
+
+    return heap_usage;
+}
+
+term externalterm_buffer_to_term(const void *buf, Context *ctx)
+{
+    struct DecodeState state;
+    state.buf = (const uint8_t *) buf + 1;
+    state.pos = 0;
+    state.ctx = ctx;
+    state.global = ctx->global;
+
+    return decode_term(&state);
+}
+
+//
+// Encoding
+//
+
+enum EncodeFrameType
+{
+    EncodeTerms,
+    EncodeMapEntries,
+    EncodeList
+};
+
+// terms that still have to be encoded, after the term that pushed the frame
+struct EncodeFrame
+{
+    enum EncodeFrameType type;
+    const term *terms;
+    // flat map values, keys are in terms
+    const term *values;
+    size_t index;
+    size_t count;
+    // EncodeList: the remaining cells
+    term list;
+    // freed when the frame is done
+    term *allocated;
+    // offset of the size field of a fun, that is written once its free variables have been encoded
+    size_t fun_size_offset;
+};
+
+struct EncodeState
+{
+    // only the size is computed when NULL
+    uint8_t *buf;
+    size_t pos;
+    GlobalContext *global;
+
+    struct EncodeFrame *frames;
+    int frames_count;
+    int frames_capacity;
+    struct EncodeFrame initial_frames[WALK_STACK_INITIAL_SIZE];
+};
+
+static struct EncodeFrame *encode_push(struct EncodeState *state, enum EncodeFrameType type, const term *terms, size_t count)
+{
+    if (state->frames_count == state->frames_capacity) {
+        state->frames = walk_stack_grow(state->frames, state->initial_frames, &state->frames_capacity, sizeof(struct EncodeFrame));
+    }
+
+    struct EncodeFrame *frame = &state->frames[state->frames_count++];
+    frame->type = type;
+    frame->terms = terms;
+    frame->values = NULL;
+    frame->index = 0;
+    frame->count = count;
+    frame->list = term_nil();
+    frame->allocated = NULL;
+    frame->fun_size_offset = 0;
+
+    return frame;
+}
+
+static inline void encode_bytes(struct EncodeState *state, const void *data, size_t size)
+{
+    if (state->buf) {
+        memcpy(state->buf + state->pos, data, size);
+    }
+    state->pos += size;
+}
+
+static inline void encode_u8(struct EncodeState *state, uint8_t value)
+{
+    if (state->buf) {
+        state->buf[state->pos] = value;
+    }
+    state->pos++;
+}
+
+static inline void encode_u16(struct EncodeState *state, uint16_t value)
+{
+    encode_u8(state, value >> 8);
+    encode_u8(state, value);
+}
+
+static inline void encode_u32(struct EncodeState *state, uint32_t value)
+{
+    if (state->buf) {
+        state->buf[state->pos] = value >> 24;
+        state->buf[state->pos + 1] = value >> 16;
+        state->buf[state->pos + 2] = value >> 8;
+        state->buf[state->pos + 3] = value;
+    }
+    state->pos += 4;
+}
+
+static void encode_integer(struct EncodeState *state, int64_t value)
+{
+    if ((value >= 0) && (value <= 255)) {
+        encode_u8(state, SMALL_INTEGER_EXT);
+        encode_u8(state, value);
+
+    } else if ((value >= INT32_MIN) && (value <= INT32_MAX)) {
+        encode_u8(state, INTEGER_EXT);
+        encode_u32(state, value);
+
+    } else {
+        uint64_t magnitude = (value < 0) ? 0 - (uint64_t) value : (uint64_t) value;
+        uint8_t num_bytes = 0;
+        for (uint64_t m = magnitude; m; m >>= 8) {
+            num_bytes++;
         }
+        encode_u8(state, SMALL_BIG_EXT);
+        encode_u8(state, num_bytes);
+        encode_u8(state, value < 0);
+        for (int i = 0; i < num_bytes; i++) {
+            encode_u8(state, magnitude >> (i * 8));
+        }
+    }
+}
 
-        case STRING_EXT: {
-            uint16_t string_size = READ_16_UNALIGNED(external_term_buf + 1);
-            *eterm_size = 3 + string_size;
-            return string_size * 2;
+static void encode_atom_string(struct EncodeState *state, AtomString atom)
+{
+    encode_u8(state, SMALL_ATOM_UTF8_EXT);
+    encode_u8(state, atom_string_len(atom));
+    encode_bytes(state, atom_string_data(atom), atom_string_len(atom));
+}
+
+static void encode_pid(struct EncodeState *state, int32_t process_id)
+{
+    encode_u8(state, NEW_PID_EXT);
+    encode_atom_string(state, NODE_NAME);
+    encode_u32(state, process_id);
+    // serial and creation
+    encode_u32(state, 0);
+    encode_u32(state, 0);
+}
+
+// lists of bytes are encoded as strings, like OTP does
+static int encode_list_is_string(term t)
+{
+    int len = 0;
+    while (term_is_nonempty_list(t)) {
+        term head = term_get_list_head(t);
+        if (!term_is_integer(head) || (term_to_int32(head) < 0) || (term_to_int32(head) > 255) || (len == UINT16_MAX)) {
+            return 0;
         }
+        len++;
+        t = term_get_list_tail(t);
+    }
 
-        case LIST_EXT: {
-            uint32_t list_len = READ_32_UNALIGNED(external_term_buf + 1);
+    return term_is_nil(t);
+}
 
-            int buf_pos = 5;
-            int heap_usage = 0;
+// returns 0 if the term cannot be encoded
+static int encode_item(struct EncodeState *state, term t)
+{
+    if (term_is_any_integer(t)) {
+        encode_integer(state, term_maybe_unbox_int64(t));
 
-            for (unsigned int i = 0; i < list_len; i++) {
-                int item_size;
-                heap_usage += calculate_heap_usage(external_term_buf + buf_pos, &item_size, ctx) + 2;
+    } else if (term_is_atom(t)) {
+        encode_atom_string(state, globalcontext_atomstring_from_term(state->global, t));
 
-                buf_pos += item_size;
+    } else if (term_is_nil(t)) {
+        encode_u8(state, NIL_EXT);
+
+    } else if (term_is_pid(t)) {
+        encode_pid(state, term_to_local_process_id(t));
+
+    } else if (term_is_reference(t)) {
+        uint64_t ref_ticks = term_to_ref_ticks(t);
+        encode_u8(state, NEWER_REFERENCE_EXT);
+        encode_u16(state, 2);
+        encode_atom_string(state, NODE_NAME);
+        // creation
+        encode_u32(state, 0);
+        encode_u32(state, ref_ticks);
+        encode_u32(state, ref_ticks >> 32);
+
+    } else if (term_is_tuple(t)) {
+        int arity = term_get_tuple_arity(t);
+        if (arity <= 255) {
+            encode_u8(state, SMALL_TUPLE_EXT);
+            encode_u8(state, arity);
+        } else {
+            encode_u8(state, LARGE_TUPLE_EXT);
+            encode_u32(state, arity);
+        }
+        if (arity) {
+            encode_push(state, EncodeTerms, term_to_const_term_ptr(t) + 1, arity);
+        }
+
+    } else if (term_is_nonempty_list(t)) {
+        if (encode_list_is_string(t)) {
+            uint16_t len = term_list_length(t);
+            encode_u8(state, STRING_EXT);
+            encode_u16(state, len);
+            if (state->buf) {
+                for (int i = 0; i < len; i++) {
+                    state->buf[state->pos + i] = term_to_int32(term_get_list_head(t));
+                    t = term_get_list_tail(t);
+                }
+            }
+            state->pos += len;
+        } else {
+            uint32_t len = 0;
+            for (term l = t; term_is_nonempty_list(l); l = term_get_list_tail(l)) {
+                len++;
+            }
+            encode_u8(state, LIST_EXT);
+            encode_u32(state, len);
+            struct EncodeFrame *frame = encode_push(state, EncodeList, NULL, 1);
+            frame->list = t;
+        }
+
+    } else if (term_is_binary(t)) {
+        uint32_t size = term_binary_size(t);
+        encode_u8(state, BINARY_EXT);
+        encode_u32(state, size);
+        encode_bytes(state, term_binary_data(t), size);
+
+    } else if (term_is_map(t)) {
+        size_t size = map_size(t);
+        encode_u8(state, MAP_EXT);
+        encode_u32(state, size);
+        if (size == 0) {
+            return 1;
+        }
+        if (term_is_flatmap(t)) {
+            const term *boxed_value = term_to_const_term_ptr(t);
+            struct EncodeFrame *frame = encode_push(state, EncodeMapEntries, term_to_const_term_ptr(boxed_value[TERM_MAP_KEYS_INDEX]) + 1, size * 2);
+            frame->values = boxed_value + TERM_MAP_VALUES_INDEX;
+        } else {
+            // hash map entries are copied, so they can be walked like a tuple
+            term *entries = malloc(size * 2 * sizeof(term));
+            if (IS_NULL_PTR(entries)) {
+                fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+                abort();
+            }
+            struct MapIterator it;
+            map_iterator_init(&it, t);
+            for (size_t i = 0; i < size; i++) {
+                map_iterator_next(&it, &entries[i * 2], &entries[i * 2 + 1]);
             }
+            struct EncodeFrame *frame = encode_push(state, EncodeTerms, entries, size * 2);
+            frame->allocated = entries;
+        }
 
-            int tail_size;
-            heap_usage += calculate_heap_usage(external_term_buf + buf_pos, &tail_size, ctx);
-            buf_pos += tail_size;
+    } else if (term_is_function(t)) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        const Module *fun_module = (const Module *) boxed_value[1];
+        uint32_t fun_index = boxed_value[2];
+        uint32_t label;
+        uint32_t arity;
+        uint32_t n_freeze;
+        module_get_fun(fun_module, fun_index, &label, &arity, &n_freeze);
 
-            *eterm_size = buf_pos;
-            return heap_usage;
+        encode_u8(state, NEW_FUN_EXT);
+        size_t fun_size_offset = state->pos;
+        encode_u32(state, 0);
+        encode_u8(state, arity - n_freeze);
+        // there is no module md5 to use as uniq
+        for (int i = 0; i < 16; i++) {
+            encode_u8(state, 0);
         }
+        encode_u32(state, fun_index);
+        encode_u32(state, n_freeze);
+        term module_name = module_get_atom_term_by_id(fun_module, 1);
+        encode_atom_string(state, globalcontext_atomstring_from_term(state->global, module_name));
+        // old index, old uniq and creator pid
+        encode_integer(state, fun_index);
+        encode_integer(state, 0);
+        encode_pid(state, 0);
 
-        case BINARY_EXT: {
-            uint32_t binary_size = READ_32_UNALIGNED(external_term_buf + 1);
-            *eterm_size = 5 + binary_size;
+        struct EncodeFrame *frame = encode_push(state, EncodeTerms, boxed_value + 3, n_freeze);
+        frame->fun_size_offset = fun_size_offset;
 
-            #if TERM_BYTES == 4
-                int size_in_terms = ((binary_size + 4 - 1) >> 2);
-            #elif TERM_BYTES == 8
-                int size_in_terms = ((binary_size + 8 - 1) >> 3);
-            #else
-                #error
-            #endif
+    } else {
+        return 0;
+    }
 
-            return 2 + size_in_terms;
+    return 1;
+}
+
+static void encode_frame_done(struct EncodeState *state, struct EncodeFrame *frame)
+{
+    free(frame->allocated);
+
+    if (frame->fun_size_offset) {
+        size_t pos = state->pos;
+        state->pos = frame->fun_size_offset;
+        encode_u32(state, pos - frame->fun_size_offset);
+        state->pos = pos;
+    }
+}
+
+// returns the size of the encoded term, or 0 if it cannot be encoded
+static size_t encode_term(term t, uint8_t *buf, GlobalContext *glb)
+{
+    struct EncodeState state;
+    state.buf = buf;
+    state.pos = 0;
+    state.global = glb;
+    state.frames = state.initial_frames;
+    state.frames_count = 0;
+    state.frames_capacity = WALK_STACK_INITIAL_SIZE;
+
+    encode_u8(&state, EXTERNAL_TERM_TAG);
+    int ok = encode_item(&state, t);
+
+    while (ok && state.frames_count) {
+        struct EncodeFrame *frame = &state.frames[state.frames_count - 1];
+        if (frame->index == frame->count) {
+            encode_frame_done(&state, frame);
+            state.frames_count--;
+            continue;
         }
 
-        default:
-            fprintf(stderr, "Unknown term type: %i\n", (int) external_term_buf[0]);
-            abort();
+        term next;
+        switch (frame->type) {
+            case EncodeTerms:
+                next = frame->terms[frame->index++];
+                break;
+            case EncodeMapEntries: {
+                // keys and values are interleaved
+                size_t i = frame->index++;
+                next = (i & 1) ? frame->values[i / 2] : frame->terms[i / 2];
+                break;
+            }
+            default:
+                // list elements and then the tail, that is usually nil
+                if (term_is_nonempty_list(frame->list)) {
+                    next = term_get_list_head(frame->list);
+                    frame->list = term_get_list_tail(frame->list);
+                } else {
+                    next = frame->list;
+                    frame->index++;
+                }
+                break;
+        }
+        ok = encode_item(&state, next);
     }
+
+    // frames left by an unsupported term
+    while (state.frames_count) {
+        free(state.frames[--state.frames_count].allocated);
+    }
+    if (state.frames != state.initial_frames) {
+        free(state.frames);
+    }
+
+    return ok ? state.pos : 0;
+}
+
+size_t externalterm_encoded_size(term t, GlobalContext *glb)
+{
+    return encode_term(t, NULL, glb);
+}
+
+void externalterm_encode(term t, void *buf, GlobalContext *glb)
+{
+    encode_term(t, (uint8_t *) buf, glb);
 }
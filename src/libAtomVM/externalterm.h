@@ -19,14 +19,18 @@
 
 /**
  * @file externalterm.h
- * @brief External term deserialization functions
+ * @brief External term serialization and deserialization functions
  *
- * @details This header provides external term deserialization functions.
+ * @details This header provides external term serialization and deserialization functions.
  */
 
 #ifndef _EXTERNALTERM_H_
 #define _EXTERNALTERM_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "globalcontext.h"
 #include "term.h"
 
 /**
@@ -39,4 +43,66 @@
  */
 term externalterm_to_term(const void *external_term, Context *ctx);
 
+/**
+ * @brief Gets the amount of memory required to deserialize an external term.
+ *
+ * @details Returns the number of terms that externalterm_to_term_in_heap will use to store the given external term.
+ * @param external_term the external term that will be deserialized.
+ * @returns the required memory in term units.
+ */
+int externalterm_heap_usage(const void *external_term);
+
+/**
+ * @brief Gets a term from external term data using a caller supplied memory area.
+ *
+ * @details Deserialize an external term into a memory area that is not owned by any process, such as the literals area of a module.
+ * @param external_term the external term that will be deserialized.
+ * @param heap_ptr pointer to the destination memory area, it will be advanced by the used amount of terms.
+ * @param glb the global context, used to register atoms.
+ * @returns a term.
+ */
+term externalterm_to_term_in_heap(const void *external_term, term **heap_ptr, GlobalContext *glb);
+
+/**
+ * @brief Validates an external term buffer and gets the amount of memory required to deserialize it.
+ *
+ * @details Unlike externalterm_heap_usage, the buffer might come from an untrusted source such as a binary: it is
+ * checked against its length and unsupported terms are reported. Binaries larger than REFC_BINARY_MIN are accounted
+ * as reference counted binaries.
+ * @param buf the external term buffer, including the version byte.
+ * @param len buffer length in bytes.
+ * @param glb the global context, used to look up the modules of encoded funs.
+ * @returns the required memory in term units, or -1 if the buffer is not valid.
+ */
+int externalterm_buffer_heap_usage(const void *buf, size_t len, GlobalContext *glb);
+
+/**
+ * @brief Gets a term from an external term buffer.
+ *
+ * @details The buffer must have been validated with externalterm_buffer_heap_usage and the returned amount of
+ * memory must be already available on the context heap. Duplicated map keys are found only while decoding.
+ * @param buf the external term buffer, including the version byte.
+ * @param ctx the context that owns the memory that will be allocated.
+ * @returns a term, or an invalid term if a map has duplicated keys.
+ */
+term externalterm_buffer_to_term(const void *buf, Context *ctx);
+
+/**
+ * @brief Gets the size of the external term representation of a term.
+ *
+ * @param t the term that will be serialized.
+ * @param glb the global context, used to get atom names.
+ * @returns the size in bytes, or 0 if the term (or any of its subterms) cannot be serialized.
+ */
+size_t externalterm_encoded_size(term t, GlobalContext *glb);
+
+/**
+ * @brief Serializes a term to external term format.
+ *
+ * @param t the term that will be serialized.
+ * @param buf the destination buffer, externalterm_encoded_size bytes long.
+ * @param glb the global context, used to get atom names.
+ */
+void externalterm_encode(term t, void *buf, GlobalContext *glb);
+
 #endif
@@ -29,11 +29,32 @@
 #include "valueshashtable.h"
 #include "sys.h"
 #include "context.h"
+#include "mailbox.h"
+#include "scheduler.h"
 
-struct RegisteredProcess
+// A local process id is made of a process table slot index (low bits) and of the slot generation (high bits).
+// Slot 0 is never used, so 0 is never a valid process id, and the process id fits in a small integer also on 32 bits.
+#define PROCESS_TABLE_INDEX_BITS 16
+#define PROCESS_TABLE_MAX_SLOTS (1 << PROCESS_TABLE_INDEX_BITS)
+#define PROCESS_TABLE_INDEX_MASK (PROCESS_TABLE_MAX_SLOTS - 1)
+#define PROCESS_TABLE_GENERATION_BITS 11
+#define PROCESS_TABLE_GENERATION_MASK ((1 << PROCESS_TABLE_GENERATION_BITS) - 1)
+#define PROCESS_TABLE_INITIAL_SLOTS 16
+
+#define REGISTERED_PROCESSES_INITIAL_CAPACITY 16
+
+// module_address keeps the module index in the 8 most significant bits
+#define MAX_MODULES 256
+
+struct ProcessTableSlot
 {
-    struct ListHead registered_processes_list_head;
+    Context *ctx;
+    int generation;
+    int next_free;
+};
 
+struct RegisteredProcess
+{
     int atom_index;
     int local_process_id;
 };
@@ -44,13 +65,18 @@ GlobalContext *globalcontext_new()
     if (IS_NULL_PTR(glb)) {
         return NULL;
     }
-    list_init(&glb->ready_processes);
-    list_init(&glb->waiting_processes);
     glb->listeners = NULL;
     glb->processes_table = NULL;
-    glb->registered_processes = NULL;
 
-    glb->last_process_id = 0;
+    glb->processes_slots = NULL;
+    glb->processes_slots_count = 0;
+    glb->processes_count = 0;
+    glb->free_slots_head = -1;
+    glb->free_slots_tail = -1;
+
+    glb->registered_processes = NULL;
+    glb->registered_processes_capacity = 0;
+    glb->registered_processes_count = 0;
 
     glb->atoms_table = atomshashtable_new();
     if (IS_NULL_PTR(glb->atoms_table)) {
@@ -64,6 +90,10 @@ GlobalContext *globalcontext_new()
         return NULL;
     }
 
+    SMP_RWLOCK_INIT(&glb->processes_table_lock);
+    SMP_MUTEX_INIT(&glb->atoms_lock);
+    SMP_MUTEX_INIT(&glb->modules_lock);
+
     defaultatoms_init(glb);
 
     glb->modules_by_index = NULL;
@@ -76,73 +106,335 @@ GlobalContext *globalcontext_new()
         return NULL;
     }
 
-    glb->next_timeout_at.tv_sec = 0;
-    glb->next_timeout_at.tv_nsec = 0;
+    #ifdef AVM_ENABLE_SMP
+        // modules_by_index is never moved, so schedulers can read it while another one is loading a module
+        glb->modules_by_index = calloc(MAX_MODULES, sizeof(Module *));
+        if (IS_NULL_PTR(glb->modules_by_index)) {
+            free(glb->modules_table);
+            free(glb->atoms_ids_table);
+            free(glb->atoms_table);
+            free(glb);
+            return NULL;
+        }
+    #endif
+
+    timer_wheel_init(&glb->timer_wheel, 0);
+    glb->timer_listener = NULL;
+
+    timer_wheel_init(&glb->erlang_timers_wheel, 0);
+    glb->erlang_timers = NULL;
+    glb->erlang_timers_capacity = 0;
 
     glb->ref_ticks = 0;
 
+    glb->exited_reductions = 0;
+    glb->exited_run_time_us = 0;
+    glb->exited_minor_gcs = 0;
+    glb->exited_major_gcs = 0;
+    glb->last_reductions = 0;
+    glb->last_run_time_ms = 0;
+    glb->last_wall_clock_ms = 0;
+
+    profiler_init(&glb->profiler);
+
+    #ifdef AVM_ENABLE_OPCODE_COUNTERS
+        memset(glb->opcode_counters, 0, sizeof(glb->opcode_counters));
+    #endif
+
+    glb->platform_data = NULL;
+    if (UNLIKELY(!sys_init_platform(glb))) {
+        free(glb->modules_by_index);
+        free(glb->modules_table);
+        free(glb->atoms_ids_table);
+        free(glb->atoms_table);
+        free(glb);
+        return NULL;
+    }
+
+    if (UNLIKELY(!scheduler_init(glb))) {
+        sys_free_platform(glb);
+        free(glb->modules_by_index);
+        free(glb->modules_table);
+        free(glb->atoms_ids_table);
+        free(glb->atoms_table);
+        free(glb);
+        return NULL;
+    }
+
     return glb;
 }
 
 COLD_FUNC void globalcontext_destroy(GlobalContext *glb)
 {
+    scheduler_cancel_all_timers(glb);
+    scheduler_destroy(glb);
+    free(glb->timer_listener);
+    sys_free_platform(glb);
+    free(glb->processes_slots);
+    free(glb->registered_processes);
+    profiler_destroy(&glb->profiler);
+
+    SMP_RWLOCK_DESTROY(&glb->processes_table_lock);
+    SMP_MUTEX_DESTROY(&glb->atoms_lock);
+    SMP_MUTEX_DESTROY(&glb->modules_lock);
+
     free(glb);
 }
 
 Context *globalcontext_get_process(GlobalContext *glb, int32_t process_id)
 {
-    Context *processes = GET_LIST_ENTRY(glb->processes_table, Context, processes_table_head);
+    int index = process_id & PROCESS_TABLE_INDEX_MASK;
+    if (UNLIKELY(index == 0 || index >= glb->processes_slots_count)) {
+        return NULL;
+    }
 
-    Context *p = processes;
-    do {
-        if (p->process_id == process_id) {
-            return p;
+    Context *ctx = glb->processes_slots[index].ctx;
+    if (ctx && ctx->process_id == process_id) {
+        return ctx;
+    }
+
+    return NULL;
+}
+
+Context *globalcontext_get_process_lock(GlobalContext *glb, int32_t process_id)
+{
+    SMP_RWLOCK_RDLOCK(&glb->processes_table_lock);
+    Context *ctx = globalcontext_get_process(glb, process_id);
+    if (IS_NULL_PTR(ctx)) {
+        SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+    }
+
+    return ctx;
+}
+
+void globalcontext_get_process_unlock(GlobalContext *glb, Context *ctx)
+{
+    #ifdef AVM_ENABLE_SMP
+        if (ctx) {
+            SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
         }
+    #else
+        UNUSED(glb);
+        UNUSED(ctx);
+    #endif
+}
+
+void globalcontext_send_message(GlobalContext *glb, int32_t process_id, term t)
+{
+    Message *m = mailbox_message_create_from_term(t);
+    if (IS_NULL_PTR(m)) {
+        return;
+    }
 
-        p = GET_LIST_ENTRY(p->processes_table_head.next, Context, processes_table_head);
-    } while (processes != p);
+    Context *target = globalcontext_get_process_lock(glb, process_id);
+    if (IS_NULL_PTR(target)) {
+        mailbox_destroy_message(m);
+        return;
+    }
+    mailbox_enqueue_message(target, m);
+    globalcontext_get_process_unlock(glb, target);
+}
 
-    return NULL;
+static int globalcontext_grow_process_table(GlobalContext *glb)
+{
+    int old_count = glb->processes_slots_count;
+    if (old_count == PROCESS_TABLE_MAX_SLOTS) {
+        return 0;
+    }
+    int new_count = old_count ? old_count * 2 : PROCESS_TABLE_INITIAL_SLOTS;
+
+    struct ProcessTableSlot *new_slots = realloc(glb->processes_slots, new_count * sizeof(struct ProcessTableSlot));
+    if (IS_NULL_PTR(new_slots)) {
+        return 0;
+    }
+
+    for (int i = old_count; i < new_count; i++) {
+        new_slots[i].ctx = NULL;
+        new_slots[i].generation = 0;
+        new_slots[i].next_free = (i + 1 < new_count) ? i + 1 : -1;
+    }
+
+    // slot 0 is reserved so that the first generation of process ids starts from 1
+    int first_free = old_count ? old_count : 1;
+
+    glb->processes_slots = new_slots;
+    glb->processes_slots_count = new_count;
+    if (glb->free_slots_tail >= 0) {
+        new_slots[glb->free_slots_tail].next_free = first_free;
+    } else {
+        glb->free_slots_head = first_free;
+    }
+    glb->free_slots_tail = new_count - 1;
+
+    return 1;
 }
 
-int32_t globalcontext_get_new_process_id(GlobalContext *glb)
+int32_t globalcontext_insert_process(GlobalContext *glb, Context *ctx)
 {
-    glb->last_process_id++;
+    SMP_RWLOCK_WRLOCK(&glb->processes_table_lock);
+
+    if (glb->free_slots_head < 0 && !globalcontext_grow_process_table(glb)) {
+        SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+        return -1;
+    }
+
+    int index = glb->free_slots_head;
+    struct ProcessTableSlot *slot = &glb->processes_slots[index];
+    glb->free_slots_head = slot->next_free;
+    if (glb->free_slots_head < 0) {
+        glb->free_slots_tail = -1;
+    }
+
+    slot->ctx = ctx;
+    slot->next_free = -1;
+    ctx->process_id = (slot->generation << PROCESS_TABLE_INDEX_BITS) | index;
+    linkedlist_append(&glb->processes_table, &ctx->processes_table_head);
+    glb->processes_count++;
+    int32_t process_id = ctx->process_id;
 
-    return glb->last_process_id;
+    SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+
+    return process_id;
 }
 
-void globalcontext_register_process(GlobalContext *glb, int atom_index, int local_process_id)
+static void globalcontext_unregister_process_name(GlobalContext *glb, Context *ctx);
+
+void globalcontext_remove_process(GlobalContext *glb, Context *ctx)
 {
-    struct RegisteredProcess *registered_process = malloc(sizeof(struct RegisteredProcess));
-    if (IS_NULL_PTR(registered_process)) {
-        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
-        abort();
+    SMP_RWLOCK_WRLOCK(&glb->processes_table_lock);
+
+    linkedlist_remove(&glb->processes_table, &ctx->processes_table_head);
+    glb->processes_count--;
+
+    glb->exited_reductions += ctx->stats.reductions;
+    glb->exited_run_time_us += ctx->stats.run_time_us;
+    glb->exited_minor_gcs += ctx->stats.minor_gcs;
+    glb->exited_major_gcs += ctx->stats.major_gcs;
+
+    globalcontext_unregister_process_name(glb, ctx);
+
+    int index = ctx->process_id & PROCESS_TABLE_INDEX_MASK;
+    struct ProcessTableSlot *slot = &glb->processes_slots[index];
+    slot->ctx = NULL;
+    slot->generation = (slot->generation + 1) & PROCESS_TABLE_GENERATION_MASK;
+
+    // Released slots are appended to the free list so they are reused as late as possible
+    slot->next_free = -1;
+    if (glb->free_slots_tail >= 0) {
+        glb->processes_slots[glb->free_slots_tail].next_free = index;
+    } else {
+        glb->free_slots_head = index;
     }
+    glb->free_slots_tail = index;
+
+    SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+}
+
+static inline int registered_process_hash(int atom_index, int capacity)
+{
+    return (int) (((uint32_t) atom_index * 2654435761U) & (capacity - 1));
+}
+
+static struct RegisteredProcess *globalcontext_find_registered_slot(struct RegisteredProcess *table, int capacity, int atom_index)
+{
+    int index = registered_process_hash(atom_index, capacity);
+    while (table[index].local_process_id && table[index].atom_index != atom_index) {
+        index = (index + 1) & (capacity - 1);
+    }
+    return &table[index];
+}
+
+// linear probing: the entries that follow the removed one are moved back, so no probe sequence is broken
+static void globalcontext_remove_registered_slot(struct RegisteredProcess *table, int capacity, int index)
+{
+    int hole = index;
+    int next = (index + 1) & (capacity - 1);
+    while (table[next].local_process_id) {
+        int home = registered_process_hash(table[next].atom_index, capacity);
+        // the entry can fill the hole unless its home slot is between the hole and the entry itself
+        if (((next - home) & (capacity - 1)) >= ((next - hole) & (capacity - 1))) {
+            table[hole] = table[next];
+            hole = next;
+        }
+        next = (next + 1) & (capacity - 1);
+    }
+    table[hole].local_process_id = 0;
+}
+
+// processes_table_lock must be held for writing
+static void globalcontext_unregister_process_name(GlobalContext *glb, Context *ctx)
+{
+    if (!ctx->has_registered_name) {
+        return;
+    }
+    struct RegisteredProcess *registered_process = globalcontext_find_registered_slot(glb->registered_processes, glb->registered_processes_capacity, ctx->registered_name);
+    if (registered_process->local_process_id == ctx->process_id) {
+        globalcontext_remove_registered_slot(glb->registered_processes, glb->registered_processes_capacity, registered_process - glb->registered_processes);
+        glb->registered_processes_count--;
+    }
+    ctx->has_registered_name = 0;
+}
+
+int globalcontext_register_process(GlobalContext *glb, int atom_index, int local_process_id)
+{
+    SMP_RWLOCK_WRLOCK(&glb->processes_table_lock);
+
+    // a process can have just one name, and names of exited processes have already been removed
+    Context *ctx = globalcontext_get_process(glb, local_process_id);
+    if (IS_NULL_PTR(ctx) || ctx->has_registered_name
+            || (glb->registered_processes && globalcontext_find_registered_slot(glb->registered_processes, glb->registered_processes_capacity, atom_index)->local_process_id)) {
+        SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+        return 0;
+    }
+
+    // keep the load factor below 3/4 so probe sequences stay short
+    if ((glb->registered_processes_count + 1) * 4 > glb->registered_processes_capacity * 3) {
+        int new_capacity = glb->registered_processes_capacity ? glb->registered_processes_capacity * 2 : REGISTERED_PROCESSES_INITIAL_CAPACITY;
+        struct RegisteredProcess *new_table = calloc(new_capacity, sizeof(struct RegisteredProcess));
+        if (IS_NULL_PTR(new_table)) {
+            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+            abort();
+        }
+        for (int i = 0; i < glb->registered_processes_capacity; i++) {
+            struct RegisteredProcess *p = &glb->registered_processes[i];
+            if (p->local_process_id) {
+                *globalcontext_find_registered_slot(new_table, new_capacity, p->atom_index) = *p;
+            }
+        }
+        free(glb->registered_processes);
+        glb->registered_processes = new_table;
+        glb->registered_processes_capacity = new_capacity;
+    }
+
+    struct RegisteredProcess *registered_process = globalcontext_find_registered_slot(glb->registered_processes, glb->registered_processes_capacity, atom_index);
     registered_process->atom_index = atom_index;
     registered_process->local_process_id = local_process_id;
+    glb->registered_processes_count++;
+
+    ctx->registered_name = atom_index;
+    ctx->has_registered_name = 1;
 
-    linkedlist_append(&glb->registered_processes, &registered_process->registered_processes_list_head);
+    SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+
+    return 1;
 }
 
 int globalcontext_get_registered_process(GlobalContext *glb, int atom_index)
 {
-    if (!glb->registered_processes) {
-        return 0;
-    }
+    int local_process_id = 0;
 
-    const struct RegisteredProcess *registered_processes = GET_LIST_ENTRY(glb->registered_processes, struct RegisteredProcess, registered_processes_list_head);
+    SMP_RWLOCK_RDLOCK(&glb->processes_table_lock);
 
-    const struct RegisteredProcess *p = registered_processes;
-    do {
-        if (p->atom_index == atom_index) {
-            return p->local_process_id;
+    if (glb->registered_processes) {
+        const struct RegisteredProcess *p = globalcontext_find_registered_slot(glb->registered_processes, glb->registered_processes_capacity, atom_index);
+        if (p->local_process_id && globalcontext_get_process(glb, p->local_process_id)) {
+            local_process_id = p->local_process_id;
         }
+    }
 
-        p = GET_LIST_ENTRY(p->registered_processes_list_head.next, struct RegisteredProcess, registered_processes_list_head);
-    } while (p != registered_processes);
+    SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
 
-    return 0;
+    return local_process_id;
 }
 
 int globalcontext_insert_atom(GlobalContext *glb, AtomString atom_string)
@@ -150,16 +442,26 @@ int globalcontext_insert_atom(GlobalContext *glb, AtomString atom_string)
     struct AtomsHashTable *htable = glb->atoms_table;
 
     unsigned long atom_index = atomshashtable_get_value(htable, atom_string, ULONG_MAX);
+    if (atom_index != ULONG_MAX) {
+        return (int) atom_index;
+    }
+
+    SMP_MUTEX_LOCK(&glb->atoms_lock);
+
+    // another scheduler might have inserted it meanwhile
+    atom_index = atomshashtable_get_value(htable, atom_string, ULONG_MAX);
     if (atom_index == ULONG_MAX) {
         atom_index = htable->count;
-        if (!atomshashtable_insert(htable, atom_string, atom_index)) {
-            return -1;
-        }
-        if (!valueshashtable_insert(glb->atoms_ids_table, atom_index, (unsigned long) atom_string)) {
+        // the id is published first, so the atom string can be found as soon as the atom is visible
+        if (!valueshashtable_insert(glb->atoms_ids_table, atom_index, (unsigned long) atom_string)
+                || !atomshashtable_insert(htable, atom_string, atom_index)) {
+            SMP_MUTEX_UNLOCK(&glb->atoms_lock);
             return -1;
         }
     }
 
+    SMP_MUTEX_UNLOCK(&glb->atoms_lock);
+
     return (int) atom_index;
 }
 
@@ -176,32 +478,48 @@ AtomString globalcontext_atomstring_from_term(GlobalContext *glb, term t)
     return (AtomString) ret;
 }
 
-int globalcontext_insert_module(GlobalContext *global, Module *module, AtomString module_name_atom)
+static int globalcontext_insert_module_unlocked(GlobalContext *global, Module *module, AtomString module_name_atom)
 {
-    if (!atomshashtable_insert(global->modules_table, module_name_atom, TO_ATOMSHASHTABLE_VALUE(module))) {
-        return -1;
-    }
-
     int module_index = global->loaded_modules_count;
 
-    Module **new_modules_by_index = calloc(module_index + 1, sizeof(Module *));
-    if (IS_NULL_PTR(new_modules_by_index)) {
-        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
-        abort();
-    }
-    if (global->modules_by_index) {
-        for (int i = 0; i < module_index; i++) {
-            new_modules_by_index[i] = global->modules_by_index[i];
+    #ifdef AVM_ENABLE_SMP
+        if (UNLIKELY(module_index >= MAX_MODULES)) {
+            fprintf(stderr, "Too many loaded modules: %s:%i.\n", __FILE__, __LINE__);
+            return -1;
         }
-        free(global->modules_by_index);
-    }
+    #else
+        Module **new_modules_by_index = calloc(module_index + 1, sizeof(Module *));
+        if (IS_NULL_PTR(new_modules_by_index)) {
+            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+            abort();
+        }
+        if (global->modules_by_index) {
+            for (int i = 0; i < module_index; i++) {
+                new_modules_by_index[i] = global->modules_by_index[i];
+            }
+            free(global->modules_by_index);
+        }
+        global->modules_by_index = new_modules_by_index;
+    #endif
 
     module->module_index = module_index;
-
-    global->modules_by_index = new_modules_by_index;
     global->modules_by_index[module_index] = module;
     global->loaded_modules_count++;
 
+    // the module can be found by name only once it has an index
+    if (!atomshashtable_insert(global->modules_table, module_name_atom, TO_ATOMSHASHTABLE_VALUE(module))) {
+        return -1;
+    }
+
+    return module_index;
+}
+
+int globalcontext_insert_module(GlobalContext *global, Module *module, AtomString module_name_atom)
+{
+    SMP_MUTEX_LOCK(&global->modules_lock);
+    int module_index = globalcontext_insert_module_unlocked(global, module, module_name_atom);
+    SMP_MUTEX_UNLOCK(&global->modules_lock);
+
     return module_index;
 }
 
@@ -231,10 +549,18 @@ void globalcontext_insert_module_with_filename(GlobalContext *glb, Module *modul
 Module *globalcontext_get_module(GlobalContext *global, AtomString module_name_atom)
 {
     Module *found_module = (Module *) atomshashtable_get_value(global->modules_table, module_name_atom, (unsigned long) NULL);
+    if (found_module) {
+        return found_module;
+    }
 
+    SMP_MUTEX_LOCK(&global->modules_lock);
+
+    // another scheduler might have loaded it meanwhile
+    found_module = (Module *) atomshashtable_get_value(global->modules_table, module_name_atom, (unsigned long) NULL);
     if (!found_module) {
         char *module_name = malloc(256 + 5);
         if (IS_NULL_PTR(module_name)) {
+            SMP_MUTEX_UNLOCK(&global->modules_lock);
             return NULL;
         }
 
@@ -243,12 +569,12 @@ Module *globalcontext_get_module(GlobalContext *global, AtomString module_name_a
         Module *loaded_module = sys_load_module(global, module_name);
         free(module_name);
 
-        if (UNLIKELY(!loaded_module || (globalcontext_insert_module(global, loaded_module, module_name_atom) < 0))) {
-            return NULL;
+        if (LIKELY(loaded_module && (globalcontext_insert_module_unlocked(global, loaded_module, module_name_atom) >= 0))) {
+            found_module = loaded_module;
         }
-
-        return loaded_module;
     }
 
+    SMP_MUTEX_UNLOCK(&global->modules_lock);
+
     return found_module;
 }
@@ -33,6 +33,9 @@
 #include "atom.h"
 #include "term.h"
 #include "linkedlist.h"
+#include "profiler.h"
+#include "smp.h"
+#include "timer_wheel.h"
 
 struct Context;
 
@@ -50,15 +53,28 @@ typedef struct Module Module;
 
 struct Module;
 
-typedef struct
+struct ErlangTimer;
+struct EventListener;
+struct ProcessTableSlot;
+struct RegisteredProcess;
+struct Scheduler;
+
+typedef struct GlobalContext
 {
-    struct ListHead ready_processes;
-    struct ListHead waiting_processes;
+    // ready ports, their native handlers are run while schedulers are waiting for events
+    struct ListHead ready_native_handlers;
     struct ListHead *listeners;
     struct ListHead *processes_table;
-    struct ListHead *registered_processes;
 
-    int32_t last_process_id;
+    struct ProcessTableSlot *processes_slots;
+    int processes_slots_count;
+    int processes_count;
+    int free_slots_head;
+    int free_slots_tail;
+
+    struct RegisteredProcess *registered_processes;
+    int registered_processes_capacity;
+    int registered_processes_count;
 
     struct AtomsHashTable *atoms_table;
     struct ValuesHashTable *atoms_ids_table;
@@ -69,10 +85,68 @@ typedef struct
     const void *avmpack_data;
     const void *avmpack_platform_data;
 
-    struct timespec next_timeout_at;
+    // owned by sys.c, such as the epoll instance used to wait for listeners events
+    void *platform_data;
+
+    struct TimerWheel timer_wheel;
+    struct EventListener *timer_listener;
+
+    struct TimerWheel erlang_timers_wheel;
+    struct ErlangTimer **erlang_timers;
+    int erlang_timers_capacity;
 
     uint64_t ref_ticks;
 
+    // counters of processes that exited are added here, so they are still part of the statistics totals
+    uint64_t exited_reductions;
+    uint64_t exited_run_time_us;
+    unsigned long exited_minor_gcs;
+    unsigned long exited_major_gcs;
+    // statistics/1 returns values since the previous call too, they are protected by the processes table lock
+    uint64_t last_reductions;
+    uint64_t last_run_time_ms;
+    uint64_t last_wall_clock_ms;
+    uint64_t start_time_us;
+
+    struct Profiler profiler;
+
+    #ifdef AVM_ENABLE_OPCODE_COUNTERS
+        // how many times each opcode has been executed, indexed by opcode
+        uint64_t opcode_counters[256];
+    #endif
+
+    #ifdef AVM_ENABLE_SMP
+        // processes table and registered processes
+        RWLock processes_table_lock;
+        // atoms are inserted while holding it, lookups don't need any lock
+        Mutex atoms_lock;
+        // module loading and lazy module data, such as resolved imports and cached literals
+        Mutex modules_lock;
+        // both timer wheels and erlang timers table
+        Mutex timers_lock;
+        Mutex native_handlers_lock;
+
+        struct Scheduler *schedulers;
+        int schedulers_count;
+        int ready_count;
+        int idle_schedulers;
+        // a scheduler is running native handlers or it is waiting for events
+        int poller_active;
+        // it is waiting for events, new timers that expire before poll_deadline must wake it up
+        int polling;
+        uint64_t poll_deadline;
+        int poll_signaled;
+        int stopping;
+        // held by the scheduler that runs native handlers and waits for events
+        Mutex poller_lock;
+        Mutex schedulers_lock;
+        CondVar schedulers_cv;
+        struct EventListener *signal_listener;
+        int signal_pipe[2];
+    #else
+        struct ListHead ready_processes;
+    #endif
+
 } GlobalContext;
 
 /**
@@ -94,31 +168,81 @@ void globalcontext_destroy(GlobalContext *glb);
 /**
  * @brief Gets a Context from the process table
  *
- * @details Retrieves from the process table the context with the given local process id.
+ * @details Retrieves from the process table the context with the given local process id, the lookup is O(1):
+ * the process id encodes a process table slot index and the slot generation. It doesn't lock the process table, so in
+ * SMP builds it can be used only by schedulers that are sure the process cannot be destroyed meanwhile.
  * @param glb the global context (that owns the process table).
  * @param process_id the local process id.
- * @returns a Context * with the requested local process id.
+ * @returns a Context * with the requested local process id or NULL if the process doesn't exist anymore.
  */
 Context *globalcontext_get_process(GlobalContext *glb, int32_t process_id);
 
 /**
- * @brief Gets a new process id
+ * @brief Gets a Context from the process table and locks the process table
+ *
+ * @details Same as globalcontext_get_process, but in SMP builds the process table is kept locked so the returned
+ * context cannot be destroyed until globalcontext_get_process_unlock is called. The table is released at once when
+ * the process doesn't exist.
+ * @param glb the global context (that owns the process table).
+ * @param process_id the local process id.
+ * @returns a Context * with the requested local process id or NULL if the process doesn't exist anymore.
+ */
+Context *globalcontext_get_process_lock(GlobalContext *glb, int32_t process_id);
+
+/**
+ * @brief Releases the process table
+ *
+ * @details Releases the process table that has been locked by globalcontext_get_process_lock, it does nothing when
+ * ctx is NULL.
+ * @param glb the global context (that owns the process table).
+ * @param ctx the context returned by globalcontext_get_process_lock.
+ */
+void globalcontext_get_process_unlock(GlobalContext *glb, Context *ctx);
+
+/**
+ * @brief Sends a message to a process
+ *
+ * @details Copies a term and sends it to the process with the given local process id, nothing happens if the process
+ * doesn't exist anymore. The term is copied before the process table is locked.
+ * @param glb the global context (that owns the process table).
+ * @param process_id the local process id of the receiver.
+ * @param t the term that will be sent.
+ */
+void globalcontext_send_message(GlobalContext *glb, int32_t process_id, term t);
+
+/**
+ * @brief Inserts a process into the process table
+ *
+ * @details Allocates a process table slot for the given context and returns its new local process id.
+ * Slots are reused in FIFO order and their generation is bumped each time they are released, so stale process ids
+ * are never resolved to a different process until the generation counter wraps around.
+ * @param glb the global context.
+ * @param ctx the context that will be added to the process table.
+ * @returns A new local process id integer or -1 if the process table is full.
+ */
+int32_t globalcontext_insert_process(GlobalContext *glb, Context *ctx);
+
+/**
+ * @brief Removes a process from the process table
  *
- * @details Returns a new (unused) process id, this functions should be used to allocate a new local process id.
+ * @details Releases the process table slot of the given context, its process id will not be valid anymore. The names
+ * registered for the process are removed as well.
  * @param glb the global context.
- * @returns A new local process id integer.
+ * @param ctx the context that will be removed from the process table.
  */
-int32_t globalcontext_get_new_process_id(GlobalContext *glb);
+void globalcontext_remove_process(GlobalContext *glb, Context *ctx);
 
 /**
  * @brief Register a process
  *
- * @details Register a process with a certain name (atom) so it can be easily retrieved later.
+ * @details Register a process with a certain name (atom) so it can be easily retrieved later, the name is removed when
+ * the process exits.
  * @param glb the global context, each registered process will be globally available for that context.
  * @param atom_index the atom table index.
  * @param local_process_id the process local id.
+ * @returns 1 on success, 0 if the name is already registered, or if the process is not alive or already has a name.
  */
-void globalcontext_register_process(GlobalContext *glb, int atom_index, int local_process_id);
+int globalcontext_register_process(GlobalContext *glb, int atom_index, int local_process_id);
 
 /**
  * @brief Get a registered process
@@ -126,7 +250,7 @@ void globalcontext_register_process(GlobalContext *glb, int atom_index, int loca
  * @details Returns the local process id of a previously registered process.
  * @param glb the global context.
  * @param atom_index the atom table index.
- * @returns a previously registered process local id.
+ * @returns a previously registered process local id or 0 if there is no such alive process.
  */
 int globalcontext_get_registered_process(GlobalContext *glb, int atom_index);
 
@@ -187,7 +311,7 @@ Module *globalcontext_get_module(GlobalContext *global, AtomString module_name_a
 
 static inline uint64_t globalcontext_get_ref_ticks(GlobalContext *global)
 {
-    return ++global->ref_ticks;
+    return SMP_ATOMIC_FETCH_ADD(&global->ref_ticks, 1) + 1;
 }
 
 #endif
@@ -88,6 +88,10 @@ void scan_iff(const void *iff_binary, int buf_size, unsigned long *offsets, unsi
         } else if (!memcmp(current_record->name, "FunT", 4)) {
             offsets[FUNT] = current_pos;
             sizes[FUNT] = ENDIAN_SWAP_32(current_record->size);
+
+        } else if (!memcmp(current_record->name, "StrT", 4)) {
+            offsets[STRT] = current_pos;
+            sizes[STRT] = ENDIAN_SWAP_32(current_record->size);
         }
 
         current_pos += iff_align(ENDIAN_SWAP_32(current_record->size) + 8);
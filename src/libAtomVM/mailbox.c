@@ -22,54 +22,193 @@
 #include "scheduler.h"
 #include "trace.h"
 
-#define ADDITIONAL_PROCESSING_MEMORY_SIZE 4
-
 static inline term *mailbox_message_memory(Message *msg)
 {
     return &msg->message + 1;
 }
 
-void mailbox_send(Context *c, term t)
+Message *mailbox_message_create_from_term(term t)
 {
-    TRACE("Sending 0x%lx to pid %i\n", t, c->process_id);
-
     unsigned long estimated_mem_usage = memory_estimate_usage(t);
 
-    Message *m = malloc(sizeof(Message) + estimated_mem_usage * sizeof(term));
+    // one more term, so the garbage collector can replace the last term with a moved marker even if it is a header
+    Message *m = malloc(sizeof(Message) + (estimated_mem_usage + 1) * sizeof(term));
     if (IS_NULL_PTR(m)) {
         fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
-        return;
+        return NULL;
     }
 
     term *heap_pos = mailbox_message_memory(m);
-    m->message = memory_copy_term_tree(&heap_pos, t);
+    m->fragment.next = NULL;
+    m->fragment.heap_start = heap_pos;
+    m->fragment.off_heap_binaries = NULL;
+    m->fragment.retained = 0;
+    m->message = memory_copy_term_tree(&heap_pos, t, &m->fragment.off_heap_binaries);
+    m->fragment.heap_end = heap_pos;
     m->msg_memory_size = estimated_mem_usage;
+    m->on_heap = 0;
 
-    linkedlist_append(&c->mailbox, &m->mailbox_list_head);
+    return m;
+}
 
-    if (c->jump_to_on_restore) {
-        c->saved_ip = c->jump_to_on_restore;
-        c->jump_to_on_restore = NULL;
+void mailbox_enqueue_message(Context *c, Message *m)
+{
+    TRACE("Sending 0x%lx to pid %i\n", m->message, c->process_id);
+
+    // counters are updated first, so the owner never sees them going below 0
+    SMP_ATOMIC_ADD(&c->messages_count, 1);
+    SMP_ATOMIC_ADD(&c->messages_size, sizeof(Message) + m->msg_memory_size);
+
+    Message *outer_first = SMP_ATOMIC_LOAD(&c->outer_messages);
+    do {
+        m->next = outer_first;
+    } while (!SMP_ATOMIC_CAS(&c->outer_messages, &outer_first, m));
+
+    scheduler_signal_message(c->global, c);
+}
+
+void mailbox_send(Context *c, term t)
+{
+    Message *m = mailbox_message_create_from_term(t);
+    if (!IS_NULL_PTR(m)) {
+        mailbox_enqueue_message(c, m);
     }
-    scheduler_make_ready(c->global, c);
 }
 
-term mailbox_receive(Context *c)
+// moves all the messages that have been pushed by senders to the mailbox, in the order they have been sent
+static void mailbox_process_outer_list(Context *c)
 {
-    Message *m = GET_LIST_ENTRY(c->mailbox, Message, mailbox_list_head);
-    linkedlist_remove(&c->mailbox, &m->mailbox_list_head);
+    Message *outer_first = SMP_ATOMIC_LOAD(&c->outer_messages);
+    if (!outer_first) {
+        return;
+    }
+    while (!SMP_ATOMIC_CAS(&c->outer_messages, &outer_first, NULL)) {
+    }
 
-    if (c->e - c->heap_ptr < m->msg_memory_size) {
-        //ADDITIONAL_PROCESSING_MEMORY_SIZE: ensure some additional memory for message processing, so there is
-        //no need to run GC again.
-        if (UNLIKELY(memory_gc(c, context_memory_size(c) + m->msg_memory_size + ADDITIONAL_PROCESSING_MEMORY_SIZE) != MEMORY_GC_OK)) {
-            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
-        }
+    Message *reversed = NULL;
+    while (outer_first) {
+        Message *next = outer_first->next;
+        outer_first->next = reversed;
+        reversed = outer_first;
+        outer_first = next;
     }
 
-    term rt = memory_copy_term_tree(&c->heap_ptr, m->message);
+    while (reversed) {
+        Message *next = reversed->next;
+        linkedlist_append(&c->mailbox, &reversed->mailbox_list_head);
+        reversed = next;
+    }
+}
 
-    free(m);
+static Message *mailbox_first(Context *c)
+{
+    // messages in the outer list are always newer than the ones in the mailbox
+    if (!c->mailbox) {
+        mailbox_process_outer_list(c);
+    }
+
+    return c->mailbox ? GET_LIST_ENTRY(c->mailbox, Message, mailbox_list_head) : NULL;
+}
+
+// returns the message that follows item, or the first one when item is NULL
+static struct ListHead *mailbox_next_item(Context *c, struct ListHead *item)
+{
+    if (!item) {
+        return c->mailbox;
+    }
+
+    return (item->next != c->mailbox) ? item->next : NULL;
+}
+
+// returns the message that loop_rec should examine, that is the one after the saved position
+static Message *mailbox_current(Context *c)
+{
+    struct ListHead *current = mailbox_next_item(c, c->mailbox_save);
+    if (!current) {
+        mailbox_process_outer_list(c);
+        current = mailbox_next_item(c, c->mailbox_save);
+    }
+
+    return current ? GET_LIST_ENTRY(current, Message, mailbox_list_head) : NULL;
+}
+
+static void mailbox_unlink(Context *c, Message *m)
+{
+    struct ListHead *item = &m->mailbox_list_head;
+
+    // saved position and mark move back to the previous message, so they still split older and newer messages
+    struct ListHead *prev = (item != c->mailbox) ? item->prev : NULL;
+    if (c->mailbox_save == item) {
+        c->mailbox_save = prev;
+    }
+    if (c->mailbox_mark == item) {
+        c->mailbox_mark = prev;
+    }
+
+    linkedlist_remove(&c->mailbox, item);
+    SMP_ATOMIC_SUB(&c->messages_count, 1);
+    SMP_ATOMIC_SUB(&c->messages_size, sizeof(Message) + m->msg_memory_size);
+}
+
+static Message *mailbox_take_first(Context *c)
+{
+    Message *m = mailbox_first(c);
+    if (m) {
+        mailbox_unlink(c, m);
+    }
+
+    return m;
+}
+
+int mailbox_is_empty(Context *c)
+{
+    return !c->mailbox && !SMP_ATOMIC_LOAD(&c->outer_messages);
+}
+
+// messages made only of immediate terms don't need to be part of the heap
+static inline int mailbox_message_has_terms(const Message *m)
+{
+    return m->fragment.heap_end != m->fragment.heap_start;
+}
+
+// the message is attached to the heap while it is still in the mailbox, so the fragment is retained
+static void mailbox_attach_examined_message(Context *c, Message *m)
+{
+    if (m->on_heap || !mailbox_message_has_terms(m)) {
+        return;
+    }
+
+    m->on_heap = 1;
+    m->fragment.retained = 1;
+    memory_attach_heap_fragment(c, &m->fragment);
+    c->mailbox_heap_messages++;
+}
+
+// the message has been removed from the mailbox, its terms become part of the heap
+static void mailbox_attach_message(Context *c, Message *m)
+{
+    if (m->on_heap) {
+        c->mailbox_heap_messages--;
+        if (m->fragment.heap_start) {
+            // next collection will free it
+            m->fragment.retained = 0;
+        } else {
+            // terms have already been moved to the heap by a collection
+            free(m);
+        }
+    } else if (mailbox_message_has_terms(m)) {
+        memory_attach_heap_fragment(c, &m->fragment);
+    } else {
+        mailbox_destroy_message(m);
+    }
+}
+
+term mailbox_receive(Context *c)
+{
+    Message *m = mailbox_take_first(c);
+    term rt = m->message;
+    mailbox_attach_message(c, m);
+    c->stats.messages_received++;
 
     TRACE("Pid %i is receiving 0x%lx.\n", c->process_id, rt);
 
@@ -78,44 +217,80 @@ term mailbox_receive(Context *c)
 
 Message *mailbox_dequeue(Context *c)
 {
-    Message *m = GET_LIST_ENTRY(c->mailbox, Message, mailbox_list_head);
-    linkedlist_remove(&c->mailbox, &m->mailbox_list_head);
+    Message *m = mailbox_take_first(c);
 
     TRACE("Pid %i is dequeueing 0x%lx.\n", c->process_id, m->message);
 
     return m;
 }
 
-term mailbox_peek(Context *c)
+void mailbox_destroy_message(Message *m)
 {
-    Message *m = GET_LIST_ENTRY(c->mailbox, Message, mailbox_list_head);
+    memory_release_off_heap_binaries(m->fragment.off_heap_binaries);
+    free(m);
+}
+
+int mailbox_peek(Context *c, term *out)
+{
+    Message *m = mailbox_current(c);
+    if (!m) {
+        return 0;
+    }
 
     TRACE("Pid %i is peeking 0x%lx.\n", c->process_id, m->message);
 
-    if (c->e - c->heap_ptr < m->msg_memory_size) {
-        //ADDITIONAL_PROCESSING_MEMORY_SIZE: ensure some additional memory for message processing, so there is
-        //no need to run GC again.
-        if (UNLIKELY(memory_gc(c, context_memory_size(c) + m->msg_memory_size + ADDITIONAL_PROCESSING_MEMORY_SIZE) != MEMORY_GC_OK)) {
-            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
-        }
-    }
+    mailbox_attach_examined_message(c, m);
+    *out = m->message;
 
-    term rt = memory_copy_term_tree(&c->heap_ptr, m->message);
+    return 1;
+}
 
-    return rt;
+void mailbox_next(Context *c)
+{
+    Message *m = mailbox_current(c);
+    if (m) {
+        c->mailbox_save = &m->mailbox_list_head;
+    }
+}
+
+void mailbox_reset(Context *c)
+{
+    c->mailbox_save = NULL;
 }
 
 void mailbox_remove(Context *c)
 {
-    if (!c->mailbox) {
+    Message *m = mailbox_current(c);
+    if (!m) {
         TRACE("Pid %i tried to remove a message from an empty mailbox.\n", c->process_id);
         return;
     }
 
-    Message *m = GET_LIST_ENTRY(c->mailbox, Message, mailbox_list_head);
-    linkedlist_remove(&c->mailbox, &m->mailbox_list_head);
-
     TRACE("Pid %i is removing a message.\n", c->process_id);
 
-    free(m);
+    mailbox_unlink(c, m);
+    c->mailbox_save = NULL;
+    mailbox_attach_message(c, m);
+    c->stats.messages_received++;
+
+    // registers are roots, so the removed message survives if it is still used
+    if (UNLIKELY(memory_ensure_free(c, 0) != MEMORY_GC_OK)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+    }
+}
+
+void mailbox_recv_mark(Context *c, const void *mark_label)
+{
+    // messages that have already been sent are older than the mark
+    mailbox_process_outer_list(c);
+
+    c->mailbox_mark = c->mailbox ? c->mailbox->prev : NULL;
+    c->mailbox_mark_label = mark_label;
+}
+
+void mailbox_recv_set(Context *c, const void *mark_label)
+{
+    if (c->mailbox_mark_label == mark_label) {
+        c->mailbox_save = c->mailbox_mark;
+    }
 }
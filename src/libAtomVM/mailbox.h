@@ -31,27 +31,64 @@
 #include "term.h"
 #include "context.h"
 
-typedef struct
+typedef struct Message
 {
+    // once received the message becomes part of the process heap, so the fragment must be the first member
+    HeapFragment fragment;
     struct ListHead mailbox_list_head;
+    // next message in the outer list
+    struct Message *next;
     int msg_memory_size;
+    // set when receive examines the message: its terms are part of the heap from then on
+    int on_heap;
     term message;
 } Message;
 
 /**
  * @brief Sends a message to a certain mailbox.
  *
- * @details Sends a term to a certain process or port mailbox.
+ * @details Sends a term to a certain process or port mailbox. Sending doesn't take any lock, but in SMP builds
+ * callers must make sure that the context is not destroyed meanwhile, such as by using globalcontext_send_message.
  * @param c the process context.
  * @param t the term that will be sent.
  */
 void mailbox_send(Context *c, term t);
 
 /**
- * @brief Gets next message from a mailbox.
+ * @brief Copies a term to a new message.
+ *
+ * @details Allocates a message that holds a copy of the given term, so it can be enqueued later.
+ * @param t the term that will be copied.
+ * @returns the new message or NULL if memory allocation fails.
+ */
+Message *mailbox_message_create_from_term(term t);
+
+/**
+ * @brief Enqueues a message.
  *
- * @details Dequeue a term that has been previously queued on a certain process or driver mailbox.
+ * @details Pushes a message created with mailbox_message_create_from_term to the mailbox outer list and makes its
+ * owner ready. It is lock-free and O(1), so it can be used by any scheduler and by drivers.
  * @param c the process or driver context.
+ * @param m the message, that will be owned by the mailbox.
+ */
+void mailbox_enqueue_message(Context *c, Message *m);
+
+/**
+ * @brief Checks if a mailbox is empty.
+ *
+ * @details Checks if there are no queued messages, it is safe to call while other schedulers are sending messages
+ * but only the process itself or the scheduler that is running it can use it.
+ * @param c the process or driver context.
+ * @returns 1 if there are no messages, otherwise 0.
+ */
+int mailbox_is_empty(Context *c);
+
+/**
+ * @brief Gets next message from a mailbox.
+ *
+ * @details Dequeue a term that has been previously queued on a certain process mailbox, the message is attached to
+ * the process heap without copying it.
+ * @param c the process context.
  * @returns next queued term.
  */
 term mailbox_receive(Context *c);
@@ -59,27 +96,78 @@ term mailbox_receive(Context *c);
 /**
  * @brief Dequeue next message struct from mailbox.
  *
- * @details Dequeue a message that has been previously queued on a certain process or driver mailbox.
+ * @details Dequeue a message that has been previously queued on a certain process or driver mailbox, it is meant
+ * to be used by native handlers: messages that have been examined by receive are part of the process heap.
  * @param c the process or driver context.
- * @returns dequeued message, the caller must free() the message.
+ * @returns dequeued message, the caller must destroy the message using mailbox_destroy_message.
  */
 Message *mailbox_dequeue(Context *c);
 
 /**
- * @brief Gets next message from a mailbox (without removing it).
+ * @brief Frees a message.
  *
- * @details Peek the mailbox and retrieve a term that has been previously queued on a certain process or driver mailbox.
- * @param c the process or driver context.
- * @returns peek queued term.
+ * @details Frees a message that has been dequeued, binaries referenced by the message are released.
+ * @param m the message that will be freed.
  */
-term mailbox_peek(Context *c);
+void mailbox_destroy_message(Message *m);
 
 /**
- * @brief Remove next message from mailbox.
+ * @brief Gets the message that receive is examining (without removing it).
  *
- * @details Discard a term that has been previously queued on a certain process or driver mailbox.
- * @param c the process or driver context.
+ * @details Gets the first message after the saved position, that is the first message that has not been examined
+ * yet by the running receive. The term is not copied: the first time a message is examined its memory is attached
+ * to the process heap as a heap fragment, and the message term is a garbage collection root until it is removed.
+ * @param c the process context.
+ * @param out the message term.
+ * @returns 1 if there is a message to examine, 0 if all of them have been examined.
+ */
+int mailbox_peek(Context *c, term *out);
+
+/**
+ * @brief Moves the saved position past the message that receive is examining.
+ *
+ * @details The message is left in the mailbox and it will not be examined again until the saved position is
+ * reset, so loop_rec_end doesn't need to scan the mailbox from the first message.
+ * @param c the process context.
+ */
+void mailbox_next(Context *c);
+
+/**
+ * @brief Resets the saved position.
+ *
+ * @details Makes next receive examine the mailbox starting from the first message.
+ * @param c the process context.
+ */
+void mailbox_reset(Context *c);
+
+/**
+ * @brief Remove the message that receive is examining from mailbox.
+ *
+ * @details Removes the message returned by mailbox_peek, whose terms stay on the process heap, and resets the saved
+ * position. Garbage collection is performed when heap fragments grow bigger than the free heap memory, any existing
+ * term might be moved after this call.
+ * @param c the process context.
  */
 void mailbox_remove(Context *c);
 
+/**
+ * @brief Marks the end of the mailbox.
+ *
+ * @details Remembers the last message in the mailbox, so the receive at mark_label can skip all the messages
+ * that were sent before the mark, such as the ones sent before a reference used by the receive was created.
+ * @param c the process context.
+ * @param mark_label the address of the receive that will use the mark.
+ */
+void mailbox_recv_mark(Context *c, const void *mark_label);
+
+/**
+ * @brief Moves the saved position to the mark.
+ *
+ * @details Moves the saved position to the mark set using mailbox_recv_mark, if it has been set for the same
+ * receive, otherwise the saved position is not changed.
+ * @param c the process context.
+ * @param mark_label the address of the receive that is going to be executed.
+ */
+void mailbox_recv_set(Context *c, const void *mark_label);
+
 #endif
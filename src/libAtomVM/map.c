@@ -0,0 +1,1012 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+#include "map.h"
+
+#include "context.h"
+#include "globalcontext.h"
+#include "memory.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MAP_BITS_PER_LEVEL 4
+#define MAP_LEVEL_MASK 0xF
+
+#define MAP_HASH_SEED 2166136261U
+#define MAP_HASH_PRIME 16777619U
+
+// when both ctx and heap_ptr are NULL nothing is allocated, only the required heap size is computed
+struct MapBuilder
+{
+    Context *ctx;
+    term **heap_ptr;
+    GlobalContext *global;
+    size_t used;
+    int added;
+    int removed;
+};
+
+enum MapNodeUpdate
+{
+    MapNodeReplace,
+    MapNodeInsert,
+    MapNodeDelete
+};
+
+static inline void map_builder_init(struct MapBuilder *b, Context *ctx, GlobalContext *global)
+{
+    b->ctx = ctx;
+    b->heap_ptr = NULL;
+    b->global = global;
+    b->used = 0;
+    b->added = 0;
+    b->removed = 0;
+}
+
+static inline term *map_alloc(struct MapBuilder *b, size_t size)
+{
+    b->used += size;
+    if (b->ctx) {
+        return memory_heap_alloc(b->ctx, size);
+    }
+    if (!b->heap_ptr) {
+        return NULL;
+    }
+
+    term *allocated = *b->heap_ptr;
+    *b->heap_ptr += size;
+
+    return allocated;
+}
+
+static inline int map_popcount(uint32_t bitmap)
+{
+    bitmap = bitmap - ((bitmap >> 1) & 0x55555555);
+    bitmap = (bitmap & 0x33333333) + ((bitmap >> 2) & 0x33333333);
+    return (((bitmap + (bitmap >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+static inline int map_hash_slot(uint32_t hash, int depth)
+{
+    return (hash >> (32 - MAP_BITS_PER_LEVEL * (depth + 1))) & MAP_LEVEL_MASK;
+}
+
+// flat map keys are sorted in term order, so atoms are compared by name, while keys colliding in hash maps just
+// need a total order consistent with equality, such as the faster one used without the global context
+static inline int map_key_compare(term a, term b, GlobalContext *global)
+{
+    return term_compare(a, b, global);
+}
+
+// hash map root has also the size before the bitmap
+static inline int map_node_offset(const term *node)
+{
+    return ((node[0] & TERM_BOXED_TAG_MASK) == TERM_BOXED_HASHMAP) ? 3 : 2;
+}
+
+static inline uint32_t map_node_bitmap(const term *node, int offset)
+{
+    return term_to_int32(node[offset - 1]);
+}
+
+static inline int map_node_children(const term *node, int offset)
+{
+    return term_get_size_from_boxed_header(node[0]) + 1 - offset;
+}
+
+static inline const term *map_flat_keys(const term *boxed_value)
+{
+    return term_to_const_term_ptr(boxed_value[TERM_MAP_KEYS_INDEX]) + 1;
+}
+
+size_t map_size(term map)
+{
+    const term *boxed_value = term_to_const_term_ptr(map);
+
+    if ((boxed_value[0] & TERM_BOXED_TAG_MASK) == TERM_BOXED_MAP) {
+        return term_get_size_from_boxed_header(boxed_value[0]) - 1;
+    } else {
+        return term_to_int32(boxed_value[TERM_HASHMAP_SIZE_INDEX]);
+    }
+}
+
+static term map_tuple_alloc(size_t size, term **elements, struct MapBuilder *b)
+{
+    term *boxed_value = map_alloc(b, size + 1);
+    if (!boxed_value) {
+        *elements = NULL;
+        return term_invalid_term();
+    }
+    boxed_value[0] = (size << 6) | TERM_BOXED_TUPLE;
+    *elements = boxed_value + 1;
+
+    return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+}
+
+static term map_flat_alloc(term keys, size_t size, term **values, struct MapBuilder *b)
+{
+    term *boxed_value = map_alloc(b, size + 2);
+    if (!boxed_value) {
+        *values = NULL;
+        return term_invalid_term();
+    }
+    boxed_value[0] = ((size + 1) << 6) | TERM_BOXED_MAP;
+    boxed_value[TERM_MAP_KEYS_INDEX] = keys;
+    *values = boxed_value + TERM_MAP_VALUES_INDEX;
+
+    return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+}
+
+term map_new(Context *ctx)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, ctx, ctx->global);
+
+    term *unused;
+    term keys = map_tuple_alloc(0, &unused, &b);
+    return map_flat_alloc(keys, 0, &unused, &b);
+}
+
+// returns the index of the key or -(insertion point) - 1 when it is missing
+static int map_flat_search(const term *boxed_value, term key, GlobalContext *global)
+{
+    const term *keys = map_flat_keys(boxed_value);
+    int low = 0;
+    int high = term_get_size_from_boxed_header(boxed_value[0]) - 2;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = map_key_compare(key, keys[mid], global);
+        if (cmp == 0) {
+            return mid;
+        } else if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    return -low - 1;
+}
+
+static inline uint32_t map_hash_combine(uint32_t hash, uint32_t value)
+{
+    return (hash ^ value) * MAP_HASH_PRIME;
+}
+
+static inline uint32_t map_hash_word(uint32_t hash, term value)
+{
+    hash = map_hash_combine(hash, (uint32_t) value);
+    #if TERM_BYTES == 8
+        hash = map_hash_combine(hash, (uint32_t) (((uint64_t) value) >> 32));
+    #endif
+
+    return hash;
+}
+
+static uint32_t map_hash_term(uint32_t hash, term t)
+{
+    // lists are walked, so long lists don't need deep recursion
+    while (term_is_nonempty_list(t)) {
+        hash = map_hash_combine(hash, 0x1);
+        hash = map_hash_term(hash, term_get_list_head(t));
+        t = term_get_list_tail(t);
+    }
+
+    if (term_is_binary(t)) {
+        unsigned long size = term_binary_size(t);
+        const uint8_t *data = (const uint8_t *) term_binary_data(t);
+        hash = map_hash_combine(hash, size);
+        for (unsigned long i = 0; i < size; i++) {
+            hash = map_hash_combine(hash, data[i]);
+        }
+
+    } else if (term_is_tuple(t)) {
+        int arity = term_get_tuple_arity(t);
+        hash = map_hash_combine(hash, arity);
+        for (int i = 0; i < arity; i++) {
+            hash = map_hash_term(hash, term_get_tuple_element(t, i));
+        }
+
+    } else if (term_is_map(t)) {
+        // same keys might be stored in a different order
+        uint32_t sum = 0;
+        struct MapIterator it;
+        map_iterator_init(&it, t);
+        term key;
+        term value;
+        while (map_iterator_next(&it, &key, &value)) {
+            sum += map_hash_term(map_hash_term(MAP_HASH_SEED, key), value);
+        }
+        hash = map_hash_combine(hash, sum);
+
+    } else if (term_is_function(t)) {
+        // module and function index, frozen values don't need to be hashed
+        const term *boxed_value = term_to_const_term_ptr(t);
+        hash = map_hash_word(hash, boxed_value[1]);
+        hash = map_hash_word(hash, boxed_value[2]);
+
+    } else if (term_is_boxed(t)) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        int boxed_size = term_boxed_size(t);
+        for (int i = 0; i <= boxed_size; i++) {
+            hash = map_hash_word(hash, boxed_value[i]);
+        }
+
+    } else {
+        hash = map_hash_word(hash, t);
+    }
+
+    return hash;
+}
+
+uint32_t map_hash_key(term key)
+{
+    uint32_t hash = map_hash_term(MAP_HASH_SEED, key);
+
+    // spread all bits, since the trie uses the most significant ones first
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+term map_get_value(term map, term key, GlobalContext *global)
+{
+    const term *boxed_value = term_to_const_term_ptr(map);
+
+    if ((boxed_value[0] & TERM_BOXED_TAG_MASK) == TERM_BOXED_MAP) {
+        int index = map_flat_search(boxed_value, key, global);
+        if (index < 0) {
+            return term_invalid_term();
+        }
+        return boxed_value[TERM_MAP_VALUES_INDEX + index];
+    }
+
+    uint32_t hash = map_hash_key(key);
+    const term *node = boxed_value;
+
+    for (int depth = 0; depth < MAP_MAX_DEPTH; depth++) {
+        int offset = map_node_offset(node);
+        uint32_t bitmap = map_node_bitmap(node, offset);
+        uint32_t bit = 1U << map_hash_slot(hash, depth);
+        if (!(bitmap & bit)) {
+            return term_invalid_term();
+        }
+
+        term child = node[offset + map_popcount(bitmap & (bit - 1))];
+        if (term_is_nonempty_list(child)) {
+            if (term_exactly_equals(key, term_get_list_head(child))) {
+                return term_get_list_tail(child);
+            }
+            return term_invalid_term();
+        }
+        node = term_to_const_term_ptr(child);
+    }
+
+    int offset = map_node_offset(node);
+    int children = map_node_children(node, offset);
+    for (int i = 0; i < children; i++) {
+        term leaf = node[offset + i];
+        if (term_exactly_equals(key, term_get_list_head(leaf))) {
+            return term_get_list_tail(leaf);
+        }
+    }
+
+    return term_invalid_term();
+}
+
+static term map_leaf(term key, term value, struct MapBuilder *b)
+{
+    term *leaf = map_alloc(b, 2);
+    if (!leaf) {
+        return term_invalid_term();
+    }
+
+    return term_list_init_prepend(leaf, key, value);
+}
+
+static term map_copy_node(const term *node, uint32_t bitmap, int pos, enum MapNodeUpdate update, term child, struct MapBuilder *b)
+{
+    int offset = map_node_offset(node);
+    int children = map_node_children(node, offset);
+    int new_children = children + (update == MapNodeInsert) - (update == MapNodeDelete);
+
+    term *new_node = map_alloc(b, offset + new_children);
+    if (!new_node) {
+        return term_invalid_term();
+    }
+    new_node[0] = ((offset - 1 + new_children) << 6) | (node[0] & TERM_BOXED_TAG_MASK);
+    if (offset == 3) {
+        new_node[TERM_HASHMAP_SIZE_INDEX] = node[TERM_HASHMAP_SIZE_INDEX];
+    }
+    new_node[offset - 1] = term_from_int32(bitmap);
+
+    const term *src = node + offset;
+    term *dst = new_node + offset;
+    memcpy(dst, src, pos * sizeof(term));
+    switch (update) {
+        case MapNodeReplace:
+            dst[pos] = child;
+            memcpy(dst + pos + 1, src + pos + 1, (children - pos - 1) * sizeof(term));
+            break;
+        case MapNodeInsert:
+            dst[pos] = child;
+            memcpy(dst + pos + 1, src + pos, (children - pos) * sizeof(term));
+            break;
+        case MapNodeDelete:
+            memcpy(dst + pos, src + pos + 1, (children - pos - 1) * sizeof(term));
+            break;
+    }
+
+    return ((term) new_node) | TERM_BOXED_VALUE_TAG;
+}
+
+// builds the smallest subtree that holds two leaves whose hashes are equal up to depth
+static term map_pair_node(term leaf1, uint32_t hash1, term key1, term leaf2, uint32_t hash2, term key2, int depth, struct MapBuilder *b)
+{
+    term *node;
+
+    if (depth == MAP_MAX_DEPTH) {
+        node = map_alloc(b, 4);
+        if (!node) {
+            return term_invalid_term();
+        }
+        node[0] = (3 << 6) | TERM_BOXED_HASHMAP_NODE;
+        node[TERM_HASHMAP_NODE_BITMAP_INDEX] = term_from_int32(0);
+        int first = map_key_compare(key1, key2, NULL) < 0;
+        node[2] = first ? leaf1 : leaf2;
+        node[3] = first ? leaf2 : leaf1;
+
+        return ((term) node) | TERM_BOXED_VALUE_TAG;
+    }
+
+    int slot1 = map_hash_slot(hash1, depth);
+    int slot2 = map_hash_slot(hash2, depth);
+
+    if (slot1 == slot2) {
+        term child = map_pair_node(leaf1, hash1, key1, leaf2, hash2, key2, depth + 1, b);
+        node = map_alloc(b, 3);
+        if (!node) {
+            return term_invalid_term();
+        }
+        node[0] = (2 << 6) | TERM_BOXED_HASHMAP_NODE;
+        node[TERM_HASHMAP_NODE_BITMAP_INDEX] = term_from_int32(1U << slot1);
+        node[2] = child;
+
+    } else {
+        node = map_alloc(b, 4);
+        if (!node) {
+            return term_invalid_term();
+        }
+        node[0] = (3 << 6) | TERM_BOXED_HASHMAP_NODE;
+        node[TERM_HASHMAP_NODE_BITMAP_INDEX] = term_from_int32((1U << slot1) | (1U << slot2));
+        node[2] = (slot1 < slot2) ? leaf1 : leaf2;
+        node[3] = (slot1 < slot2) ? leaf2 : leaf1;
+    }
+
+    return ((term) node) | TERM_BOXED_VALUE_TAG;
+}
+
+static term map_hashmap_put(term node_term, int depth, uint32_t hash, term key, term value, struct MapBuilder *b)
+{
+    const term *node = term_to_const_term_ptr(node_term);
+    int offset = map_node_offset(node);
+    int children = map_node_children(node, offset);
+    uint32_t bitmap = map_node_bitmap(node, offset);
+
+    if (depth == MAP_MAX_DEPTH) {
+        // colliding leaves are sorted by key
+        int pos = children;
+        for (int i = 0; i < children; i++) {
+            term leaf = node[offset + i];
+            int cmp = map_key_compare(key, term_get_list_head(leaf), NULL);
+            if (cmp == 0) {
+                if (term_get_list_tail(leaf) == value) {
+                    return node_term;
+                }
+                return map_copy_node(node, bitmap, i, MapNodeReplace, map_leaf(key, value, b), b);
+            } else if (cmp < 0) {
+                pos = i;
+                break;
+            }
+        }
+        b->added = 1;
+        return map_copy_node(node, bitmap, pos, MapNodeInsert, map_leaf(key, value, b), b);
+    }
+
+    uint32_t bit = 1U << map_hash_slot(hash, depth);
+    int pos = map_popcount(bitmap & (bit - 1));
+
+    if (!(bitmap & bit)) {
+        b->added = 1;
+        return map_copy_node(node, bitmap | bit, pos, MapNodeInsert, map_leaf(key, value, b), b);
+    }
+
+    term child = node[offset + pos];
+    term new_child;
+
+    if (term_is_nonempty_list(child)) {
+        term child_key = term_get_list_head(child);
+        if (term_exactly_equals(key, child_key)) {
+            if (term_get_list_tail(child) == value) {
+                return node_term;
+            }
+            new_child = map_leaf(key, value, b);
+        } else {
+            b->added = 1;
+            term leaf = map_leaf(key, value, b);
+            new_child = map_pair_node(child, map_hash_key(child_key), child_key, leaf, hash, key, depth + 1, b);
+        }
+    } else {
+        new_child = map_hashmap_put(child, depth + 1, hash, key, value, b);
+        if (new_child == child) {
+            return node_term;
+        }
+    }
+
+    return map_copy_node(node, bitmap, pos, MapNodeReplace, new_child, b);
+}
+
+// returns node_term when key is missing, or the only leaf left when a node can be collapsed
+static term map_hashmap_remove(term node_term, int depth, uint32_t hash, term key, struct MapBuilder *b)
+{
+    const term *node = term_to_const_term_ptr(node_term);
+    int offset = map_node_offset(node);
+    int children = map_node_children(node, offset);
+    uint32_t bitmap = map_node_bitmap(node, offset);
+    int is_root = (depth == 0);
+    int pos;
+
+    if (depth == MAP_MAX_DEPTH) {
+        pos = -1;
+        for (int i = 0; i < children; i++) {
+            if (term_exactly_equals(key, term_get_list_head(node[offset + i]))) {
+                pos = i;
+                break;
+            }
+        }
+        if (pos < 0) {
+            return node_term;
+        }
+
+    } else {
+        uint32_t bit = 1U << map_hash_slot(hash, depth);
+        if (!(bitmap & bit)) {
+            return node_term;
+        }
+        pos = map_popcount(bitmap & (bit - 1));
+
+        term child = node[offset + pos];
+        if (term_is_nonempty_list(child)) {
+            if (!term_exactly_equals(key, term_get_list_head(child))) {
+                return node_term;
+            }
+            bitmap &= ~bit;
+
+        } else {
+            term new_child = map_hashmap_remove(child, depth + 1, hash, key, b);
+            if (new_child == child) {
+                return node_term;
+            }
+            if (!is_root && (children == 1) && term_is_nonempty_list(new_child)) {
+                return new_child;
+            }
+            return map_copy_node(node, bitmap, pos, MapNodeReplace, new_child, b);
+        }
+    }
+
+    b->removed = 1;
+
+    // any node but the root has at least 2 leaves, a single leaf replaces its node
+    if (!is_root && (children == 2)) {
+        term other = node[offset + 1 - pos];
+        if (term_is_nonempty_list(other)) {
+            return other;
+        }
+    }
+
+    return map_copy_node(node, bitmap, pos, MapNodeDelete, term_invalid_term(), b);
+}
+
+static term map_build_node(const struct MapEntry *entries, size_t n, int depth, struct MapBuilder *b)
+{
+    if ((depth > 0) && (n == 1)) {
+        return map_leaf(entries[0].key, entries[0].value, b);
+    }
+
+    int offset = (depth == 0) ? 3 : 2;
+    uint32_t bitmap = 0;
+    int children;
+    if (depth == MAP_MAX_DEPTH) {
+        children = n;
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            bitmap |= 1U << map_hash_slot(entries[i].hash, depth);
+        }
+        children = map_popcount(bitmap);
+    }
+
+    term *node = map_alloc(b, offset + children);
+    if (node) {
+        node[0] = ((offset - 1 + children) << 6) | ((depth == 0) ? TERM_BOXED_HASHMAP : TERM_BOXED_HASHMAP_NODE);
+        if (depth == 0) {
+            node[TERM_HASHMAP_SIZE_INDEX] = term_from_int32(n);
+        }
+        node[offset - 1] = term_from_int32(bitmap);
+    }
+
+    if (depth == MAP_MAX_DEPTH) {
+        for (size_t i = 0; i < n; i++) {
+            term leaf = map_leaf(entries[i].key, entries[i].value, b);
+            if (node) {
+                node[offset + i] = leaf;
+            }
+        }
+
+    } else {
+        // entries are sorted by hash, so entries that share a slot are contiguous
+        size_t start = 0;
+        int child = 0;
+        while (start < n) {
+            int slot = map_hash_slot(entries[start].hash, depth);
+            size_t end = start + 1;
+            while ((end < n) && (map_hash_slot(entries[end].hash, depth) == slot)) {
+                end++;
+            }
+            term child_term = map_build_node(entries + start, end - start, depth + 1, b);
+            if (node) {
+                node[offset + child] = child_term;
+            }
+            child++;
+            start = end;
+        }
+    }
+
+    if (!node) {
+        return term_invalid_term();
+    }
+
+    return ((term) node) | TERM_BOXED_VALUE_TAG;
+}
+
+static term map_build(const struct MapEntry *entries, size_t n, struct MapBuilder *b)
+{
+    if (n > MAP_FLAT_MAX_SIZE) {
+        return map_build_node(entries, n, 0, b);
+    }
+
+    term *keys;
+    term *values;
+    term keys_tuple = map_tuple_alloc(n, &keys, b);
+    term map = map_flat_alloc(keys_tuple, n, &values, b);
+    if (keys) {
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = entries[i].key;
+            values[i] = entries[i].value;
+        }
+    }
+
+    return map;
+}
+
+static int map_entry_hash_compare(const void *a, const void *b)
+{
+    const struct MapEntry *entry_a = (const struct MapEntry *) a;
+    const struct MapEntry *entry_b = (const struct MapEntry *) b;
+
+    if (entry_a->hash != entry_b->hash) {
+        return (entry_a->hash < entry_b->hash) ? -1 : 1;
+    }
+    int cmp = map_key_compare(entry_a->key, entry_b->key, NULL);
+    if (cmp) {
+        return cmp;
+    }
+
+    return (entry_a->order < entry_b->order) ? -1 : (entry_a->order > entry_b->order);
+}
+
+/*
+ * Sorts entries with unique keys in term order using tmp, that has room for n entries.
+ * qsort cannot be used since atoms are compared by name, that requires the global context.
+ */
+static void map_entries_sort_by_key(struct MapEntry *entries, struct MapEntry *tmp, size_t n, GlobalContext *global)
+{
+    if (n < 2) {
+        return;
+    }
+
+    size_t half = n / 2;
+    map_entries_sort_by_key(entries, tmp, half, global);
+    map_entries_sort_by_key(entries + half, tmp, n - half, global);
+
+    memcpy(tmp, entries, half * sizeof(struct MapEntry));
+    size_t i = 0;
+    size_t j = half;
+    size_t k = 0;
+    while ((i < half) && (j < n)) {
+        if (map_key_compare(entries[j].key, tmp[i].key, global) < 0) {
+            entries[k++] = entries[j++];
+        } else {
+            entries[k++] = tmp[i++];
+        }
+    }
+    memcpy(entries + k, tmp + i, (half - i) * sizeof(struct MapEntry));
+}
+
+size_t map_entries_prepare(struct MapEntry *entries, size_t n, GlobalContext *global)
+{
+    qsort(entries, n, sizeof(struct MapEntry), map_entry_hash_compare);
+
+    // equal keys are contiguous, the last one has the greatest order
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++) {
+        if ((i + 1 < n) && (entries[i].hash == entries[i + 1].hash)
+                && term_exactly_equals(entries[i].key, entries[i + 1].key)) {
+            continue;
+        }
+        entries[unique] = entries[i];
+        unique++;
+    }
+
+    if (unique <= MAP_FLAT_MAX_SIZE) {
+        struct MapEntry tmp[MAP_FLAT_MAX_SIZE];
+        map_entries_sort_by_key(entries, tmp, unique, global);
+    }
+
+    return unique;
+}
+
+size_t map_from_entries_heap_size(const struct MapEntry *entries, size_t n)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, NULL, NULL);
+    map_build(entries, n, &b);
+
+    return b.used;
+}
+
+term map_from_entries(const struct MapEntry *entries, size_t n, Context *ctx)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, ctx, ctx->global);
+
+    return map_build(entries, n, &b);
+}
+
+term map_from_entries_in_heap(const struct MapEntry *entries, size_t n, term **heap_ptr, GlobalContext *global)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, NULL, global);
+    b.heap_ptr = heap_ptr;
+
+    return map_build(entries, n, &b);
+}
+
+size_t map_max_heap_size(size_t n)
+{
+    if (n <= MAP_FLAT_MAX_SIZE) {
+        return map_flat_heap_size(n);
+    }
+
+    // every node and leaf but the root is the child of one node, and a node below the root holds at least two
+    // entries, so there are at most n / 2 of them for each level: root header, 2 words for each leaf and each node
+    // header plus one child pointer for each of them
+    size_t nodes = MAP_MAX_DEPTH * (n / 2);
+    return 3 + (2 + 1) * n + (2 + 1) * nodes;
+}
+
+static term map_flat_to_hashmap(const term *boxed_value, term key, term value, struct MapBuilder *b)
+{
+    size_t size = term_get_size_from_boxed_header(boxed_value[0]) - 1;
+    const term *keys = map_flat_keys(boxed_value);
+    const term *values = boxed_value + TERM_MAP_VALUES_INDEX;
+
+    struct MapEntry entries[MAP_FLAT_MAX_SIZE + 1];
+
+    for (size_t i = 0; i < size; i++) {
+        entries[i].hash = map_hash_key(keys[i]);
+        entries[i].order = i;
+        entries[i].key = keys[i];
+        entries[i].value = values[i];
+    }
+    entries[size].hash = map_hash_key(key);
+    entries[size].order = size;
+    entries[size].key = key;
+    entries[size].value = value;
+
+    size_t n = map_entries_prepare(entries, size + 1, b->global);
+
+    return map_build(entries, n, b);
+}
+
+static term map_flat_put(term map, term key, term value, struct MapBuilder *b)
+{
+    const term *boxed_value = term_to_const_term_ptr(map);
+    size_t size = term_get_size_from_boxed_header(boxed_value[0]) - 1;
+    const term *keys = map_flat_keys(boxed_value);
+    const term *values = boxed_value + TERM_MAP_VALUES_INDEX;
+    term *new_values;
+
+    int index = map_flat_search(boxed_value, key, b->global);
+    if (index >= 0) {
+        if (values[index] == value) {
+            return map;
+        }
+        // keys are not changed, so they are shared
+        term new_map = map_flat_alloc(boxed_value[TERM_MAP_KEYS_INDEX], size, &new_values, b);
+        if (new_values) {
+            memcpy(new_values, values, size * sizeof(term));
+            new_values[index] = value;
+        }
+        return new_map;
+    }
+
+    b->added = 1;
+    if (size + 1 > MAP_FLAT_MAX_SIZE) {
+        return map_flat_to_hashmap(boxed_value, key, value, b);
+    }
+
+    size_t pos = -index - 1;
+    term *new_keys;
+    term new_keys_tuple = map_tuple_alloc(size + 1, &new_keys, b);
+    term new_map = map_flat_alloc(new_keys_tuple, size + 1, &new_values, b);
+    if (new_values) {
+        memcpy(new_keys, keys, pos * sizeof(term));
+        memcpy(new_values, values, pos * sizeof(term));
+        new_keys[pos] = key;
+        new_values[pos] = value;
+        memcpy(new_keys + pos + 1, keys + pos, (size - pos) * sizeof(term));
+        memcpy(new_values + pos + 1, values + pos, (size - pos) * sizeof(term));
+    }
+
+    return new_map;
+}
+
+static term map_put_internal(term map, term key, term value, struct MapBuilder *b)
+{
+    if (term_is_flatmap(map)) {
+        return map_flat_put(map, key, value, b);
+    }
+
+    term new_map = map_hashmap_put(map, 0, map_hash_key(key), key, value, b);
+    if (b->ctx && b->added) {
+        term *root = term_to_term_ptr(new_map);
+        root[TERM_HASHMAP_SIZE_INDEX] = term_from_int32(map_size(map) + 1);
+    }
+
+    return new_map;
+}
+
+size_t map_put_heap_size(term map, term key, GlobalContext *global)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, NULL, global);
+
+    // an invalid term is never a map value, so the worst case is computed
+    map_put_internal(map, key, term_invalid_term(), &b);
+
+    return b.used;
+}
+
+term map_put(term map, term key, term value, Context *ctx)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, ctx, ctx->global);
+
+    return map_put_internal(map, key, value, &b);
+}
+
+static term map_remove_internal(term map, term key, struct MapBuilder *b)
+{
+    const term *boxed_value = term_to_const_term_ptr(map);
+
+    if ((boxed_value[0] & TERM_BOXED_TAG_MASK) == TERM_BOXED_HASHMAP) {
+        term new_map = map_hashmap_remove(map, 0, map_hash_key(key), key, b);
+        if (b->ctx && b->removed) {
+            term *root = term_to_term_ptr(new_map);
+            root[TERM_HASHMAP_SIZE_INDEX] = term_from_int32(map_size(map) - 1);
+        }
+        return new_map;
+    }
+
+    int index = map_flat_search(boxed_value, key, b->global);
+    if (index < 0) {
+        return map;
+    }
+    b->removed = 1;
+
+    size_t size = term_get_size_from_boxed_header(boxed_value[0]) - 1;
+    const term *keys = map_flat_keys(boxed_value);
+    const term *values = boxed_value + TERM_MAP_VALUES_INDEX;
+    term *new_keys;
+    term *new_values;
+    term new_keys_tuple = map_tuple_alloc(size - 1, &new_keys, b);
+    term new_map = map_flat_alloc(new_keys_tuple, size - 1, &new_values, b);
+    if (new_values) {
+        memcpy(new_keys, keys, index * sizeof(term));
+        memcpy(new_values, values, index * sizeof(term));
+        memcpy(new_keys + index, keys + index + 1, (size - index - 1) * sizeof(term));
+        memcpy(new_values + index, values + index + 1, (size - index - 1) * sizeof(term));
+    }
+
+    return new_map;
+}
+
+size_t map_remove_heap_size(term map, term key, GlobalContext *global)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, NULL, global);
+    map_remove_internal(map, key, &b);
+
+    return b.used;
+}
+
+term map_remove(term map, term key, Context *ctx)
+{
+    struct MapBuilder b;
+    map_builder_init(&b, ctx, ctx->global);
+
+    return map_remove_internal(map, key, &b);
+}
+
+void map_flat_sort(term *keys, term *values, size_t n, GlobalContext *global)
+{
+    // binary insertion sort: literal maps are small and usually almost sorted
+    for (size_t i = 1; i < n; i++) {
+        term key = keys[i];
+        term value = values[i];
+
+        size_t low = 0;
+        size_t high = i;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (map_key_compare(key, keys[mid], global) < 0) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+
+        memmove(keys + low + 1, keys + low, (i - low) * sizeof(term));
+        memmove(values + low + 1, values + low, (i - low) * sizeof(term));
+        keys[low] = key;
+        values[low] = value;
+    }
+}
+
+static struct MapEntry *map_sorted_entries(term map, size_t size, GlobalContext *global)
+{
+    // the second half is used by the sort
+    struct MapEntry *entries = malloc(size * 2 * sizeof(struct MapEntry));
+    if (IS_NULL_PTR(entries)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        abort();
+    }
+
+    struct MapIterator it;
+    map_iterator_init(&it, map);
+    for (size_t i = 0; i < size; i++) {
+        map_iterator_next(&it, &entries[i].key, &entries[i].value);
+        entries[i].order = i;
+    }
+    map_entries_sort_by_key(entries, entries + size, size, global);
+
+    return entries;
+}
+
+int map_compare(term a, term b, struct GlobalContext *global)
+{
+    size_t size = map_size(a);
+    if (size == 0) {
+        return 0;
+    }
+
+    if (term_is_flatmap(a) && term_is_flatmap(b)) {
+        const term *boxed_a = term_to_const_term_ptr(a);
+        const term *boxed_b = term_to_const_term_ptr(b);
+        const term *keys_a = map_flat_keys(boxed_a);
+        const term *keys_b = map_flat_keys(boxed_b);
+
+        for (size_t i = 0; i < size; i++) {
+            int cmp = term_compare(keys_a[i], keys_b[i], global);
+            if (cmp) {
+                return cmp;
+            }
+        }
+        for (size_t i = 0; i < size; i++) {
+            int cmp = term_compare(boxed_a[TERM_MAP_VALUES_INDEX + i], boxed_b[TERM_MAP_VALUES_INDEX + i], global);
+            if (cmp) {
+                return cmp;
+            }
+        }
+        return 0;
+    }
+
+    // hash maps are sorted like flat maps first
+    struct MapEntry *entries_a = map_sorted_entries(a, size, global);
+    struct MapEntry *entries_b = map_sorted_entries(b, size, global);
+
+    int cmp = 0;
+    for (size_t i = 0; (i < size) && !cmp; i++) {
+        cmp = term_compare(entries_a[i].key, entries_b[i].key, global);
+    }
+    for (size_t i = 0; (i < size) && !cmp; i++) {
+        cmp = term_compare(entries_a[i].value, entries_b[i].value, global);
+    }
+
+    free(entries_a);
+    free(entries_b);
+
+    return cmp;
+}
+
+void map_iterator_init(struct MapIterator *it, term map)
+{
+    it->map = map;
+    it->depth = 0;
+    it->nodes[0] = term_to_const_term_ptr(map);
+    it->positions[0] = 0;
+}
+
+int map_iterator_next(struct MapIterator *it, term *key, term *value)
+{
+    if (term_is_flatmap(it->map)) {
+        const term *boxed_value = it->nodes[0];
+        int pos = it->positions[0];
+        if (pos >= term_get_size_from_boxed_header(boxed_value[0]) - 1) {
+            return 0;
+        }
+        *key = map_flat_keys(boxed_value)[pos];
+        *value = boxed_value[TERM_MAP_VALUES_INDEX + pos];
+        it->positions[0]++;
+
+        return 1;
+    }
+
+    while (it->depth >= 0) {
+        const term *node = it->nodes[it->depth];
+        int offset = map_node_offset(node);
+        int pos = it->positions[it->depth];
+
+        if (pos >= map_node_children(node, offset)) {
+            it->depth--;
+            continue;
+        }
+        it->positions[it->depth]++;
+
+        term child = node[offset + pos];
+        if (term_is_nonempty_list(child)) {
+            *key = term_get_list_head(child);
+            *value = term_get_list_tail(child);
+            return 1;
+        }
+
+        it->depth++;
+        it->nodes[it->depth] = term_to_const_term_ptr(child);
+        it->positions[it->depth] = 0;
+    }
+
+    return 0;
+}
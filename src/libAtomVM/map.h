@@ -0,0 +1,254 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+/**
+ * @file map.h
+ * @brief Map terms
+ *
+ * @details Maps with up to MAP_FLAT_MAX_SIZE keys are flat maps: a tuple of sorted keys followed by the values, so a
+ * lookup is a binary search and an update that doesn't add keys shares the keys tuple. Bigger maps are hash array
+ * mapped tries: each node consumes 4 bits of the key hash and has a 16 bits bitmap of its children, so any update
+ * copies only the path to the changed leaf. All map functions never trigger a garbage collection: functions that
+ * allocate require the amount of memory returned by the matching heap size function to be already available.
+ */
+
+#ifndef _MAP_H_
+#define _MAP_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "term.h"
+
+#define MAP_FLAT_MAX_SIZE 32
+
+// 32 bits hash, 4 bits for each level, nodes at MAP_MAX_DEPTH only have colliding leaves
+#define MAP_MAX_DEPTH 8
+
+/**
+ * @brief A key and value pair, used to build a map at once.
+ */
+struct MapEntry
+{
+    uint32_t hash;
+    uint32_t order;
+    term key;
+    term value;
+};
+
+/**
+ * @brief Iterates over all keys and values of a map.
+ *
+ * @details Iteration order is the map internal order, no garbage collection must happen while iterating.
+ */
+struct MapIterator
+{
+    term map;
+    int depth;
+    int positions[MAP_MAX_DEPTH + 1];
+    const term *nodes[MAP_MAX_DEPTH + 1];
+};
+
+/**
+ * @brief Heap size of a flat map
+ *
+ * @param size the number of keys.
+ * @return the number of terms used by a flat map and its keys tuple.
+ */
+static inline size_t map_flat_heap_size(size_t size)
+{
+    return (size + 1) + (size + 2);
+}
+
+/**
+ * @brief Gets the number of keys
+ *
+ * @param map a map term.
+ * @return the number of keys in the map.
+ */
+size_t map_size(term map);
+
+/**
+ * @brief Creates an empty map
+ *
+ * @details map_flat_heap_size(0) terms must be already available on the heap.
+ * @param ctx the context that owns the heap.
+ * @return a new empty map.
+ */
+term map_new(Context *ctx);
+
+/**
+ * @brief Gets the value of a key
+ *
+ * @param map a map term.
+ * @param key the key, keys are matched using exact equality.
+ * @param global the global context, flat map keys are sorted by term_compare using it.
+ * @return the value, or an invalid term if the key is not in the map.
+ */
+term map_get_value(term map, term key, struct GlobalContext *global);
+
+/**
+ * @brief Hashes a key
+ *
+ * @details Returns a hash of a term, terms that are exactly equal have the same hash.
+ * @param key any term.
+ * @return the hash of the term.
+ */
+uint32_t map_hash_key(term key);
+
+/**
+ * @brief Gets the heap size required to put a key
+ *
+ * @param map a map term.
+ * @param key the key that will be put.
+ * @param global the global context, see map_get_value.
+ * @return the number of terms map_put will allocate at most.
+ */
+size_t map_put_heap_size(term map, term key, struct GlobalContext *global);
+
+/**
+ * @brief Puts a key
+ *
+ * @details Returns a map with key associated to value, the given map is not modified.
+ * map_put_heap_size terms must be already available on the heap.
+ * @param map a map term.
+ * @param key the key.
+ * @param value the value.
+ * @param ctx the context that owns the heap.
+ * @return the updated map, map itself when nothing changes.
+ */
+term map_put(term map, term key, term value, Context *ctx);
+
+/**
+ * @brief Gets the heap size required to remove a key
+ *
+ * @param map a map term.
+ * @param key the key that will be removed.
+ * @param global the global context, see map_get_value.
+ * @return the number of terms map_remove will allocate at most.
+ */
+size_t map_remove_heap_size(term map, term key, struct GlobalContext *global);
+
+/**
+ * @brief Removes a key
+ *
+ * @details Returns a map without given key, the given map is not modified.
+ * map_remove_heap_size terms must be already available on the heap.
+ * @param map a map term.
+ * @param key the key.
+ * @param ctx the context that owns the heap.
+ * @return the updated map, map itself when the key is missing.
+ */
+term map_remove(term map, term key, Context *ctx);
+
+/**
+ * @brief Sorts map entries and removes duplicated keys
+ *
+ * @details Entries must have their hash and order fields set, when a key appears more than once the entry with the
+ * greatest order is kept. Entries are sorted as map_from_entries requires.
+ * @param entries the entries.
+ * @param n the number of entries.
+ * @param global the global context, see map_get_value.
+ * @return the number of entries left.
+ */
+size_t map_entries_prepare(struct MapEntry *entries, size_t n, struct GlobalContext *global);
+
+/**
+ * @brief Gets the heap size of a map made of given entries
+ *
+ * @param entries entries returned by map_entries_prepare.
+ * @param n the number of entries.
+ * @return the number of terms map_from_entries will allocate.
+ */
+size_t map_from_entries_heap_size(const struct MapEntry *entries, size_t n);
+
+/**
+ * @brief Builds a map at once
+ *
+ * @details map_from_entries_heap_size terms must be already available on the heap.
+ * @param entries entries returned by map_entries_prepare.
+ * @param n the number of entries.
+ * @param ctx the context that owns the heap.
+ * @return a new map.
+ */
+term map_from_entries(const struct MapEntry *entries, size_t n, Context *ctx);
+
+/**
+ * @brief Builds a map at once using a caller supplied memory area
+ *
+ * @details Like map_from_entries, but the map is stored into a memory area that is not owned by any process, such as
+ * the literals area of a module.
+ * @param entries entries returned by map_entries_prepare.
+ * @param n the number of entries.
+ * @param heap_ptr pointer to the destination memory area, it will be advanced by the used amount of terms.
+ * @param global the global context, see map_get_value.
+ * @return a new map.
+ */
+term map_from_entries_in_heap(const struct MapEntry *entries, size_t n, term **heap_ptr, struct GlobalContext *global);
+
+/**
+ * @brief Gets the heap size of a map with given number of keys in the worst case
+ *
+ * @details Unlike map_from_entries_heap_size, keys are not required, so it can be used before decoding them.
+ * @param n the number of keys.
+ * @return the number of terms map_from_entries will allocate at most for n unique keys.
+ */
+size_t map_max_heap_size(size_t n);
+
+/**
+ * @brief Sorts the keys of a flat map
+ *
+ * @details Sorts keys and values of a flat map that has been filled in an arbitrary order.
+ * @param keys the keys, such as the elements of the keys tuple.
+ * @param values the values, in the same order of the keys.
+ * @param n the number of keys.
+ * @param global the global context, see map_get_value.
+ */
+void map_flat_sort(term *keys, term *values, size_t n, struct GlobalContext *global);
+
+/**
+ * @brief Compares two maps with the same size
+ *
+ * @details Keys are compared first and values later, both in key order.
+ * @param a the first map.
+ * @param b the second map.
+ * @param global the global context, see term_compare.
+ * @return a negative value if a < b, 0 if they are equal and a positive value if a > b.
+ */
+int map_compare(term a, term b, struct GlobalContext *global);
+
+/**
+ * @brief Starts iterating over a map
+ *
+ * @param it the iterator.
+ * @param map the map that will be iterated.
+ */
+void map_iterator_init(struct MapIterator *it, term map);
+
+/**
+ * @brief Gets the next key and value
+ *
+ * @param it the iterator.
+ * @param key where the key will be stored.
+ * @param value where the value will be stored.
+ * @return 1 if a key has been returned, 0 when there are no more keys.
+ */
+int map_iterator_next(struct MapIterator *it, term *key, term *value);
+
+#endif
@@ -22,7 +22,9 @@
 
 #include "context.h"
 #include "debug.h"
+#include "mailbox.h"
 #include "memory.h"
+#include "refc_binary.h"
 
 //#define ENABLE_TRACE
 
@@ -30,10 +32,31 @@
 
 #define MIN_FREE_SPACE_SIZE 16
 
+// a major collection is forced after this amount of minor collections
+#define FULLSWEEP_AFTER 16
+
+// smallest heap size chosen by the fibonacci and doubling growth strategies
+#define MIN_HEAP_GROWTH_SIZE 34
+// fibonacci growth is too aggressive above this size (in terms)
+#define FIBONACCI_GROWTH_LIMIT (1024 * 1024)
+
+// the heap is shrunk only after it has been mostly unused for this amount of collections in a row
+#define SHRINK_AFTER 4
+// a heap is mostly unused when less than 1 / HEAP_SHRINK_RATIO of it is used after a collection
+#define HEAP_SHRINK_RATIO 4
+// the heap is kept at least 1 / OLD_HEAP_RATIO of the used old heap, otherwise major collections, that copy all of
+// it, would run too often
+#define OLD_HEAP_RATIO 2
+
+// sub binaries smaller than 1 / SUB_BINARY_SHRINK_RATIO of their refc parent get their own copy when they are copied
+#define SUB_BINARY_SHRINK_RATIO 4
+
+#if REFC_BINARY_HANDLE_SIZE > TERM_BOXED_SUB_BINARY_SIZE
+    #error "A sub binary must be big enough to be replaced by a refc binary handle"
+#endif
+
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
-static void memory_scan_and_copy(term *mem_start, const term *mem_end, term **new_heap_pos, int move);
-static term memory_shallow_copy_term(term t, term **new_heap, int move);
 
 HOT_FUNC term *memory_heap_alloc(Context *c, uint32_t size)
 {
@@ -47,23 +70,137 @@ HOT_FUNC term *memory_heap_alloc(Context *c, uint32_t size)
     return allocated;
 }
 
+/*
+ * Returns the size of the memory block that is going to be allocated when at least needed terms are required,
+ * according to the growth strategy that has been chosen for the process.
+ */
+static unsigned long memory_next_heap_size(const Context *ctx, unsigned long needed)
+{
+    unsigned long size;
+
+    switch (ctx->heap_growth) {
+        case HEAP_GROWTH_MINIMUM:
+            size = needed;
+            break;
+
+        case HEAP_GROWTH_DOUBLING:
+            size = MIN_HEAP_GROWTH_SIZE;
+            while (size < needed) {
+                size *= 2;
+            }
+            break;
+
+        case HEAP_GROWTH_FIBONACCI:
+        default: {
+            unsigned long prev_size = MIN_HEAP_GROWTH_SIZE / 2;
+            size = MIN_HEAP_GROWTH_SIZE;
+            while (size < needed) {
+                if (size < FIBONACCI_GROWTH_LIMIT) {
+                    unsigned long next_size = size + prev_size;
+                    prev_size = size;
+                    size = next_size;
+                } else {
+                    // like BEAM, switch to 20% increments when the heap is already big
+                    size += size / 5;
+                }
+            }
+            break;
+        }
+    }
+
+    if (ctx->has_min_heap_size && (size < (unsigned long) ctx->min_heap_size)) {
+        size = ctx->min_heap_size;
+    }
+    if (ctx->has_max_heap_size && (size > (unsigned long) ctx->max_heap_size) && (needed <= (unsigned long) ctx->max_heap_size)) {
+        size = ctx->max_heap_size;
+    }
+
+    return size;
+}
+
+static inline int memory_needs_major_gc(const Context *ctx)
+{
+    unsigned long mature_size = ctx->heap_high_water_mark - ctx->heap_start;
+    unsigned long old_heap_free = ctx->old_heap_end - ctx->old_heap_ptr;
+
+    return (ctx->minor_gcs_since_major >= FULLSWEEP_AFTER) || (mature_size > old_heap_free);
+}
+
+static enum MemoryGCResult memory_collect(Context *ctx, int new_size, int num_roots, term *roots);
+
 enum MemoryGCResult memory_ensure_free(Context *c, uint32_t size)
+{
+    return memory_ensure_free_with_roots(c, size, 0, NULL);
+}
+
+enum MemoryGCResult memory_ensure_free_with_roots(Context *c, uint32_t size, int num_roots, term *roots)
 {
     size_t free_space = context_avail_free_memory(c);
-    if (free_space < size + MIN_FREE_SPACE_SIZE) {
-        size_t memory_size = context_memory_size(c);
-        if (UNLIKELY(memory_gc(c, memory_size + size + MIN_FREE_SPACE_SIZE) != MEMORY_GC_OK)) {
+    // live terms in heap fragments are moved to the heap, so they are accounted as if they were already there
+    if (free_space < size + MIN_FREE_SPACE_SIZE + c->heap_fragments_size) {
+        unsigned long memory_size = context_memory_size(c);
+        unsigned long stack_size = c->stack_base - c->e;
+        unsigned long mature_size = c->heap_high_water_mark - c->heap_start;
+        int major = memory_needs_major_gc(c);
+
+        // mature terms are moved to the old heap, so only younger terms might still be on the heap after the
+        // collection, a major collection leaves the heap empty instead.
+        unsigned long survivors = c->heap_fragments_size;
+        if (!major) {
+            survivors += c->heap_ptr - c->heap_high_water_mark;
+        }
+        // most young terms are garbage, so the heap is not grown to hold all of them together with the
+        // requested terms, otherwise it would grow after each major collection: it must just be big enough
+        // to copy them, and it is grown later if too many of them survived.
+        unsigned long needed = stack_size + size + MIN_FREE_SPACE_SIZE;
+        if (stack_size + survivors > memory_size) {
+            needed += survivors;
+        }
+        // most of the heap survived the last collection: grow it, otherwise collections would run back-to-back
+        if (mature_size * 4 > memory_size * 3) {
+            needed = MAX(needed, memory_size + 1);
+        }
+        needed = MAX(needed, (unsigned long) (c->old_heap_ptr - c->old_heap_start) / OLD_HEAP_RATIO);
+
+        unsigned long new_size = MAX(memory_next_heap_size(c, needed), stack_size + survivors);
+        if (new_size < memory_size) {
+            // shrinking is delayed until the heap has been mostly unused for a number of collections, and it is
+            // performed only by major collections, that know exactly how much memory is required
+            if (major && (c->heap_shrink_candidates >= SHRINK_AFTER)) {
+                new_size = MAX(new_size, memory_next_heap_size(c, memory_size / 2));
+                c->heap_shrink_candidates = 0;
+            } else {
+                new_size = memory_size;
+            }
+        }
+
+        enum MemoryGCResult result = memory_collect(c, new_size, num_roots, roots);
+        if (UNLIKELY(result != MEMORY_GC_OK)) {
             //TODO: handle this more gracefully
             TRACE("Unable to allocate memory for GC\n");
-            return MEMORY_GC_ERROR_FAILED_ALLOCATION;
+            return result;
         }
-        size_t new_free_space = context_avail_free_memory(c);
-        size_t new_minimum_free_space = 2 * (size + MIN_FREE_SPACE_SIZE);
-        if (new_free_space > new_minimum_free_space) {
-            size_t new_memory_size = context_memory_size(c);
-            if (UNLIKELY(memory_gc(c, (new_memory_size - new_free_space) + new_minimum_free_space) != MEMORY_GC_OK)) {
-                TRACE("Unable to allocate memory for GC shrink\n");
-                return MEMORY_GC_ERROR_FAILED_ALLOCATION;
+
+        // too many young terms survived: they are promoted by a second collection to a bigger heap
+        if (context_avail_free_memory(c) < size + MIN_FREE_SPACE_SIZE) {
+            needed = stack_size + size + MIN_FREE_SPACE_SIZE;
+            if (!c->has_max_heap_size || (context_memory_size(c) < (unsigned long) c->max_heap_size)) {
+                needed = MAX(needed, context_memory_size(c) + 1);
+            }
+            result = memory_collect(c, memory_next_heap_size(c, needed), num_roots, roots);
+            if (UNLIKELY(result != MEMORY_GC_OK)) {
+                TRACE("Unable to allocate memory for GC\n");
+                return result;
+            }
+            // the second collection left the heap empty, but it was too small
+            c->heap_shrink_candidates = 0;
+
+        } else {
+            unsigned long used_size = context_memory_size(c) - context_avail_free_memory(c) + size;
+            if (used_size * HEAP_SHRINK_RATIO < context_memory_size(c)) {
+                c->heap_shrink_candidates++;
+            } else {
+                c->heap_shrink_candidates = 0;
             }
         }
     }
@@ -74,7 +211,8 @@ enum MemoryGCResult memory_ensure_free(Context *c, uint32_t size)
 enum MemoryGCResult memory_gc_and_shrink(Context *c)
 {
     if (context_avail_free_memory(c) >= MIN_FREE_SPACE_SIZE * 2) {
-        if (UNLIKELY(memory_gc(c, context_memory_size(c) - context_avail_free_memory(c) / 2) != MEMORY_GC_OK)) {
+        unsigned long new_size = context_memory_size(c) - context_avail_free_memory(c) / 2 + c->heap_fragments_size;
+        if (UNLIKELY(memory_gc(c, new_size) != MEMORY_GC_OK)) {
             fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
         }
     }
@@ -88,60 +226,108 @@ static inline void push_to_stack(term **stack, term value)
     **stack = value;
 }
 
-enum MemoryGCResult memory_gc(Context *ctx, int new_size)
+// memory area of a heap fragment, fragments are sorted by address during a collection
+struct FragmentRange
 {
-    TRACE("Going to perform gc\n");
+    const term *start;
+    const term *end;
+};
 
-    if (UNLIKELY(ctx->has_max_heap_size && (new_size > ctx->max_heap_size))) {
-        return MEMORY_GC_DENIED_ALLOCATION;
-    }
+/*
+ * Describes an ongoing copy: terms that are found in the collected memory areas are moved to the destination
+ * heaps, while terms that live anywhere else (such as module literals) are shared.
+ * When no memory area is being collected (from_start is NULL) terms are copied wherever they live.
+ */
+struct CopyState
+{
+    // young generation that is being collected
+    const term *from_start;
+    const term *from_end;
 
-    term *new_heap = calloc(new_size, sizeof(term));
-    if (IS_NULL_PTR(new_heap)) {
-        return MEMORY_GC_ERROR_FAILED_ALLOCATION;
-    }
-    term *new_stack = new_heap + new_size;
+    // young terms below this address survived a previous collection and they are promoted
+    const term *mature_end;
 
-    term *heap_ptr = new_heap;
-    term *stack_ptr = new_stack;
+    // old generation, it is collected only during a major collection
+    const term *old_from_start;
+    const term *old_from_end;
+
+    // heap fragments are collected together with the young generation, their terms are promoted by major
+    // collections, since terms that reference them are promoted as well
+    const struct FragmentRange *fragments;
+    int fragments_count;
+    int promote_fragments;
+
+    term *heap_ptr;
+    term *old_heap_ptr;
+
+    // off-heap list where new binary handles are added
+    term **off_heap_binaries;
+
+    int move;
+};
 
+static void memory_scan_and_copy(term *mem_start, const term *mem_end, struct CopyState *state);
+static term memory_shallow_copy_term(term t, struct CopyState *state);
+
+static void memory_copy_roots(Context *ctx, term *new_stack, int num_roots, term *roots, struct CopyState *state)
+{
     TRACE("- Running copy GC on registers\n");
     for (int i = 0; i < ctx->avail_registers; i++) {
-        term new_root = memory_shallow_copy_term(ctx->x[i], &heap_ptr, 1);
-        ctx->x[i] = new_root;
+        ctx->x[i] = memory_shallow_copy_term(ctx->x[i], state);
+    }
+    ctx->bs = memory_shallow_copy_term(ctx->bs, state);
+    for (int i = 0; i < num_roots; i++) {
+        roots[i] = memory_shallow_copy_term(roots[i], state);
+    }
+
+    if (ctx->mailbox_heap_messages) {
+        TRACE("- Running copy GC on messages examined by receive\n");
+        struct ListHead *item = ctx->mailbox;
+        do {
+            Message *m = GET_LIST_ENTRY(item, Message, mailbox_list_head);
+            if (m->on_heap) {
+                m->message = memory_shallow_copy_term(m->message, state);
+            }
+            item = item->next;
+        } while (item != ctx->mailbox);
     }
 
     term *stack = ctx->e;
+    term *stack_ptr = new_stack;
     int stack_size = ctx->stack_base - ctx->e;
     TRACE("- Running copy GC on stack (stack size: %i)\n", stack_size);
     for (int i = stack_size - 1; i >= 0; i--) {
-        term new_root = memory_shallow_copy_term(stack[i], &heap_ptr, 1);
+        term new_root = memory_shallow_copy_term(stack[i], state);
         push_to_stack(&stack_ptr, new_root);
     }
+}
 
-    term *temp_start = new_heap;
-    term *temp_end = heap_ptr;
-    do {
-        term *next_end = temp_end;
-        memory_scan_and_copy(temp_start, temp_end, &next_end, 1);
-        temp_start = temp_end;
-        temp_end = next_end;
-    } while (temp_start != temp_end);
+static void memory_scan_copied_terms(term *young_scan, term *old_scan, struct CopyState *state)
+{
+    while ((young_scan != state->heap_ptr) || (old_scan != state->old_heap_ptr)) {
+        term *young_end = state->heap_ptr;
+        memory_scan_and_copy(young_scan, young_end, state);
+        young_scan = young_end;
+
+        term *old_end = state->old_heap_ptr;
+        memory_scan_and_copy(old_scan, old_end, state);
+        old_scan = old_end;
+    }
+}
 
-    heap_ptr = temp_end;
+static void memory_replace_heap(Context *ctx, term *new_heap, int new_size, term *heap_ptr)
+{
+    int stack_size = ctx->stack_base - ctx->e;
 
     free(ctx->heap_start);
 
     ctx->heap_start = new_heap;
     ctx->stack_base = ctx->heap_start + new_size;
     ctx->heap_ptr = heap_ptr;
-    ctx->e = stack_ptr;
-
-    return MEMORY_GC_OK;
+    ctx->e = ctx->stack_base - stack_size;
 }
 
-
-static inline int memory_is_moved_marker(term *t)
+static inline int memory_is_moved_marker(const term *t)
 {
     // 0x2B is an unused tag
     return *t == 0x2B;
@@ -158,22 +344,370 @@ static inline term memory_dereference_moved_marker(const term *moved_marker)
     return moved_marker[1];
 }
 
-term memory_copy_term_tree(term **new_heap, term t)
+static inline void memory_off_heap_link(term **off_heap_binaries, term *handle)
+{
+    handle[REFC_BINARY_HANDLE_NEXT_INDEX] = (term) *off_heap_binaries;
+    *off_heap_binaries = handle;
+}
+
+/*
+ * Walks a list of binary handles that were in the collected memory: handles that have been moved are added to the list
+ * of the generation they have been moved to, the others are garbage and their binary reference is released.
+ * It must be called before the collected memory is freed.
+ */
+static void memory_sweep_off_heap_binaries(Context *ctx, term *handle, const term *old_heap_start, const term *old_heap_end)
+{
+    while (handle) {
+        term *next = (term *) handle[REFC_BINARY_HANDLE_NEXT_INDEX];
+
+        if (memory_is_moved_marker(handle)) {
+            term *new_handle = term_to_term_ptr(memory_dereference_moved_marker(handle));
+            if ((new_handle >= old_heap_start) && (new_handle < old_heap_end)) {
+                memory_off_heap_link(&ctx->old_off_heap_binaries, new_handle);
+            } else {
+                memory_off_heap_link(&ctx->off_heap_binaries, new_handle);
+            }
+        } else {
+            refc_binary_decrement_refcount((struct RefcBinary *) handle[REFC_BINARY_HANDLE_REFC_INDEX]);
+        }
+
+        handle = next;
+    }
+}
+
+/*
+ * Adds handles that have been created during a collection to the list of the generation they belong to.
+ */
+static void memory_link_new_off_heap_binaries(Context *ctx, term *handle, const term *old_heap_start, const term *old_heap_end)
+{
+    while (handle) {
+        term *next = (term *) handle[REFC_BINARY_HANDLE_NEXT_INDEX];
+
+        if ((handle >= old_heap_start) && (handle < old_heap_end)) {
+            memory_off_heap_link(&ctx->old_off_heap_binaries, handle);
+        } else {
+            memory_off_heap_link(&ctx->off_heap_binaries, handle);
+        }
+
+        handle = next;
+    }
+}
+
+void memory_release_off_heap_binaries(term *handle)
+{
+    while (handle) {
+        term *next = (term *) handle[REFC_BINARY_HANDLE_NEXT_INDEX];
+        refc_binary_decrement_refcount((struct RefcBinary *) handle[REFC_BINARY_HANDLE_REFC_INDEX]);
+        handle = next;
+    }
+}
+
+void memory_attach_heap_fragment(Context *ctx, HeapFragment *fragment)
+{
+    fragment->next = ctx->heap_fragments;
+    ctx->heap_fragments = fragment;
+    ctx->heap_fragments_size += fragment->heap_end - fragment->heap_start;
+}
+
+static void memory_free_heap_fragment(HeapFragment *fragment)
+{
+    if (fragment->retained) {
+        fragment->next = NULL;
+        fragment->heap_start = NULL;
+        fragment->heap_end = NULL;
+        fragment->off_heap_binaries = NULL;
+    } else {
+        free(fragment);
+    }
+}
+
+void memory_release_heap_fragments(HeapFragment *fragment)
+{
+    while (fragment) {
+        HeapFragment *next = fragment->next;
+        memory_release_off_heap_binaries(fragment->off_heap_binaries);
+        memory_free_heap_fragment(fragment);
+        fragment = next;
+    }
+}
+
+static int memory_compare_fragment_ranges(const void *a, const void *b)
+{
+    const struct FragmentRange *range_a = (const struct FragmentRange *) a;
+    const struct FragmentRange *range_b = (const struct FragmentRange *) b;
+
+    if (range_a->start < range_b->start) {
+        return -1;
+    } else if (range_a->start > range_b->start) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/*
+ * Prepares the sorted list of heap fragment areas used by memory_copy_destination, it returns 0 when it cannot be
+ * allocated. The list must be freed once the collection is over.
+ */
+static int memory_prepare_fragment_ranges(Context *ctx, struct CopyState *state)
+{
+    state->fragments = NULL;
+    state->fragments_count = 0;
+    if (!ctx->heap_fragments) {
+        return 1;
+    }
+
+    int count = 0;
+    for (HeapFragment *fragment = ctx->heap_fragments; fragment; fragment = fragment->next) {
+        count++;
+    }
+
+    struct FragmentRange *ranges = malloc(count * sizeof(struct FragmentRange));
+    if (IS_NULL_PTR(ranges)) {
+        return 0;
+    }
+    int i = 0;
+    for (HeapFragment *fragment = ctx->heap_fragments; fragment; fragment = fragment->next) {
+        ranges[i].start = fragment->heap_start;
+        ranges[i].end = fragment->heap_end;
+        i++;
+    }
+    qsort(ranges, count, sizeof(struct FragmentRange), memory_compare_fragment_ranges);
+
+    state->fragments = ranges;
+    state->fragments_count = count;
+
+    return 1;
+}
+
+static inline int memory_is_in_fragment(const term *ptr, const struct CopyState *state)
+{
+    int low = 0;
+    int high = state->fragments_count - 1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (ptr < state->fragments[middle].start) {
+            high = middle - 1;
+        } else if (ptr >= state->fragments[middle].end) {
+            low = middle + 1;
+        } else {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Frees the heap fragments once their live terms have been moved, binary handles stored in them are swept like
+ * the ones on the collected heap.
+ */
+static void memory_sweep_heap_fragments(Context *ctx, struct CopyState *state, const term *old_heap_start, const term *old_heap_end)
+{
+    HeapFragment *fragment = ctx->heap_fragments;
+    while (fragment) {
+        HeapFragment *next = fragment->next;
+        memory_sweep_off_heap_binaries(ctx, fragment->off_heap_binaries, old_heap_start, old_heap_end);
+        memory_free_heap_fragment(fragment);
+        fragment = next;
+    }
+    ctx->heap_fragments = NULL;
+    ctx->heap_fragments_size = 0;
+
+    free((void *) state->fragments);
+}
+
+term memory_alloc_refc_binary(Context *ctx, struct RefcBinary *refc)
+{
+    term *boxed_value = memory_heap_alloc(ctx, REFC_BINARY_HANDLE_SIZE);
+    boxed_value[0] = ((REFC_BINARY_HANDLE_SIZE - 1) << 6) | TERM_BOXED_REFC_BINARY;
+    boxed_value[1] = refc->used;
+    boxed_value[REFC_BINARY_HANDLE_REFC_INDEX] = (term) refc;
+    memory_off_heap_link(&ctx->off_heap_binaries, boxed_value);
+
+    return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+}
+
+/*
+ * Minor collection: only the young heap is collected. Terms that already survived a collection
+ * (they are below the high water mark) are promoted to the old heap, that is never scanned:
+ * terms are immutable so old terms can only reference older terms.
+ */
+static enum MemoryGCResult memory_minor_gc(Context *ctx, int new_size, int num_roots, term *roots)
+{
+    TRACE("- Minor GC\n");
+
+    struct CopyState state;
+    if (UNLIKELY(!memory_prepare_fragment_ranges(ctx, &state))) {
+        return MEMORY_GC_ERROR_FAILED_ALLOCATION;
+    }
+
+    term *new_heap = calloc(new_size, sizeof(term));
+    if (IS_NULL_PTR(new_heap)) {
+        free((void *) state.fragments);
+        return MEMORY_GC_ERROR_FAILED_ALLOCATION;
+    }
+
+    state.from_start = ctx->heap_start;
+    state.from_end = ctx->heap_ptr;
+    // fragments have been attached after the last collection, so mature terms can't reference them
+    state.mature_end = ctx->heap_high_water_mark;
+    state.promote_fragments = 0;
+    state.old_from_start = NULL;
+    state.old_from_end = NULL;
+    state.heap_ptr = new_heap;
+    state.old_heap_ptr = ctx->old_heap_ptr;
+    term *new_binaries = NULL;
+    state.off_heap_binaries = &new_binaries;
+    state.move = 1;
+
+    term *old_scan = ctx->old_heap_ptr;
+
+    memory_copy_roots(ctx, new_heap + new_size, num_roots, roots, &state);
+    memory_scan_copied_terms(new_heap, old_scan, &state);
+
+    term *young_binaries = ctx->off_heap_binaries;
+    ctx->off_heap_binaries = NULL;
+    memory_sweep_off_heap_binaries(ctx, young_binaries, ctx->old_heap_start, ctx->old_heap_end);
+    memory_sweep_heap_fragments(ctx, &state, ctx->old_heap_start, ctx->old_heap_end);
+    memory_link_new_off_heap_binaries(ctx, new_binaries, ctx->old_heap_start, ctx->old_heap_end);
+
+    ctx->stats.copied_words += (state.heap_ptr - new_heap) + (state.old_heap_ptr - old_scan);
+
+    memory_replace_heap(ctx, new_heap, new_size, state.heap_ptr);
+    ctx->old_heap_ptr = state.old_heap_ptr;
+    ctx->heap_high_water_mark = ctx->heap_ptr;
+
+    ctx->stats.minor_gcs++;
+    ctx->minor_gcs_since_major++;
+
+    return MEMORY_GC_OK;
+}
+
+/*
+ * Major collection: both generations are collected and every live term is moved to a new old heap,
+ * so the young heap is left empty.
+ */
+static enum MemoryGCResult memory_major_gc(Context *ctx, int new_size, int num_roots, term *roots)
+{
+    TRACE("- Major GC\n");
+
+    // leave room for terms that will be promoted by the next minor collections
+    unsigned long old_heap_size = memory_next_heap_size(ctx, context_heap_size(ctx) + ctx->heap_fragments_size + new_size);
+
+    struct CopyState state;
+    if (UNLIKELY(!memory_prepare_fragment_ranges(ctx, &state))) {
+        return MEMORY_GC_ERROR_FAILED_ALLOCATION;
+    }
+
+    term *new_old_heap = calloc(old_heap_size, sizeof(term));
+    if (IS_NULL_PTR(new_old_heap)) {
+        free((void *) state.fragments);
+        return MEMORY_GC_ERROR_FAILED_ALLOCATION;
+    }
+    term *new_heap = calloc(new_size, sizeof(term));
+    if (IS_NULL_PTR(new_heap)) {
+        free(new_old_heap);
+        free((void *) state.fragments);
+        return MEMORY_GC_ERROR_FAILED_ALLOCATION;
+    }
+
+    state.from_start = ctx->heap_start;
+    state.from_end = ctx->heap_ptr;
+    state.mature_end = ctx->heap_ptr;
+    state.promote_fragments = 1;
+    state.old_from_start = ctx->old_heap_start;
+    state.old_from_end = ctx->old_heap_ptr;
+    state.heap_ptr = new_heap;
+    state.old_heap_ptr = new_old_heap;
+    term *new_binaries = NULL;
+    state.off_heap_binaries = &new_binaries;
+    state.move = 1;
+
+    memory_copy_roots(ctx, new_heap + new_size, num_roots, roots, &state);
+    memory_scan_copied_terms(new_heap, new_old_heap, &state);
+
+    term *young_binaries = ctx->off_heap_binaries;
+    term *old_binaries = ctx->old_off_heap_binaries;
+    ctx->off_heap_binaries = NULL;
+    ctx->old_off_heap_binaries = NULL;
+    memory_sweep_off_heap_binaries(ctx, young_binaries, new_old_heap, new_old_heap + old_heap_size);
+    memory_sweep_off_heap_binaries(ctx, old_binaries, new_old_heap, new_old_heap + old_heap_size);
+    memory_sweep_heap_fragments(ctx, &state, new_old_heap, new_old_heap + old_heap_size);
+    memory_link_new_off_heap_binaries(ctx, new_binaries, new_old_heap, new_old_heap + old_heap_size);
+
+    ctx->stats.copied_words += (state.heap_ptr - new_heap) + (state.old_heap_ptr - new_old_heap);
+
+    memory_replace_heap(ctx, new_heap, new_size, state.heap_ptr);
+    ctx->heap_high_water_mark = ctx->heap_ptr;
+
+    free(ctx->old_heap_start);
+    ctx->old_heap_start = new_old_heap;
+    ctx->old_heap_ptr = state.old_heap_ptr;
+    ctx->old_heap_end = new_old_heap + old_heap_size;
+
+    ctx->stats.major_gcs++;
+    ctx->minor_gcs_since_major = 0;
+
+    return MEMORY_GC_OK;
+}
+
+static enum MemoryGCResult memory_collect(Context *ctx, int new_size, int num_roots, term *roots)
+{
+    TRACE("Going to perform gc\n");
+
+    if (UNLIKELY(ctx->has_max_heap_size && (new_size > ctx->max_heap_size))) {
+        return MEMORY_GC_DENIED_ALLOCATION;
+    }
+
+    if (memory_needs_major_gc(ctx)) {
+        return memory_major_gc(ctx, new_size, num_roots, roots);
+    } else {
+        return memory_minor_gc(ctx, new_size, num_roots, roots);
+    }
+}
+
+enum MemoryGCResult memory_gc(Context *ctx, int new_size)
+{
+    return memory_collect(ctx, new_size, 0, NULL);
+}
+
+enum MemoryGCResult memory_full_gc(Context *ctx, int new_size)
+{
+    TRACE("Going to perform full gc\n");
+
+    if (UNLIKELY(ctx->has_max_heap_size && (new_size > ctx->max_heap_size))) {
+        return MEMORY_GC_DENIED_ALLOCATION;
+    }
+
+    return memory_major_gc(ctx, new_size, 0, NULL);
+}
+
+
+term memory_copy_term_tree(term **new_heap, term t, term **off_heap_binaries)
 {
     TRACE("Copy term tree: 0x%lx, heap: 0x%p\n", t, *new_heap);
 
-    term *temp_start = *new_heap;
-    term copied_term = memory_shallow_copy_term(t, new_heap, 0);
-    term *temp_end = *new_heap;
+    struct CopyState state;
+    state.from_start = NULL;
+    state.from_end = NULL;
+    state.mature_end = NULL;
+    state.old_from_start = NULL;
+    state.old_from_end = NULL;
+    state.fragments = NULL;
+    state.fragments_count = 0;
+    state.promote_fragments = 0;
+    state.heap_ptr = *new_heap;
+    state.old_heap_ptr = NULL;
+    state.off_heap_binaries = off_heap_binaries;
+    state.move = 0;
 
-    do {
-        term *next_end = temp_end;
-        memory_scan_and_copy(temp_start, temp_end, &next_end, 0);
-        temp_start = temp_end;
-        temp_end = next_end;
-    } while (temp_start != temp_end);
+    term *temp_start = *new_heap;
+    term copied_term = memory_shallow_copy_term(t, &state);
+    memory_scan_copied_terms(temp_start, NULL, &state);
 
-    *new_heap = temp_end;
+    *new_heap = state.heap_ptr;
 
     return copied_term;
 }
@@ -275,6 +809,24 @@ unsigned long memory_estimate_usage(term t)
                 t = term_nil();
             }
 
+        } else if (term_is_map(t) || term_is_hashmap_node(t)) {
+            const term *boxed_value = term_to_const_term_ptr(t);
+            int boxed_size = term_boxed_size(t);
+            acc += boxed_size + 1;
+
+            for (int i = 2; i <= boxed_size; i++) {
+                temp_stack_push(&temp_stack, boxed_value[i]);
+            }
+            t = boxed_value[1];
+
+        } else if (term_is_sub_binary(t)) {
+            acc += TERM_BOXED_SUB_BINARY_SIZE;
+            t = term_get_sub_binary_parent(t);
+
+        } else if (term_is_bin_match_state(t)) {
+            acc += term_boxed_size(t) + 1;
+            t = term_get_bin_match_state_binary(t);
+
         } else if (term_is_boxed(t)) {
             acc += term_boxed_size(t) + 1;
             t = temp_stack_pop(&temp_stack);
@@ -295,10 +847,9 @@ unsigned long memory_estimate_usage(term t)
     return acc;
 }
 
-static void memory_scan_and_copy(term *mem_start, const term *mem_end, term **new_heap_pos, int move)
+static void memory_scan_and_copy(term *mem_start, const term *mem_end, struct CopyState *state)
 {
     term *ptr = mem_start;
-    term *new_heap = *new_heap_pos;
 
     while (ptr < mem_end) {
         term t = *ptr;
@@ -329,15 +880,39 @@ static void memory_scan_and_copy(term *mem_start, const term *mem_end, term **ne
 
                     for (int i = 1; i <= arity; i++) {
                         TRACE("-- Elem: %lx\n", ptr[i]);
-                        ptr[i] = memory_shallow_copy_term(ptr[i], &new_heap, move);
+                        ptr[i] = memory_shallow_copy_term(ptr[i], state);
+                    }
+                    break;
+                }
+
+                case TERM_BOXED_MAP:
+                case TERM_BOXED_HASHMAP:
+                case TERM_BOXED_HASHMAP_NODE: {
+                    int map_size = term_get_size_from_boxed_header(t);
+                    TRACE("- Found map or map node (%lx), size: %i\n", t, map_size);
+
+                    // sizes and bitmaps are stored as integers, so all of them are terms
+                    for (int i = 1; i <= map_size; i++) {
+                        ptr[i] = memory_shallow_copy_term(ptr[i], state);
                     }
                     break;
                 }
 
+                case TERM_BOXED_BIN_MATCH_STATE:
+                    TRACE("- Found match state.\n");
+                    // saved offsets are raw values, the matched binary is the only term
+                    ptr[BIN_MATCH_STATE_BINARY_INDEX] = memory_shallow_copy_term(ptr[BIN_MATCH_STATE_BINARY_INDEX], state);
+                    break;
+
                 case TERM_BOXED_REF:
                     TRACE("- Found ref.\n");
                     break;
 
+                case TERM_BOXED_POSITIVE_INTEGER:
+                case TERM_BOXED_NEGATIVE_INTEGER:
+                    TRACE("- Found boxed integer.\n");
+                    break;
+
                 case TERM_BOXED_FUN: {
                     int fun_size = term_get_size_from_boxed_header(t);
                     TRACE("- Found fun, size: %i.\n", fun_size);
@@ -346,7 +921,7 @@ static void memory_scan_and_copy(term *mem_start, const term *mem_end, term **ne
 
                     for (int i = 3; i <= fun_size; i++) {
                         TRACE("-- Frozen: %lx\n", ptr[i]);
-                        ptr[i] = memory_shallow_copy_term(ptr[i], &new_heap, move);
+                        ptr[i] = memory_shallow_copy_term(ptr[i], state);
                     }
                     break;
                 }
@@ -355,6 +930,15 @@ static void memory_scan_and_copy(term *mem_start, const term *mem_end, term **ne
                     TRACE("- Found binary.\n");
                     break;
 
+                case TERM_BOXED_REFC_BINARY:
+                    TRACE("- Found refc binary.\n");
+                    break;
+
+                case TERM_BOXED_SUB_BINARY:
+                    TRACE("- Found sub binary.\n");
+                    ptr[SUB_BINARY_PARENT_INDEX] = memory_shallow_copy_term(ptr[SUB_BINARY_PARENT_INDEX], state);
+                    break;
+
                 default:
                     fprintf(stderr, "- Found unknown boxed type: %lx\n", (t >> 2) & 0xF);
                     abort();
@@ -364,12 +948,12 @@ static void memory_scan_and_copy(term *mem_start, const term *mem_end, term **ne
 
         } else if (term_is_nonempty_list(t)) {
             TRACE("Found nonempty list (%lx)\n", t);
-            *ptr = memory_shallow_copy_term(t, &new_heap, move);
+            *ptr = memory_shallow_copy_term(t, state);
             ptr++;
 
         } else if (term_is_boxed(t)) {
             TRACE("Found boxed (%lx)\n", t);
-            *ptr = memory_shallow_copy_term(t, &new_heap, move);
+            *ptr = memory_shallow_copy_term(t, state);
             ptr++;
 
         } else {
@@ -377,11 +961,80 @@ static void memory_scan_and_copy(term *mem_start, const term *mem_end, term **ne
             abort();
         }
     }
+}
+
+/*
+ * Copies the data of a sub binary that references a small part of a big refc binary to a new refc binary, so the big
+ * one can be released. The new handle has the same size of a sub binary, so copied memory does not grow.
+ * Returns an invalid term when the parent has to be retained instead.
+ */
+static term memory_shrink_sub_binary(term *sub_binary, term **new_heap, struct CopyState *state)
+{
+    const term *parent = term_to_const_term_ptr(sub_binary[SUB_BINARY_PARENT_INDEX]);
+    if (memory_is_moved_marker(parent)) {
+        parent = term_to_const_term_ptr(memory_dereference_moved_marker(parent));
+    }
+    if ((parent[0] & TERM_BOXED_TAG_MASK) != TERM_BOXED_REFC_BINARY) {
+        return term_invalid_term();
+    }
+
+    const struct RefcBinary *parent_refc = (const struct RefcBinary *) parent[REFC_BINARY_HANDLE_REFC_INDEX];
+    uint32_t len = sub_binary[1];
+    if (len * SUB_BINARY_SHRINK_RATIO >= parent_refc->size) {
+        return term_invalid_term();
+    }
+
+    struct RefcBinary *refc = refc_binary_create(parent_refc->data + sub_binary[SUB_BINARY_OFFSET_INDEX], len);
+    if (IS_NULL_PTR(refc)) {
+        return term_invalid_term();
+    }
+
+    term *dest = *new_heap;
+    dest[0] = ((REFC_BINARY_HANDLE_SIZE - 1) << 6) | TERM_BOXED_REFC_BINARY;
+    dest[1] = len;
+    dest[REFC_BINARY_HANDLE_REFC_INDEX] = (term) refc;
+    memory_off_heap_link(state->off_heap_binaries, dest);
+    *new_heap += REFC_BINARY_HANDLE_SIZE;
+
+    term new_term = ((term) dest) | TERM_BOXED_VALUE_TAG;
+
+    if (state->move) {
+        memory_replace_with_moved_marker(sub_binary, new_term);
+    }
+
+    return new_term;
+}
+
+/*
+ * Returns the memory area where a copy of the term pointed by ptr has to be allocated,
+ * or NULL when the term is not part of the collected memory and it can be shared.
+ */
+static inline term **memory_copy_destination(const term *ptr, struct CopyState *state)
+{
+    if (!state->move) {
+        return &state->heap_ptr;
+    }
+
+    if ((ptr >= state->from_start) && (ptr < state->from_end)) {
+        if (ptr < state->mature_end) {
+            return &state->old_heap_ptr;
+        } else {
+            return &state->heap_ptr;
+        }
+    }
+
+    if ((ptr >= state->old_from_start) && (ptr < state->old_from_end)) {
+        return &state->old_heap_ptr;
+    }
+
+    if (state->fragments_count && memory_is_in_fragment(ptr, state)) {
+        return state->promote_fragments ? &state->old_heap_ptr : &state->heap_ptr;
+    }
 
-    *new_heap_pos = new_heap;
+    return NULL;
 }
 
-HOT_FUNC static term memory_shallow_copy_term(term t, term **new_heap, int move)
+HOT_FUNC static term memory_shallow_copy_term(term t, struct CopyState *state)
 {
     if (term_is_atom(t)) {
         return t;
@@ -406,10 +1059,22 @@ HOT_FUNC static term memory_shallow_copy_term(term t, term **new_heap, int move)
     } else if (term_is_boxed(t)) {
         term *boxed_value = term_to_term_ptr(t);
 
+        term **new_heap = memory_copy_destination(boxed_value, state);
+        if (!new_heap) {
+            return t;
+        }
+
         if (memory_is_moved_marker(boxed_value)) {
             return memory_dereference_moved_marker(boxed_value);
         }
 
+        if ((boxed_value[0] & TERM_BOXED_TAG_MASK) == TERM_BOXED_SUB_BINARY) {
+            term shrunk = memory_shrink_sub_binary(boxed_value, new_heap, state);
+            if (!term_is_invalid_term(shrunk)) {
+                return shrunk;
+            }
+        }
+
         int boxed_size = term_boxed_size(t) + 1;
         term *dest = *new_heap;
         for (int i = 0; i < boxed_size; i++) {
@@ -419,8 +1084,12 @@ HOT_FUNC static term memory_shallow_copy_term(term t, term **new_heap, int move)
 
         term new_term = ((term) dest) | TERM_BOXED_VALUE_TAG;
 
-        if (move) {
+        if (state->move) {
             memory_replace_with_moved_marker(boxed_value, new_term);
+        } else if ((dest[0] & TERM_BOXED_TAG_MASK) == TERM_BOXED_REFC_BINARY) {
+            // a copy is a new reference to the same binary
+            refc_binary_increment_refcount((struct RefcBinary *) dest[REFC_BINARY_HANDLE_REFC_INDEX]);
+            memory_off_heap_link(state->off_heap_binaries, dest);
         }
 
         return new_term;
@@ -428,6 +1097,11 @@ HOT_FUNC static term memory_shallow_copy_term(term t, term **new_heap, int move)
     } else if (term_is_nonempty_list(t)) {
         term *list_ptr = term_get_list_ptr(t);
 
+        term **new_heap = memory_copy_destination(list_ptr, state);
+        if (!new_heap) {
+            return t;
+        }
+
         if (memory_is_moved_marker(list_ptr)) {
             return memory_dereference_moved_marker(list_ptr);
         }
@@ -439,7 +1113,7 @@ HOT_FUNC static term memory_shallow_copy_term(term t, term **new_heap, int move)
 
         term new_term = ((term) dest) | 0x1;
 
-        if (move) {
+        if (state->move) {
             memory_replace_with_moved_marker(list_ptr, new_term);
         }
 
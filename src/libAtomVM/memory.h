@@ -25,13 +25,31 @@
 
 #include <stdint.h>
 
-#define HEAP_NEED_GC_SHRINK_THRESHOLD_COEFF 64
-
 #ifndef TYPEDEF_CONTEXT
 #define TYPEDEF_CONTEXT
 typedef struct Context Context;
 #endif
 
+struct RefcBinary;
+
+/**
+ * @brief a block of terms that is part of a process heap but that has been allocated separately
+ *
+ * @details heap fragments let terms that have been built somewhere else, such as received messages, become part of a
+ * process heap without copying them again. Next collection moves their live terms to the heap and frees them, so a
+ * fragment must be at the beginning of a block allocated with malloc.
+ */
+typedef struct HeapFragment
+{
+    struct HeapFragment *next;
+    term *heap_start;
+    term *heap_end;
+    // handles to reference counted binaries stored in the fragment
+    term *off_heap_binaries;
+    // set while the block is still used by its owner: it is not freed, heap_start is set to NULL instead
+    int retained;
+} HeapFragment;
+
 enum MemoryGCResult
 {
     MEMORY_GC_OK = 0,
@@ -39,6 +57,16 @@ enum MemoryGCResult
     MEMORY_GC_DENIED_ALLOCATION = 2
 };
 
+/**
+ * @brief strategy used to choose the new heap size when a process heap has to grow
+ */
+enum HeapGrowthStrategy
+{
+    HEAP_GROWTH_FIBONACCI = 0,
+    HEAP_GROWTH_DOUBLING = 1,
+    HEAP_GROWTH_MINIMUM = 2
+};
+
 /**
  * @brief allocates space for a certain ammount of terms on the heap
  *
@@ -53,31 +81,102 @@ MALLOC_LIKE term *memory_heap_alloc(Context *ctx, uint32_t size);
  * @brief allocates a new memory block and executes garbage collection
  *
  * @details allocates a new memory block (that can have new size) and executes garbage collection, any existing term might be invalid after this call.
+ * A minor collection is performed when possible: terms that survived the previous collection are promoted to the old heap,
+ * a major collection of both generations is performed when the old heap is full or after a number of minor collections.
+ * Live terms in heap fragments are moved to the new memory block, that must have room for them, and fragments are freed.
  * @param ctx the context that owns the memory block.
  * @param new_size the size of the new memory block in term units.
  * @returns MEMORY_GC_OK when successful.
  */
 enum MemoryGCResult memory_gc(Context *ctx, int new_size);
 
+/**
+ * @brief allocates a new memory block and executes a major garbage collection
+ *
+ * @details like memory_gc, but both the young and the old generation are collected, any existing term might be invalid after this call.
+ * @param ctx the context that owns the memory block.
+ * @param new_size the size of the new memory block in term units.
+ * @returns MEMORY_GC_OK when successful.
+ */
+enum MemoryGCResult memory_full_gc(Context *ctx, int new_size);
+
 /**
  * @brief copies a term to a destination heap
  *
  * @details deep copies a term to a destination heap, once finished old memory can be freed.
+ * Reference counted binaries are not copied: their reference count is incremented and the new handles are added to the
+ * given off-heap list.
  * @param new_heap the destination heap where terms will be copied.
+ * @param t the term that will be copied.
+ * @param off_heap_binaries the off-heap list of the destination heap.
  * @returns a new term that is stored on the new heap.
  */
-term memory_copy_term_tree(term **new_heap, term t);
+term memory_copy_term_tree(term **new_heap, term t, term **off_heap_binaries);
+
+/**
+ * @brief allocates a handle for a reference counted binary on the heap
+ *
+ * @details allocates REFC_BINARY_HANDLE_SIZE terms on the heap for a handle that points to the given binary, the handle is
+ * added to the context off-heap list so the binary reference is released when the handle is garbage collected.
+ * @param ctx the context that owns the heap, REFC_BINARY_HANDLE_SIZE terms must be already available.
+ * @param refc the binary, ownership of one reference is transferred to the handle.
+ * @returns a binary term.
+ */
+term memory_alloc_refc_binary(Context *ctx, struct RefcBinary *refc);
+
+/**
+ * @brief releases binaries referenced by an off-heap list
+ *
+ * @details decrements the reference count of every binary referenced by the handles in the list, it should be called
+ * when the memory that holds the handles is going to be freed.
+ * @param off_heap_binaries the first handle of the list or NULL.
+ */
+void memory_release_off_heap_binaries(term *off_heap_binaries);
+
+/**
+ * @brief attaches a heap fragment to a process heap
+ *
+ * @details terms stored in the fragment become part of the process heap and they are valid until they are garbage
+ * collected. The fragment and references to the binaries in its off-heap list are owned by the context from now on.
+ * @param ctx the context that owns the heap.
+ * @param fragment the fragment, the memory block that contains it will be freed by the garbage collector.
+ */
+void memory_attach_heap_fragment(Context *ctx, HeapFragment *fragment);
+
+/**
+ * @brief frees a list of heap fragments
+ *
+ * @details frees the fragments and releases binaries referenced by their off-heap lists, it should be called when
+ * terms stored in the fragments are not used anymore. Retained fragments are emptied but not freed.
+ * @param fragment the first fragment of the list or NULL.
+ */
+void memory_release_heap_fragments(HeapFragment *fragment);
 
 /**
  * @brief meakes sure that the given context has given free memory
  *
  * @details this function makes sure that at least size terms are available, when not available gc will be performed, any existing term might be invalid after this call.
+ * Collection is performed also when heap fragments are bigger than the free memory, so they don't grow without bounds.
+ * The new heap size is chosen according to the process heap growth strategy, min_heap_size and max_heap_size, the heap is
+ * shrunk only when it has been mostly unused for a number of collections in a row.
 
  * @param ctx the target context.
  * @param size needed available memory.
  */
 enum MemoryGCResult memory_ensure_free(Context *ctx, uint32_t size) MUST_CHECK;
 
+/**
+ * @brief makes sure that the given context has given free memory, keeping additional terms alive
+ *
+ * @details like memory_ensure_free, but also the given terms are used as roots, so terms that are not stored in a
+ * register or on the stack survive a garbage collection. They are updated in place when they are moved.
+ * @param ctx the target context.
+ * @param size needed available memory.
+ * @param num_roots the number of terms in roots.
+ * @param roots terms that are going to be used after this call.
+ */
+enum MemoryGCResult memory_ensure_free_with_roots(Context *ctx, uint32_t size, int num_roots, term *roots) MUST_CHECK;
+
 /**
  * @brief runs a garbage collection and shrinks used memory
  *
@@ -41,9 +41,13 @@
     static void *module_uncompress_literals(const uint8_t *litT, int size);
 #endif
 static void const* *module_build_literals_table(const void *literalsBuf);
+static enum ModuleLoadResult module_build_literals_cache(Module *mod);
 static void module_add_label(Module *mod, int index, void *ptr);
 static enum ModuleLoadResult module_build_imported_functions_table(Module *this_module, uint8_t *table_data);
 static void module_add_label(Module *mod, int index, void *ptr);
+static void module_add_large_integer(Module *mod, const uint8_t *operand, int64_t value);
+static void module_add_function(Module *mod, const CodeUnit *code, int function_atom_id, int arity);
+static term module_decode_literal(Module *mod, int index);
 
 #define IMPL_CODE_LOADER 1
 #include "opcodesswitch.h"
@@ -161,6 +165,86 @@ static void module_add_label(Module *mod, int index, void *ptr)
     mod->labels[index] = ptr;
 }
 
+static void module_add_large_integer(Module *mod, const uint8_t *operand, int64_t value)
+{
+    // code is loaded front to back, so large integers are sorted by operand address
+    struct ModuleLargeInteger *large_integers = realloc(mod->large_integers,
+        (mod->large_integers_count + 1) * sizeof(struct ModuleLargeInteger));
+    if (IS_NULL_PTR(large_integers)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        abort();
+    }
+
+    struct ModuleLargeInteger *large_integer = &large_integers[mod->large_integers_count];
+    large_integer->operand = operand;
+    term_init_boxed_int64(large_integer->boxed_value, value);
+
+    mod->large_integers = large_integers;
+    mod->large_integers_count++;
+}
+
+term module_get_large_integer(const Module *mod, const uint8_t *operand)
+{
+    int low = 0;
+    int high = mod->large_integers_count - 1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const struct ModuleLargeInteger *large_integer = &mod->large_integers[middle];
+        if (large_integer->operand == operand) {
+            return ((term) large_integer->boxed_value) | TERM_BOXED_VALUE_TAG;
+        } else if (large_integer->operand < operand) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    fprintf(stderr, "Large integer operand not found: %s:%i.\n", __FILE__, __LINE__);
+    abort();
+}
+
+static void module_add_function(Module *mod, const CodeUnit *code, int function_atom_id, int arity)
+{
+    // code is loaded front to back, so functions are sorted by address
+    struct ModuleFunctionInfo *functions = realloc(mod->functions, (mod->functions_count + 1) * sizeof(struct ModuleFunctionInfo));
+    if (IS_NULL_PTR(functions)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        abort();
+    }
+
+    struct ModuleFunctionInfo *function = &functions[mod->functions_count];
+    function->code = code;
+    function->function_atom_id = function_atom_id;
+    function->arity = arity;
+
+    mod->functions = functions;
+    mod->functions_count++;
+}
+
+const struct ModuleFunctionInfo *module_find_function(const Module *mod, const void *code_ptr)
+{
+    const CodeUnit *code_end = module_get_code(mod) + mod->end_instruction_ii;
+    if ((mod->functions_count == 0) || ((const CodeUnit *) code_ptr < mod->functions[0].code)
+            || ((const CodeUnit *) code_ptr >= code_end)) {
+        return NULL;
+    }
+
+    // last function that starts before code_ptr
+    int low = 0;
+    int high = mod->functions_count - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (mod->functions[middle].code <= (const CodeUnit *) code_ptr) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return &mod->functions[low];
+}
+
 Module *module_new_from_iff_binary(GlobalContext *global, const void *iff_binary, unsigned long size)
 {
     uint8_t *beam_file = (void *) iff_binary;
@@ -195,7 +279,11 @@ Module *module_new_from_iff_binary(GlobalContext *global, const void *iff_binary
     mod->code = (CodeChunk *) (beam_file + offsets[CODE]);
     mod->export_table = beam_file + offsets[EXPT];
     mod->atom_table = beam_file + offsets[AT8U];
-    mod->fun_table = beam_file + offsets[FUNT];
+    mod->fun_table = offsets[FUNT] ? beam_file + offsets[FUNT] : NULL;
+    if (offsets[STRT]) {
+        mod->str_table = beam_file + offsets[STRT] + IFF_SECTION_HEADER_SIZE;
+        mod->str_table_len = sizes[STRT];
+    }
     mod->labels = calloc(ENDIAN_SWAP_32(mod->code->labels), sizeof(void *));
     if (IS_NULL_PTR(mod->labels)) {
         module_destroy(mod);
@@ -229,6 +317,11 @@ Module *module_new_from_iff_binary(GlobalContext *global, const void *iff_binary
         mod->free_literals_data = 0;
     }
 
+    if (UNLIKELY(module_build_literals_cache(mod) != MODULE_LOAD_OK)) {
+        module_destroy(mod);
+        return NULL;
+    }
+
     mod->end_instruction_ii = read_core_chunk(mod);
 
     return mod;
@@ -237,8 +330,20 @@ Module *module_new_from_iff_binary(GlobalContext *global, const void *iff_binary
 COLD_FUNC void module_destroy(Module *module)
 {
     free(module->labels);
+#ifdef ENABLE_PREDECODED_CODE
+    free(module->predecoded_code);
+#endif
     free(module->imported_funcs);
     free(module->literals_table);
+    if (module->literals_heaps) {
+        for (uint32_t i = 0; i < module->literals_count; i++) {
+            free(module->literals_heaps[i]);
+        }
+    }
+    free(module->literals_heaps);
+    free(module->literals_cache);
+    free(module->large_integers);
+    free(module->functions);
     if (module->free_literals_data) {
         free(module->literals_data);
     }
@@ -302,19 +407,92 @@ static void const* *module_build_literals_table(const void *literalsBuf)
     return literals_table;
 }
 
+static enum ModuleLoadResult module_build_literals_cache(Module *mod)
+{
+    if (!mod->literals_data) {
+        mod->literals_cache = NULL;
+        mod->literals_heaps = NULL;
+        mod->literals_count = 0;
+        return MODULE_LOAD_OK;
+    }
+
+    mod->literals_count = READ_32_ALIGNED(mod->literals_data);
+    mod->literals_cache = calloc(mod->literals_count, sizeof(term));
+    mod->literals_heaps = calloc(mod->literals_count, sizeof(term *));
+    if (IS_NULL_PTR(mod->literals_cache) || IS_NULL_PTR(mod->literals_heaps)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        return MODULE_ERROR_FAILED_ALLOCATION;
+    }
+
+    return MODULE_LOAD_OK;
+}
+
+// Decodes a literal into the cache of the module, modules_lock must be held once the module can be used by other
+// schedulers. An invalid term is returned when memory cannot be allocated.
+static term module_decode_literal(Module *mod, int index)
+{
+    term literal = mod->literals_cache[index];
+    if (!term_is_invalid_term(literal)) {
+        return literal;
+    }
+
+    const void *external_term = mod->literals_table[index];
+    int heap_usage = externalterm_heap_usage(external_term);
+
+    term *literal_heap = NULL;
+    if (heap_usage > 0) {
+        literal_heap = malloc(heap_usage * sizeof(term));
+        if (IS_NULL_PTR(literal_heap)) {
+            return term_invalid_term();
+        }
+    }
+
+    term *heap_ptr = literal_heap;
+    literal = externalterm_to_term_in_heap(external_term, &heap_ptr, mod->global);
+
+    mod->literals_heaps[index] = literal_heap;
+    SMP_ATOMIC_STORE(&mod->literals_cache[index], literal);
+
+    return literal;
+}
+
 term module_load_literal(Module *mod, int index, Context *ctx)
 {
-    return externalterm_to_term(mod->literals_table[index], ctx);
+    term literal = SMP_ATOMIC_LOAD(&mod->literals_cache[index]);
+    if (LIKELY(!term_is_invalid_term(literal))) {
+        return literal;
+    }
+
+    // another scheduler might be decoding the same literal
+    SMP_MUTEX_LOCK(&mod->global->modules_lock);
+    literal = module_decode_literal(mod, index);
+    SMP_MUTEX_UNLOCK(&mod->global->modules_lock);
+
+    if (UNLIKELY(term_is_invalid_term(literal))) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        return externalterm_to_term(mod->literals_table[index], ctx);
+    }
+
+    return literal;
 }
 
 const struct ExportedFunction *module_resolve_function(Module *mod, int import_table_index)
 {
-    struct ExportedFunction *func = (struct ExportedFunction *) mod->imported_funcs[import_table_index].func;
+    // another scheduler might resolve the same import meanwhile, the unresolved call is freed when it is replaced
+    SMP_MUTEX_LOCK(&mod->global->modules_lock);
+    const struct ExportedFunction *func = mod->imported_funcs[import_table_index].func;
+    if (func->type != UnresolvedFunctionCall) {
+        SMP_MUTEX_UNLOCK(&mod->global->modules_lock);
+        return func;
+    }
     struct UnresolvedFunctionCall *unresolved = EXPORTED_FUNCTION_TO_UNRESOLVED_FUNCTION_CALL(func);
-
-    AtomString module_name_atom = (AtomString) valueshashtable_get_value(mod->global->atoms_ids_table, unresolved->module_atom_index, (unsigned long) NULL);
-    AtomString function_name_atom = (AtomString) valueshashtable_get_value(mod->global->atoms_ids_table, unresolved->function_atom_index, (unsigned long) NULL);
+    int module_atom_index = unresolved->module_atom_index;
+    int function_atom_index = unresolved->function_atom_index;
     int arity = unresolved->arity;
+    SMP_MUTEX_UNLOCK(&mod->global->modules_lock);
+
+    AtomString module_name_atom = (AtomString) valueshashtable_get_value(mod->global->atoms_ids_table, module_atom_index, (unsigned long) NULL);
+    AtomString function_name_atom = (AtomString) valueshashtable_get_value(mod->global->atoms_ids_table, function_atom_index, (unsigned long) NULL);
 
     Module *found_module = globalcontext_get_module(mod->global, module_name_atom);
 
@@ -335,9 +513,18 @@ const struct ExportedFunction *module_resolve_function(Module *mod, int import_t
         mfunc->target = found_module;
         mfunc->label = exported_label;
 
-        free(unresolved);
-        mod->imported_funcs[import_table_index].func = &mfunc->base;
-        return &mfunc->base;
+        SMP_MUTEX_LOCK(&mod->global->modules_lock);
+        func = mod->imported_funcs[import_table_index].func;
+        if (func->type == UnresolvedFunctionCall) {
+            free(EXPORTED_FUNCTION_TO_UNRESOLVED_FUNCTION_CALL(func));
+            SMP_ATOMIC_STORE(&mod->imported_funcs[import_table_index].func, &mfunc->base);
+            func = &mfunc->base;
+        } else {
+            free(mfunc);
+        }
+        SMP_MUTEX_UNLOCK(&mod->global->modules_lock);
+
+        return func;
     } else {
         char buf[256];
         atom_string_to_c(module_name_atom, buf, 256);
@@ -47,8 +47,39 @@ typedef struct
     uint8_t code[1];
 } __attribute__((packed)) CodeChunk;
 
+/*
+ * When ENABLE_PREDECODED_CODE is set the loader transcodes the CODE chunk into a stream of words: each opcode is
+ * followed by one word for each operand, that is already decoded (registers, immediate terms, literals) and label
+ * operands are stream positions. Labels, continuation pointers and saved instruction pointers refer to the stream.
+ */
+#ifdef ENABLE_PREDECODED_CODE
+    typedef term CodeUnit;
+#else
+    typedef uint8_t CodeUnit;
+#endif
+
 struct ExportedFunction;
 
+/**
+ * @brief An integer operand of the code that does not fit a small integer, it is boxed when the module is loaded.
+ */
+struct ModuleLargeInteger
+{
+    const uint8_t *operand;
+    term boxed_value[BOXED_INT64_SIZE];
+};
+
+/**
+ * @brief A function of the module, it is used to find which function some code belongs to.
+ */
+struct ModuleFunctionInfo
+{
+    // address of the func_info instruction that precedes the function entry point
+    const CodeUnit *code;
+    int function_atom_id;
+    int arity;
+};
+
 struct Module
 {
     GlobalContext *global;
@@ -58,6 +89,9 @@ struct Module
 #endif
 
     CodeChunk *code;
+#ifdef ENABLE_PREDECODED_CODE
+    CodeUnit *predecoded_code;
+#endif
     void *export_table;
     void *atom_table;
     void *fun_table;
@@ -69,6 +103,18 @@ struct Module
 
     void *literals_data;
     void const* *literals_table;
+    term *literals_cache;
+    term **literals_heaps;
+    uint32_t literals_count;
+
+    struct ModuleLargeInteger *large_integers;
+    int large_integers_count;
+
+    struct ModuleFunctionInfo *functions;
+    int functions_count;
+
+    const uint8_t *str_table;
+    uint32_t str_table_len;
 
     int *local_atoms_to_global_table;
 
@@ -135,11 +181,35 @@ Module *module_new_from_iff_binary(GlobalContext *global, const void *iff_binary
  * @brief Gets a literal stored on the literal table of the specified module
  *
  * @details Loads and deserialize a term stored in the literal table and returns a term.
+ * Literals are deserialized once, on first use, into a memory area owned by the module: returned terms are
+ * immutable, are shared by all processes and they are never copied by the garbage collector.
  * @param mod The module that owns that is going to be loaded.
  * @param index a valid literal index.
+ * @param ctx the context that is loading the literal.
  */
 term module_load_literal(Module *mod, int index, Context *ctx);
 
+/**
+ * @brief Gets a large integer operand
+ *
+ * @details Gets the boxed integer of an integer operand that does not fit a small integer. Such integers are boxed
+ * when the module is loaded, the returned term is owned by the module.
+ * @param mod the module that owns the code.
+ * @param operand the address of the compact term in the code.
+ * @return the boxed integer term.
+ */
+term module_get_large_integer(const Module *mod, const uint8_t *operand);
+
+/**
+ * @brief Finds the function that contains some code
+ *
+ * @details Functions are sorted by address when the module is loaded, so a binary search is used.
+ * @param mod the module that owns the code.
+ * @param code_ptr an address in the code of the module, such as a saved instruction pointer.
+ * @return the function, or NULL if the address is not part of any function.
+ */
+const struct ModuleFunctionInfo *module_find_function(const Module *mod, const void *code_ptr);
+
 /**
  * @brief Gets the AtomString for the given local atom id
  *
@@ -178,6 +248,22 @@ static inline term module_get_atom_term_by_id(const Module *mod, int local_atom_
  */
 const struct ExportedFunction *module_resolve_function(Module *mod, int import_table_index);
 
+/**
+ * @brief Gets the code that is executed
+ *
+ * @details Instruction indexes, such as the ones of return addresses, are relative to this code.
+ * @param mod the module.
+ * @return the CODE chunk, or the stream it has been transcoded to when ENABLE_PREDECODED_CODE is set.
+ */
+static inline CodeUnit *module_get_code(const Module *mod)
+{
+#ifdef ENABLE_PREDECODED_CODE
+    return mod->predecoded_code;
+#else
+    return mod->code->code;
+#endif
+}
+
 /*
  * @brief Casts an instruction index and module index to a return address
  *
@@ -191,6 +277,21 @@ static inline term module_address(unsigned int module_index, unsigned int instru
     return (term) ((module_index << 24) | (instruction_index << 2));
 }
 
+/**
+ * @brief Gets the number of funs defined in a module
+ *
+ * @param this_module the module.
+ * @return the count of entries in the module fun table, 0 if the module has no fun table.
+ */
+static inline uint32_t module_get_funs_count(const Module *this_module)
+{
+    if (IS_NULL_PTR(this_module->fun_table)) {
+        return 0;
+    }
+
+    return READ_32_ALIGNED((const uint8_t *) this_module->fun_table + 8);
+}
+
 static inline uint32_t module_get_fun_freeze(const Module *this_module, int fun_index)
 {
     const uint8_t *table_data = (const uint8_t *) this_module->fun_table;
@@ -24,16 +24,22 @@
 #include "atomshashtable.h"
 #include "context.h"
 #include "defaultatoms.h"
+#include "externalterm.h"
 #include "interop.h"
 #include "mailbox.h"
+#include "map.h"
 #include "module.h"
 #include "port.h"
+#include "profiler.h"
 #include "scheduler.h"
 #include "term.h"
 #include "utils.h"
 #include "sys.h"
 #include "version.h"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -54,6 +60,16 @@
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
+static term make_maybe_boxed_int64(Context *ctx, int64_t value)
+{
+    size_t heap_size = term_int64_heap_size(value);
+    if (UNLIKELY(heap_size && (memory_ensure_free(ctx, heap_size) != MEMORY_GC_OK))) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return term_make_maybe_boxed_int64(value, ctx);
+}
+
 #ifdef ENABLE_ADVANCED_TRACE
 static const char *const trace_calls_atom = "\xB" "trace_calls";
 static const char *const trace_call_args_atom = "\xF" "trace_call_args";
@@ -81,6 +97,7 @@ static term nif_erlang_binary_to_atom_2(Context *ctx, int argc, term argv[]);
 static term nif_erlang_binary_to_integer_1(Context *ctx, int argc, term argv[]);
 static term nif_erlang_binary_to_list_1(Context *ctx, int argc, term argv[]);
 static term nif_erlang_binary_to_existing_atom_2(Context *ctx, int argc, term argv[]);
+static term nif_erlang_binary_to_term_1(Context *ctx, int argc, term argv[]);
 static term nif_erlang_concat_2(Context *ctx, int argc, term argv[]);
 static term nif_erlang_display_1(Context *ctx, int argc, term argv[]);
 static term nif_erlang_make_ref_0(Context *ctx, int argc, term argv[]);
@@ -101,14 +118,42 @@ static term nif_erlang_spawn(Context *ctx, int argc, term argv[]);
 static term nif_erlang_spawn_fun(Context *ctx, int argc, term argv[]);
 static term nif_erlang_whereis_1(Context *ctx, int argc, term argv[]);
 static term nif_erlang_system_time_1(Context *ctx, int argc, term argv[]);
+static term nif_erlang_term_to_binary_1(Context *ctx, int argc, term argv[]);
 static term nif_erlang_tuple_to_list_1(Context *ctx, int argc, term argv[]);
 static term nif_erlang_universaltime_0(Context *ctx, int argc, term argv[]);
 static term nif_erlang_timestamp_0(Context *ctx, int argc, term argv[]);
+static term nif_erlang_send_after_3(Context *ctx, int argc, term argv[]);
+static term nif_erlang_start_timer_3(Context *ctx, int argc, term argv[]);
+static term nif_erlang_cancel_timer_1(Context *ctx, int argc, term argv[]);
+static term nif_erlang_read_timer_1(Context *ctx, int argc, term argv[]);
 static term nif_erts_debug_flat_size(Context *ctx, int argc, term argv[]);
 static term nifs_erlang_process_flag(Context *ctx, int argc, term argv[]);
 static term nifs_erlang_processes(Context *ctx, int argc, term argv[]);
 static term nifs_erlang_process_info(Context *ctx, int argc, term argv[]);
 static term nifs_erlang_system_info(Context *ctx, int argc, term argv[]);
+static term nif_erlang_statistics_1(Context *ctx, int argc, term argv[]);
+static term nif_erlang_garbage_collect_0(Context *ctx, int argc, term argv[]);
+static term nif_avm_profiler_start(Context *ctx, int argc, term argv[]);
+static term nif_avm_profiler_stop_0(Context *ctx, int argc, term argv[]);
+static term nif_avm_profiler_folded_stacks_0(Context *ctx, int argc, term argv[]);
+static term nif_maps_get_2(Context *ctx, int argc, term argv[]);
+static term nif_maps_get_3(Context *ctx, int argc, term argv[]);
+static term nif_maps_find_2(Context *ctx, int argc, term argv[]);
+static term nif_maps_is_key_2(Context *ctx, int argc, term argv[]);
+static term nif_maps_put_3(Context *ctx, int argc, term argv[]);
+static term nif_maps_update_3(Context *ctx, int argc, term argv[]);
+static term nif_maps_remove_2(Context *ctx, int argc, term argv[]);
+static term nif_maps_keys_1(Context *ctx, int argc, term argv[]);
+static term nif_maps_values_1(Context *ctx, int argc, term argv[]);
+static term nif_maps_to_list_1(Context *ctx, int argc, term argv[]);
+static term nif_maps_from_list_1(Context *ctx, int argc, term argv[]);
+static term nif_maps_size_1(Context *ctx, int argc, term argv[]);
+static term nif_maps_new_0(Context *ctx, int argc, term argv[]);
+static term nif_maps_merge_2(Context *ctx, int argc, term argv[]);
+static term nif_lists_sort_1(Context *ctx, int argc, term argv[]);
+static term nif_lists_usort_1(Context *ctx, int argc, term argv[]);
+static term nif_lists_keysort_2(Context *ctx, int argc, term argv[]);
+static term nif_lists_keyfind_3(Context *ctx, int argc, term argv[]);
 
 static const struct Nif binary_at_nif =
 {
@@ -176,6 +221,18 @@ static const struct Nif binary_to_list_nif =
     .nif_ptr = nif_erlang_binary_to_list_1
 };
 
+static const struct Nif binary_to_term_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_binary_to_term_1
+};
+
+static const struct Nif term_to_binary_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_term_to_binary_1
+};
+
 static const struct Nif binary_to_existing_atom_nif =
 {
     .base.type = NIFFunctionType,
@@ -326,6 +383,30 @@ static const struct Nif timestamp_nif =
     .nif_ptr = nif_erlang_timestamp_0
 };
 
+static const struct Nif send_after_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_send_after_3
+};
+
+static const struct Nif start_timer_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_start_timer_3
+};
+
+static const struct Nif cancel_timer_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_cancel_timer_1
+};
+
+static const struct Nif read_timer_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_read_timer_1
+};
+
 static const struct Nif tuple_to_list_nif =
 {
     .base.type = NIFFunctionType,
@@ -356,12 +437,150 @@ static const struct Nif process_info_nif =
     .nif_ptr = nifs_erlang_process_info
 };
 
+static const struct Nif statistics_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_statistics_1
+};
+
+static const struct Nif garbage_collect_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_erlang_garbage_collect_0
+};
+
+static const struct Nif profiler_start_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_avm_profiler_start
+};
+
+static const struct Nif profiler_stop_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_avm_profiler_stop_0
+};
+
+static const struct Nif profiler_folded_stacks_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_avm_profiler_folded_stacks_0
+};
+
 static const struct Nif system_info_nif =
 {
     .base.type = NIFFunctionType,
     .nif_ptr = nifs_erlang_system_info
 };
 
+static const struct Nif maps_get_2_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_get_2
+};
+
+static const struct Nif maps_get_3_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_get_3
+};
+
+static const struct Nif maps_find_2_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_find_2
+};
+
+static const struct Nif maps_is_key_2_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_is_key_2
+};
+
+static const struct Nif maps_put_3_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_put_3
+};
+
+static const struct Nif maps_update_3_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_update_3
+};
+
+static const struct Nif maps_remove_2_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_remove_2
+};
+
+static const struct Nif maps_keys_1_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_keys_1
+};
+
+static const struct Nif maps_values_1_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_values_1
+};
+
+static const struct Nif maps_to_list_1_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_to_list_1
+};
+
+static const struct Nif maps_from_list_1_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_from_list_1
+};
+
+static const struct Nif maps_size_1_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_size_1
+};
+
+static const struct Nif maps_new_0_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_new_0
+};
+
+static const struct Nif maps_merge_2_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_maps_merge_2
+};
+
+static const struct Nif lists_sort_1_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_lists_sort_1
+};
+
+static const struct Nif lists_usort_1_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_lists_usort_1
+};
+
+static const struct Nif lists_keysort_2_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_lists_keysort_2
+};
+
+static const struct Nif lists_keyfind_3_nif =
+{
+    .base.type = NIFFunctionType,
+    .nif_ptr = nif_lists_keyfind_3
+};
+
 //Ignore warning caused by gperf generated code
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
@@ -455,13 +674,16 @@ static term nif_erlang_register_2(Context *ctx, int argc, term argv[])
     term pid_or_port_term = argv[1];
     VALIDATE_VALUE(pid_or_port_term, term_is_pid);
 
+    if (reg_name_term == UNDEFINED_ATOM) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
     int atom_index = term_to_atom_index(reg_name_term);
     int pid = term_to_local_process_id(pid_or_port_term);
 
-    // TODO: pid must be existing, not already registered.
-    // TODO: reg_name_term must not be the atom undefined and not already registered.
-
-    globalcontext_register_process(ctx->global, atom_index, pid);
+    if (!globalcontext_register_process(ctx->global, atom_index, pid)) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
 
     return term_nil();
 }
@@ -490,10 +712,9 @@ static void process_echo_mailbox(Context *ctx)
     term val = term_get_tuple_element(msg->message, 1);
 
     int local_process_id = term_to_local_process_id(pid);
-    Context *target = globalcontext_get_process(ctx->global, local_process_id);
-    mailbox_send(target, val);
+    globalcontext_send_message(ctx->global, local_process_id, val);
 
-    free(msg);
+    mailbox_destroy_message(msg);
 }
 
 static void process_console_mailbox(Context *ctx)
@@ -536,7 +757,63 @@ static void process_console_mailbox(Context *ctx)
         fprintf(stderr, "WARNING: Invalid port command.  Unable to send reply");
     }
 
-    free(message);
+    mailbox_destroy_message(message);
+}
+
+static term heap_growth_strategy_to_atom(enum HeapGrowthStrategy strategy)
+{
+    switch (strategy) {
+        case HEAP_GROWTH_DOUBLING:
+            return DOUBLING_ATOM;
+        case HEAP_GROWTH_MINIMUM:
+            return MINIMUM_ATOM;
+        case HEAP_GROWTH_FIBONACCI:
+        default:
+            return FIBONACCI_ATOM;
+    }
+}
+
+// applies min_heap_size, max_heap_size and heap_growth spawn options, returns 0 when they are not valid
+static int spawn_opts_apply(Context *new_ctx, term opts_term)
+{
+    term min_heap_size_term = interop_proplist_get_value(opts_term, MIN_HEAP_SIZE_ATOM);
+    term max_heap_size_term = interop_proplist_get_value(opts_term, MAX_HEAP_SIZE_ATOM);
+    term heap_growth_term = interop_proplist_get_value(opts_term, HEAP_GROWTH_ATOM);
+
+    if (min_heap_size_term != term_nil()) {
+        if (UNLIKELY(!term_is_integer(min_heap_size_term) || (term_to_int32(min_heap_size_term) < 0))) {
+            return 0;
+        }
+        new_ctx->has_min_heap_size = 1;
+        new_ctx->min_heap_size = term_to_int32(min_heap_size_term);
+    }
+    if (max_heap_size_term != term_nil()) {
+        if (UNLIKELY(!term_is_integer(max_heap_size_term) || (term_to_int32(max_heap_size_term) < 0))) {
+            return 0;
+        }
+        new_ctx->has_max_heap_size = 1;
+        new_ctx->max_heap_size = term_to_int32(max_heap_size_term);
+    }
+
+    if (new_ctx->has_min_heap_size && new_ctx->has_max_heap_size) {
+        if (new_ctx->min_heap_size > new_ctx->max_heap_size) {
+            return 0;
+        }
+    }
+
+    if (heap_growth_term != term_nil()) {
+        if (heap_growth_term == FIBONACCI_ATOM) {
+            new_ctx->heap_growth = HEAP_GROWTH_FIBONACCI;
+        } else if (heap_growth_term == DOUBLING_ATOM) {
+            new_ctx->heap_growth = HEAP_GROWTH_DOUBLING;
+        } else if (heap_growth_term == MINIMUM_ATOM) {
+            new_ctx->heap_growth = HEAP_GROWTH_MINIMUM;
+        } else {
+            return 0;
+        }
+    }
+
+    return 1;
 }
 
 static term nif_erlang_spawn_fun(Context *ctx, int argc, term argv[])
@@ -575,14 +852,22 @@ static term nif_erlang_spawn_fun(Context *ctx, int argc, term argv[])
     new_ctx->saved_ip = fun_module->labels[label];
     new_ctx->cp = module_address(fun_module->module_index, fun_module->end_instruction_ii);
 
-    term max_heap_size_term = interop_proplist_get_value(opts_term, MAX_HEAP_SIZE_ATOM);
-    if (max_heap_size_term != term_nil()) {
-        new_ctx->has_max_heap_size = 1;
-        //TODO: check type, make sure max_heap_size_term is an int32
-        new_ctx->max_heap_size = term_to_int32(max_heap_size_term);
+    if (UNLIKELY(!spawn_opts_apply(new_ctx, opts_term))) {
+        scheduler_terminate(new_ctx);
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    if (new_ctx->has_min_heap_size) {
+        if (UNLIKELY(memory_ensure_free(new_ctx, new_ctx->min_heap_size) != MEMORY_GC_OK)) {
+            scheduler_terminate(new_ctx);
+            RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+        }
     }
 
-    return term_from_local_process_id(new_ctx->process_id);
+    term new_pid = term_from_local_process_id(new_ctx->process_id);
+    scheduler_init_ready(new_ctx);
+
+    return new_pid;
 }
 
 static term nif_erlang_spawn(Context *ctx, int argc, term argv[])
@@ -610,6 +895,7 @@ static term nif_erlang_spawn(Context *ctx, int argc, term argv[])
 
     Module *found_module = globalcontext_get_module(ctx->global, module_string);
     if (UNLIKELY(!found_module)) {
+        scheduler_terminate(new_ctx);
         return UNDEFINED_ATOM;
     }
 
@@ -619,38 +905,15 @@ static term nif_erlang_spawn(Context *ctx, int argc, term argv[])
     new_ctx->saved_ip = found_module->labels[label];
     new_ctx->cp = module_address(found_module->module_index, found_module->end_instruction_ii);
 
-    term min_heap_size_term = interop_proplist_get_value(opts_term, MIN_HEAP_SIZE_ATOM);
-    term max_heap_size_term = interop_proplist_get_value(opts_term, MAX_HEAP_SIZE_ATOM);
-
-    if (min_heap_size_term != term_nil()) {
-        if (UNLIKELY(!term_is_integer(min_heap_size_term))) {
-            //TODO: gracefully handle this error
-            abort();
-        }
-        new_ctx->has_min_heap_size = 1;
-        new_ctx->min_heap_size = term_to_int32(min_heap_size_term);
-    } else {
-        min_heap_size_term = term_from_int32(0);
-    }
-    if (max_heap_size_term != term_nil()) {
-        if (UNLIKELY(!term_is_integer(max_heap_size_term))) {
-            //TODO: gracefully handle this error
-            abort();
-        }
-        new_ctx->has_max_heap_size = 1;
-        new_ctx->max_heap_size = term_to_int32(max_heap_size_term);
-    }
-
-    if (new_ctx->has_min_heap_size && new_ctx->has_max_heap_size) {
-        if (term_to_int32(min_heap_size_term) > term_to_int32(max_heap_size_term)) {
-            RAISE_ERROR(BADARG_ATOM);
-        }
+    if (UNLIKELY(!spawn_opts_apply(new_ctx, opts_term))) {
+        scheduler_terminate(new_ctx);
+        RAISE_ERROR(BADARG_ATOM);
     }
 
     //TODO: check available registers count
     int reg_index = 0;
     term t = argv[2];
-    uint32_t size = MAX((unsigned long) term_to_int32(min_heap_size_term), memory_estimate_usage(t));
+    uint32_t size = MAX((unsigned long) new_ctx->min_heap_size, memory_estimate_usage(t));
     if (UNLIKELY(memory_ensure_free(new_ctx, size) != MEMORY_GC_OK)) {
         //TODO: new process should be terminated, however a new pid is returned anyway
         fprintf(stderr, "Unable to allocate sufficient memory to spawn process.\n");
@@ -658,12 +921,15 @@ static term nif_erlang_spawn(Context *ctx, int argc, term argv[])
     }
     while (!term_is_nil(t)) {
         term *t_ptr = term_get_list_ptr(t);
-        new_ctx->x[reg_index] = memory_copy_term_tree(&new_ctx->heap_ptr, t_ptr[1]);
+        new_ctx->x[reg_index] = memory_copy_term_tree(&new_ctx->heap_ptr, t_ptr[1], &new_ctx->off_heap_binaries);
         t = *t_ptr;
         reg_index++;
     }
 
-    return term_from_local_process_id(new_ctx->process_id);
+    term new_pid = term_from_local_process_id(new_ctx->process_id);
+    scheduler_init_ready(new_ctx);
+
+    return new_pid;
 }
 static term nif_erlang_send_2(Context *ctx, int argc, term argv[])
 {
@@ -673,9 +939,8 @@ static term nif_erlang_send_2(Context *ctx, int argc, term argv[])
     VALIDATE_VALUE(pid_term, term_is_pid);
 
     int local_process_id = term_to_local_process_id(pid_term);
-    Context *target = globalcontext_get_process(ctx->global, local_process_id);
-
-    mailbox_send(target, argv[1]);
+    globalcontext_send_message(ctx->global, local_process_id, argv[1]);
+    ctx->stats.messages_sent++;
 
     return argv[1];
 }
@@ -685,7 +950,8 @@ static term nif_erlang_is_process_alive_1(Context *ctx, int argc, term argv[])
     UNUSED(argc);
 
     int local_process_id = term_to_local_process_id(argv[0]);
-    Context *target = globalcontext_get_process(ctx->global, local_process_id);
+    Context *target = globalcontext_get_process_lock(ctx->global, local_process_id);
+    globalcontext_get_process_unlock(ctx->global, target);
 
     return target ? TRUE_ATOM : FALSE_ATOM;
 }
@@ -766,9 +1032,21 @@ term nif_erlang_system_time_1(Context *ctx, int argc, term argv[])
     struct timespec ts;
     sys_time(&ts);
 
-    term minute_atom = context_make_atom(ctx, "\x6" "minute");
-    if (argv[0] == minute_atom) {
-        // FIXME: This is not standard, however we cannot hold seconds since 1970 in just 27 bits.
+    term unit = argv[0];
+    if (unit == context_make_atom(ctx, "\x6" "second")) {
+        return make_maybe_boxed_int64(ctx, (int64_t) ts.tv_sec);
+
+    } else if (unit == context_make_atom(ctx, "\xB" "millisecond")) {
+        return make_maybe_boxed_int64(ctx, ((int64_t) ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+
+    } else if (unit == context_make_atom(ctx, "\xB" "microsecond")) {
+        return make_maybe_boxed_int64(ctx, ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000);
+
+    } else if (unit == context_make_atom(ctx, "\xA" "nanosecond")) {
+        return make_maybe_boxed_int64(ctx, ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec);
+
+    } else if (unit == context_make_atom(ctx, "\x6" "minute")) {
+        // minute is not a standard time unit, it is kept for code written when integers were limited to 28 bits
         return term_from_int32(ts.tv_sec / 60);
 
     } else {
@@ -831,6 +1109,82 @@ term nif_erlang_timestamp_0(Context *ctx, int argc, term argv[])
     return timestamp_tuple;
 }
 
+static term start_erlang_timer(Context *ctx, term argv[], int timeout_message)
+{
+    VALIDATE_VALUE(argv[0], term_is_any_integer);
+    int64_t timeout = term_maybe_unbox_int64(argv[0]);
+    if (UNLIKELY((timeout < 0) || (timeout > UINT32_MAX))) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+    if (UNLIKELY(!term_is_pid(argv[1]) && !term_is_atom(argv[1]))) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    // a ref is 64 bits, hence 8 bytes, {timeout, TimerRef, Msg} tuple takes 4 more terms
+    if (UNLIKELY(memory_ensure_free(ctx, (8 / TERM_BYTES) + 1 + (timeout_message ? 4 : 0)) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    uint64_t ref_ticks = globalcontext_get_ref_ticks(ctx->global);
+    term timer_ref = term_from_ref_ticks(ref_ticks, ctx);
+
+    term message = argv[2];
+    if (timeout_message) {
+        message = term_alloc_tuple(3, ctx);
+        term_put_tuple_element(message, 0, TIMEOUT_ATOM);
+        term_put_tuple_element(message, 1, timer_ref);
+        term_put_tuple_element(message, 2, argv[2]);
+    }
+
+    if (UNLIKELY(!scheduler_start_timer(ctx->global, ref_ticks, timeout, argv[1], message))) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return timer_ref;
+}
+
+static term nif_erlang_send_after_3(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    return start_erlang_timer(ctx, argv, 0);
+}
+
+static term nif_erlang_start_timer_3(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    return start_erlang_timer(ctx, argv, 1);
+}
+
+static term nif_erlang_cancel_timer_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_VALUE(argv[0], term_is_reference);
+
+    uint32_t remaining;
+    if (!scheduler_cancel_timer(ctx->global, term_to_ref_ticks(argv[0]), &remaining)) {
+        return FALSE_ATOM;
+    }
+
+    return make_maybe_boxed_int64(ctx, remaining);
+}
+
+static term nif_erlang_read_timer_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_VALUE(argv[0], term_is_reference);
+
+    uint32_t remaining;
+    if (!scheduler_read_timer(ctx->global, term_to_ref_ticks(argv[0]), &remaining)) {
+        return FALSE_ATOM;
+    }
+
+    return make_maybe_boxed_int64(ctx, remaining);
+}
+
 static term nif_erlang_make_tuple_2(Context *ctx, int argc, term argv[])
 {
     UNUSED(argc);
@@ -1008,15 +1362,18 @@ static term nif_erlang_binary_to_integer_1(Context *ctx, int argc, term argv[])
     memcpy(null_terminated_buf, bin_data, bin_data_size);
     null_terminated_buf[bin_data_size] = '\0';
 
-    //TODO: handle 64 bits numbers
-    //TODO: handle errors
     char *endptr;
-    uint32_t value = strtol(null_terminated_buf, &endptr, 10);
+    errno = 0;
+    long long value = strtoll(null_terminated_buf, &endptr, 10);
     if (*endptr != '\0') {
         RAISE_ERROR(BADARG_ATOM);
     }
+    if (UNLIKELY(errno == ERANGE)) {
+        // overflow error is not standard, but integers are limited to 64 bits
+        RAISE_ERROR(OVERFLOW_ATOM);
+    }
 
-    return term_from_int32(value);
+    return make_maybe_boxed_int64(ctx, value);
 }
 
 static term nif_erlang_binary_to_list_1(Context *ctx, int argc, term argv[])
@@ -1041,26 +1398,71 @@ static term nif_erlang_binary_to_list_1(Context *ctx, int argc, term argv[])
     return prev;
 }
 
-static term nif_erlang_binary_to_existing_atom_2(Context *ctx, int argc, term argv[])
-{
-    return binary_to_atom(ctx, argc, argv, 0);
-}
-
-static term binary_to_atom(Context *ctx, int argc, term argv[], int create_new)
+static term nif_erlang_binary_to_term_1(Context *ctx, int argc, term argv[])
 {
     UNUSED(argc);
 
-    term a_binary = argv[0];
-    VALIDATE_VALUE(a_binary, term_is_binary);
+    VALIDATE_VALUE(argv[0], term_is_binary);
 
-    if (UNLIKELY(argv[1] != LATIN1_ATOM)) {
+    int heap_usage = externalterm_buffer_heap_usage(term_binary_data(argv[0]), term_binary_size(argv[0]), ctx->global);
+    if (UNLIKELY(heap_usage < 0)) {
         RAISE_ERROR(BADARG_ATOM);
     }
+    if (UNLIKELY(memory_ensure_free(ctx, heap_usage) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
 
-    char *atom_string = interop_binary_to_string(a_binary);
-    if (IS_NULL_PTR(atom_string)) {
-        fprintf(stderr, "Failed to alloc temporary string\n");
-        abort();
+    // heap binaries might have been moved by the garbage collector
+    term t = externalterm_buffer_to_term(term_binary_data(argv[0]), ctx);
+    if (UNLIKELY(term_is_invalid_term(t))) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    return t;
+}
+
+static term nif_erlang_term_to_binary_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    // the size pass also checks that the whole term can be encoded
+    size_t size = externalterm_encoded_size(argv[0], ctx->global);
+    if (UNLIKELY((size == 0) || (size > UINT32_MAX))) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+    if (UNLIKELY(memory_ensure_free(ctx, term_binary_heap_size(size)) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    term binary = term_create_uninitialized_binary(size, ctx);
+    if (UNLIKELY(term_is_invalid_term(binary))) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+    externalterm_encode(argv[0], (void *) term_binary_data(binary), ctx->global);
+
+    return binary;
+}
+
+static term nif_erlang_binary_to_existing_atom_2(Context *ctx, int argc, term argv[])
+{
+    return binary_to_atom(ctx, argc, argv, 0);
+}
+
+static term binary_to_atom(Context *ctx, int argc, term argv[], int create_new)
+{
+    UNUSED(argc);
+
+    term a_binary = argv[0];
+    VALIDATE_VALUE(a_binary, term_is_binary);
+
+    if (UNLIKELY(argv[1] != LATIN1_ATOM)) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    char *atom_string = interop_binary_to_string(a_binary);
+    if (IS_NULL_PTR(atom_string)) {
+        fprintf(stderr, "Failed to alloc temporary string\n");
+        abort();
     }
     int atom_string_len = strlen(atom_string);
     if (UNLIKELY(atom_string_len > 255)) {
@@ -1193,13 +1595,13 @@ static term nif_erlang_integer_to_binary_1(Context *ctx, int argc, term argv[])
     UNUSED(argc);
 
     term value = argv[0];
-    VALIDATE_VALUE(value, term_is_integer);
+    VALIDATE_VALUE(value, term_is_any_integer);
 
-    int32_t int_value = term_to_int32(value);
+    int64_t int_value = term_maybe_unbox_int64(value);
     char integer_string[24];
 
     //TODO: just copy data to the binary instead of using the stack
-    snprintf(integer_string, 24, "%i", int_value);
+    snprintf(integer_string, 24, "%" PRId64, int_value);
     int len = strlen(integer_string);
 
     if (UNLIKELY(memory_ensure_free(ctx, term_binary_data_size_in_terms(len) + BINARY_HEADER_SIZE) != MEMORY_GC_OK)) {
@@ -1214,12 +1616,12 @@ static term nif_erlang_integer_to_list_1(Context *ctx, int argc, term argv[])
     UNUSED(argc);
 
     term value = argv[0];
-    VALIDATE_VALUE(value, term_is_integer);
+    VALIDATE_VALUE(value, term_is_any_integer);
 
-    int32_t int_value = term_to_int32(value);
+    int64_t int_value = term_maybe_unbox_int64(value);
     char integer_string[24];
 
-    snprintf(integer_string, 24, "%i", int_value);
+    snprintf(integer_string, 24, "%" PRId64, int_value);
     int integer_string_len = strlen(integer_string);
 
     if (UNLIKELY(memory_ensure_free(ctx, integer_string_len * 2) != MEMORY_GC_OK)) {
@@ -1266,7 +1668,8 @@ static term nif_erlang_list_to_integer_1(Context *ctx, int argc, term argv[])
     UNUSED(argc);
 
     term t = argv[0];
-    int32_t acc = 0;
+    // digits are accumulated as a negative value, since INT64_MIN has no positive counterpart
+    int64_t acc = 0;
     int digits = 0;
 
     VALIDATE_VALUE(t, term_is_nonempty_list);
@@ -1291,25 +1694,28 @@ static term nif_erlang_list_to_integer_1(Context *ctx, int argc, term argv[])
             RAISE_ERROR(BADARG_ATOM);
         }
 
-        if (acc > INT32_MAX / 10) {
-            // overflow error is not standard, but we need it since we are running on an embedded device
+        if (UNLIKELY((acc < INT64_MIN / 10) || ((acc * 10) < INT64_MIN + (c - '0')))) {
+            // overflow error is not standard, but integers are limited to 64 bits
             RAISE_ERROR(OVERFLOW_ATOM);
         }
 
-        acc = (acc * 10) + (c - '0');
+        acc = (acc * 10) - (c - '0');
         digits++;
         t = term_get_list_tail(t);
     }
 
-    if (negative) {
-        acc = -acc;
-    }
-
     if (UNLIKELY(digits == 0)) {
         RAISE_ERROR(BADARG_ATOM);
     }
 
-    return term_from_int32(acc);
+    if (!negative) {
+        if (UNLIKELY(acc == INT64_MIN)) {
+            RAISE_ERROR(OVERFLOW_ATOM);
+        }
+        acc = -acc;
+    }
+
+    return make_maybe_boxed_int64(ctx, acc);
 }
 
 static term nif_erlang_display_1(Context *ctx, int argc, term argv[])
@@ -1418,6 +1824,7 @@ static void *nifs_cons_context(Context *ctx, void *p)
     return (void *) accum;
 }
 
+// processes_table_lock must be held
 static void *nifs_iterate_processes(GlobalContext *glb, context_iterator fun, void *accum)
 {
     Context *processes = GET_LIST_ENTRY(glb->processes_table, Context, processes_table_head);
@@ -1431,12 +1838,20 @@ static void *nifs_iterate_processes(GlobalContext *glb, context_iterator fun, vo
 
 static size_t nifs_num_processes(GlobalContext *glb)
 {
-    return (size_t) nifs_iterate_processes(glb, nifs_increment_context_count, NULL);
+    SMP_RWLOCK_RDLOCK(&glb->processes_table_lock);
+    size_t count = (size_t) nifs_iterate_processes(glb, nifs_increment_context_count, NULL);
+    SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+
+    return count;
 }
 
 static size_t nifs_num_ports(GlobalContext *glb)
 {
-    return (size_t) nifs_iterate_processes(glb, nifs_increment_port_count, NULL);
+    SMP_RWLOCK_RDLOCK(&glb->processes_table_lock);
+    size_t count = (size_t) nifs_iterate_processes(glb, nifs_increment_port_count, NULL);
+    SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+
+    return count;
 }
 
 static term nifs_list_processes(Context *ctx)
@@ -1453,62 +1868,370 @@ static term nifs_erlang_processes(Context *ctx, int argc, term argv[])
     UNUSED(argv);
     UNUSED(argc);
 
-    size_t num_processes = nifs_num_processes(ctx->global);
+    // the table is kept locked, so no process can be spawned between counting and listing them
+    SMP_RWLOCK_RDLOCK(&ctx->global->processes_table_lock);
+    size_t num_processes = (size_t) nifs_iterate_processes(ctx->global, nifs_increment_context_count, NULL);
     if (memory_ensure_free(ctx, 2 * num_processes) != MEMORY_GC_OK) {
+        SMP_RWLOCK_UNLOCK(&ctx->global->processes_table_lock);
         RAISE_ERROR(OUT_OF_MEMORY_ATOM);
     }
-    return nifs_list_processes(ctx);
+    term processes = nifs_list_processes(ctx);
+    SMP_RWLOCK_UNLOCK(&ctx->global->processes_table_lock);
+
+    return processes;
 }
 
-static term nifs_erlang_process_info(Context *ctx, int argc, term argv[])
+// items returned by process_info/1
+static const int process_info_default_items[] = {
+    CURRENT_FUNCTION_ATOM_INDEX,
+    STATUS_ATOM_INDEX,
+    MESSAGE_QUEUE_LEN_ATOM_INDEX,
+    HEAP_SIZE_ATOM_INDEX,
+    STACK_SIZE_ATOM_INDEX,
+    REDUCTIONS_ATOM_INDEX,
+    MEMORY_ATOM_INDEX,
+    GARBAGE_COLLECTION_ATOM_INDEX,
+    MESSAGES_SENT_ATOM_INDEX,
+    MESSAGES_RECEIVED_ATOM_INDEX,
+    RUN_TIME_ATOM_INDEX
+};
+
+#define PROCESS_INFO_DEFAULT_ITEMS_COUNT (sizeof(process_info_default_items) / sizeof(int))
+
+// returns the heap size of the {Item, Value} tuple, or -1 if the item is not supported
+static int process_info_item_heap_size(term item)
 {
-    UNUSED(argc);
+    if (item == STATUS_ATOM) {
+        return 3;
 
-    term pid = argv[0];
-    term item_or_item_info = argv[1];
+    // counters and sizes might not fit a small integer
+    } else if ((item == HEAP_SIZE_ATOM) || (item == STACK_SIZE_ATOM) || (item == MESSAGE_QUEUE_LEN_ATOM)
+            || (item == MEMORY_ATOM) || (item == REDUCTIONS_ATOM) || (item == MESSAGES_SENT_ATOM)
+            || (item == MESSAGES_RECEIVED_ATOM) || (item == RUN_TIME_ATOM)) {
+        return 3 + BOXED_INT64_SIZE;
 
-    if (!term_is_atom(item_or_item_info)) {
-        RAISE_ERROR(BADARG_ATOM);
+    // {Module, Function, Arity}
+    } else if (item == CURRENT_FUNCTION_ATOM) {
+        return 3 + 4;
+
+    // garbage_collection info list with 4 {Key, Value} items: 4 * (2 + 3), 3 of them with a counter
+    } else if (item == GARBAGE_COLLECTION_ATOM) {
+        return 3 + 4 * (2 + 3) + 3 * BOXED_INT64_SIZE;
     }
-    // TODO add support for process_info/1
-    // and process_info/2 when second argument is a list
-    term item = item_or_item_info;
 
-    int local_process_id = term_to_local_process_id(pid);
-    Context *target = globalcontext_get_process(ctx->global, local_process_id);
+    return -1;
+}
 
-    if (memory_ensure_free(ctx, 3) != MEMORY_GC_OK) {
-        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+static term process_info_current_function(Context *ctx, Context *target, int argc)
+{
+    // the caller is running process_info
+    if (target == ctx) {
+        term mfa = term_alloc_tuple(3, ctx);
+        term_put_tuple_element(mfa, 0, context_make_atom(ctx, "\x6" "erlang"));
+        term_put_tuple_element(mfa, 1, context_make_atom(ctx, "\xC" "process_info"));
+        term_put_tuple_element(mfa, 2, term_from_int32(argc));
+        return mfa;
     }
 
-    term ret = term_alloc_tuple(2, ctx);
+    // other processes are looked up from the point where they have been scheduled out
+    const Module *mod = target->saved_module;
+    const struct ModuleFunctionInfo *function = NULL;
+    if (!context_is_port_driver(target) && target->saved_ip) {
+        function = module_find_function(mod, target->saved_ip);
+    }
+    if (IS_NULL_PTR(function)) {
+        return UNDEFINED_ATOM;
+    }
+
+    term mfa = term_alloc_tuple(3, ctx);
+    term_put_tuple_element(mfa, 0, module_get_atom_term_by_id(mod, 1));
+    term_put_tuple_element(mfa, 1, module_get_atom_term_by_id(mod, function->function_atom_id));
+    term_put_tuple_element(mfa, 2, term_from_int32(function->arity));
+    return mfa;
+}
+
+static term process_info_status(Context *target)
+{
+    int state = SMP_ATOMIC_LOAD(&target->scheduling_state);
+    if (state & CONTEXT_RUNNING) {
+        return RUNNING_ATOM;
+    } else if (state == CONTEXT_READY) {
+        return RUNNABLE_ATOM;
+    }
+
+    return WAITING_ATOM;
+}
+
+// builds the {Item, Value} tuple, process_info_item_heap_size(item) terms must be available
+static term process_info_item(Context *ctx, Context *target, term item, int argc)
+{
+    term value;
+
     // heap_size size in words of the heap of the process
     if (item == HEAP_SIZE_ATOM) {
-        term_put_tuple_element(ret, 0, HEAP_SIZE_ATOM);
-        term_put_tuple_element(ret, 1, term_from_int32(context_heap_size(target)));
+        value = term_make_maybe_boxed_int64(context_heap_size(target), ctx);
 
     // stack_size stack size, in words, of the process
     } else if (item == STACK_SIZE_ATOM) {
-        term_put_tuple_element(ret, 0, STACK_SIZE_ATOM);
-        term_put_tuple_element(ret, 1, term_from_int32(context_stack_size(target)));
+        value = term_make_maybe_boxed_int64(context_stack_size(target), ctx);
 
     // message_queue_len number of messages currently in the message queue of the process
     } else if (item == MESSAGE_QUEUE_LEN_ATOM) {
-        term_put_tuple_element(ret, 0, MESSAGE_QUEUE_LEN_ATOM);
-        term_put_tuple_element(ret, 1, term_from_int32(context_message_queue_len(target)));
+        value = term_make_maybe_boxed_int64(context_message_queue_len(target), ctx);
 
     // memory size in bytes of the process. This includes call stack, heap, and internal structures.
     } else if (item == MEMORY_ATOM) {
-        term_put_tuple_element(ret, 0, MEMORY_ATOM);
-        term_put_tuple_element(ret, 1, term_from_int32(context_size(target)));
+        value = term_make_maybe_boxed_int64(context_size(target), ctx);
+
+    // status running, runnable (ready to run) or waiting
+    } else if (item == STATUS_ATOM) {
+        value = process_info_status(target);
+
+    // reductions number of function calls executed by the process
+    } else if (item == REDUCTIONS_ATOM) {
+        value = term_make_maybe_boxed_int64(target->stats.reductions, ctx);
+
+    } else if (item == MESSAGES_SENT_ATOM) {
+        value = term_make_maybe_boxed_int64(target->stats.messages_sent, ctx);
+
+    } else if (item == MESSAGES_RECEIVED_ATOM) {
+        value = term_make_maybe_boxed_int64(target->stats.messages_received, ctx);
+
+    // run_time time spent running by the process in microseconds
+    } else if (item == RUN_TIME_ATOM) {
+        value = term_make_maybe_boxed_int64(scheduler_run_time_us(target), ctx);
+
+    // current_function {Module, Function, Arity} of the function the process is running
+    } else if (item == CURRENT_FUNCTION_ATOM) {
+        value = process_info_current_function(ctx, target, argc);
 
+    // garbage_collection list with the number of minor and major collections of the process, the amount of
+    // bytes copied by them and the heap growth strategy
     } else {
+        term minor_gcs = term_alloc_tuple(2, ctx);
+        term_put_tuple_element(minor_gcs, 0, MINOR_GCS_ATOM);
+        term_put_tuple_element(minor_gcs, 1, term_make_maybe_boxed_int64(target->stats.minor_gcs, ctx));
+
+        term major_gcs = term_alloc_tuple(2, ctx);
+        term_put_tuple_element(major_gcs, 0, MAJOR_GCS_ATOM);
+        term_put_tuple_element(major_gcs, 1, term_make_maybe_boxed_int64(target->stats.major_gcs, ctx));
+
+        term bytes_copied = term_alloc_tuple(2, ctx);
+        term_put_tuple_element(bytes_copied, 0, BYTES_COPIED_ATOM);
+        term_put_tuple_element(bytes_copied, 1, term_make_maybe_boxed_int64((uint64_t) target->stats.copied_words * sizeof(term), ctx));
+
+        term heap_growth = term_alloc_tuple(2, ctx);
+        term_put_tuple_element(heap_growth, 0, HEAP_GROWTH_ATOM);
+        term_put_tuple_element(heap_growth, 1, heap_growth_strategy_to_atom(target->heap_growth));
+
+        value = term_list_prepend(heap_growth, term_nil(), ctx);
+        value = term_list_prepend(bytes_copied, value, ctx);
+        value = term_list_prepend(major_gcs, value, ctx);
+        value = term_list_prepend(minor_gcs, value, ctx);
+    }
+
+    term ret = term_alloc_tuple(2, ctx);
+    term_put_tuple_element(ret, 0, item);
+    term_put_tuple_element(ret, 1, value);
+
+    return ret;
+}
+
+static term nifs_erlang_process_info(Context *ctx, int argc, term argv[])
+{
+    VALIDATE_VALUE(argv[0], term_is_pid);
+
+    // process_info/1 is the same as process_info/2 with the list of default items
+    int needed_memory = 0;
+    if (argc == 1) {
+        for (unsigned int i = 0; i < PROCESS_INFO_DEFAULT_ITEMS_COUNT; i++) {
+            needed_memory += process_info_item_heap_size(term_from_atom_index(process_info_default_items[i])) + 2;
+        }
+
+    } else if (term_is_atom(argv[1])) {
+        needed_memory = process_info_item_heap_size(argv[1]);
+
+    } else {
+        term t = argv[1];
+        while (term_is_nonempty_list(t)) {
+            int item_size = process_info_item_heap_size(term_get_list_head(t));
+            if (item_size < 0) {
+                break;
+            }
+            needed_memory += item_size + 2;
+            t = term_get_list_tail(t);
+        }
+        if (!term_is_nil(t)) {
+            RAISE_ERROR(BADARG_ATOM);
+        }
+    }
+    if (needed_memory < 0) {
         RAISE_ERROR(BADARG_ATOM);
     }
 
+    if (memory_ensure_free(ctx, needed_memory) != MEMORY_GC_OK) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    int local_process_id = term_to_local_process_id(argv[0]);
+    Context *target = globalcontext_get_process_lock(ctx->global, local_process_id);
+    if (IS_NULL_PTR(target)) {
+        return UNDEFINED_ATOM;
+    }
+
+    term ret;
+    if (argc == 1) {
+        ret = term_nil();
+        for (int i = PROCESS_INFO_DEFAULT_ITEMS_COUNT - 1; i >= 0; i--) {
+            term item = term_from_atom_index(process_info_default_items[i]);
+            ret = term_list_prepend(process_info_item(ctx, target, item, argc), ret, ctx);
+        }
+
+    } else if (term_is_atom(argv[1])) {
+        ret = process_info_item(ctx, target, argv[1], argc);
+
+    } else {
+        // items are appended to the tail, so they are in the same order of the requested ones
+        ret = term_nil();
+        term *tail = &ret;
+        for (term t = argv[1]; !term_is_nil(t); t = term_get_list_tail(t)) {
+            term item_info = process_info_item(ctx, target, term_get_list_head(t), argc);
+            term cell = term_list_prepend(item_info, term_nil(), ctx);
+            *tail = cell;
+            tail = term_get_list_ptr(cell);
+        }
+    }
+    globalcontext_get_process_unlock(ctx->global, target);
+
+    return ret;
+}
+
+static term nif_erlang_garbage_collect_0(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    // both generations are collected, the heap keeps its size
+    if (UNLIKELY(memory_full_gc(ctx, context_memory_size(ctx)) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return TRUE_ATOM;
+}
+
+static term nif_erlang_statistics_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    term key = argv[0];
+    GlobalContext *glb = ctx->global;
+
+    if (key == RUN_QUEUE_ATOM) {
+        return term_from_int32(scheduler_run_queue_length(glb));
+    }
+    if ((key != REDUCTIONS_ATOM) && (key != RUNTIME_ATOM) && (key != WALL_CLOCK_ATOM)) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    // {Total, SinceLastCall}
+    if (memory_ensure_free(ctx, 3 + 2 * BOXED_INT64_SIZE) != MEMORY_GC_OK) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    // the write lock also protects the values returned by the last call
+    SMP_RWLOCK_WRLOCK(&glb->processes_table_lock);
+    uint64_t total;
+    uint64_t *last;
+    if (key == WALL_CLOCK_ATOM) {
+        total = scheduler_uptime_us(glb) / 1000;
+        last = &glb->last_wall_clock_ms;
+
+    } else {
+        int reductions = (key == REDUCTIONS_ATOM);
+        // processes that exited are accounted in the global context
+        total = reductions ? glb->exited_reductions : glb->exited_run_time_us;
+        Context *processes = GET_LIST_ENTRY(glb->processes_table, Context, processes_table_head);
+        Context *p = processes;
+        do {
+            total += reductions ? p->stats.reductions : scheduler_run_time_us(p);
+            p = GET_LIST_ENTRY(p->processes_table_head.next, Context, processes_table_head);
+        } while (processes != p);
+
+        if (reductions) {
+            last = &glb->last_reductions;
+        } else {
+            // runtime is the time spent running processes, in milliseconds
+            total /= 1000;
+            last = &glb->last_run_time_ms;
+        }
+    }
+    uint64_t since_last_call = total - *last;
+    *last = total;
+    SMP_RWLOCK_UNLOCK(&glb->processes_table_lock);
+
+    term ret = term_alloc_tuple(2, ctx);
+    term_put_tuple_element(ret, 0, term_make_maybe_boxed_int64(total, ctx));
+    term_put_tuple_element(ret, 1, term_make_maybe_boxed_int64(since_last_call, ctx));
+
     return ret;
 }
 
+static term nif_avm_profiler_start(Context *ctx, int argc, term argv[])
+{
+    // 0 is the default ring buffer size
+    int64_t samples = 0;
+    if (argc == 1) {
+        VALIDATE_VALUE(argv[0], term_is_integer);
+        samples = term_to_int64(argv[0]);
+        if (UNLIKELY((samples <= 0) || (samples > INT_MAX / (int) sizeof(struct ProfilerSample)))) {
+            RAISE_ERROR(BADARG_ATOM);
+        }
+    }
+
+    if (UNLIKELY(!profiler_start(ctx->global, samples))) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return OK_ATOM;
+}
+
+static term nif_avm_profiler_stop_0(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    profiler_stop(ctx->global);
+
+    return OK_ATOM;
+}
+
+static term nif_avm_profiler_folded_stacks_0(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    size_t size;
+    char *folded_stacks = profiler_folded_stacks(ctx->global, &size);
+    if (IS_NULL_PTR(folded_stacks)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    if (UNLIKELY(memory_ensure_free(ctx, term_binary_heap_size(size)) != MEMORY_GC_OK)) {
+        free(folded_stacks);
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+    term binary = term_create_uninitialized_binary(size, ctx);
+    if (LIKELY(!term_is_invalid_term(binary))) {
+        memcpy((void *) term_binary_data(binary), folded_stacks, size);
+    }
+    free(folded_stacks);
+    if (UNLIKELY(term_is_invalid_term(binary))) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return binary;
+}
+
 static term nifs_erlang_system_info(Context *ctx, int argc, term argv[])
 {
     UNUSED(argc);
@@ -1524,6 +2247,13 @@ static term nifs_erlang_system_info(Context *ctx, int argc, term argv[])
     if (key == PORT_COUNT_ATOM) {
         return term_from_int32(nifs_num_ports(ctx->global));
     }
+    if (key == SCHEDULERS_ATOM) {
+        #ifdef AVM_ENABLE_SMP
+            return term_from_int32(ctx->global->schedulers_count);
+        #else
+            return term_from_int32(1);
+        #endif
+    }
     if (key == ATOM_COUNT_ATOM) {
         return term_from_int32(ctx->global->atoms_table->count);
     }
@@ -1619,13 +2349,11 @@ static term nif_binary_part_3(Context *ctx, int argc, term argv[])
         RAISE_ERROR(BADARG_ATOM);
     }
 
-    // + 2, which is the binary header size
-    if (UNLIKELY(memory_ensure_free(ctx, term_binary_data_size_in_terms(len) + BINARY_HEADER_SIZE) != MEMORY_GC_OK)) {
+    if (UNLIKELY(memory_ensure_free(ctx, TERM_BOXED_SUB_BINARY_SIZE) != MEMORY_GC_OK)) {
         RAISE_ERROR(OUT_OF_MEMORY_ATOM);
     }
 
-    const char *bin_data = term_binary_data(argv[0]);
-    return term_from_literal_binary(bin_data + pos, len, ctx);
+    return term_maybe_create_sub_binary(argv[0], pos, len, ctx);
 }
 
 static term nif_binary_split_2(Context *ctx, int argc, term argv[])
@@ -1654,22 +2382,15 @@ static term nif_binary_split_2(Context *ctx, int argc, term argv[])
 
     if (found) {
         int tok_size = offset;
-        // + 2, which is the binary header size
-        int tok_size_in_terms = term_binary_data_size_in_terms(tok_size) + BINARY_HEADER_SIZE;
-
         int rest_size = bin_size - offset - pattern_size;
-        // + 2, which is the binary header size
-        int rest_size_in_terms = term_binary_data_size_in_terms(rest_size) + BINARY_HEADER_SIZE;
 
-        // + 2 which is the result cons
-        if (UNLIKELY(memory_ensure_free(ctx, tok_size_in_terms + rest_size_in_terms + 2) != MEMORY_GC_OK)) {
+        // + 2 * 2 which is the result list
+        if (UNLIKELY(memory_ensure_free(ctx, TERM_BOXED_SUB_BINARY_SIZE * 2 + 2 * 2) != MEMORY_GC_OK)) {
             RAISE_ERROR(OUT_OF_MEMORY_ATOM);
         }
 
-        const char *bin_data = term_binary_data(argv[0]);
-
-        term tok = term_from_literal_binary(bin_data, tok_size, ctx);
-        term rest = term_from_literal_binary(bin_data + offset + pattern_size, rest_size, ctx);
+        term tok = term_maybe_create_sub_binary(argv[0], 0, tok_size, ctx);
+        term rest = term_maybe_create_sub_binary(argv[0], offset + pattern_size, rest_size, ctx);
 
         term result_list = term_list_prepend(rest, term_nil(), ctx);
         result_list = term_list_prepend(tok, result_list, ctx);
@@ -1696,3 +2417,494 @@ static term nif_erts_debug_flat_size(Context *ctx, int argc, term argv[])
 
     return term_from_int32(terms_count);
 }
+
+// raises {error_type_atom, argv[index]}, such as {badmap, Map} or {badkey, Key}
+static term raise_map_error(Context *ctx, term error_type_atom, term argv[], int index)
+{
+    if (UNLIKELY(memory_ensure_free(ctx, 3) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    term error = term_alloc_tuple(2, ctx);
+    term_put_tuple_element(error, 0, error_type_atom);
+    term_put_tuple_element(error, 1, argv[index]);
+
+    RAISE_ERROR(error);
+}
+
+#define VALIDATE_MAP(index) \
+    if (UNLIKELY(!term_is_map(argv[(index)]))) { \
+        return raise_map_error(ctx, BADMAP_ATOM, argv, (index)); \
+    }
+
+static term nif_maps_get_2(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(1);
+
+    term value = map_get_value(argv[1], argv[0], ctx->global);
+    if (term_is_invalid_term(value)) {
+        return raise_map_error(ctx, BADKEY_ATOM, argv, 0);
+    }
+
+    return value;
+}
+
+static term nif_maps_get_3(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(1);
+
+    term value = map_get_value(argv[1], argv[0], ctx->global);
+    if (term_is_invalid_term(value)) {
+        return argv[2];
+    }
+
+    return value;
+}
+
+static term nif_maps_find_2(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(1);
+
+    if (term_is_invalid_term(map_get_value(argv[1], argv[0], ctx->global))) {
+        return ERROR_ATOM;
+    }
+
+    if (UNLIKELY(memory_ensure_free(ctx, 3) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    term result = term_alloc_tuple(2, ctx);
+    term_put_tuple_element(result, 0, OK_ATOM);
+    term_put_tuple_element(result, 1, map_get_value(argv[1], argv[0], ctx->global));
+
+    return result;
+}
+
+static term nif_maps_is_key_2(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(1);
+
+    return term_is_invalid_term(map_get_value(argv[1], argv[0], ctx->global)) ? FALSE_ATOM : TRUE_ATOM;
+}
+
+static term maps_put(Context *ctx, term argv[])
+{
+    size_t heap_size = map_put_heap_size(argv[2], argv[0], ctx->global);
+    if (UNLIKELY(memory_ensure_free(ctx, heap_size) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return map_put(argv[2], argv[0], argv[1], ctx);
+}
+
+static term nif_maps_put_3(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(2);
+
+    return maps_put(ctx, argv);
+}
+
+static term nif_maps_update_3(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(2);
+
+    if (term_is_invalid_term(map_get_value(argv[2], argv[0], ctx->global))) {
+        return raise_map_error(ctx, BADKEY_ATOM, argv, 0);
+    }
+
+    return maps_put(ctx, argv);
+}
+
+static term nif_maps_remove_2(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(1);
+
+    if (UNLIKELY(memory_ensure_free(ctx, map_remove_heap_size(argv[1], argv[0], ctx->global)) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return map_remove(argv[1], argv[0], ctx);
+}
+
+enum MapsListItem
+{
+    MapsListKeys,
+    MapsListValues,
+    MapsListPairs
+};
+
+static term maps_to_list(Context *ctx, term argv[], enum MapsListItem item)
+{
+    VALIDATE_MAP(0);
+
+    size_t size = map_size(argv[0]);
+    size_t item_size = (item == MapsListPairs) ? 3 : 0;
+    if (UNLIKELY(memory_ensure_free(ctx, size * (2 + item_size)) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    // list items are allocated at once and filled front to back, tuples are allocated later
+    term *list_items = memory_heap_alloc(ctx, size * 2);
+    term list = (size > 0) ? term_list_from_list_ptr(list_items) : term_nil();
+
+    struct MapIterator it;
+    map_iterator_init(&it, argv[0]);
+    term key;
+    term value;
+    for (size_t i = 0; map_iterator_next(&it, &key, &value); i++) {
+        term head;
+        switch (item) {
+            case MapsListKeys:
+                head = key;
+                break;
+            case MapsListValues:
+                head = value;
+                break;
+            default:
+                head = term_alloc_tuple(2, ctx);
+                term_put_tuple_element(head, 0, key);
+                term_put_tuple_element(head, 1, value);
+                break;
+        }
+        term tail = (i + 1 < size) ? term_list_from_list_ptr(list_items + (i + 1) * 2) : term_nil();
+        term_list_init_prepend(list_items + i * 2, head, tail);
+    }
+
+    return list;
+}
+
+static term nif_maps_keys_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    return maps_to_list(ctx, argv, MapsListKeys);
+}
+
+static term nif_maps_values_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    return maps_to_list(ctx, argv, MapsListValues);
+}
+
+static term nif_maps_to_list_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    return maps_to_list(ctx, argv, MapsListPairs);
+}
+
+typedef void (*maps_entries_fill_t)(term argv[], struct MapEntry *entries);
+
+// entries are filled twice: garbage collection moves keys and values after the heap size has been computed
+static term maps_from_entries(Context *ctx, term argv[], size_t n, maps_entries_fill_t fill_entries)
+{
+    if (n == 0) {
+        if (UNLIKELY(memory_ensure_free(ctx, map_flat_heap_size(0)) != MEMORY_GC_OK)) {
+            RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+        }
+        return map_new(ctx);
+    }
+
+    struct MapEntry *entries = malloc(n * sizeof(struct MapEntry));
+    if (IS_NULL_PTR(entries)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    fill_entries(argv, entries);
+    size_t unique = map_entries_prepare(entries, n, ctx->global);
+    if (UNLIKELY(memory_ensure_free(ctx, map_from_entries_heap_size(entries, unique)) != MEMORY_GC_OK)) {
+        free(entries);
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    fill_entries(argv, entries);
+    unique = map_entries_prepare(entries, n, ctx->global);
+    term map = map_from_entries(entries, unique, ctx);
+    free(entries);
+
+    return map;
+}
+
+static void maps_fill_from_list(term argv[], struct MapEntry *entries)
+{
+    uint32_t i = 0;
+    for (term l = argv[0]; !term_is_nil(l); l = term_get_list_tail(l)) {
+        term pair = term_get_list_head(l);
+        entries[i].key = term_get_tuple_element(pair, 0);
+        entries[i].value = term_get_tuple_element(pair, 1);
+        entries[i].hash = map_hash_key(entries[i].key);
+        entries[i].order = i;
+        i++;
+    }
+}
+
+static term nif_maps_from_list_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    size_t n = 0;
+    term l = argv[0];
+    while (term_is_nonempty_list(l)) {
+        term pair = term_get_list_head(l);
+        if (UNLIKELY(!term_is_tuple(pair) || term_get_tuple_arity(pair) != 2)) {
+            RAISE_ERROR(BADARG_ATOM);
+        }
+        n++;
+        l = term_get_list_tail(l);
+    }
+    if (UNLIKELY(!term_is_nil(l))) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    return maps_from_entries(ctx, argv, n, maps_fill_from_list);
+}
+
+static term nif_maps_size_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(0);
+
+    return term_from_int32(map_size(argv[0]));
+}
+
+static term nif_maps_new_0(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    if (UNLIKELY(memory_ensure_free(ctx, map_flat_heap_size(0)) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    return map_new(ctx);
+}
+
+static void maps_fill_from_maps(term argv[], struct MapEntry *entries)
+{
+    // keys of the second map have a greater order, so their values win
+    uint32_t i = 0;
+    for (int m = 0; m < 2; m++) {
+        struct MapIterator it;
+        map_iterator_init(&it, argv[m]);
+        while (map_iterator_next(&it, &entries[i].key, &entries[i].value)) {
+            entries[i].hash = map_hash_key(entries[i].key);
+            entries[i].order = i;
+            i++;
+        }
+    }
+}
+
+static term nif_maps_merge_2(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_MAP(0);
+    VALIDATE_MAP(1);
+
+    size_t size1 = map_size(argv[0]);
+    size_t size2 = map_size(argv[1]);
+    if (size2 == 0) {
+        return argv[0];
+    }
+    if (size1 == 0) {
+        return argv[1];
+    }
+
+    return maps_from_entries(ctx, argv, size1 + size2, maps_fill_from_maps);
+}
+
+// sorted lists are a copy of the original list: the new cells are sorted in place by relinking them
+
+// key_index is 0 when whole elements are compared, otherwise the 1-based index of the tuple element used as key
+static inline int lists_compare(term a, term b, int key_index, GlobalContext *global)
+{
+    if (key_index) {
+        a = term_get_tuple_element(a, key_index - 1);
+        b = term_get_tuple_element(b, key_index - 1);
+    }
+
+    return term_compare(a, b, global);
+}
+
+static term lists_merge(term a, term b, int key_index, GlobalContext *global)
+{
+    term result;
+    term *tail = &result;
+
+    while (!term_is_nil(a) && !term_is_nil(b)) {
+        // ties are taken from the first list, which makes the sort stable
+        if (lists_compare(term_get_list_head(b), term_get_list_head(a), key_index, global) < 0) {
+            *tail = b;
+            b = term_get_list_tail(b);
+        } else {
+            *tail = a;
+            a = term_get_list_tail(a);
+        }
+        // the tail is the first word of a cell
+        tail = term_get_list_ptr(*tail);
+    }
+    *tail = term_is_nil(a) ? b : a;
+
+    return result;
+}
+
+// bottom up merge sort, runs[i] is either empty or a sorted run of 2^i elements that come before the ones in runs[i - 1]
+static term lists_sort_cells(term list, int key_index, GlobalContext *global)
+{
+    term runs[sizeof(size_t) * 8];
+    int runs_count = 0;
+
+    while (!term_is_nil(list)) {
+        term run = list;
+        term *cell = term_get_list_ptr(list);
+        list = cell[0];
+        cell[0] = term_nil();
+
+        int i;
+        for (i = 0; (i < runs_count) && !term_is_nil(runs[i]); i++) {
+            run = lists_merge(runs[i], run, key_index, global);
+            runs[i] = term_nil();
+        }
+        if (i == runs_count) {
+            runs_count++;
+        }
+        runs[i] = run;
+    }
+
+    term result = term_nil();
+    for (int i = 0; i < runs_count; i++) {
+        if (!term_is_nil(runs[i])) {
+            result = lists_merge(runs[i], result, key_index, global);
+        }
+    }
+
+    return result;
+}
+
+// validates the list and its elements, see lists_compare for key_index
+static int lists_sortable_length(term list, int key_index, size_t *len)
+{
+    size_t n = 0;
+    while (term_is_nonempty_list(list)) {
+        term t = term_get_list_head(list);
+        if (key_index && (!term_is_tuple(t) || (term_get_tuple_arity(t) < key_index))) {
+            return 0;
+        }
+        n++;
+        list = term_get_list_tail(list);
+    }
+    *len = n;
+
+    return term_is_nil(list);
+}
+
+static term lists_sort(Context *ctx, term argv[], int list_index, int key_index)
+{
+    size_t len;
+    if (UNLIKELY(!lists_sortable_length(argv[list_index], key_index, &len))) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+    if (len == 0) {
+        return term_nil();
+    }
+
+    if (UNLIKELY(memory_ensure_free(ctx, len * 2) != MEMORY_GC_OK)) {
+        RAISE_ERROR(OUT_OF_MEMORY_ATOM);
+    }
+
+    term *cells = memory_heap_alloc(ctx, len * 2);
+    term list = argv[list_index];
+    for (size_t i = 0; i < len; i++) {
+        term tail = (i + 1 < len) ? term_list_from_list_ptr(cells + (i + 1) * 2) : term_nil();
+        term_list_init_prepend(cells + i * 2, term_get_list_head(list), tail);
+        list = term_get_list_tail(list);
+    }
+
+    return lists_sort_cells(term_list_from_list_ptr(cells), key_index, ctx->global);
+}
+
+static term nif_lists_sort_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    return lists_sort(ctx, argv, 0, 0);
+}
+
+static term nif_lists_usort_1(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    term sorted = lists_sort(ctx, argv, 0, 0);
+    if (UNLIKELY(term_is_invalid_term(sorted)) || term_is_nil(sorted)) {
+        return sorted;
+    }
+
+    // equal elements are adjacent now, only the first one of them is kept
+    term *cell = term_get_list_ptr(sorted);
+    while (!term_is_nil(cell[0])) {
+        term *next = term_get_list_ptr(cell[0]);
+        if (term_compare(cell[1], next[1], ctx->global) == 0) {
+            cell[0] = next[0];
+        } else {
+            cell = next;
+        }
+    }
+
+    return sorted;
+}
+
+static term nif_lists_keysort_2(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    VALIDATE_VALUE(argv[0], term_is_integer);
+    int32_t key_index = term_to_int32(argv[0]);
+    if (UNLIKELY(key_index < 1)) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    return lists_sort(ctx, argv, 1, key_index);
+}
+
+static term nif_lists_keyfind_3(Context *ctx, int argc, term argv[])
+{
+    UNUSED(argc);
+
+    term key = argv[0];
+    VALIDATE_VALUE(argv[1], term_is_integer);
+    int32_t key_index = term_to_int32(argv[1]);
+    if (UNLIKELY(key_index < 1)) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    term list = argv[2];
+    while (term_is_nonempty_list(list)) {
+        term t = term_get_list_head(list);
+        if (term_is_tuple(t) && (term_get_tuple_arity(t) >= key_index)
+                && term_equals(term_get_tuple_element(t, key_index - 1), key)) {
+            return t;
+        }
+        list = term_get_list_tail(list);
+    }
+    if (UNLIKELY(!term_is_nil(list))) {
+        RAISE_ERROR(BADARG_ATOM);
+    }
+
+    return FALSE_ATOM;
+}
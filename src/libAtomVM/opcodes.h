@@ -80,23 +80,51 @@
 #define OP_CALL_FUN 75
 #define OP_IS_FUNCTION 77
 #define OP_CALL_EXT_ONLY 78
+#define OP_BS_PUT_INTEGER 89
+#define OP_BS_PUT_BINARY 90
+#define OP_BS_PUT_STRING 92
 #define OP_MAKE_FUN2 103
 #define OP_TRY 104
 #define OP_TRY_END 105
 #define OP_TRY_CASE 106
 #define OP_TRY_CASE_END 107
+#define OP_BS_INIT2 109
+#define OP_BS_ADD 111
 #define OP_APPLY 112
 #define OP_APPLY_LAST 113
 #define OP_IS_BOOLEAN 114
 #define OP_IS_FUNCTION2 115
+#define OP_BS_START_MATCH2 116
+#define OP_BS_GET_INTEGER2 117
+#define OP_BS_GET_BINARY2 119
+#define OP_BS_SKIP_BITS2 120
+#define OP_BS_TEST_TAIL2 121
+#define OP_BS_SAVE2 122
+#define OP_BS_RESTORE2 123
 #define OP_GC_BIF1 124
 #define OP_GC_BIF2 125
+#define OP_BS_CONTEXT_TO_BINARY 130
+#define OP_BS_TEST_UNIT 131
+#define OP_BS_MATCH_STRING 132
+#define OP_BS_INIT_WRITABLE 133
+#define OP_BS_APPEND 134
+#define OP_BS_PRIVATE_APPEND 135
 #define OP_TRIM 136
+#define OP_BS_INIT_BITS 137
 #define OP_RECV_MARK 150
 #define OP_RECV_SET 151
 #define OP_LINE 153
+#define OP_PUT_MAP_ASSOC 154
+#define OP_PUT_MAP_EXACT 155
+#define OP_IS_MAP 156
+#define OP_HAS_MAP_FIELDS 157
+#define OP_GET_MAP_ELEMENTS 158
 #define OP_IS_TAGGED_TUPLE 159
 #define OP_GET_HD 162
 #define OP_GET_TL 163
+#define OP_BS_GET_TAIL 165
+#define OP_BS_START_MATCH3 166
+#define OP_BS_GET_POSITION 167
+#define OP_BS_SET_POSITION 168
 
 #endif
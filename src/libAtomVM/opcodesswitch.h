@@ -22,6 +22,8 @@
 #include <assert.h>
 #include <string.h>
 
+#include "bitstring.h"
+#include "map.h"
 #include "debug.h"
 #include "defaultatoms.h"
 #include "exportedfunction.h"
@@ -32,9 +34,11 @@
 
 #ifdef IMPL_EXECUTE_LOOP
     #include "mailbox.h"
+    #include "profiler.h"
 #endif
 
 #define ENABLE_OTP21
+#define ENABLE_OTP22
 
 //#define ENABLE_TRACE
 
@@ -54,7 +58,7 @@
 #define COMPACT_11BITS_VALUE 0x8
 #define COMPACT_NBITS_VALUE 0x18
 
-#ifdef IMPL_CODE_LOADER
+#if defined(IMPL_CODE_LOADER) && !defined(ENABLE_PREDECODED_CODE)
 #define DECODE_COMPACT_TERM(dest_term, code_chunk, base_index, off, next_operand_offset)\
 {                                                                                       \
     uint8_t first_byte = (code_chunk[(base_index) + (off)]);                            \
@@ -87,6 +91,27 @@
             break;                                                                      \
                                                                                         \
         case COMPACT_LARGE_INTEGER:                                                     \
+            switch (first_byte & COMPACT_LARGE_IMM_MASK) {                              \
+                case COMPACT_11BITS_VALUE:                                              \
+                    next_operand_offset += 2;                                           \
+                    break;                                                              \
+                                                                                        \
+                case COMPACT_NBITS_VALUE: {                                             \
+                    /* integers that do not fit a small integer are boxed once here */  \
+                    const uint8_t *operand = (code_chunk) + (base_index) + (off);       \
+                    int64_t value = large_integer_to_int64(operand, &(next_operand_offset)); \
+                    if (term_int64_heap_size(value)) {                                  \
+                        module_add_large_integer(mod, operand, value);                  \
+                    }                                                                   \
+                    break;                                                              \
+                }                                                                       \
+                                                                                        \
+                default:                                                                \
+                    abort();                                                            \
+                    break;                                                              \
+            }                                                                           \
+            break;                                                                      \
+                                                                                        \
         case COMPACT_LARGE_ATOM:                                                        \
             switch (first_byte & COMPACT_LARGE_IMM_MASK) {                              \
                 case COMPACT_11BITS_VALUE:                                              \
@@ -112,7 +137,7 @@
 }
 #endif
 
-#ifdef IMPL_EXECUTE_LOOP
+#if defined(IMPL_EXECUTE_LOOP) && !defined(ENABLE_PREDECODED_CODE)
 #define DECODE_COMPACT_TERM(dest_term, code_chunk, base_index, off, next_operand_offset)                                \
 {                                                                                                                       \
     uint8_t first_byte = (code_chunk[(base_index) + (off)]);                                                            \
@@ -185,11 +210,16 @@
                     next_operand_offset += 2;                                                                           \
                     break;                                                                                              \
                                                                                                                         \
-                case COMPACT_NBITS_VALUE:                                                                               \
-                    dest_term = term_from_int64(                                                                        \
-                            large_integer_to_int64((code_chunk) + (base_index) + (off), &(next_operand_offset))         \
-                        );                                                                                              \
+                case COMPACT_NBITS_VALUE: {                                                                             \
+                    const uint8_t *operand = (code_chunk) + (base_index) + (off);                                       \
+                    int64_t value = large_integer_to_int64(operand, &(next_operand_offset));                            \
+                    if (term_int64_heap_size(value)) {                                                                  \
+                        dest_term = module_get_large_integer(mod, operand);                                             \
+                    } else {                                                                                            \
+                        dest_term = term_from_int64(value);                                                             \
+                    }                                                                                                   \
                     break;                                                                                              \
+                }                                                                                                       \
                                                                                                                         \
                 default:                                                                                                \
                     abort();                                                                                            \
@@ -204,7 +234,7 @@
 #endif
 
 
-#define DECODE_LABEL(label, code_chunk, base_index, off, next_operand_offset)                       \
+#define DECODE_CHUNK_LABEL(label, code_chunk, base_index, off, next_operand_offset)                 \
 {                                                                                                   \
     uint8_t first_byte = (code_chunk[(base_index) + (off)]);                                        \
     switch (((first_byte) >> 3) & 0x3) {                                                            \
@@ -226,7 +256,7 @@
     }                                                                                               \
 }
 
-#define DECODE_ATOM(atom, code_chunk, base_index, off, next_operand_offset)                         \
+#define DECODE_CHUNK_ATOM(atom, code_chunk, base_index, off, next_operand_offset)                   \
 {                                                                                                   \
     uint8_t first_byte = (code_chunk[(base_index) + (off)]);                                        \
     switch (((first_byte) >> 3) & 0x3) {                                                            \
@@ -248,7 +278,7 @@
     }                                                                                               \
 }
 
-#define DECODE_INTEGER(label, code_chunk, base_index, off, next_operand_offset)                     \
+#define DECODE_CHUNK_INTEGER(label, code_chunk, base_index, off, next_operand_offset)               \
 {                                                                                                   \
     uint8_t first_byte = (code_chunk[(base_index) + (off)]);                                        \
     switch (((first_byte) >> 3) & 0x3) {                                                            \
@@ -270,7 +300,19 @@
     }                                                                                               \
 }
 
-#define DECODE_DEST_REGISTER(dreg, dreg_type, code_chunk, base_index, off, next_operand_offset)     \
+// Reads the slot operand of bs_save2/bs_restore2: the start atom refers to slot 0, saved offsets follow.
+#define DECODE_CHUNK_BS_SLOT(slot, code_chunk, base_index, off, next_operand_offset)                \
+{                                                                                                   \
+    if (((code_chunk)[(base_index) + (off)] & 0x7) == COMPACT_ATOM) {                               \
+        DECODE_CHUNK_ATOM(slot, code_chunk, base_index, off, next_operand_offset)                   \
+        slot = 0;                                                                                   \
+    } else {                                                                                        \
+        DECODE_CHUNK_INTEGER(slot, code_chunk, base_index, off, next_operand_offset)                \
+        slot++;                                                                                     \
+    }                                                                                               \
+}
+
+#define DECODE_CHUNK_DEST_REGISTER(dreg, dreg_type, code_chunk, base_index, off, next_operand_offset) \
 {                                                                                                   \
     dreg_type = code_chunk[(base_index) + (off)] & 0xF;                                             \
     dreg = code_chunk[(base_index) + (off)] >> 4;                                                   \
@@ -309,25 +351,107 @@
 #define NEXT_INSTRUCTION(operands_size) \
     i += operands_size
 
+/*
+ * When ENABLE_COMPUTED_GOTO is set the execute loop dispatches through a table of label addresses
+ * (a GNU C extension) instead of the switch. Every handler is still a case of the switch, so the
+ * loader pass and non GNU compilers keep using the portable path.
+ * Handlers end with DISPATCH_NEXT, that jumps straight to the handler of the next instruction, so
+ * each handler has its own indirect jump that the branch predictor can learn. Only the slow paths
+ * (errors, exceptions) go back to the top of the loop.
+ */
+#if defined(IMPL_EXECUTE_LOOP) && defined(ENABLE_COMPUTED_GOTO) && defined(__GNUC__)
+    #define USE_COMPUTED_GOTO
+#endif
+
+#ifdef USE_COMPUTED_GOTO
+    #define OPCODE_CASE(opcode) \
+        case opcode: \
+        opcode_label_##opcode:
+
+    #define OPCODE_DEFAULT() \
+        default: \
+        opcode_label_default:
+
+    #define DISPATCH_OPCODE() \
+        _Pragma("GCC diagnostic push") \
+        _Pragma("GCC diagnostic ignored \"-Wpedantic\"") \
+        goto *dispatch_table[code[i]]; \
+        _Pragma("GCC diagnostic pop")
+
+    #define DISPATCH_NEXT() \
+        COUNT_OPCODE() \
+        DISPATCH_OPCODE()
+#else
+    #define OPCODE_CASE(opcode) \
+        case opcode:
+
+    #define OPCODE_DEFAULT() \
+        default:
+
+    #define DISPATCH_OPCODE()
+
+    #define DISPATCH_NEXT() \
+        break;
+#endif
+
+#if defined(IMPL_EXECUTE_LOOP) && defined(AVM_ENABLE_OPCODE_COUNTERS)
+    #define COUNT_OPCODE() \
+        SMP_ATOMIC_ADD(&ctx->global->opcode_counters[code[i]], 1);
+#else
+    #define COUNT_OPCODE()
+#endif
+
 #ifndef TRACE_JUMP
     #define JUMP_TO_ADDRESS(address) \
-        i = ((uint8_t *) (address)) - code
+        i = ((CodeUnit *) (address)) - code
 #else
     #define JUMP_TO_ADDRESS(address) \
-        i = ((uint8_t *) (address)) - code; \
+        i = ((CodeUnit *) (address)) - code; \
         fprintf(stderr, "going to jump to %i\n", i)
 #endif
 
+// label operands are stream positions once the code has been pre-decoded, label numbers otherwise
+#ifdef ENABLE_PREDECODED_CODE
+    #define LABEL_ADDRESS(label) \
+        ((void *) &code[label])
+#else
+    #define LABEL_ADDRESS(label) \
+        (mod->labels[label])
+#endif
+
+#define JUMP_TO_LABEL(label) \
+    JUMP_TO_ADDRESS(LABEL_ADDRESS(label))
+
+// catch labels are label numbers of a module that might not be the current one
+#define JUMP_TO_CATCH_LABEL(target_label) \
+    code = module_get_code(mod); \
+    JUMP_TO_ADDRESS(mod->labels[target_label])
+
+// reductions are accounted once for each time slice, when the process is scheduled out
+#define ACCOUNT_REDUCTIONS() \
+    ctx->stats.reductions += DEFAULT_REDUCTIONS_AMOUNT - remaining_reductions; \
+    remaining_reductions = DEFAULT_REDUCTIONS_AMOUNT;
+
+// the sample is weighted by the reductions of the time slice, so it must be taken before they are accounted
+#define PROFILER_SAMPLE(sample_mod, sample_ip) \
+    if (UNLIKELY(profiler_is_enabled(&ctx->global->profiler))) { \
+        profiler_sample(ctx, sample_mod, sample_ip, DEFAULT_REDUCTIONS_AMOUNT - remaining_reductions); \
+    }
+
 #define SCHEDULE_NEXT(restore_mod, restore_to) \
     {                                                                                             \
+        PROFILER_SAMPLE(restore_mod, restore_to);                                                 \
+        ACCOUNT_REDUCTIONS();                                                                     \
         ctx->saved_ip = restore_to;                                                               \
         ctx->jump_to_on_restore = NULL;                                                           \
         ctx->saved_module = restore_mod;                                                          \
         Context *scheduled_context = scheduler_next(ctx->global, ctx);                            \
+        if (UNLIKELY(!scheduled_context)) {                                                       \
+            return 0;                                                                             \
+        }                                                                                         \
         ctx = scheduled_context;                                                                  \
         mod = ctx->saved_module;                                                                  \
-        code = mod->code->code;                                                                   \
-        remaining_reductions = DEFAULT_REDUCTIONS_AMOUNT;                                         \
+        code = module_get_code(mod);                                                              \
         JUMP_TO_ADDRESS(scheduled_context->saved_ip);                                             \
     }
 
@@ -336,28 +460,389 @@
 
 #define DO_RETURN() \
     mod = mod->global->modules_by_index[ctx->cp >> 24]; \
-    code = mod->code->code; \
+    code = module_get_code(mod); \
     i = (ctx->cp & 0xFFFFFF) >> 2;
 
-#define POINTER_TO_II(instruction_pointer) \
-    (((uint8_t *) (instruction_pointer)) - code)
-
 #define RAISE_EXCEPTION() \
     int target_label = get_catch_label_and_change_module(ctx, &mod); \
     if (target_label) { \
-        JUMP_TO_ADDRESS(mod->labels[target_label]); \
+        JUMP_TO_CATCH_LABEL(target_label); \
         break; \
     } else { \
         fprintf(stderr, "exception.\n"); \
         abort(); \
     }
 
-#ifdef IMPL_EXECUTE_LOOP
-struct Int24
+// pre-decoded code is executed with the integers that have been decoded by the loader
+#if !defined(ENABLE_PREDECODED_CODE) || defined(IMPL_CODE_LOADER)
+static int64_t large_integer_to_int64(const uint8_t *compact_term, int *next_operand_offset)
+{
+    int num_bytes = (*compact_term >> 5) + 2;
+    if (UNLIKELY(num_bytes > 8)) {
+        // this is the encoding of integers with more than 8 bytes
+        fprintf(stderr, "Integers larger than 64 bits are not supported.\n");
+        abort();
+    }
+
+    // big endian two's complement: the sign is extended from the first byte
+    uint64_t value = (compact_term[1] & 0x80) ? UINT64_MAX : 0;
+    for (int i = 1; i <= num_bytes; i++) {
+        value = (value << 8) | compact_term[i];
+    }
+    *next_operand_offset += num_bytes + 1;
+
+    return (int64_t) value;
+}
+#endif
+
+#ifdef ENABLE_PREDECODED_CODE
+
+// Registers are the only operands of a pre-decoded stream that are not terms, they use the 00 primary tag
+#define PREDECODED_X_REGISTER 0x0
+#define PREDECODED_Y_REGISTER 0x4
+#define PREDECODED_REGISTER_SHIFT 3
+
+#ifdef IMPL_CODE_LOADER
+
+#define PREDECODED_FIXUP_LABEL 0
+#define PREDECODED_FIXUP_LARGE_INTEGER 1
+
+// Label operands and boxed integers are known only when the whole chunk has been read, so the position of their
+// operands is recorded and they are resolved by predecoded_stream_finish.
+struct PredecodedStream
 {
-    int32_t val24 : 24;
+    CodeUnit *code;
+    unsigned int size;
+    unsigned int instruction;
+
+    unsigned int *fixups;
+    unsigned int fixups_count;
+    unsigned int fixups_capacity;
 };
 
+static void predecoded_stream_init(struct PredecodedStream *stream, Module *mod)
+{
+    // each opcode and operand takes at least one byte, so the chunk size is an upper bound
+    stream->code = malloc(ENDIAN_SWAP_32(mod->code->size) * sizeof(CodeUnit));
+    if (IS_NULL_PTR(stream->code)) {
+        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+        abort();
+    }
+    // no label points to the first position, so 0 still means that a label operand is not set
+    stream->code[0] = 0;
+    stream->size = 1;
+    stream->instruction = 0;
+
+    stream->fixups = NULL;
+    stream->fixups_count = 0;
+    stream->fixups_capacity = 0;
+}
+
+static inline void predecoded_stream_append(struct PredecodedStream *stream, CodeUnit unit)
+{
+    stream->code[stream->size] = unit;
+    stream->size++;
+}
+
+static void predecoded_stream_append_fixup(struct PredecodedStream *stream, int kind, CodeUnit value)
+{
+    if (stream->fixups_count == stream->fixups_capacity) {
+        unsigned int capacity = stream->fixups_capacity ? stream->fixups_capacity * 2 : 64;
+        unsigned int *fixups = realloc(stream->fixups, capacity * sizeof(unsigned int));
+        if (IS_NULL_PTR(fixups)) {
+            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+            abort();
+        }
+        stream->fixups = fixups;
+        stream->fixups_capacity = capacity;
+    }
+
+    stream->fixups[stream->fixups_count] = (stream->size << 1) | kind;
+    stream->fixups_count++;
+    predecoded_stream_append(stream, value);
+}
+
+static inline void predecoded_stream_append_opcode(struct PredecodedStream *stream, uint8_t opcode)
+{
+    stream->instruction = stream->size;
+    predecoded_stream_append(stream, opcode);
+}
+
+// label instructions are not copied to the stream, labels point to the instruction that follows them
+static inline void predecoded_stream_drop_instruction(struct PredecodedStream *stream)
+{
+    stream->size = stream->instruction;
+}
+
+static inline void predecoded_stream_append_label(struct PredecodedStream *stream, int label)
+{
+    if (label) {
+        predecoded_stream_append_fixup(stream, PREDECODED_FIXUP_LABEL, label);
+    } else {
+        predecoded_stream_append(stream, 0);
+    }
+}
+
+static void predecoded_stream_append_compact_term(struct PredecodedStream *stream, Module *mod, const uint8_t *operand, int *next_operand_offset)
+{
+    uint8_t first_byte = operand[0];
+    switch (first_byte & 0xF) {
+        case COMPACT_SMALLINT4:
+            predecoded_stream_append(stream, term_from_int4(first_byte >> 4));
+            *next_operand_offset += 1;
+            break;
+
+        case COMPACT_ATOM:
+            if (first_byte == COMPACT_ATOM) {
+                predecoded_stream_append(stream, term_nil());
+            } else {
+                predecoded_stream_append(stream, module_get_atom_term_by_id(mod, first_byte >> 4));
+            }
+            *next_operand_offset += 1;
+            break;
+
+        case COMPACT_XREG:
+            predecoded_stream_append(stream, ((first_byte >> 4) << PREDECODED_REGISTER_SHIFT) | PREDECODED_X_REGISTER);
+            *next_operand_offset += 1;
+            break;
+
+        case COMPACT_YREG:
+            predecoded_stream_append(stream, ((first_byte >> 4) << PREDECODED_REGISTER_SHIFT) | PREDECODED_Y_REGISTER);
+            *next_operand_offset += 1;
+            break;
+
+        case COMPACT_EXTENDED: {
+            if (first_byte != COMPACT_EXTENDED_LITERAL) {
+                printf("Unexpected %i\n", (int) first_byte);
+                abort();
+            }
+
+            int index;
+            uint8_t first_extended_byte = operand[1];
+            if (!(first_extended_byte & 0xF)) {
+                index = first_extended_byte >> 4;
+                *next_operand_offset += 2;
+            } else if ((first_extended_byte & 0xF) == 0x8) {
+                index = ((first_extended_byte & 0xE0) << 3) | operand[2];
+                *next_operand_offset += 3;
+            } else {
+                abort();
+            }
+
+            // literals are decoded once, they are kept in the cache until the module is destroyed
+            term literal = module_decode_literal(mod, index);
+            if (UNLIKELY(term_is_invalid_term(literal))) {
+                fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+                abort();
+            }
+            predecoded_stream_append(stream, literal);
+            break;
+        }
+
+        case COMPACT_LARGE_INTEGER:
+            switch (first_byte & COMPACT_LARGE_IMM_MASK) {
+                case COMPACT_11BITS_VALUE:
+                    predecoded_stream_append(stream, term_from_int11(((first_byte & 0xE0) << 3) | operand[1]));
+                    *next_operand_offset += 2;
+                    break;
+
+                case COMPACT_NBITS_VALUE: {
+                    int64_t value = large_integer_to_int64(operand, next_operand_offset);
+                    if (term_int64_heap_size(value)) {
+                        // the boxed integer moves while the table grows
+                        module_add_large_integer(mod, operand, value);
+                        predecoded_stream_append_fixup(stream, PREDECODED_FIXUP_LARGE_INTEGER, mod->large_integers_count - 1);
+                    } else {
+                        predecoded_stream_append(stream, term_from_int64(value));
+                    }
+                    break;
+                }
+
+                default:
+                    abort();
+                    break;
+            }
+            break;
+
+        case COMPACT_LARGE_ATOM:
+            switch (first_byte & COMPACT_LARGE_IMM_MASK) {
+                case COMPACT_11BITS_VALUE:
+                    predecoded_stream_append(stream, module_get_atom_term_by_id(mod, ((first_byte & 0xE0) << 3) | operand[1]));
+                    *next_operand_offset += 2;
+                    break;
+
+                case COMPACT_NBITS_VALUE: {
+                    int num_bytes = (first_byte >> 5) + 2;
+                    if (UNLIKELY(num_bytes > 8)) {
+                        fprintf(stderr, "Atom index encoding is not supported.\n");
+                        abort();
+                    }
+                    int atom_index = 0;
+                    for (int i = 1; i <= num_bytes; i++) {
+                        atom_index = (atom_index << 8) | operand[i];
+                    }
+                    predecoded_stream_append(stream, module_get_atom_term_by_id(mod, atom_index));
+                    *next_operand_offset += num_bytes + 1;
+                    break;
+                }
+
+                default:
+                    abort();
+                    break;
+            }
+            break;
+
+        default:
+            fprintf(stderr, "unknown compect term type: %i\n", ((first_byte) & 0xF));
+            abort();
+            break;
+    }
+}
+
+// Resolves the fixups and returns the position of the int_call_end instruction
+static int predecoded_stream_finish(struct PredecodedStream *stream, Module *mod)
+{
+    uint32_t labels_count = ENDIAN_SWAP_32(mod->code->labels);
+
+    for (unsigned int j = 0; j < stream->fixups_count; j++) {
+        unsigned int position = stream->fixups[j] >> 1;
+        CodeUnit value = stream->code[position];
+
+        if ((stream->fixups[j] & 1) == PREDECODED_FIXUP_LABEL) {
+            if (UNLIKELY((value >= labels_count) || IS_NULL_PTR(mod->labels[value]))) {
+                fprintf(stderr, "Undefined label: %i.\n", (int) value);
+                abort();
+            }
+            stream->code[position] = ((CodeUnit *) mod->labels[value]) - stream->code;
+        } else {
+            stream->code[position] = ((term) mod->large_integers[value].boxed_value) | TERM_BOXED_VALUE_TAG;
+        }
+    }
+    free(stream->fixups);
+
+    // the stream has been allocated for the worst case, labels and functions are moved to the trimmed copy
+    CodeUnit *code = malloc(stream->size * sizeof(CodeUnit));
+    if (!IS_NULL_PTR(code)) {
+        memcpy(code, stream->code, stream->size * sizeof(CodeUnit));
+        for (uint32_t j = 0; j < labels_count; j++) {
+            if (mod->labels[j]) {
+                mod->labels[j] = code + (((CodeUnit *) mod->labels[j]) - stream->code);
+            }
+        }
+        for (int j = 0; j < mod->functions_count; j++) {
+            mod->functions[j].code = code + (mod->functions[j].code - stream->code);
+        }
+        free(stream->code);
+        stream->code = code;
+    }
+
+    mod->predecoded_code = stream->code;
+
+    return stream->instruction;
+}
+
+#define DECODE_COMPACT_TERM(dest_term, code_chunk, base_index, off, next_operand_offset)                \
+    predecoded_stream_append_compact_term(&stream, mod, (code_chunk) + (base_index) + (off), &(next_operand_offset));
+
+#define DECODE_LABEL(label, code_chunk, base_index, off, next_operand_offset)                           \
+{                                                                                                       \
+    DECODE_CHUNK_LABEL(label, code_chunk, base_index, off, next_operand_offset)                         \
+    predecoded_stream_append_label(&stream, label);                                                     \
+}
+
+#define DECODE_ATOM(atom, code_chunk, base_index, off, next_operand_offset)                             \
+{                                                                                                       \
+    DECODE_CHUNK_ATOM(atom, code_chunk, base_index, off, next_operand_offset)                           \
+    predecoded_stream_append(&stream, atom);                                                            \
+}
+
+#define DECODE_INTEGER(integer, code_chunk, base_index, off, next_operand_offset)                       \
+{                                                                                                       \
+    DECODE_CHUNK_INTEGER(integer, code_chunk, base_index, off, next_operand_offset)                     \
+    predecoded_stream_append(&stream, integer);                                                         \
+}
+
+#define DECODE_BS_SLOT(slot, code_chunk, base_index, off, next_operand_offset)                          \
+{                                                                                                       \
+    DECODE_CHUNK_BS_SLOT(slot, code_chunk, base_index, off, next_operand_offset)                        \
+    predecoded_stream_append(&stream, slot);                                                            \
+}
+
+#define DECODE_DEST_REGISTER(dreg, dreg_type, code_chunk, base_index, off, next_operand_offset)         \
+{                                                                                                       \
+    predecoded_stream_append(&stream, code_chunk[(base_index) + (off)]);                                \
+    DECODE_CHUNK_DEST_REGISTER(dreg, dreg_type, code_chunk, base_index, off, next_operand_offset)       \
+}
+
+#endif
+
+#ifdef IMPL_EXECUTE_LOOP
+
+#define DECODE_COMPACT_TERM(dest_term, code_chunk, base_index, off, next_operand_offset)                \
+{                                                                                                       \
+    term unit = (code_chunk)[(base_index) + (off)];                                                     \
+    if (unit & 0x3) {                                                                                   \
+        dest_term = unit;                                                                               \
+    } else if (unit & PREDECODED_Y_REGISTER) {                                                          \
+        dest_term = ctx->e[unit >> PREDECODED_REGISTER_SHIFT];                                          \
+    } else {                                                                                            \
+        dest_term = ctx->x[unit >> PREDECODED_REGISTER_SHIFT];                                          \
+    }                                                                                                   \
+    next_operand_offset++;                                                                              \
+}
+
+#define DECODE_OPERAND(value, code_chunk, base_index, off, next_operand_offset)                         \
+{                                                                                                       \
+    value = (code_chunk)[(base_index) + (off)];                                                         \
+    next_operand_offset++;                                                                              \
+}
+
+#define DECODE_LABEL DECODE_OPERAND
+#define DECODE_ATOM DECODE_OPERAND
+#define DECODE_INTEGER DECODE_OPERAND
+#define DECODE_BS_SLOT DECODE_OPERAND
+
+#define DECODE_DEST_REGISTER(dreg, dreg_type, code_chunk, base_index, off, next_operand_offset)         \
+{                                                                                                       \
+    dreg_type = (code_chunk)[(base_index) + (off)] & 0xF;                                               \
+    dreg = (code_chunk)[(base_index) + (off)] >> 4;                                                     \
+    next_operand_offset++;                                                                              \
+}
+
+// list tags and the put instructions of put_tuple are not copied to the stream
+#define SKIP_EXTENDED_LIST_TAG(next_operand_offset)
+
+#define SKIP_PUT_OPCODE(code_chunk, base_index, off, next_operand_offset)
+
+#endif
+
+#else
+
+#define DECODE_LABEL DECODE_CHUNK_LABEL
+#define DECODE_ATOM DECODE_CHUNK_ATOM
+#define DECODE_INTEGER DECODE_CHUNK_INTEGER
+#define DECODE_BS_SLOT DECODE_CHUNK_BS_SLOT
+#define DECODE_DEST_REGISTER DECODE_CHUNK_DEST_REGISTER
+
+#endif
+
+#if !defined(ENABLE_PREDECODED_CODE) || defined(IMPL_CODE_LOADER)
+
+#define SKIP_EXTENDED_LIST_TAG(next_operand_offset) \
+    next_operand_offset++
+
+#define SKIP_PUT_OPCODE(code_chunk, base_index, off, next_operand_offset)                               \
+{                                                                                                       \
+    if (code_chunk[(base_index) + (off)] != OP_PUT) {                                                   \
+        fprintf(stderr, "Expected put, got opcode: %i\n", code_chunk[(base_index) + (off)]);            \
+        abort();                                                                                        \
+    }                                                                                                   \
+    next_operand_offset++;                                                                              \
+}
+
+#endif
+
+#ifdef IMPL_EXECUTE_LOOP
 static int get_catch_label_and_change_module(Context *ctx, Module **mod)
 {
     term *ct = ctx->e;
@@ -386,37 +871,6 @@ static int get_catch_label_and_change_module(Context *ctx, Module **mod)
     return 0;
 }
 
-static int64_t large_integer_to_int64(uint8_t *compact_term, int *next_operand_offset)
-{
-    int num_bytes = (*compact_term >> 5) + 2;
-
-    switch (num_bytes) {
-        case 2: {
-            *next_operand_offset += 3;
-            int16_t ret_val16 = ((int16_t) compact_term[1]) << 8 | compact_term[2];
-            return ret_val16;
-        }
-
-        case 3: {
-            *next_operand_offset += 4;
-            struct Int24 ret_val24;
-            ret_val24.val24 = ((int32_t) compact_term[1]) << 16 | ((int32_t) compact_term[2] << 8) | compact_term[3];
-            return ret_val24.val24;
-        }
-
-        case 4: {
-            *next_operand_offset += 5;
-            int32_t ret_val32;
-            ret_val32 = ((int32_t) compact_term[1]) << 24 | ((int32_t) compact_term[2] << 16)
-                | ((int32_t) compact_term[3] << 8) | compact_term[4];
-            return ret_val32;
-        }
-
-        default:
-            abort();
-    }
-}
-
 term make_fun(Context *ctx, const Module *mod, int fun_index)
 {
     uint32_t n_freeze = module_get_fun_freeze(mod, fun_index);
@@ -543,11 +997,194 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
     if (target_label) {                                                 \
         ctx->x[0] = context_make_atom(ctx, error_atom);                 \
         ctx->x[1] = context_make_atom(ctx, (error_type_atom));          \
-        JUMP_TO_ADDRESS(mod->labels[target_label]);                     \
+        JUMP_TO_CATCH_LABEL(target_label);                              \
         continue;                                                       \
     } else {                                                            \
         abort();                                                        \
     }
+
+static const char *const badarg_atom = "\x6" "badarg";
+static const char *const badmap_atom = "\x6" "badmap";
+static const char *const badkey_atom = "\x6" "badkey";
+
+// Computes the size in bits of a field that is going to be read from a match state, 0 is returned when the size is not
+// valid or when there are not enough bits left. The 'all' atom is used to match everything that is left.
+static int bs_field_size(term match_state, term size, int unit, size_t *bits)
+{
+    size_t offset = term_get_bin_match_state_offset(match_state);
+    size_t available = term_binary_size(term_get_bin_match_state_binary(match_state)) * 8 - offset;
+
+    if (term_is_atom(size)) {
+        if (unit && (available % unit)) {
+            return 0;
+        }
+        *bits = available;
+        return 1;
+    }
+
+    if (UNLIKELY(!term_is_integer(size) || (term_to_int32(size) < 0))) {
+        return 0;
+    }
+
+    size_t field_bits = (size_t) term_to_int32(size) * unit;
+    if (field_bits > available) {
+        return 0;
+    }
+    *bits = field_bits;
+    return 1;
+}
+
+// Creates a match state for a binary, or a new one that continues from where another match state is
+static term bs_start_match(term src, int slots, Context *ctx)
+{
+    if (term_is_bin_match_state(src)) {
+        return term_alloc_bin_match_state(term_get_bin_match_state_binary(src), term_get_bin_match_state_offset(src), slots, ctx);
+    }
+
+    return term_alloc_bin_match_state(src, 0, slots, ctx);
+}
+
+// Turns a match state back into the binary that is matched from its start offset. The match state is rewritten in
+// place as a sub binary, as it is never smaller than a sub binary no memory has to be allocated.
+static term bs_match_state_to_binary(term match_state)
+{
+    term binary = term_get_bin_match_state_binary(match_state);
+    size_t start = term_get_bin_match_state_saved_offset(match_state, 0);
+
+    if (start == 0) {
+        return binary;
+    }
+
+    uint32_t offset = start / 8;
+    uint32_t len = term_binary_size(binary) - offset;
+    if (term_is_sub_binary(binary)) {
+        const term *sub_boxed_value = term_to_const_term_ptr(binary);
+        offset += sub_boxed_value[SUB_BINARY_OFFSET_INDEX];
+        binary = term_get_sub_binary_parent(binary);
+    }
+
+    term *boxed_value = term_to_term_ptr(match_state);
+    int boxed_size = term_boxed_size(match_state) + 1;
+    boxed_value[0] = ((TERM_BOXED_SUB_BINARY_SIZE - 1) << 6) | TERM_BOXED_SUB_BINARY;
+    boxed_value[1] = len;
+    boxed_value[SUB_BINARY_OFFSET_INDEX] = offset;
+    boxed_value[SUB_BINARY_PARENT_INDEX] = binary;
+    // unused saved offsets are overwritten with valid terms, since the heap is scanned linearly
+    for (int i = TERM_BOXED_SUB_BINARY_SIZE; i < boxed_size; i++) {
+        boxed_value[i] = term_nil();
+    }
+
+    return match_state;
+}
+
+// Returns a slice of the matched binary. TERM_BOXED_SUB_BINARY_SIZE terms must be already available on the heap.
+static term bs_match_state_slice(term match_state, size_t offset, size_t bits, Context *ctx)
+{
+    term binary = term_get_bin_match_state_binary(match_state);
+    if ((offset == 0) && (bits / 8 == term_binary_size(binary))) {
+        return binary;
+    }
+
+    return term_maybe_create_sub_binary(binary, offset / 8, bits / 8, ctx);
+}
+
+#define JUMP_OR_RAISE_ERROR(fail_label, error_type_atom)                \
+    if (fail_label) {                                                   \
+        JUMP_TO_LABEL(fail_label);                                      \
+        continue;                                                       \
+    } else {                                                            \
+        RAISE_ERROR(error_type_atom);                                   \
+    }
+
+#define JUMP_OR_RAISE_BADARG(fail_label)                                \
+    JUMP_OR_RAISE_ERROR(fail_label, badarg_atom)
+
+// Checks that a field fits the binary that is being built
+static inline int bs_put_fits(Context *ctx, size_t bits)
+{
+    return ctx->bs_offset + bits <= term_binary_size(ctx->bs) * 8;
+}
+
+static inline uint8_t *bs_put_data(Context *ctx)
+{
+    return (uint8_t *) term_binary_data(ctx->bs);
+}
+
+// Writable binaries at least double their capacity when they are extended, so appends are amortized O(1)
+static inline uint32_t bs_writable_capacity(uint32_t size)
+{
+    uint32_t capacity = size * 2;
+    return (capacity < REFC_BINARY_WRITABLE_MIN) ? REFC_BINARY_WRITABLE_MIN : capacity;
+}
+
+// Returns a binary that is binary followed by extra bytes that have to be written by the caller. When binary is the
+// last one that has been appended to a writable binary its trailing capacity is used, so nothing is copied.
+// REFC_BINARY_HANDLE_SIZE terms must be already available on the heap.
+static term bs_append(term binary, uint32_t extra, Context *ctx)
+{
+    uint32_t size = term_binary_size(binary);
+    uint32_t new_size = size + extra;
+
+    if (term_is_refc_binary(binary)) {
+        const term *boxed_value = term_to_const_term_ptr(binary);
+        struct RefcBinary *refc = (struct RefcBinary *) boxed_value[REFC_BINARY_HANDLE_REFC_INDEX];
+        // binaries can be shared between schedulers, only one of them can claim the trailing capacity
+        uint32_t expected_used = size;
+        if ((refc->size >= new_size) && SMP_ATOMIC_CAS(&refc->used, &expected_used, new_size)) {
+            refc_binary_increment_refcount(refc);
+            return memory_alloc_refc_binary(ctx, refc);
+        }
+    }
+
+    struct RefcBinary *refc = refc_binary_create_writable(term_binary_data(binary), size, bs_writable_capacity(new_size));
+    if (IS_NULL_PTR(refc)) {
+        return term_invalid_term();
+    }
+    refc->used = new_size;
+
+    return memory_alloc_refc_binary(ctx, refc);
+}
+
+// Extends in place a writable binary that is referenced only by the caller, such as the accumulator of a binary
+// comprehension. No heap space is required.
+static term bs_private_append(term binary, uint32_t extra)
+{
+    if (UNLIKELY(!term_is_refc_binary(binary))) {
+        return term_invalid_term();
+    }
+
+    term *boxed_value = term_to_term_ptr(binary);
+    struct RefcBinary *refc = (struct RefcBinary *) boxed_value[REFC_BINARY_HANDLE_REFC_INDEX];
+    uint32_t size = boxed_value[1];
+    uint32_t new_size = size + extra;
+
+    int shared = SMP_ATOMIC_LOAD(&refc->ref_count) > 1;
+    uint32_t expected_used = size;
+    // a shared binary is extended in place only when its trailing capacity can be claimed, as bs_append does
+    if ((refc->size < new_size) || (shared && !SMP_ATOMIC_CAS(&refc->used, &expected_used, new_size))) {
+        struct RefcBinary *new_refc;
+        if (shared) {
+            new_refc = refc_binary_create_writable(refc->data, size, bs_writable_capacity(new_size));
+            if (!IS_NULL_PTR(new_refc)) {
+                refc_binary_decrement_refcount(refc);
+            }
+        } else {
+            new_refc = refc_binary_resize(refc, bs_writable_capacity(new_size));
+        }
+        if (IS_NULL_PTR(new_refc)) {
+            return term_invalid_term();
+        }
+        refc = new_refc;
+        boxed_value[REFC_BINARY_HANDLE_REFC_INDEX] = (term) refc;
+        refc->used = new_size;
+    } else if (!shared) {
+        refc->used = new_size;
+    }
+
+    boxed_value[1] = new_size;
+
+    return binary;
+}
 #endif
 
 #pragma GCC diagnostic push
@@ -567,57 +1204,212 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
     #endif
 #endif
 {
-    uint8_t *code = mod->code->code;
-
+    #ifdef IMPL_CODE_LOADER
+        uint8_t *code = mod->code->code;
+    #else
+        CodeUnit *code = module_get_code(mod);
+    #endif
+
     unsigned int i = 0;
 
     #ifdef IMPL_CODE_LOADER
         TRACE("-- Loading code\n");
     #endif
 
+    #if defined(IMPL_CODE_LOADER) && defined(ENABLE_PREDECODED_CODE)
+        struct PredecodedStream stream;
+        predecoded_stream_init(&stream, mod);
+    #endif
+
     #ifdef IMPL_EXECUTE_LOOP
         TRACE("-- Executing code\n");
 
-        int function_len = strlen(function_name);
-        uint8_t *tmp_atom_name = malloc(function_len + 1);
-        tmp_atom_name[0] = function_len;
-        memcpy(tmp_atom_name + 1, function_name, function_len);
+        int remaining_reductions = DEFAULT_REDUCTIONS_AMOUNT;
 
-        int label = module_search_exported_function(mod, tmp_atom_name, arity);
-        free(tmp_atom_name);
+        if (IS_NULL_PTR(function_name)) {
+            // scheduler threads resume a process where it has been suspended
+            JUMP_TO_ADDRESS(ctx->saved_ip);
+        } else {
+            int function_len = strlen(function_name);
+            uint8_t *tmp_atom_name = malloc(function_len + 1);
+            tmp_atom_name[0] = function_len;
+            memcpy(tmp_atom_name + 1, function_name, function_len);
+
+            int label = module_search_exported_function(mod, tmp_atom_name, arity);
+            free(tmp_atom_name);
+
+            if (UNLIKELY(!label)) {
+                fprintf(stderr, "No %s/%i function found.\n", function_name, arity);
+                return 0;
+            }
 
-        if (UNLIKELY(!label)) {
-            fprintf(stderr, "No %s/%i function found.\n", function_name, arity);
-            return 0;
+            ctx->cp = module_address(mod->module_index, mod->end_instruction_ii);
+            scheduler_start(ctx->global, ctx);
+            JUMP_TO_ADDRESS(mod->labels[label]);
         }
+    #endif
 
-        ctx->cp = module_address(mod->module_index, mod->end_instruction_ii);
-        JUMP_TO_ADDRESS(mod->labels[label]);
-
-        int remaining_reductions = DEFAULT_REDUCTIONS_AMOUNT;
+    #ifdef USE_COMPUTED_GOTO
+        // label addresses are not ISO C, and the default entry is overridden by the opcode ones
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wpedantic"
+        #ifdef __clang__
+            #pragma GCC diagnostic ignored "-Winitializer-overrides"
+        #else
+            #pragma GCC diagnostic ignored "-Woverride-init"
+        #endif
+        static const void *const dispatch_table[256] = {
+            [0 ... 255] = &&opcode_label_default,
+            [OP_LABEL] = &&opcode_label_OP_LABEL,
+            [OP_FUNC_INFO] = &&opcode_label_OP_FUNC_INFO,
+            [OP_INT_CALL_END] = &&opcode_label_OP_INT_CALL_END,
+            [OP_CALL] = &&opcode_label_OP_CALL,
+            [OP_CALL_LAST] = &&opcode_label_OP_CALL_LAST,
+            [OP_CALL_ONLY] = &&opcode_label_OP_CALL_ONLY,
+            [OP_CALL_EXT] = &&opcode_label_OP_CALL_EXT,
+            [OP_CALL_EXT_LAST] = &&opcode_label_OP_CALL_EXT_LAST,
+            [OP_BIF0] = &&opcode_label_OP_BIF0,
+            [OP_BIF1] = &&opcode_label_OP_BIF1,
+            [OP_BIF2] = &&opcode_label_OP_BIF2,
+            [OP_ALLOCATE] = &&opcode_label_OP_ALLOCATE,
+            [OP_ALLOCATE_HEAP] = &&opcode_label_OP_ALLOCATE_HEAP,
+            [OP_ALLOCATE_ZERO] = &&opcode_label_OP_ALLOCATE_ZERO,
+            [OP_ALLOCATE_HEAP_ZERO] = &&opcode_label_OP_ALLOCATE_HEAP_ZERO,
+            [OP_TEST_HEAP] = &&opcode_label_OP_TEST_HEAP,
+            [OP_KILL] = &&opcode_label_OP_KILL,
+            [OP_DEALLOCATE] = &&opcode_label_OP_DEALLOCATE,
+            [OP_RETURN] = &&opcode_label_OP_RETURN,
+            [OP_SEND] = &&opcode_label_OP_SEND,
+            [OP_REMOVE_MESSAGE] = &&opcode_label_OP_REMOVE_MESSAGE,
+            [OP_TIMEOUT] = &&opcode_label_OP_TIMEOUT,
+            [OP_LOOP_REC] = &&opcode_label_OP_LOOP_REC,
+            [OP_LOOP_REC_END] = &&opcode_label_OP_LOOP_REC_END,
+            [OP_WAIT] = &&opcode_label_OP_WAIT,
+            [OP_WAIT_TIMEOUT] = &&opcode_label_OP_WAIT_TIMEOUT,
+            [OP_IS_LT] = &&opcode_label_OP_IS_LT,
+            [OP_IS_GE] = &&opcode_label_OP_IS_GE,
+            [OP_IS_EQUAL] = &&opcode_label_OP_IS_EQUAL,
+            [OP_IS_NOT_EQUAL] = &&opcode_label_OP_IS_NOT_EQUAL,
+            [OP_IS_EQ_EXACT] = &&opcode_label_OP_IS_EQ_EXACT,
+            [OP_IS_NOT_EQ_EXACT] = &&opcode_label_OP_IS_NOT_EQ_EXACT,
+            [OP_IS_INTEGER] = &&opcode_label_OP_IS_INTEGER,
+            [OP_IS_NUMBER] = &&opcode_label_OP_IS_NUMBER,
+            [OP_IS_BINARY] = &&opcode_label_OP_IS_BINARY,
+            [OP_IS_LIST] = &&opcode_label_OP_IS_LIST,
+            [OP_IS_NONEMPTY_LIST] = &&opcode_label_OP_IS_NONEMPTY_LIST,
+            [OP_IS_NIL] = &&opcode_label_OP_IS_NIL,
+            [OP_IS_ATOM] = &&opcode_label_OP_IS_ATOM,
+            [OP_IS_PID] = &&opcode_label_OP_IS_PID,
+            [OP_IS_REFERENCE] = &&opcode_label_OP_IS_REFERENCE,
+            [OP_IS_PORT] = &&opcode_label_OP_IS_PORT,
+            [OP_IS_TUPLE] = &&opcode_label_OP_IS_TUPLE,
+            [OP_TEST_ARITY] = &&opcode_label_OP_TEST_ARITY,
+            [OP_SELECT_VAL] = &&opcode_label_OP_SELECT_VAL,
+            [OP_SELECT_TUPLE_ARITY] = &&opcode_label_OP_SELECT_TUPLE_ARITY,
+            [OP_JUMP] = &&opcode_label_OP_JUMP,
+            [OP_MOVE] = &&opcode_label_OP_MOVE,
+            [OP_GET_LIST] = &&opcode_label_OP_GET_LIST,
+            [OP_GET_TUPLE_ELEMENT] = &&opcode_label_OP_GET_TUPLE_ELEMENT,
+            [OP_SET_TUPLE_ELEMENT] = &&opcode_label_OP_SET_TUPLE_ELEMENT,
+            [OP_PUT_LIST] = &&opcode_label_OP_PUT_LIST,
+            [OP_PUT_TUPLE] = &&opcode_label_OP_PUT_TUPLE,
+            [OP_BADMATCH] = &&opcode_label_OP_BADMATCH,
+            [OP_IF_END] = &&opcode_label_OP_IF_END,
+            [OP_CASE_END] = &&opcode_label_OP_CASE_END,
+            [OP_CALL_FUN] = &&opcode_label_OP_CALL_FUN,
+            [OP_IS_FUNCTION] = &&opcode_label_OP_IS_FUNCTION,
+            [OP_CALL_EXT_ONLY] = &&opcode_label_OP_CALL_EXT_ONLY,
+            [OP_BS_PUT_INTEGER] = &&opcode_label_OP_BS_PUT_INTEGER,
+            [OP_BS_PUT_BINARY] = &&opcode_label_OP_BS_PUT_BINARY,
+            [OP_BS_PUT_STRING] = &&opcode_label_OP_BS_PUT_STRING,
+            [OP_MAKE_FUN2] = &&opcode_label_OP_MAKE_FUN2,
+            [OP_TRY] = &&opcode_label_OP_TRY,
+            [OP_TRY_END] = &&opcode_label_OP_TRY_END,
+            [OP_TRY_CASE] = &&opcode_label_OP_TRY_CASE,
+            [OP_TRY_CASE_END] = &&opcode_label_OP_TRY_CASE_END,
+            [OP_BS_INIT2] = &&opcode_label_OP_BS_INIT2,
+            [OP_BS_ADD] = &&opcode_label_OP_BS_ADD,
+            [OP_APPLY] = &&opcode_label_OP_APPLY,
+            [OP_APPLY_LAST] = &&opcode_label_OP_APPLY_LAST,
+            [OP_IS_BOOLEAN] = &&opcode_label_OP_IS_BOOLEAN,
+            [OP_IS_FUNCTION2] = &&opcode_label_OP_IS_FUNCTION2,
+            [OP_BS_START_MATCH2] = &&opcode_label_OP_BS_START_MATCH2,
+            [OP_BS_GET_INTEGER2] = &&opcode_label_OP_BS_GET_INTEGER2,
+            [OP_BS_GET_BINARY2] = &&opcode_label_OP_BS_GET_BINARY2,
+            [OP_BS_SKIP_BITS2] = &&opcode_label_OP_BS_SKIP_BITS2,
+            [OP_BS_TEST_TAIL2] = &&opcode_label_OP_BS_TEST_TAIL2,
+            [OP_BS_SAVE2] = &&opcode_label_OP_BS_SAVE2,
+            [OP_BS_RESTORE2] = &&opcode_label_OP_BS_RESTORE2,
+            [OP_GC_BIF1] = &&opcode_label_OP_GC_BIF1,
+            [OP_GC_BIF2] = &&opcode_label_OP_GC_BIF2,
+            [OP_BS_CONTEXT_TO_BINARY] = &&opcode_label_OP_BS_CONTEXT_TO_BINARY,
+            [OP_BS_TEST_UNIT] = &&opcode_label_OP_BS_TEST_UNIT,
+            [OP_BS_MATCH_STRING] = &&opcode_label_OP_BS_MATCH_STRING,
+            [OP_BS_INIT_WRITABLE] = &&opcode_label_OP_BS_INIT_WRITABLE,
+            [OP_BS_APPEND] = &&opcode_label_OP_BS_APPEND,
+            [OP_BS_PRIVATE_APPEND] = &&opcode_label_OP_BS_PRIVATE_APPEND,
+            [OP_TRIM] = &&opcode_label_OP_TRIM,
+            [OP_BS_INIT_BITS] = &&opcode_label_OP_BS_INIT_BITS,
+            [OP_RECV_MARK] = &&opcode_label_OP_RECV_MARK,
+            [OP_RECV_SET] = &&opcode_label_OP_RECV_SET,
+            [OP_LINE] = &&opcode_label_OP_LINE,
+            [OP_PUT_MAP_ASSOC] = &&opcode_label_OP_PUT_MAP_ASSOC,
+            [OP_PUT_MAP_EXACT] = &&opcode_label_OP_PUT_MAP_EXACT,
+            [OP_IS_MAP] = &&opcode_label_OP_IS_MAP,
+            [OP_HAS_MAP_FIELDS] = &&opcode_label_OP_HAS_MAP_FIELDS,
+            [OP_GET_MAP_ELEMENTS] = &&opcode_label_OP_GET_MAP_ELEMENTS,
+            [OP_IS_TAGGED_TUPLE] = &&opcode_label_OP_IS_TAGGED_TUPLE,
+#ifdef ENABLE_OTP21
+            [OP_GET_HD] = &&opcode_label_OP_GET_HD,
+            [OP_GET_TL] = &&opcode_label_OP_GET_TL,
+#endif
+#ifdef ENABLE_OTP22
+            [OP_BS_GET_TAIL] = &&opcode_label_OP_BS_GET_TAIL,
+            [OP_BS_START_MATCH3] = &&opcode_label_OP_BS_START_MATCH3,
+            [OP_BS_GET_POSITION] = &&opcode_label_OP_BS_GET_POSITION,
+            [OP_BS_SET_POSITION] = &&opcode_label_OP_BS_SET_POSITION,
+#endif
+        };
+        #pragma GCC diagnostic pop
     #endif
 
     while(1) {
 
+        COUNT_OPCODE()
+        DISPATCH_OPCODE()
+
+        #if defined(IMPL_CODE_LOADER) && defined(ENABLE_PREDECODED_CODE)
+            predecoded_stream_append_opcode(&stream, code[i]);
+        #endif
+
         switch (code[i]) {
-            case OP_LABEL: {
+            OPCODE_CASE(OP_LABEL) {
                 int label;
                 int next_offset = 1;
-                DECODE_LABEL(label, code, i, next_offset, next_offset)
+                #ifdef IMPL_CODE_LOADER
+                    DECODE_CHUNK_LABEL(label, code, i, next_offset, next_offset)
+                #else
+                    DECODE_LABEL(label, code, i, next_offset, next_offset)
+                #endif
 
                 TRACE("label/1 label=%i\n", label);
                 USED_BY_TRACE(label);
 
                 #ifdef IMPL_CODE_LOADER
                     TRACE("Mark label %i here at %i\n", label, i);
-                    module_add_label(mod, label, &code[i]);
+                    #ifdef ENABLE_PREDECODED_CODE
+                        predecoded_stream_drop_instruction(&stream);
+                        module_add_label(mod, label, &stream.code[stream.size]);
+                    #else
+                        module_add_label(mod, label, &code[i]);
+                    #endif
                 #endif
 
                 NEXT_INSTRUCTION(next_offset);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_FUNC_INFO: {
+            OPCODE_CASE(OP_FUNC_INFO) {
                 int next_offset = 1;
                 int module_atom;
                 DECODE_ATOM(module_atom, code, i, next_offset, next_offset)
@@ -631,34 +1423,62 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 USED_BY_TRACE(module_atom);
                 USED_BY_TRACE(arity);
 
+                #ifdef IMPL_CODE_LOADER
+                    #ifdef ENABLE_PREDECODED_CODE
+                        module_add_function(mod, &stream.code[stream.instruction], function_name_atom, arity);
+                    #else
+                        module_add_function(mod, &code[i], function_name_atom, arity);
+                    #endif
+                #endif
+
                 #ifdef IMPL_EXECUTE_LOOP
                     int target_label = get_catch_label_and_change_module(ctx, &mod);
 
                     if (target_label) {
                         ctx->x[0] = ERROR_ATOM;
                         ctx->x[1] = FUNCTION_CLAUSE_ATOM;
-                        JUMP_TO_ADDRESS(mod->labels[target_label]);
+                        JUMP_TO_CATCH_LABEL(target_label);
                     } else {
                         fprintf(stderr, "FUNC_INFO: No function clause for module %i atom %i arity %i.\n", module_atom, function_name_atom, arity);
                         abort();
                     }
+                #endif
 
+                #ifdef IMPL_CODE_LOADER
+                    NEXT_INSTRUCTION(next_offset);
                 #endif
 
-                NEXT_INSTRUCTION(next_offset);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_INT_CALL_END: {
+            OPCODE_CASE(OP_INT_CALL_END) {
                 TRACE("int_call_end!\n");
 
             #ifdef IMPL_CODE_LOADER
                 TRACE("-- Code loading finished --\n");
-                return i;
+                #ifdef ENABLE_PREDECODED_CODE
+                    return predecoded_stream_finish(&stream, mod);
+                #else
+                    return i;
+                #endif
             #endif
 
             #ifdef IMPL_EXECUTE_LOOP
                 TRACE("-- Code execution finished for %i--\n", ctx->process_id);
+                ACCOUNT_REDUCTIONS();
+            #ifdef AVM_ENABLE_SMP
+                // the virtual machine stops when the leader process exits
+                GlobalContext *glb = ctx->global;
+                if (ctx->leader) {
+                    scheduler_stop(glb);
+                }
+                scheduler_terminate(ctx);
+
+                Context *scheduled_context = scheduler_wait(glb, NULL);
+                if (IS_NULL_PTR(scheduled_context)) {
+                    return 0;
+                }
+            #else
                 if (schudule_processes_count(ctx->global) == 1) {
                     scheduler_terminate(ctx);
                     return 0;
@@ -673,18 +1493,18 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 }
 
                 scheduler_terminate(ctx);
+            #endif
 
                 ctx = scheduled_context;
                 mod = ctx->saved_module;
-                code = mod->code->code;
-                remaining_reductions = DEFAULT_REDUCTIONS_AMOUNT;
+                code = module_get_code(mod);
                 JUMP_TO_ADDRESS(scheduled_context->saved_ip);
 
                 break;
             #endif
             }
 
-            case OP_CALL: {
+            OPCODE_CASE(OP_CALL) {
                 int next_offset = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_offset, next_offset);
@@ -701,9 +1521,9 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     remaining_reductions--;
                     if (LIKELY(remaining_reductions)) {
                         TRACE_CALL(ctx, mod, "call", label, arity);
-                        JUMP_TO_ADDRESS(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     } else {
-                        SCHEDULE_NEXT(mod, mod->labels[label]);
+                        SCHEDULE_NEXT(mod, LABEL_ADDRESS(label));
                     }
                 #endif
 
@@ -711,10 +1531,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_offset);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_CALL_LAST: {
+            OPCODE_CASE(OP_CALL_LAST) {
                 int next_offset = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_offset, next_offset);
@@ -737,9 +1557,9 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     remaining_reductions--;
                     if (LIKELY(remaining_reductions)) {
                         TRACE_CALL(ctx, mod, "call_last", label, arity);
-                        JUMP_TO_ADDRESS(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     } else {
-                        SCHEDULE_NEXT(mod, mod->labels[label]);
+                        SCHEDULE_NEXT(mod, LABEL_ADDRESS(label));
                     }
                 #endif
 
@@ -747,10 +1567,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_offset);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_CALL_ONLY: {
+            OPCODE_CASE(OP_CALL_ONLY) {
                 int next_off = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_off, next_off);
@@ -767,9 +1587,9 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     remaining_reductions--;
                     if (LIKELY(remaining_reductions)) {
                         TRACE_CALL(ctx, mod, "call_only", label, arity);
-                        JUMP_TO_ADDRESS(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     } else {
-                        SCHEDULE_NEXT(mod, mod->labels[label]);
+                        SCHEDULE_NEXT(mod, LABEL_ADDRESS(label));
                     }
                 #endif
 
@@ -777,10 +1597,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_CALL_EXT: {
+            OPCODE_CASE(OP_CALL_EXT) {
                 int next_off = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_off, next_off);
@@ -828,7 +1648,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
 
                             ctx->cp = module_address(mod->module_index, i);
                             mod = jump->target;
-                            code = mod->code->code;
+                            code = module_get_code(mod);
                             JUMP_TO_ADDRESS(mod->labels[jump->label]);
 
                             break;
@@ -840,10 +1660,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     }
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_CALL_EXT_LAST: {
+            OPCODE_CASE(OP_CALL_EXT_LAST) {
                 int next_off = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_off, next_off);
@@ -892,7 +1712,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                             const struct ModuleFunction *jump = EXPORTED_FUNCTION_TO_MODULE_FUNCTION(func);
 
                             mod = jump->target;
-                            code = mod->code->code;
+                            code = module_get_code(mod);
                             JUMP_TO_ADDRESS(mod->labels[jump->label]);
 
                             break;
@@ -908,10 +1728,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_BIF0: {
+            OPCODE_CASE(OP_BIF0) {
                 int next_off = 1;
                 int bif;
                 DECODE_INTEGER(bif, code, i, next_off, next_off);
@@ -932,11 +1752,11 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
             //TODO: implement me
-            case OP_BIF1: {
+            OPCODE_CASE(OP_BIF1) {
                 int next_off = 1;
                 int fail_label;
                 DECODE_LABEL(fail_label, code, i, next_off, next_off);
@@ -968,11 +1788,11 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
             //TODO: implement me
-            case OP_BIF2: {
+            OPCODE_CASE(OP_BIF2) {
                 int next_off = 1;
                 int fail_label;
                 DECODE_LABEL(fail_label, code, i, next_off, next_off);
@@ -1007,10 +1827,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_ALLOCATE: {
+            OPCODE_CASE(OP_ALLOCATE) {
                 int next_off = 1;
                 int stack_need;
                 DECODE_INTEGER(stack_need, code, i, next_off, next_off);
@@ -1038,10 +1858,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_ALLOCATE_HEAP: {
+            OPCODE_CASE(OP_ALLOCATE_HEAP) {
                 int next_off = 1;
                 int stack_need;
                 DECODE_INTEGER(stack_need, code, i, next_off, next_off);
@@ -1072,10 +1892,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_ALLOCATE_ZERO: {
+            OPCODE_CASE(OP_ALLOCATE_ZERO) {
                 int next_off = 1;
                 int stack_need;
                 DECODE_INTEGER(stack_need, code, i, next_off, next_off);
@@ -1107,10 +1927,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_ALLOCATE_HEAP_ZERO: {
+            OPCODE_CASE(OP_ALLOCATE_HEAP_ZERO) {
                 int next_off = 1;
                 int stack_need;
                 DECODE_INTEGER(stack_need, code, i, next_off, next_off);
@@ -1144,10 +1964,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_TEST_HEAP: {
+            OPCODE_CASE(OP_TEST_HEAP) {
                 int next_offset = 1;
                 unsigned int heap_need;
                 DECODE_INTEGER(heap_need, code, i, next_offset, next_offset);
@@ -1164,20 +1984,14 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                         if (UNLIKELY(memory_ensure_free(ctx, heap_need) != MEMORY_GC_OK)) {
                             RAISE_ERROR(out_of_memory_atom);
                         }
-                    } else if (context_avail_free_memory(ctx) > heap_need * HEAP_NEED_GC_SHRINK_THRESHOLD_COEFF) {
-                        context_clean_registers(ctx, live_registers);
-                        int used_size = context_memory_size(ctx) - context_avail_free_memory(ctx);
-                        if (UNLIKELY(memory_ensure_free(ctx, used_size + heap_need * (HEAP_NEED_GC_SHRINK_THRESHOLD_COEFF / 2)) != MEMORY_GC_OK)) {
-                            RAISE_ERROR(out_of_memory_atom);
-                        }
                     }
                 #endif
 
                 NEXT_INSTRUCTION(next_offset);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_KILL: {
+            OPCODE_CASE(OP_KILL) {
                 int next_offset = 1;
                 int target;
                 DECODE_INTEGER(target, code, i, next_offset, next_offset);
@@ -1190,10 +2004,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
 
                 NEXT_INSTRUCTION(next_offset);
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_DEALLOCATE: {
+            OPCODE_CASE(OP_DEALLOCATE) {
                 int next_off = 1;
                 int n_words;
                 DECODE_INTEGER(n_words, code, i, next_off, next_off);
@@ -1210,10 +2024,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_RETURN: {
+            OPCODE_CASE(OP_RETURN) {
                 TRACE("return/0\n");
 
                 #ifdef IMPL_EXECUTE_LOOP
@@ -1229,11 +2043,11 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #ifdef IMPL_CODE_LOADER
                     NEXT_INSTRUCTION(1);
                 #endif
-                break;
+                DISPATCH_NEXT()
             }
 
             //TODO: implement send/0
-            case OP_SEND: {
+            OPCODE_CASE(OP_SEND) {
                 #ifdef IMPL_CODE_LOADER
                     TRACE("send/0\n");
                 #endif
@@ -1242,45 +2056,43 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     int local_process_id = term_to_local_process_id(ctx->x[0]);
                     TRACE("send/0 target_pid=%i\n", local_process_id);
                     TRACE_SEND(ctx, ctx->x[0], ctx->x[1]);
-                    Context *target = globalcontext_get_process(ctx->global, local_process_id);
-                    if (!IS_NULL_PTR(target)) {
-                        mailbox_send(target, ctx->x[1]);
-                    }
+                    globalcontext_send_message(ctx->global, local_process_id, ctx->x[1]);
+                    ctx->stats.messages_sent++;
 
                     ctx->x[0] = ctx->x[1];
                 #endif
 
                 NEXT_INSTRUCTION(1);
-                break;
+                DISPATCH_NEXT()
             }
 
             //TODO: implement remove_message/0
-            case OP_REMOVE_MESSAGE: {
+            OPCODE_CASE(OP_REMOVE_MESSAGE) {
                 TRACE("remove_message/0\n");
 
                 #ifdef IMPL_EXECUTE_LOOP
                     mailbox_remove(ctx);
+                    scheduler_cancel_timeout(ctx);
                 #endif
 
                 NEXT_INSTRUCTION(1);
-                break;
+                DISPATCH_NEXT()
             }
 
             //TODO: implement timeout/0
-            case OP_TIMEOUT: {
+            OPCODE_CASE(OP_TIMEOUT) {
                 TRACE("timeout/0\n");
 
                 #ifdef IMPL_EXECUTE_LOOP
-                    ctx->timeout_at.tv_sec = 0;
-                    ctx->timeout_at.tv_nsec = 0;
+                    scheduler_cancel_timeout(ctx);
+                    mailbox_reset(ctx);
                 #endif
 
                 NEXT_INSTRUCTION(1);
-                break;
+                DISPATCH_NEXT()
             }
 
-            //TODO: implemente loop_rec/2
-            case OP_LOOP_REC: {
+            OPCODE_CASE(OP_LOOP_REC) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1292,10 +2104,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 USED_BY_TRACE(dreg);
 
                 #ifdef IMPL_EXECUTE_LOOP
-                    if (ctx->mailbox == NULL) {
-                        JUMP_TO_ADDRESS(mod->labels[label]);
+                    term ret;
+                    if (!mailbox_peek(ctx, &ret)) {
+                        JUMP_TO_LABEL(label);
                     } else {
-                        term ret = mailbox_peek(ctx);
                         TRACE_RECEIVE(ctx, ret);
 
                         WRITE_REGISTER(dreg_type, dreg, ret);
@@ -1307,11 +2119,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            //TODO: stub, implement loop_rec_end/1
-            case OP_LOOP_REC_END: {
+            OPCODE_CASE(OP_LOOP_REC_END) {
                 int next_offset = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_offset, next_offset);
@@ -1319,12 +2130,20 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("loop_rec_end/1 label=%i\n", label);
                 USED_BY_TRACE(label);
 
-                NEXT_INSTRUCTION(next_offset);
-                break;
+                #ifdef IMPL_EXECUTE_LOOP
+                    mailbox_next(ctx);
+                    JUMP_TO_LABEL(label);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    NEXT_INSTRUCTION(next_offset);
+                #endif
+
+                DISPATCH_NEXT()
             }
 
             //TODO: implement wait/1
-            case OP_WAIT: {
+            OPCODE_CASE(OP_WAIT) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1332,14 +2151,19 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("wait/1\n");
 
                 #ifdef IMPL_EXECUTE_LOOP
-                    ctx->saved_ip = mod->labels[label];
+                    PROFILER_SAMPLE(mod, LABEL_ADDRESS(label));
+                    ACCOUNT_REDUCTIONS();
+                    ctx->saved_ip = LABEL_ADDRESS(label);
                     ctx->jump_to_on_restore = NULL;
                     ctx->saved_module = mod;
                     Context *scheduled_context = scheduler_wait(ctx->global, ctx);
+                    if (UNLIKELY(!scheduled_context)) {
+                        return 0;
+                    }
                     ctx = scheduled_context;
 
                     mod = ctx->saved_module;
-                    code = mod->code->code;
+                    code = module_get_code(mod);
                     JUMP_TO_ADDRESS(scheduled_context->saved_ip);
                 #endif
 
@@ -1347,11 +2171,11 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
             //TODO: implement wait_timeout/2
-            case OP_WAIT_TIMEOUT: {
+            OPCODE_CASE(OP_WAIT_TIMEOUT) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1364,7 +2188,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                     //TODO: it looks like x[0] might be used instead of jump_to_on_restore
                     ctx->saved_ip = INSTRUCTION_POINTER();
-                    ctx->jump_to_on_restore = mod->labels[label];
+                    ctx->jump_to_on_restore = LABEL_ADDRESS(label);
                     ctx->saved_module = mod;
 
                     int needs_to_wait = 0;
@@ -1376,10 +2200,15 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     }
 
                     if (needs_to_wait) {
+                        PROFILER_SAMPLE(mod, ctx->saved_ip);
+                        ACCOUNT_REDUCTIONS();
                         Context *scheduled_context = scheduler_wait(ctx->global, ctx);
+                        if (UNLIKELY(!scheduled_context)) {
+                            return 0;
+                        }
                         ctx = scheduled_context;
                         mod = ctx->saved_module;
-                        code = mod->code->code;
+                        code = module_get_code(mod);
                         JUMP_TO_ADDRESS(scheduled_context->saved_ip);
                     }
                 #endif
@@ -1392,11 +2221,11 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
 
-            case OP_IS_LT: {
+            OPCODE_CASE(OP_IS_LT) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off);
@@ -1408,10 +2237,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #ifdef IMPL_EXECUTE_LOOP
                     TRACE("is_lt/2, label=%i, arg1=%lx, arg2=%lx\n", label, arg1, arg2);
 
-                    if (arg1 < arg2) {
+                    if (term_compare(arg1, arg2, ctx->global) < 0) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1422,10 +2251,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_GE: {
+            OPCODE_CASE(OP_IS_GE) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off);
@@ -1437,10 +2266,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #ifdef IMPL_EXECUTE_LOOP
                     TRACE("is_ge/2, label=%i, arg1=%lx, arg2=%lx\n", label, arg1, arg2);
 
-                    if (arg1 >= arg2) {
+                    if (term_compare(arg1, arg2, ctx->global) >= 0) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1451,10 +2280,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_EQUAL: {
+            OPCODE_CASE(OP_IS_EQUAL) {
                 int label;
                 term arg1;
                 term arg2;
@@ -1470,7 +2299,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_equals(arg1, arg2)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1481,10 +2310,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_NOT_EQUAL: {
+            OPCODE_CASE(OP_IS_NOT_EQUAL) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1496,10 +2325,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #ifdef IMPL_EXECUTE_LOOP
                     TRACE("is_not_equal/2, label=%i, arg1=%lx, arg2=%lx\n", label, arg1, arg2);
 
-                    if (arg1 != arg2) {
+                    if (!term_equals(arg1, arg2)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1510,10 +2339,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_EQ_EXACT: {
+            OPCODE_CASE(OP_IS_EQ_EXACT) {
                 int label;
                 term arg1;
                 term arg2;
@@ -1529,7 +2358,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_exactly_equals(arg1, arg2)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1540,10 +2369,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_NOT_EQ_EXACT: {
+            OPCODE_CASE(OP_IS_NOT_EQ_EXACT) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1555,11 +2384,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #ifdef IMPL_EXECUTE_LOOP
                     TRACE("is_not_eq_exact/2, label=%i, arg1=%lx, arg2=%lx\n", label, arg1, arg2);
 
-                    //TODO: implement this
-                    if (arg1 != arg2) {
+                    if (!term_exactly_equals(arg1, arg2)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1570,10 +2398,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
            }
 
-           case OP_IS_INTEGER: {
+           OPCODE_CASE(OP_IS_INTEGER) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1583,10 +2411,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #ifdef IMPL_EXECUTE_LOOP
                     TRACE("is_integer/2, label=%i, arg1=%lx\n", label, arg1);
 
-                    if (term_is_integer(arg1)) {
+                    if (term_is_any_integer(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1597,10 +2425,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-           case OP_IS_NUMBER: {
+           OPCODE_CASE(OP_IS_NUMBER) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1611,10 +2439,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     TRACE("is_number/2, label=%i, arg1=%lx\n", label, arg1);
 
                     //TODO: check for floats too
-                    if (term_is_integer(arg1)) {
+                    if (term_is_any_integer(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1625,10 +2453,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_BINARY: {
+            OPCODE_CASE(OP_IS_BINARY) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1641,7 +2469,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_binary(arg1) || term_is_nil(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1651,10 +2479,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_LIST: {
+            OPCODE_CASE(OP_IS_LIST) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1667,7 +2495,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_list(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1677,10 +2505,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_NONEMPTY_LIST: {
+            OPCODE_CASE(OP_IS_NONEMPTY_LIST) {
                 int label;
                 term arg1;
                 int next_off = 1;
@@ -1693,7 +2521,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_nonempty_list(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1703,10 +2531,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_NIL: {
+            OPCODE_CASE(OP_IS_NIL) {
                 int label;
                 term arg1;
                 int next_off = 1;
@@ -1719,7 +2547,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_nil(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1729,10 +2557,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_ATOM: {
+            OPCODE_CASE(OP_IS_ATOM) {
                 int label;
                 term arg1;
                 int next_off = 1;
@@ -1745,7 +2573,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_atom(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1755,10 +2583,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_PID: {
+            OPCODE_CASE(OP_IS_PID) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1771,7 +2599,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_pid(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1781,10 +2609,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_REFERENCE: {
+            OPCODE_CASE(OP_IS_REFERENCE) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1797,7 +2625,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_reference(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1807,10 +2635,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_PORT: {
+            OPCODE_CASE(OP_IS_PORT) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1822,15 +2650,17 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
 
                     if (term_is_pid(arg1)) {
                         int local_process_id = term_to_local_process_id(arg1);
-                        Context *target = globalcontext_get_process(ctx->global, local_process_id);
+                        Context *target = globalcontext_get_process_lock(ctx->global, local_process_id);
+                        int is_port_driver = target && context_is_port_driver(target);
+                        globalcontext_get_process_unlock(ctx->global, target);
 
-                        if (context_is_port_driver(target)) {
+                        if (is_port_driver) {
                             NEXT_INSTRUCTION(next_off);
                         } else {
-                            i = POINTER_TO_II(mod->labels[label]);
+                            JUMP_TO_LABEL(label);
                         }
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1840,10 +2670,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
            }
 
-           case OP_IS_TUPLE: {
+           OPCODE_CASE(OP_IS_TUPLE) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -1856,7 +2686,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_tuple(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1867,10 +2697,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-           case OP_TEST_ARITY: {
+           OPCODE_CASE(OP_TEST_ARITY) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off);
@@ -1885,7 +2715,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_tuple(arg1) && term_get_tuple_arity(arg1) == arity) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = (uint8_t *) mod->labels[label] - code;
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -1896,16 +2726,16 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_SELECT_VAL: {
+            OPCODE_CASE(OP_SELECT_VAL) {
                 int next_off = 1;
                 term src_value;
                 DECODE_COMPACT_TERM(src_value, code, i, next_off, next_off)
                 int default_label;
                 DECODE_LABEL(default_label, code, i, next_off, next_off)
-                next_off++; //skip extended list tag
+                SKIP_EXTENDED_LIST_TAG(next_off);
                 int size;
                 DECODE_INTEGER(size, code, i, next_off, next_off)
 
@@ -1932,15 +2762,16 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     #endif
 
                     #ifdef IMPL_EXECUTE_LOOP
-                        if (!jump_to_address && (src_value == cmp_value)) {
-                            jump_to_address = mod->labels[jmp_label];
+                        if (!jump_to_address && ((src_value == cmp_value)
+                                || (term_is_boxed(src_value) && term_exactly_equals(src_value, cmp_value)))) {
+                            jump_to_address = LABEL_ADDRESS(jmp_label);
                         }
                     #endif
                 }
 
                 #ifdef IMPL_EXECUTE_LOOP
                     if (!jump_to_address) {
-                        JUMP_TO_ADDRESS(mod->labels[default_label]);
+                        JUMP_TO_LABEL(default_label);
                     } else {
                         JUMP_TO_ADDRESS(jump_to_address);
                     }
@@ -1950,16 +2781,16 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_SELECT_TUPLE_ARITY: {
+            OPCODE_CASE(OP_SELECT_TUPLE_ARITY) {
                 int next_off = 1;
                 term src_value;
                 DECODE_COMPACT_TERM(src_value, code, i, next_off, next_off)
                 int default_label;
                 DECODE_LABEL(default_label, code, i, next_off, next_off)
-                next_off++; //skip extended list tag
+                SKIP_EXTENDED_LIST_TAG(next_off);
                 int size;
                 DECODE_INTEGER(size, code, i, next_off, next_off)
 
@@ -1993,7 +2824,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                         #ifdef IMPL_EXECUTE_LOOP
                             //TODO: check if src_value is a tuple
                             if (!jump_to_address && (arity == cmp_value)) {
-                                jump_to_address = mod->labels[jmp_label];
+                                jump_to_address = LABEL_ADDRESS(jmp_label);
                             }
                         #endif
                     }
@@ -2003,7 +2834,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
 
                 #ifdef IMPL_EXECUTE_LOOP
                     if (!jump_to_address) {
-                        JUMP_TO_ADDRESS(mod->labels[default_label]);
+                        JUMP_TO_LABEL(default_label);
                     } else {
                         JUMP_TO_ADDRESS(jump_to_address);
                     }
@@ -2013,10 +2844,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_JUMP: {
+            OPCODE_CASE(OP_JUMP) {
                 int label;
                 int next_offset = 1;
                 DECODE_LABEL(label, code, i, next_offset, next_offset)
@@ -2027,9 +2858,9 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #ifdef IMPL_EXECUTE_LOOP
                     remaining_reductions--;
                     if (LIKELY(remaining_reductions)) {
-                        JUMP_TO_ADDRESS(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     } else {
-                        SCHEDULE_NEXT(mod, mod->labels[label]);
+                        SCHEDULE_NEXT(mod, LABEL_ADDRESS(label));
                     }
                 #endif
 
@@ -2037,10 +2868,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_offset);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_MOVE: {
+            OPCODE_CASE(OP_MOVE) {
                 int next_off = 1;
                 term src_value;
                 DECODE_COMPACT_TERM(src_value, code, i, next_off, next_off);
@@ -2060,10 +2891,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_GET_LIST: {
+            OPCODE_CASE(OP_GET_LIST) {
                 int next_off = 1;
                 term src_value;
                 DECODE_COMPACT_TERM(src_value, code, i, next_off, next_off)
@@ -2090,10 +2921,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_GET_TUPLE_ELEMENT: {
+            OPCODE_CASE(OP_GET_TUPLE_ELEMENT) {
                 int next_off = 1;
                 term src_value;
                 DECODE_COMPACT_TERM(src_value, code, i, next_off, next_off);
@@ -2120,10 +2951,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_SET_TUPLE_ELEMENT: {
+            OPCODE_CASE(OP_SET_TUPLE_ELEMENT) {
                 int next_off = 1;
                 term new_element;
                 DECODE_COMPACT_TERM(new_element, code, i, next_off, next_off);
@@ -2148,10 +2979,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 UNUSED(new_element);
 #endif
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_PUT_LIST: {
+            OPCODE_CASE(OP_PUT_LIST) {
 
                 int next_off = 1;
                 term head;
@@ -2179,10 +3010,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_PUT_TUPLE: {
+            OPCODE_CASE(OP_PUT_TUPLE) {
                 int next_off = 1;
                 int size;
                 DECODE_INTEGER(size, code, i, next_off, next_off);
@@ -2205,11 +3036,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 for (int j = 0; j < size; j++) {
-                    if (code[i + next_off] != OP_PUT) {
-                        fprintf(stderr, "Expected put, got opcode: %i\n", code[i + next_off]);
-                        abort();
-                    }
-                    next_off++;
+                    SKIP_PUT_OPCODE(code, i, next_off, next_off)
                     term put_value;
                     DECODE_COMPACT_TERM(put_value, code, i, next_off, next_off);
                     #ifdef IMPL_CODE_LOADER
@@ -2227,10 +3054,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 }
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_BADMATCH: {
+            OPCODE_CASE(OP_BADMATCH) {
                 int next_off = 1;
                 term arg1;
                 DECODE_COMPACT_TERM(arg1, code, i, next_off, next_off)
@@ -2246,7 +3073,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     int target_label = get_catch_label_and_change_module(ctx, &mod);
 
                     if (target_label) {
-                        JUMP_TO_ADDRESS(mod->labels[target_label]);
+                        JUMP_TO_CATCH_LABEL(target_label);
                     } else {
                         fprintf(stderr, "No target label for OP_BADMATCH.  arg1=0x%lx\n", arg1);
                         abort();
@@ -2257,17 +3084,17 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IF_END: {
+            OPCODE_CASE(OP_IF_END) {
                 TRACE("if_end/0\n");
 
                 #ifdef IMPL_EXECUTE_LOOP
                     int target_label = get_catch_label_and_change_module(ctx, &mod);
 
                     if (target_label) {
-                        JUMP_TO_ADDRESS(mod->labels[target_label]);
+                        JUMP_TO_CATCH_LABEL(target_label);
                     } else {
                         fprintf(stderr, "No target label for OP_IF_END\n");
                         abort();
@@ -2278,10 +3105,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(1);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_CASE_END: {
+            OPCODE_CASE(OP_CASE_END) {
                 int next_off = 1;
                 term arg1;
                 DECODE_COMPACT_TERM(arg1, code, i, next_off, next_off)
@@ -2297,7 +3124,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     int target_label = get_catch_label_and_change_module(ctx, &mod);
 
                     if (target_label) {
-                        JUMP_TO_ADDRESS(mod->labels[target_label]);
+                        JUMP_TO_CATCH_LABEL(target_label);
                     } else {
                         fprintf(stderr, "No target label for OP_CASE_END.  arg1=0x%lx\n", arg1);
                         abort();
@@ -2308,10 +3135,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_CALL_FUN: {
+            OPCODE_CASE(OP_CALL_FUN) {
                 int next_off = 1;
                 unsigned int args_count;
                 DECODE_INTEGER(args_count, code, i, next_off, next_off)
@@ -2330,7 +3157,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                             term_put_tuple_element(new_error_tuple, 0, BADFUN_ATOM);
                             term_put_tuple_element(new_error_tuple, 1, ctx->x[args_count]);
                             ctx->x[1] = new_error_tuple;
-                            JUMP_TO_ADDRESS(mod->labels[target_label]);
+                            JUMP_TO_CATCH_LABEL(target_label);
                             continue;
 
                         } else {
@@ -2355,7 +3182,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                         if (target_label) {
                             ctx->x[0] = ERROR_ATOM;
                             ctx->x[1] = BADARITY_ATOM;
-                            JUMP_TO_ADDRESS(mod->labels[target_label]);
+                            JUMP_TO_CATCH_LABEL(target_label);
                             continue;
 
                         } else {
@@ -2371,7 +3198,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     ctx->cp = module_address(mod->module_index, i);
 
                     mod = fun_module;
-                    code = mod->code->code;
+                    code = module_get_code(mod);
 
                     remaining_reductions--;
                     if (LIKELY(remaining_reductions)) {
@@ -2386,10 +3213,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-           case OP_IS_FUNCTION: {
+           OPCODE_CASE(OP_IS_FUNCTION) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -2402,7 +3229,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_function(arg1)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -2413,10 +3240,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_CALL_EXT_ONLY: {
+            OPCODE_CASE(OP_CALL_EXT_ONLY) {
                 int next_off = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_off, next_off);
@@ -2466,7 +3293,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                             const struct ModuleFunction *jump = EXPORTED_FUNCTION_TO_MODULE_FUNCTION(func);
 
                             mod = jump->target;
-                            code = mod->code->code;
+                            code = module_get_code(mod);
 
                             JUMP_TO_ADDRESS(mod->labels[jump->label]);
 
@@ -2478,10 +3305,125 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     }
                 #endif
 
-                break;
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_PUT_INTEGER) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_put_integer/5, fail=%i, size=0x%lx, unit=%i, flags=%x, src=0x%lx\n", fail, size, unit, flags, src);
+
+                    if (UNLIKELY(!term_is_integer(size) || (term_to_int32(size) < 0) || !term_is_any_integer(src))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    size_t bits = (size_t) term_to_int32(size) * unit;
+                    if (UNLIKELY(!bs_put_fits(ctx, bits)
+                            || !bitstring_insert_integer(bs_put_data(ctx), ctx->bs_offset, term_maybe_unbox_int64(src), bits, flags))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    ctx->bs_offset += bits;
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_put_integer/5\n");
+                    UNUSED(fail)
+                    UNUSED(size)
+                    UNUSED(unit)
+                    UNUSED(flags)
+                    UNUSED(src)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_PUT_BINARY) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_put_binary/5, fail=%i, size=0x%lx, unit=%i, flags=%x, src=0x%lx\n", fail, size, unit, flags, src);
+
+                    if (UNLIKELY(!term_is_binary(src))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    size_t bits = term_binary_size(src) * 8;
+                    // the 'all' atom is used to put the whole binary
+                    if (!term_is_atom(size)) {
+                        if (UNLIKELY(!term_is_integer(size) || (term_to_int32(size) < 0) || ((size_t) term_to_int32(size) * unit > bits))) {
+                            JUMP_OR_RAISE_BADARG(fail)
+                        }
+                        bits = (size_t) term_to_int32(size) * unit;
+                    }
+                    if (UNLIKELY(!bs_put_fits(ctx, bits))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    bitstring_copy_bits(bs_put_data(ctx), ctx->bs_offset, (const uint8_t *) term_binary_data(src), bits);
+                    ctx->bs_offset += bits;
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_put_binary/5\n");
+                    UNUSED(fail)
+                    UNUSED(size)
+                    UNUSED(unit)
+                    UNUSED(src)
+                #endif
+
+                UNUSED(flags)
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_PUT_STRING) {
+                int next_off = 1;
+                unsigned int len;
+                DECODE_INTEGER(len, code, i, next_off, next_off)
+                unsigned int str_offset;
+                DECODE_INTEGER(str_offset, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_put_string/2, len=%u, str_offset=%u\n", len, str_offset);
+
+                    if (UNLIKELY(!bs_put_fits(ctx, len * 8))) {
+                        RAISE_ERROR(badarg_atom);
+                    }
+                    bitstring_copy_bits(bs_put_data(ctx), ctx->bs_offset, mod->str_table + str_offset, len * 8);
+                    ctx->bs_offset += len * 8;
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_put_string/2\n");
+                    UNUSED(len)
+                    UNUSED(str_offset)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
             }
 
-            case OP_MAKE_FUN2: {
+            OPCODE_CASE(OP_MAKE_FUN2) {
                 int next_off = 1;
                 int fun_index;
                 DECODE_LABEL(fun_index, code, i, next_off, next_off)
@@ -2497,17 +3439,18 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
 
             }
 
-            case OP_TRY: {
+            OPCODE_CASE(OP_TRY) {
                 int next_off = 1;
                 int dreg;
                 uint8_t dreg_type;
                 DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+                // the catch term keeps the label number, so it is not decoded as a label operand
                 int label;
-                DECODE_LABEL(label, code, i, next_off, next_off)
+                DECODE_INTEGER(label, code, i, next_off, next_off)
 
                 TRACE("try/2, label=%i, reg=%c%i\n", label, reg_type_c(dreg_type), dreg);
 
@@ -2518,10 +3461,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_TRY_END: {
+            OPCODE_CASE(OP_TRY_END) {
                 int next_off = 1;
                 int dreg;
                 uint8_t dreg_type;
@@ -2535,11 +3478,11 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
             //TODO: implement
-            case OP_TRY_CASE: {
+            OPCODE_CASE(OP_TRY_CASE) {
                 int next_off = 1;
                 int dreg;
                 uint8_t dreg_type;
@@ -2548,10 +3491,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("try_case/1, reg=%c%i\n", reg_type_c(dreg_type), dreg);
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_TRY_CASE_END: {
+            OPCODE_CASE(OP_TRY_CASE_END) {
                 #ifdef IMPL_EXECUTE_LOOP
                     if (UNLIKELY(memory_ensure_free(ctx, 3) != MEMORY_GC_OK)) {
                         RAISE_ERROR(out_of_memory_atom);
@@ -2578,17 +3521,112 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                         term_put_tuple_element(new_error_tuple, 1, arg1);
                         ctx->x[0] = context_make_atom(ctx, error_atom);
                         ctx->x[1] = new_error_tuple;
-                        JUMP_TO_ADDRESS(mod->labels[target_label]);
+                        JUMP_TO_CATCH_LABEL(target_label);
                     } else {
                         abort();
                     }
                 #endif
 
+                #ifdef IMPL_CODE_LOADER
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_INIT2) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int words;
+                DECODE_INTEGER(words, code, i, next_off, next_off)
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_init2/6, fail=%i, size=0x%lx, words=%i, live=%i, dest=%c%i\n", fail, size, words, live, reg_type_c(dreg_type), dreg);
+
+                    if (UNLIKELY(!term_is_integer(size) || (term_to_int32(size) < 0))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    uint32_t size_in_bytes = term_to_int32(size);
+
+                    if (UNLIKELY(memory_ensure_free(ctx, term_binary_heap_size(size_in_bytes) + words) != MEMORY_GC_OK)) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    term binary = term_create_uninitialized_binary(size_in_bytes, ctx);
+                    if (UNLIKELY(term_is_invalid_term(binary))) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    ctx->bs = binary;
+                    ctx->bs_offset = 0;
+                    WRITE_REGISTER(dreg_type, dreg, binary);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_init2/6\n");
+                    UNUSED(fail)
+                    UNUSED(size)
+                    UNUSED(words)
+                    UNUSED(dreg)
+                #endif
+
+                UNUSED(live)
+                UNUSED(flags)
+
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_ADD) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src1;
+                DECODE_COMPACT_TERM(src1, code, i, next_off, next_off)
+                term src2;
+                DECODE_COMPACT_TERM(src2, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_add/5, fail=%i, src1=0x%lx, src2=0x%lx, unit=%i, dest=%c%i\n", fail, src1, src2, unit, reg_type_c(dreg_type), dreg);
+
+                    if (UNLIKELY(!term_is_integer(src1) || (term_to_int64(src1) < 0)
+                            || !term_is_integer(src2) || (term_to_int64(src2) < 0))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    int64_t sum = term_to_int64(src1) + term_to_int64(src2) * unit;
+                    if (UNLIKELY(sum > TERM_MAX_SMALL_INT)) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    WRITE_REGISTER(dreg_type, dreg, term_from_int64(sum));
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_add/5\n");
+                    UNUSED(fail)
+                    UNUSED(src1)
+                    UNUSED(src2)
+                    UNUSED(unit)
+                    UNUSED(dreg)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
             }
 
-            case OP_APPLY: {
+            OPCODE_CASE(OP_APPLY) {
                 int next_off = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_off, next_off)
@@ -2627,7 +3665,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     }
                     ctx->cp = module_address(mod->module_index, i);
                     mod = target_module;
-                    code = mod->code->code;
+                    code = module_get_code(mod);
                     JUMP_TO_ADDRESS(mod->labels[target_label]);
                 }
 #endif
@@ -2635,10 +3673,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("apply/1 arity=%i\n", arity);
                 NEXT_INSTRUCTION(next_off);
 #endif
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_APPLY_LAST: {
+            OPCODE_CASE(OP_APPLY_LAST) {
                 int next_off = 1;
                 int arity;
                 DECODE_INTEGER(arity, code, i, next_off, next_off)
@@ -2681,7 +3719,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                         RAISE_EXCEPTION();
                     }
                     mod = target_module;
-                    code = mod->code->code;
+                    code = module_get_code(mod);
                     JUMP_TO_ADDRESS(mod->labels[target_label]);
                 }
 #endif
@@ -2689,10 +3727,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("apply_last/1 arity=%i deallocate=%i\n", arity, n_words);
                 NEXT_INSTRUCTION(next_off);
 #endif
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_BOOLEAN: {
+            OPCODE_CASE(OP_IS_BOOLEAN) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -2711,7 +3749,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if ((arg1 == true_term) || (arg1 == false_term)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -2722,10 +3760,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_FUNCTION2: {
+            OPCODE_CASE(OP_IS_FUNCTION2) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -2752,10 +3790,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                         if (arity == fun_arity - fun_n_freeze) {
                             NEXT_INSTRUCTION(next_off);
                         } else {
-                            i = POINTER_TO_II(mod->labels[label]);
+                            JUMP_TO_LABEL(label);
                         }
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -2766,58 +3804,339 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_GC_BIF1: {
+            OPCODE_CASE(OP_BS_START_MATCH2) {
                 int next_off = 1;
-                int f_label;
-                DECODE_LABEL(f_label, code, i, next_off, next_off);
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
                 int live;
-                DECODE_INTEGER(live, code, i, next_off, next_off);
-                int bif;
-                DECODE_INTEGER(bif, code, i, next_off, next_off); //s?
-                term arg1;
-                DECODE_COMPACT_TERM(arg1, code, i, next_off, next_off)
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                int slots;
+                DECODE_INTEGER(slots, code, i, next_off, next_off)
                 int dreg;
                 uint8_t dreg_type;
                 DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
 
                 #ifdef IMPL_EXECUTE_LOOP
-                    TRACE("gc_bif1/5 fail_lbl=%i, live=%i, bif=%i, arg1=0x%lx, dest=r%i\n", f_label, live, bif, arg1, dreg);
+                    TRACE("bs_start_match2/5, fail=%i, src=0x%lx, live=%i, slots=%i, dest=%c%i\n", fail, src, live, slots, reg_type_c(dreg_type), dreg);
 
-                    GCBifImpl1 func = (GCBifImpl1) mod->imported_funcs[bif].bif;
-                    term ret = func(ctx, live, arg1);
-                    if (UNLIKELY(term_is_invalid_term(ret))) {
-                        RAISE_EXCEPTION();
-                    }
+                    // slot 0 holds the start offset
+                    slots++;
 
-                    WRITE_REGISTER(dreg_type, dreg, ret);
+                    if (term_is_bin_match_state(src) && (term_get_bin_match_state_slots(src) >= slots)) {
+                        term_bin_match_state_save_offset(src, 0);
+                        WRITE_REGISTER(dreg_type, dreg, src);
+                        NEXT_INSTRUCTION(next_off);
+
+                    } else if (term_is_bin_match_state(src) || (term_is_binary(src))) {
+                        // registers up to live are already roots, and live might be the number of registers
+                        if (UNLIKELY(memory_ensure_free_with_roots(ctx, TERM_BOXED_BIN_MATCH_STATE_SIZE + slots, 1, &src) != MEMORY_GC_OK)) {
+                            RAISE_ERROR(out_of_memory_atom);
+                        }
+                        term match_state = bs_start_match(src, slots, ctx);
+                        WRITE_REGISTER(dreg_type, dreg, match_state);
+                        NEXT_INSTRUCTION(next_off);
+
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
                 #endif
 
                 #ifdef IMPL_CODE_LOADER
-                    TRACE("gc_bif1/5\n");
-
-                    UNUSED(f_label)
+                    TRACE("bs_start_match2/5\n");
+                    UNUSED(fail)
+                    UNUSED(src)
                     UNUSED(live)
-                    UNUSED(bif)
-                    UNUSED(arg1)
+                    UNUSED(slots)
                     UNUSED(dreg)
+                    NEXT_INSTRUCTION(next_off);
                 #endif
 
-                UNUSED(f_label)
-
-                NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_GC_BIF2: {
+            OPCODE_CASE(OP_BS_GET_INTEGER2) {
                 int next_off = 1;
-                int f_label;
-                DECODE_LABEL(f_label, code, i, next_off, next_off);
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
                 int live;
-                DECODE_INTEGER(live, code, i, next_off, next_off);
-                int bif;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_get_integer2/7, fail=%i, src=0x%lx, size=0x%lx, unit=%i, flags=%x, dest=%c%i\n", fail, src, size, unit, flags, reg_type_c(dreg_type), dreg);
+
+                    size_t offset = term_get_bin_match_state_offset(src);
+                    size_t bits;
+                    int64_t value;
+
+                    // unsigned 64 bits fields with the highest bit set do not fit an int64, matching them fails
+                    if (bs_field_size(src, size, unit, &bits)
+                            && bitstring_extract_integer((const uint8_t *) term_binary_data(term_get_bin_match_state_binary(src)), offset, bits, flags, &value)
+                            && ((value >= 0) || (flags & BitstringFlagsSigned) || (bits < 64))) {
+                        size_t heap_size = term_int64_heap_size(value);
+                        if (heap_size) {
+                            if (UNLIKELY(memory_ensure_free_with_roots(ctx, heap_size, 1, &src) != MEMORY_GC_OK)) {
+                                RAISE_ERROR(out_of_memory_atom);
+                            }
+                        }
+                        term_set_bin_match_state_offset(src, offset + bits);
+                        WRITE_REGISTER(dreg_type, dreg, term_make_maybe_boxed_int64(value, ctx));
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_get_integer2/7\n");
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(size)
+                    UNUSED(unit)
+                    UNUSED(flags)
+                    UNUSED(dreg)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                UNUSED(live)
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_GET_BINARY2) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_get_binary2/7, fail=%i, src=0x%lx, size=0x%lx, unit=%i, flags=%x, dest=%c%i\n", fail, src, size, unit, flags, reg_type_c(dreg_type), dreg);
+
+                    size_t offset = term_get_bin_match_state_offset(src);
+                    size_t bits;
+
+                    // bitstrings are not supported, only whole bytes can be matched
+                    if (bs_field_size(src, size, unit, &bits) && ((offset % 8) == 0) && ((bits % 8) == 0)) {
+                        if (UNLIKELY(memory_ensure_free_with_roots(ctx, TERM_BOXED_SUB_BINARY_SIZE, 1, &src) != MEMORY_GC_OK)) {
+                            RAISE_ERROR(out_of_memory_atom);
+                        }
+                        term slice = bs_match_state_slice(src, offset, bits, ctx);
+                        term_set_bin_match_state_offset(src, offset + bits);
+                        WRITE_REGISTER(dreg_type, dreg, slice);
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_get_binary2/7\n");
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(live)
+                    UNUSED(size)
+                    UNUSED(unit)
+                    UNUSED(dreg)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                UNUSED(flags)
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_SKIP_BITS2) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_skip_bits2/5, fail=%i, src=0x%lx, size=0x%lx, unit=%i, flags=%x\n", fail, src, size, unit, flags);
+
+                    size_t bits;
+                    if (bs_field_size(src, size, unit, &bits)) {
+                        term_set_bin_match_state_offset(src, term_get_bin_match_state_offset(src) + bits);
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_skip_bits2/5\n");
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(size)
+                    UNUSED(unit)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                UNUSED(flags)
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_TEST_TAIL2) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                unsigned int bits;
+                DECODE_INTEGER(bits, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_test_tail2/3, fail=%i, src=0x%lx, bits=%u\n", fail, src, bits);
+
+                    size_t total_bits = term_binary_size(term_get_bin_match_state_binary(src)) * 8;
+                    if (total_bits - term_get_bin_match_state_offset(src) == bits) {
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_test_tail2/3\n");
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(bits)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_SAVE2) {
+                int next_off = 1;
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int slot;
+                DECODE_BS_SLOT(slot, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_save2/2, src=0x%lx, slot=%i\n", src, slot);
+
+                    term_bin_match_state_save_offset(src, slot);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_save2/2\n");
+                    UNUSED(src)
+                    UNUSED(slot)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_RESTORE2) {
+                int next_off = 1;
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int slot;
+                DECODE_BS_SLOT(slot, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_restore2/2, src=0x%lx, slot=%i\n", src, slot);
+
+                    term_bin_match_state_restore_offset(src, slot);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_restore2/2\n");
+                    UNUSED(src)
+                    UNUSED(slot)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_GC_BIF1) {
+                int next_off = 1;
+                int f_label;
+                DECODE_LABEL(f_label, code, i, next_off, next_off);
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off);
+                int bif;
+                DECODE_INTEGER(bif, code, i, next_off, next_off); //s?
+                term arg1;
+                DECODE_COMPACT_TERM(arg1, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("gc_bif1/5 fail_lbl=%i, live=%i, bif=%i, arg1=0x%lx, dest=r%i\n", f_label, live, bif, arg1, dreg);
+
+                    GCBifImpl1 func = (GCBifImpl1) mod->imported_funcs[bif].bif;
+                    term ret = func(ctx, live, arg1);
+                    if (UNLIKELY(term_is_invalid_term(ret))) {
+                        RAISE_EXCEPTION();
+                    }
+
+                    WRITE_REGISTER(dreg_type, dreg, ret);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("gc_bif1/5\n");
+
+                    UNUSED(f_label)
+                    UNUSED(live)
+                    UNUSED(bif)
+                    UNUSED(arg1)
+                    UNUSED(dreg)
+                #endif
+
+                UNUSED(f_label)
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_GC_BIF2) {
+                int next_off = 1;
+                int f_label;
+                DECODE_LABEL(f_label, code, i, next_off, next_off);
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off);
+                int bif;
                 DECODE_INTEGER(bif, code, i, next_off, next_off); //s?
                 term arg1;
                 DECODE_COMPACT_TERM(arg1, code, i, next_off, next_off);
@@ -2853,10 +4172,249 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 UNUSED(f_label)
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_CONTEXT_TO_BINARY) {
+                int next_off = 1;
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_context_to_binary/1, reg=%c%i\n", reg_type_c(dreg_type), dreg);
+
+                    term src;
+                    READ_REGISTER(dreg_type, dreg, src);
+
+                    if (term_is_bin_match_state(src)) {
+                        // bitstrings are not supported
+                        if (UNLIKELY(term_get_bin_match_state_saved_offset(src, 0) % 8)) {
+                            RAISE_ERROR(badarg_atom);
+                        }
+                        WRITE_REGISTER(dreg_type, dreg, bs_match_state_to_binary(src));
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_context_to_binary/1\n");
+                    UNUSED(dreg)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_TEST_UNIT) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                unsigned int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_test_unit/3, fail=%i, src=0x%lx, unit=%u\n", fail, src, unit);
+
+                    size_t total_bits = term_binary_size(term_get_bin_match_state_binary(src)) * 8;
+                    if (((total_bits - term_get_bin_match_state_offset(src)) % unit) == 0) {
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_test_unit/3\n");
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(unit)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_MATCH_STRING) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                unsigned int bits;
+                DECODE_INTEGER(bits, code, i, next_off, next_off)
+                unsigned int str_offset;
+                DECODE_INTEGER(str_offset, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_match_string/4, fail=%i, src=0x%lx, bits=%u, str_offset=%u\n", fail, src, bits, str_offset);
+
+                    term binary = term_get_bin_match_state_binary(src);
+                    size_t offset = term_get_bin_match_state_offset(src);
+
+                    if ((term_binary_size(binary) * 8 - offset >= bits)
+                            && bitstring_match_bits((const uint8_t *) term_binary_data(binary), offset, mod->str_table + str_offset, bits)) {
+                        term_set_bin_match_state_offset(src, offset + bits);
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_match_string/4\n");
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(bits)
+                    UNUSED(str_offset)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
             }
 
-            case OP_TRIM: {
+            OPCODE_CASE(OP_BS_INIT_WRITABLE) {
+                int next_off = 1;
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_init_writable/0, size=0x%lx\n", ctx->x[0]);
+
+                    if (UNLIKELY(!term_is_integer(ctx->x[0]) || (term_to_int32(ctx->x[0]) < 0))) {
+                        RAISE_ERROR(badarg_atom);
+                    }
+                    uint32_t capacity = term_to_int32(ctx->x[0]);
+                    if (capacity < REFC_BINARY_WRITABLE_MIN) {
+                        capacity = REFC_BINARY_WRITABLE_MIN;
+                    }
+
+                    if (UNLIKELY(memory_ensure_free(ctx, REFC_BINARY_HANDLE_SIZE) != MEMORY_GC_OK)) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    struct RefcBinary *refc = refc_binary_create_writable(NULL, 0, capacity);
+                    if (IS_NULL_PTR(refc)) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    ctx->x[0] = memory_alloc_refc_binary(ctx, refc);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_init_writable/0\n");
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_APPEND) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int extra;
+                DECODE_INTEGER(extra, code, i, next_off, next_off)
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_append/8, fail=%i, size=0x%lx, extra=%i, live=%i, unit=%i, src=0x%lx, dest=%c%i\n", fail, size, extra, live, unit, src, reg_type_c(dreg_type), dreg);
+
+                    // size is in bits, bitstrings are not supported
+                    if (UNLIKELY(!term_is_integer(size) || (term_to_int32(size) < 0) || (term_to_int32(size) % 8)
+                            || !term_is_binary(src) || ((term_binary_size(src) * 8) % unit))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    uint32_t extra_bytes = term_to_int32(size) / 8;
+
+                    if (UNLIKELY(memory_ensure_free_with_roots(ctx, REFC_BINARY_HANDLE_SIZE + extra, 1, &src) != MEMORY_GC_OK)) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    term binary = bs_append(src, extra_bytes, ctx);
+                    if (UNLIKELY(term_is_invalid_term(binary))) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    ctx->bs = binary;
+                    ctx->bs_offset = term_binary_size(src) * 8;
+                    WRITE_REGISTER(dreg_type, dreg, binary);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_append/8\n");
+                    UNUSED(fail)
+                    UNUSED(size)
+                    UNUSED(extra)
+                    UNUSED(live)
+                    UNUSED(unit)
+                    UNUSED(src)
+                    UNUSED(dreg)
+                #endif
+
+                UNUSED(flags)
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_PRIVATE_APPEND) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int unit;
+                DECODE_INTEGER(unit, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_private_append/6, fail=%i, size=0x%lx, unit=%i, src=0x%lx, dest=%c%i\n", fail, size, unit, src, reg_type_c(dreg_type), dreg);
+
+                    // size is in bits, bitstrings are not supported
+                    if (UNLIKELY(!term_is_integer(size) || (term_to_int32(size) < 0) || (term_to_int32(size) % 8)
+                            || !term_is_binary(src) || ((term_binary_size(src) * 8) % unit))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    size_t offset = term_binary_size(src) * 8;
+                    term binary = bs_private_append(src, term_to_int32(size) / 8);
+                    if (UNLIKELY(term_is_invalid_term(binary))) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    ctx->bs = binary;
+                    ctx->bs_offset = offset;
+                    WRITE_REGISTER(dreg_type, dreg, binary);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_private_append/6\n");
+                    UNUSED(fail)
+                    UNUSED(size)
+                    UNUSED(unit)
+                    UNUSED(src)
+                    UNUSED(dreg)
+                #endif
+
+                UNUSED(flags)
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_TRIM) {
                 int next_offset = 1;
                 int n_words;
                 DECODE_INTEGER(n_words, code, i, next_offset, next_offset);
@@ -2876,12 +4434,62 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 UNUSED(n_remaining)
 
                 NEXT_INSTRUCTION(next_offset);
-                break;
+                DISPATCH_NEXT()
             }
 
-            //TODO: stub, implement recv_mark/1
-            //it looks like it can be safely left unimplemented
-            case OP_RECV_MARK: {
+            OPCODE_CASE(OP_BS_INIT_BITS) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term size;
+                DECODE_COMPACT_TERM(size, code, i, next_off, next_off)
+                int words;
+                DECODE_INTEGER(words, code, i, next_off, next_off)
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                int flags;
+                DECODE_INTEGER(flags, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_init_bits/6, fail=%i, size=0x%lx, words=%i, live=%i, dest=%c%i\n", fail, size, words, live, reg_type_c(dreg_type), dreg);
+
+                    // bitstrings are not supported
+                    if (UNLIKELY(!term_is_integer(size) || (term_to_int32(size) < 0) || (term_to_int32(size) % 8))) {
+                        JUMP_OR_RAISE_BADARG(fail)
+                    }
+                    uint32_t size_in_bytes = term_to_int32(size) / 8;
+
+                    if (UNLIKELY(memory_ensure_free(ctx, term_binary_heap_size(size_in_bytes) + words) != MEMORY_GC_OK)) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    term binary = term_create_uninitialized_binary(size_in_bytes, ctx);
+                    if (UNLIKELY(term_is_invalid_term(binary))) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    ctx->bs = binary;
+                    ctx->bs_offset = 0;
+                    WRITE_REGISTER(dreg_type, dreg, binary);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_init_bits/6\n");
+                    UNUSED(fail)
+                    UNUSED(size)
+                    UNUSED(words)
+                    UNUSED(dreg)
+                #endif
+
+                UNUSED(live)
+                UNUSED(flags)
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_RECV_MARK) {
                 int next_offset = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_offset, next_offset);
@@ -2889,13 +4497,15 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("recv_mark/1 label=%i\n", label);
                 USED_BY_TRACE(label);
 
+                #ifdef IMPL_EXECUTE_LOOP
+                    mailbox_recv_mark(ctx, LABEL_ADDRESS(label));
+                #endif
+
                 NEXT_INSTRUCTION(next_offset);
-                break;
+                DISPATCH_NEXT()
             }
 
-            //TODO: stub, implement recv_set/1
-            //it looks like it can be safely left unimplemented
-            case OP_RECV_SET: {
+            OPCODE_CASE(OP_RECV_SET) {
                 int next_offset = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_offset, next_offset);
@@ -2903,11 +4513,15 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("recv_set/1 label=%i\n", label);
                 USED_BY_TRACE(label);
 
+                #ifdef IMPL_EXECUTE_LOOP
+                    mailbox_recv_set(ctx, LABEL_ADDRESS(label));
+                #endif
+
                 NEXT_INSTRUCTION(next_offset);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_LINE: {
+            OPCODE_CASE(OP_LINE) {
                 int next_offset = 1;
                 int line_number;
                 DECODE_INTEGER(line_number, code, i, next_offset, next_offset);
@@ -2915,10 +4529,228 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 TRACE("line/1: %i\n", line_number);
 
                 NEXT_INSTRUCTION(next_offset);
-                break;
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_PUT_MAP_ASSOC)
+            OPCODE_CASE(OP_PUT_MAP_EXACT) {
+                int exact = (code[i] == OP_PUT_MAP_EXACT);
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off)
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                SKIP_EXTENDED_LIST_TAG(next_off);
+                int list_len;
+                DECODE_INTEGER(list_len, code, i, next_off, next_off)
+                int pairs_off = next_off;
+                for (int j = 0; j < list_len; j++) {
+                    term element;
+                    DECODE_COMPACT_TERM(element, code, i, next_off, next_off)
+                    UNUSED(element)
+                }
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("put_map_%s/5, fail=%i, src=0x%lx, dest=%c%i, live=%i, pairs=%i\n", exact ? "exact" : "assoc", fail, src, reg_type_c(dreg_type), dreg, live, list_len / 2);
+
+                    if (UNLIKELY(!term_is_map(src))) {
+                        JUMP_OR_RAISE_ERROR(fail, badmap_atom)
+                    }
+
+                    // the map that is being built is passed to the garbage collector as a root
+                    term map = src;
+                    int pair_off = pairs_off;
+                    int missing_key = 0;
+                    int out_of_memory = 0;
+                    for (int j = 0; j < list_len / 2; j++) {
+                        int key_off = pair_off;
+                        term key;
+                        DECODE_COMPACT_TERM(key, code, i, key_off, key_off)
+
+                        if (exact && term_is_invalid_term(map_get_value(map, key, ctx->global))) {
+                            missing_key = 1;
+                            break;
+                        }
+                        if (UNLIKELY(memory_ensure_free_with_roots(ctx, map_put_heap_size(map, key, ctx->global), 1, &map) != MEMORY_GC_OK)) {
+                            out_of_memory = 1;
+                            break;
+                        }
+
+                        // decode again, since garbage collection might have moved them
+                        DECODE_COMPACT_TERM(key, code, i, pair_off, pair_off)
+                        term value;
+                        DECODE_COMPACT_TERM(value, code, i, pair_off, pair_off)
+
+                        map = map_put(map, key, value, ctx);
+                    }
+
+                    if (UNLIKELY(out_of_memory)) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    if (UNLIKELY(missing_key)) {
+                        JUMP_OR_RAISE_ERROR(fail, badkey_atom)
+                    }
+                    WRITE_REGISTER(dreg_type, dreg, map);
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("put_map_%s/5\n", exact ? "exact" : "assoc");
+                    UNUSED(exact)
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(dreg)
+                    UNUSED(live)
+                    UNUSED(pairs_off)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_IS_MAP) {
+                int next_off = 1;
+                int label;
+                DECODE_LABEL(label, code, i, next_off, next_off)
+                term arg1;
+                DECODE_COMPACT_TERM(arg1, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("is_map/2, label=%i, arg1=%lx\n", label, arg1);
+
+                    if (term_is_map(arg1)) {
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(label);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("is_map/2\n");
+                    UNUSED(label)
+                    UNUSED(arg1)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_HAS_MAP_FIELDS) {
+                int next_off = 1;
+                int label;
+                DECODE_LABEL(label, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                SKIP_EXTENDED_LIST_TAG(next_off);
+                int list_len;
+                DECODE_INTEGER(list_len, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("has_map_fields/3, label=%i, src=0x%lx, keys=%i\n", label, src, list_len);
+                    int has_fields = term_is_map(src);
+                #endif
+
+                for (int j = 0; j < list_len; j++) {
+                    term key;
+                    DECODE_COMPACT_TERM(key, code, i, next_off, next_off)
+
+                    #ifdef IMPL_EXECUTE_LOOP
+                        if (has_fields && term_is_invalid_term(map_get_value(src, key, ctx->global))) {
+                            has_fields = 0;
+                        }
+                    #endif
+
+                    #ifdef IMPL_CODE_LOADER
+                        UNUSED(key)
+                    #endif
+                }
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    if (has_fields) {
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(label);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("has_map_fields/3\n");
+                    UNUSED(label)
+                    UNUSED(src)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
             }
 
-            case OP_IS_TAGGED_TUPLE: {
+            OPCODE_CASE(OP_GET_MAP_ELEMENTS) {
+                int next_off = 1;
+                int label;
+                DECODE_LABEL(label, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                SKIP_EXTENDED_LIST_TAG(next_off);
+                int list_len;
+                DECODE_INTEGER(list_len, code, i, next_off, next_off)
+                int pairs_off = next_off;
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("get_map_elements/3, label=%i, src=0x%lx, keys=%i\n", label, src, list_len / 2);
+                    int has_fields = term_is_map(src);
+                #endif
+
+                // destination registers are written only when all keys have been found
+                for (int j = 0; j < list_len / 2; j++) {
+                    term key;
+                    DECODE_COMPACT_TERM(key, code, i, next_off, next_off)
+                    int dreg;
+                    uint8_t dreg_type;
+                    DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off)
+
+                    #ifdef IMPL_EXECUTE_LOOP
+                        if (has_fields && term_is_invalid_term(map_get_value(src, key, ctx->global))) {
+                            has_fields = 0;
+                        }
+                    #endif
+
+                    #ifdef IMPL_CODE_LOADER
+                        UNUSED(key)
+                        UNUSED(dreg)
+                    #endif
+                }
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    if (has_fields) {
+                        for (int j = 0; j < list_len / 2; j++) {
+                            term key;
+                            DECODE_COMPACT_TERM(key, code, i, pairs_off, pairs_off)
+                            int dreg;
+                            uint8_t dreg_type;
+                            DECODE_DEST_REGISTER(dreg, dreg_type, code, i, pairs_off, pairs_off)
+                            WRITE_REGISTER(dreg_type, dreg, map_get_value(src, key, ctx->global));
+                        }
+                        NEXT_INSTRUCTION(next_off);
+                    } else {
+                        JUMP_TO_LABEL(label);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("get_map_elements/3\n");
+                    UNUSED(label)
+                    UNUSED(src)
+                    UNUSED(pairs_off)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_IS_TAGGED_TUPLE) {
                 int next_off = 1;
                 int label;
                 DECODE_LABEL(label, code, i, next_off, next_off)
@@ -2937,7 +4769,7 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     if (term_is_tuple(arg1) && (term_get_tuple_arity(arg1) == arity) && (term_get_tuple_element(arg1, 0) == tag_atom)) {
                         NEXT_INSTRUCTION(next_off);
                     } else {
-                        i = POINTER_TO_II(mod->labels[label]);
+                        JUMP_TO_LABEL(label);
                     }
                 #endif
 
@@ -2948,11 +4780,11 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                     NEXT_INSTRUCTION(next_off);
                 #endif
 
-                break;
+                DISPATCH_NEXT()
             }
 
 #ifdef ENABLE_OTP21
-            case OP_GET_HD: {
+            OPCODE_CASE(OP_GET_HD) {
                 int next_off = 1;
                 term src_value;
                 DECODE_COMPACT_TERM(src_value, code, i, next_off, next_off)
@@ -2974,10 +4806,10 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
             }
 
-            case OP_GET_TL: {
+            OPCODE_CASE(OP_GET_TL) {
                 int next_off = 1;
                 term src_value;
                 DECODE_COMPACT_TERM(src_value, code, i, next_off, next_off)
@@ -2999,12 +4831,147 @@ static const char *const out_of_memory_atom = "\xD" "out_of_memory";
                 #endif
 
                 NEXT_INSTRUCTION(next_off);
-                break;
+                DISPATCH_NEXT()
+            }
+#endif
+
+#ifdef ENABLE_OTP22
+            OPCODE_CASE(OP_BS_GET_TAIL) {
+                int next_off = 1;
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_get_tail/3, src=0x%lx, dest=%c%i, live=%i\n", src, reg_type_c(dreg_type), dreg, live);
+
+                    size_t offset = term_get_bin_match_state_offset(src);
+                    size_t bits = term_binary_size(term_get_bin_match_state_binary(src)) * 8 - offset;
+
+                    // bitstrings are not supported
+                    if (UNLIKELY((offset % 8) != 0)) {
+                        RAISE_ERROR(badarg_atom);
+                    }
+
+                    if (UNLIKELY(memory_ensure_free_with_roots(ctx, TERM_BOXED_SUB_BINARY_SIZE, 1, &src) != MEMORY_GC_OK)) {
+                        RAISE_ERROR(out_of_memory_atom);
+                    }
+                    WRITE_REGISTER(dreg_type, dreg, bs_match_state_slice(src, offset, bits, ctx));
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_get_tail/3\n");
+                    UNUSED(src)
+                    UNUSED(dreg)
+                    UNUSED(live)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_START_MATCH3) {
+                int next_off = 1;
+                int fail;
+                DECODE_LABEL(fail, code, i, next_off, next_off)
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_start_match3/4, fail=%i, src=0x%lx, live=%i, dest=%c%i\n", fail, src, live, reg_type_c(dreg_type), dreg);
+
+                    if (term_is_bin_match_state(src)) {
+                        WRITE_REGISTER(dreg_type, dreg, src);
+                        NEXT_INSTRUCTION(next_off);
+
+                    } else if (term_is_binary(src)) {
+                        if (UNLIKELY(memory_ensure_free_with_roots(ctx, TERM_BOXED_BIN_MATCH_STATE_SIZE + 1, 1, &src) != MEMORY_GC_OK)) {
+                            RAISE_ERROR(out_of_memory_atom);
+                        }
+                        term match_state = bs_start_match(src, 1, ctx);
+                        WRITE_REGISTER(dreg_type, dreg, match_state);
+                        NEXT_INSTRUCTION(next_off);
+
+                    } else {
+                        JUMP_TO_LABEL(fail);
+                    }
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_start_match3/4\n");
+                    UNUSED(fail)
+                    UNUSED(src)
+                    UNUSED(live)
+                    UNUSED(dreg)
+                    NEXT_INSTRUCTION(next_off);
+                #endif
+
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_GET_POSITION) {
+                int next_off = 1;
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                int dreg;
+                uint8_t dreg_type;
+                DECODE_DEST_REGISTER(dreg, dreg_type, code, i, next_off, next_off);
+                int live;
+                DECODE_INTEGER(live, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_get_position/3, src=0x%lx, dest=%c%i, live=%i\n", src, reg_type_c(dreg_type), dreg, live);
+
+                    WRITE_REGISTER(dreg_type, dreg, term_from_int64(term_get_bin_match_state_offset(src)));
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_get_position/3\n");
+                    UNUSED(src)
+                    UNUSED(dreg)
+                #endif
+
+                UNUSED(live)
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
+            }
+
+            OPCODE_CASE(OP_BS_SET_POSITION) {
+                int next_off = 1;
+                term src;
+                DECODE_COMPACT_TERM(src, code, i, next_off, next_off)
+                term pos;
+                DECODE_COMPACT_TERM(pos, code, i, next_off, next_off)
+
+                #ifdef IMPL_EXECUTE_LOOP
+                    TRACE("bs_set_position/2, src=0x%lx, pos=0x%lx\n", src, pos);
+
+                    term_set_bin_match_state_offset(src, term_to_int32(pos));
+                #endif
+
+                #ifdef IMPL_CODE_LOADER
+                    TRACE("bs_set_position/2\n");
+                    UNUSED(src)
+                    UNUSED(pos)
+                #endif
+
+                NEXT_INSTRUCTION(next_off);
+                DISPATCH_NEXT()
             }
 #endif
 
-            default:
-                printf("Undecoded opcode: %i\n", code[i]);
+            OPCODE_DEFAULT()
+                printf("Undecoded opcode: %i\n", (int) code[i]);
                 #ifdef IMPL_EXECUTE_LOOP
                     fprintf(stderr, "failed at %i\n", i);
                 #endif
@@ -73,9 +73,8 @@ term port_create_ok_tuple(Context *ctx, term t)
 void port_send_reply(Context *ctx, term pid, term ref, term reply)
 {
     int local_process_id = term_to_local_process_id(pid);
-    Context *target = globalcontext_get_process(ctx->global, local_process_id);
     term msg = port_create_tuple2(ctx, ref, reply);
-    mailbox_send(target, msg);
+    globalcontext_send_message(ctx->global, local_process_id, msg);
 }
 
 void port_ensure_available(Context *ctx, size_t size)
@@ -0,0 +1,266 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atom.h"
+#include "context.h"
+#include "globalcontext.h"
+#include "module.h"
+#include "utils.h"
+
+#define FRAME_MODULE_INDEX(frame) ((frame) >> 24)
+#define FRAME_FUNCTION_INDEX(frame) ((frame) & 0xFFFFFF)
+
+void profiler_init(struct Profiler *profiler)
+{
+    profiler->enabled = 0;
+    profiler->samples = NULL;
+    profiler->samples_capacity = 0;
+    profiler->samples_head = 0;
+    profiler->samples_count = 0;
+
+    SMP_MUTEX_INIT(&profiler->lock);
+}
+
+void profiler_destroy(struct Profiler *profiler)
+{
+    free(profiler->samples);
+
+    SMP_MUTEX_DESTROY(&profiler->lock);
+}
+
+int profiler_start(GlobalContext *glb, int samples_capacity)
+{
+    struct Profiler *profiler = &glb->profiler;
+
+    if (samples_capacity <= 0) {
+        samples_capacity = PROFILER_DEFAULT_SAMPLES;
+    }
+
+    SMP_MUTEX_LOCK(&profiler->lock);
+    if (profiler->samples_capacity != samples_capacity) {
+        struct ProfilerSample *samples = malloc(samples_capacity * sizeof(struct ProfilerSample));
+        if (IS_NULL_PTR(samples)) {
+            SMP_MUTEX_UNLOCK(&profiler->lock);
+            return 0;
+        }
+        free(profiler->samples);
+        profiler->samples = samples;
+        profiler->samples_capacity = samples_capacity;
+    }
+    profiler->samples_head = 0;
+    profiler->samples_count = 0;
+    SMP_ATOMIC_STORE(&profiler->enabled, 1);
+    SMP_MUTEX_UNLOCK(&profiler->lock);
+
+    return 1;
+}
+
+void profiler_stop(GlobalContext *glb)
+{
+    struct Profiler *profiler = &glb->profiler;
+
+    SMP_MUTEX_LOCK(&profiler->lock);
+    SMP_ATOMIC_STORE(&profiler->enabled, 0);
+    SMP_MUTEX_UNLOCK(&profiler->lock);
+}
+
+static int profiler_frame(const Module *mod, const void *code_ptr, uint32_t *frame)
+{
+    const struct ModuleFunctionInfo *function = module_find_function(mod, code_ptr);
+    if (IS_NULL_PTR(function)) {
+        return 0;
+    }
+
+    *frame = (mod->module_index << 24) | (function - mod->functions);
+    return 1;
+}
+
+// stack slots that have not been initialized yet might look like continuation pointers, so they are validated
+static int profiler_frame_from_cp(GlobalContext *glb, term cp, uint32_t *frame)
+{
+    if (!term_is_cp(cp)) {
+        return 0;
+    }
+
+    unsigned long module_index = cp >> 24;
+    if (module_index >= (unsigned long) glb->loaded_modules_count) {
+        return 0;
+    }
+    const Module *mod = glb->modules_by_index[module_index];
+    if (IS_NULL_PTR(mod)) {
+        return 0;
+    }
+
+    return profiler_frame(mod, module_get_code(mod) + ((cp & 0xFFFFFF) >> 2), frame);
+}
+
+void profiler_sample(Context *ctx, const Module *mod, const void *ip, unsigned long reductions)
+{
+    GlobalContext *glb = ctx->global;
+    struct Profiler *profiler = &glb->profiler;
+
+    if (reductions == 0) {
+        return;
+    }
+
+    struct ProfilerSample sample;
+    sample.weight = reductions;
+    sample.depth = 0;
+
+    uint32_t frame;
+    if (profiler_frame(mod, ip, &frame)) {
+        sample.frames[sample.depth++] = frame;
+    }
+
+    // the continuation pointer register is saved in the frame allocated by the running function, and after a
+    // call it keeps pointing into the running function, so it is the caller only when it is not one of them
+    term *stack_top = ctx->e;
+    while ((stack_top != ctx->stack_base) && !term_is_cp(*stack_top)) {
+        stack_top++;
+    }
+    int cp_is_saved = (stack_top != ctx->stack_base) && (*stack_top == ctx->cp);
+    if (!cp_is_saved && profiler_frame_from_cp(glb, ctx->cp, &frame)
+            && ((sample.depth == 0) || (frame != sample.frames[0]))) {
+        sample.frames[sample.depth++] = frame;
+    }
+
+    for (term *t = stack_top; (t != ctx->stack_base) && (sample.depth < PROFILER_MAX_DEPTH); t++) {
+        if (profiler_frame_from_cp(glb, *t, &frame)) {
+            sample.frames[sample.depth++] = frame;
+        }
+    }
+
+    if (sample.depth == 0) {
+        return;
+    }
+
+    SMP_MUTEX_LOCK(&profiler->lock);
+    if (profiler->enabled) {
+        memcpy(&profiler->samples[profiler->samples_head], &sample, sizeof(struct ProfilerSample));
+        profiler->samples_head = (profiler->samples_head + 1) % profiler->samples_capacity;
+        if (profiler->samples_count < profiler->samples_capacity) {
+            profiler->samples_count++;
+        }
+    }
+    SMP_MUTEX_UNLOCK(&profiler->lock);
+}
+
+static int profiler_compare_samples(const void *a, const void *b)
+{
+    const struct ProfilerSample *sample_a = *((const struct ProfilerSample **) a);
+    const struct ProfilerSample *sample_b = *((const struct ProfilerSample **) b);
+
+    if (sample_a->depth != sample_b->depth) {
+        return sample_a->depth - sample_b->depth;
+    }
+
+    return memcmp(sample_a->frames, sample_b->frames, sample_a->depth * sizeof(uint32_t));
+}
+
+static size_t profiler_append(char *buf, size_t pos, const void *data, size_t len)
+{
+    if (buf) {
+        memcpy(buf + pos, data, len);
+    }
+    return pos + len;
+}
+
+// when buf is NULL only the size of the line is computed
+static size_t profiler_write_stack(GlobalContext *glb, const struct ProfilerSample *sample, unsigned long weight, char *buf, size_t pos)
+{
+    char number[24];
+
+    // folded stacks start from the outermost function
+    for (int i = sample->depth - 1; i >= 0; i--) {
+        const Module *mod = glb->modules_by_index[FRAME_MODULE_INDEX(sample->frames[i])];
+        const struct ModuleFunctionInfo *function = &mod->functions[FRAME_FUNCTION_INDEX(sample->frames[i])];
+
+        AtomString module_name = module_get_atom_string_by_id(mod, 1);
+        AtomString function_name = module_get_atom_string_by_id(mod, function->function_atom_id);
+        int number_len = snprintf(number, sizeof(number), "/%i", function->arity);
+
+        pos = profiler_append(buf, pos, atom_string_data(module_name), atom_string_len(module_name));
+        pos = profiler_append(buf, pos, ":", 1);
+        pos = profiler_append(buf, pos, atom_string_data(function_name), atom_string_len(function_name));
+        pos = profiler_append(buf, pos, number, number_len);
+        if (i > 0) {
+            pos = profiler_append(buf, pos, ";", 1);
+        }
+    }
+
+    int number_len = snprintf(number, sizeof(number), " %lu\n", weight);
+    return profiler_append(buf, pos, number, number_len);
+}
+
+// identical stacks are adjacent once sorted, so each one is written once with the sum of their weights
+static size_t profiler_write_stacks(GlobalContext *glb, const struct ProfilerSample **sorted, int count, char *buf)
+{
+    size_t pos = 0;
+
+    int i = 0;
+    while (i < count) {
+        unsigned long weight = sorted[i]->weight;
+        int j = i + 1;
+        while ((j < count) && (profiler_compare_samples(&sorted[i], &sorted[j]) == 0)) {
+            weight += sorted[j]->weight;
+            j++;
+        }
+        pos = profiler_write_stack(glb, sorted[i], weight, buf, pos);
+        i = j;
+    }
+
+    return pos;
+}
+
+char *profiler_folded_stacks(GlobalContext *glb, size_t *size)
+{
+    struct Profiler *profiler = &glb->profiler;
+
+    SMP_MUTEX_LOCK(&profiler->lock);
+
+    int count = profiler->samples_count;
+    const struct ProfilerSample **sorted = malloc((count + 1) * sizeof(struct ProfilerSample *));
+    if (IS_NULL_PTR(sorted)) {
+        SMP_MUTEX_UNLOCK(&profiler->lock);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        sorted[i] = &profiler->samples[i];
+    }
+    qsort(sorted, count, sizeof(struct ProfilerSample *), profiler_compare_samples);
+
+    size_t buf_size = profiler_write_stacks(glb, sorted, count, NULL);
+    char *buf = malloc(buf_size + 1);
+    if (!IS_NULL_PTR(buf)) {
+        profiler_write_stacks(glb, sorted, count, buf);
+        buf[buf_size] = '\0';
+        *size = buf_size;
+    }
+
+    SMP_MUTEX_UNLOCK(&profiler->lock);
+    free(sorted);
+
+    return buf;
+}
@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+/**
+ * @file profiler.h
+ * @brief Sampling profiler.
+ *
+ * @details Each time a process is scheduled out the interpreter records the function it was running and the
+ * functions found on its call stack, weighted by the reductions it executed during its time slice. Samples are
+ * kept in a ring buffer, so the most recent ones are retained, and they can be dumped as folded stacks, which is
+ * the format expected by flame graph tools.
+ */
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "smp.h"
+
+// this header is included by globalcontext.h, so structs are used instead of their typedefs
+struct Context;
+struct GlobalContext;
+struct Module;
+
+// deeper frames are not recorded, so the outermost functions of deep stacks are missing
+#define PROFILER_MAX_DEPTH 32
+#define PROFILER_DEFAULT_SAMPLES 1024
+
+struct ProfilerSample
+{
+    unsigned long weight;
+    int depth;
+    // module index in the upper 8 bits, index of the function in the module in the lower 24 bits, leaf first
+    uint32_t frames[PROFILER_MAX_DEPTH];
+};
+
+struct Profiler
+{
+    // it is read without holding the lock, so it is cheap to check on the interpreter hot paths
+    int enabled;
+
+    struct ProfilerSample *samples;
+    int samples_capacity;
+    // next sample that will be written, the oldest one is overwritten when the buffer is full
+    int samples_head;
+    int samples_count;
+
+    #ifdef AVM_ENABLE_SMP
+        Mutex lock;
+    #endif
+};
+
+/**
+ * @brief Initializes a profiler
+ *
+ * @details Initializes a stopped profiler without any sample.
+ * @param profiler the profiler that will be initialized.
+ */
+void profiler_init(struct Profiler *profiler);
+
+/**
+ * @brief Frees the profiler samples
+ *
+ * @param profiler the profiler that will be destroyed.
+ */
+void profiler_destroy(struct Profiler *profiler);
+
+/**
+ * @brief Starts the profiler
+ *
+ * @details Discards all the samples that have been collected so far and starts collecting new ones.
+ * @param glb the global context.
+ * @param samples_capacity how many samples are retained, 0 to use PROFILER_DEFAULT_SAMPLES.
+ * @returns 1 on success, 0 if the ring buffer cannot be allocated.
+ */
+int profiler_start(struct GlobalContext *glb, int samples_capacity);
+
+/**
+ * @brief Stops the profiler
+ *
+ * @details Stops collecting samples, collected samples are retained until the profiler is started again.
+ * @param glb the global context.
+ */
+void profiler_stop(struct GlobalContext *glb);
+
+/**
+ * @brief Records a sample
+ *
+ * @details Records the function that contains ip and the functions on the call stack of ctx, it is called by the
+ * interpreter when ctx is scheduled out.
+ * @param ctx the process that is being scheduled out.
+ * @param mod the module ip belongs to.
+ * @param ip the address where the execution of ctx will be resumed.
+ * @param reductions the reductions executed in the time slice, used as weight of the sample.
+ */
+void profiler_sample(struct Context *ctx, const struct Module *mod, const void *ip, unsigned long reductions);
+
+/**
+ * @brief Dumps collected samples as folded stacks
+ *
+ * @details Returns a malloc'ed buffer with a line for each distinct stack, such as
+ * "mod:outer/0;mod:inner/1 2048", outermost function first, followed by the sum of the weights of its samples.
+ * @param glb the global context.
+ * @param size set to the size of the returned buffer.
+ * @returns the buffer, that must be freed by the caller, or NULL if it cannot be allocated.
+ */
+char *profiler_folded_stacks(struct GlobalContext *glb, size_t *size);
+
+/**
+ * @brief Checks if the profiler is collecting samples
+ *
+ * @param profiler the profiler.
+ * @returns 1 if it is enabled, 0 otherwise.
+ */
+static inline int profiler_is_enabled(struct Profiler *profiler)
+{
+    return SMP_ATOMIC_LOAD(&profiler->enabled);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+#include "refc_binary.h"
+
+#include <string.h>
+
+#include "utils.h"
+
+struct RefcBinary *refc_binary_create(const void *data, uint32_t size)
+{
+    struct RefcBinary *refc = malloc(sizeof(struct RefcBinary) + size);
+    if (IS_NULL_PTR(refc)) {
+        return NULL;
+    }
+    refc->ref_count = 1;
+    refc->size = size;
+    refc->used = size;
+    if (data) {
+        memcpy(refc->data, data, size);
+    }
+
+    return refc;
+}
+
+struct RefcBinary *refc_binary_create_writable(const void *data, uint32_t used, uint32_t capacity)
+{
+    struct RefcBinary *refc = refc_binary_create(NULL, capacity);
+    if (IS_NULL_PTR(refc)) {
+        return NULL;
+    }
+    if (used) {
+        memcpy(refc->data, data, used);
+    }
+    refc->used = used;
+
+    return refc;
+}
+
+struct RefcBinary *refc_binary_resize(struct RefcBinary *refc, uint32_t capacity)
+{
+    struct RefcBinary *resized = realloc(refc, sizeof(struct RefcBinary) + capacity);
+    if (IS_NULL_PTR(resized)) {
+        return NULL;
+    }
+    resized->size = capacity;
+
+    return resized;
+}
+
+void refc_binary_decrement_refcount(struct RefcBinary *refc)
+{
+    if (SMP_ATOMIC_FETCH_SUB(&refc->ref_count, 1) == 1) {
+        free(refc);
+    }
+}
@@ -0,0 +1,104 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+/**
+ * @file refc_binary.h
+ * @brief Reference counted binaries
+ *
+ * @details Binaries that are bigger than REFC_BINARY_MIN are stored once outside of process heaps, processes hold a small
+ * boxed handle that points to them. Binary data is released when the last handle is collected.
+ * Binaries built by appending are writable: they are allocated with some spare capacity, so the last appended binary
+ * can be extended in place.
+ */
+
+#ifndef _REFC_BINARY_H_
+#define _REFC_BINARY_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "smp.h"
+
+// binaries smaller than this amount of bytes are stored on the process heap
+#define REFC_BINARY_MIN 64
+// minimum capacity of writable binaries
+#define REFC_BINARY_WRITABLE_MIN 256
+
+struct RefcBinary
+{
+    // binaries can be shared by processes running on different schedulers, so it is updated atomically
+    unsigned int ref_count;
+    // allocated bytes
+    uint32_t size;
+    // bytes that are part of some binary, bytes after them can be written by appends
+    uint32_t used;
+    uint8_t data[];
+};
+
+/**
+ * @brief Creates a new reference counted binary
+ *
+ * @details Allocates a new binary with a reference count of 1, data is copied when not NULL, otherwise binary data is not
+ * initialized.
+ * @param data binary data that will be copied or NULL.
+ * @param size binary size in bytes.
+ * @returns the newly created binary or NULL when memory allocation fails.
+ */
+struct RefcBinary *refc_binary_create(const void *data, uint32_t size);
+
+/**
+ * @brief Creates a new writable binary
+ *
+ * @details Allocates a binary that has room for capacity bytes and copies used bytes of data into it.
+ * @param data binary data that will be copied.
+ * @param used size in bytes of data.
+ * @param capacity allocated size, it must not be smaller than used.
+ * @returns the newly created binary or NULL when memory allocation fails.
+ */
+struct RefcBinary *refc_binary_create_writable(const void *data, uint32_t used, uint32_t capacity);
+
+/**
+ * @brief Changes the capacity of a binary that has a single reference
+ *
+ * @details The binary might be moved, the old pointer is not valid anymore after this call.
+ * @param refc the binary that is going to be resized.
+ * @param capacity the new allocated size.
+ * @returns the resized binary or NULL when memory allocation fails, the old binary is still valid in that case.
+ */
+struct RefcBinary *refc_binary_resize(struct RefcBinary *refc, uint32_t capacity);
+
+/**
+ * @brief Increments binary reference count
+ *
+ * @param refc the binary that is going to be referenced.
+ */
+static inline void refc_binary_increment_refcount(struct RefcBinary *refc)
+{
+    SMP_ATOMIC_ADD(&refc->ref_count, 1);
+}
+
+/**
+ * @brief Decrements binary reference count
+ *
+ * @details Decrements binary reference count, binary memory is released when no references are left.
+ * @param refc the binary that is no longer referenced.
+ */
+void refc_binary_decrement_refcount(struct RefcBinary *refc);
+
+#endif
@@ -17,277 +17,1085 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
  ***************************************************************************/
 
+
 #include "debug.h"
 #include "list.h"
+#include "mailbox.h"
+#include "memory.h"
 #include "scheduler.h"
 #include "sys.h"
 #include "utils.h"
 
 #include "time.h"
 
+#ifdef AVM_ENABLE_SMP
+    #include <fcntl.h>
+    #include <stdlib.h>
+    #include <unistd.h>
+#endif
+
+#define ERLANG_TIMERS_INITIAL_CAPACITY 16
+#define MAX_SCHEDULERS 64
+
+struct ErlangTimer
+{
+    struct TimerWheelItem timer;
+    // next timer in the same erlang_timers bucket
+    struct ErlangTimer *next;
+    uint64_t ref_ticks;
+    term dest;
+    term *off_heap_binaries;
+    term message;
+};
+
+#ifdef AVM_ENABLE_SMP
+// Each scheduler thread has its own ready queue, processes that are made ready are appended to the queue of the
+// scheduler that is running the sender, and idle schedulers steal them from the other queues.
+struct Scheduler
+{
+    GlobalContext *global;
+    pthread_t thread;
+    int index;
+    int started;
+
+    Mutex ready_lock;
+    struct ListHead ready_processes;
+    int ready_count;
+};
+
+static __thread int current_scheduler_index;
+
+static void *scheduler_thread_loop(void *arg);
+static void scheduler_signal_callback(EventListener *listener);
+#endif
+
 static void scheduler_timeout_callback(EventListener *listener);
-static void scheduler_execute_native_handlers(GlobalContext *global);
-static Context *scheduler_get_expired_before(const GlobalContext *global, const struct timespec *before_timestamp);
-static int scheduler_find_min_timeout(const GlobalContext *global, struct timespec *found_timeout);
-static inline int before_than(const struct timespec *a, const struct timespec *b);
-static int make_ready_expired_contexts(GlobalContext *global);
+static int scheduler_execute_native_handlers(GlobalContext *global);
+static void scheduler_arm_timer_listener(GlobalContext *global, uint64_t expires_at);
+static void make_ready_expired_contexts(GlobalContext *global, uint64_t now);
+static void expire_timers(GlobalContext *global);
+static int next_timer_event(GlobalContext *global, uint64_t *next);
+static inline uint64_t scheduler_now_ms();
+static inline uint64_t scheduler_now_us();
 
-Context *scheduler_wait(GlobalContext *global, Context *c)
+// makes a waiting process ready or flags a running one, returns 1 when the caller must enqueue the process
+static int scheduler_signal(Context *c)
+{
+    int state = SMP_ATOMIC_LOAD(&c->scheduling_state);
+    for (;;) {
+        int new_state;
+        if (state == CONTEXT_WAITING) {
+            new_state = CONTEXT_READY;
+        } else if (state == CONTEXT_RUNNING) {
+            new_state = CONTEXT_RUNNING | CONTEXT_SIGNALED;
+        } else {
+            return 0;
+        }
+        if (SMP_ATOMIC_CAS(&c->scheduling_state, &state, new_state)) {
+            return state == CONTEXT_WAITING;
+        }
+    }
+}
+
+// puts a running process to sleep, returns 0 when it has been signaled meanwhile and it must keep running
+static int scheduler_try_wait(Context *c)
+{
+    int state = CONTEXT_RUNNING;
+    if (SMP_ATOMIC_CAS(&c->scheduling_state, &state, CONTEXT_WAITING)) {
+        return 1;
+    }
+    // only the scheduler that is running c can change it while it is flagged
+    SMP_ATOMIC_STORE(&c->scheduling_state, CONTEXT_RUNNING);
+
+    return 0;
+}
+
+#ifdef AVM_ENABLE_SMP
+static void scheduler_signal_poller(GlobalContext *global)
 {
-    #ifdef DEBUG_PRINT_READY_PROCESSES
-        debug_print_processes_list(global->ready_processes);
+    int signaled = 0;
+    if (SMP_ATOMIC_CAS(&global->poll_signaled, &signaled, 1)) {
+        char c = 0;
+        if (UNLIKELY(write(global->signal_pipe[1], &c, 1) != 1)) {
+            fprintf(stderr, "Failed to wake up scheduler: %s:%i.\n", __FILE__, __LINE__);
+        }
+    }
+}
+
+static void scheduler_wake_idle(GlobalContext *global)
+{
+    if (SMP_ATOMIC_LOAD(&global->idle_schedulers) > 0) {
+        SMP_MUTEX_LOCK(&global->schedulers_lock);
+        pthread_cond_signal(&global->schedulers_cv);
+        SMP_MUTEX_UNLOCK(&global->schedulers_lock);
+    } else if (SMP_ATOMIC_LOAD(&global->polling)) {
+        scheduler_signal_poller(global);
+    }
+}
+
+static void scheduler_wake_poller(GlobalContext *global)
+{
+    if (SMP_ATOMIC_LOAD(&global->polling)) {
+        scheduler_signal_poller(global);
+    } else if (!SMP_ATOMIC_LOAD(&global->poller_active) && (SMP_ATOMIC_LOAD(&global->idle_schedulers) > 0)) {
+        SMP_MUTEX_LOCK(&global->schedulers_lock);
+        pthread_cond_signal(&global->schedulers_cv);
+        SMP_MUTEX_UNLOCK(&global->schedulers_lock);
+    }
+}
+#endif
+
+static void scheduler_enqueue(GlobalContext *global, Context *c)
+{
+    if (c->native_handler) {
+        SMP_MUTEX_LOCK(&global->native_handlers_lock);
+        list_append(&global->ready_native_handlers, &c->processes_list_head);
+        SMP_MUTEX_UNLOCK(&global->native_handlers_lock);
+        #ifdef AVM_ENABLE_SMP
+            scheduler_wake_poller(global);
+        #endif
+        return;
+    }
+
+    #ifdef AVM_ENABLE_SMP
+        struct Scheduler *scheduler = &global->schedulers[current_scheduler_index];
+        SMP_MUTEX_LOCK(&scheduler->ready_lock);
+        list_append(&scheduler->ready_processes, &c->processes_list_head);
+        SMP_ATOMIC_ADD(&scheduler->ready_count, 1);
+        SMP_MUTEX_UNLOCK(&scheduler->ready_lock);
+
+        SMP_ATOMIC_ADD(&global->ready_count, 1);
+        scheduler_wake_idle(global);
+    #else
+        list_append(&global->ready_processes, &c->processes_list_head);
     #endif
-    scheduler_make_waiting(global, c);
-
-    do {
-        struct timespec next_timeout;
-        next_timeout.tv_sec = global->next_timeout_at.tv_sec;
-        next_timeout.tv_nsec = global->next_timeout_at.tv_nsec;
-
-        if  (next_timeout.tv_sec | next_timeout.tv_nsec) {
-            struct timespec now_timestamp;
-            sys_set_timestamp_from_relative_to_abs(&now_timestamp, 0);
-
-            if (before_than(&next_timeout, &now_timestamp)) {
-
-                Context *expired_ctx = scheduler_get_expired_before(global, &now_timestamp);
-                if (UNLIKELY(!expired_ctx)) {
-                    fprintf(stderr, "Timeout without any expired context, aborting.\n");
-                    abort();
-                }
-                scheduler_make_ready(global, expired_ctx);
-                if (!scheduler_find_min_timeout(global, &global->next_timeout_at)) {
-                    global->next_timeout_at.tv_sec = 0;
-                    global->next_timeout_at.tv_nsec = 0;
-                }
-
-            } else if (list_is_empty(&global->ready_processes)) {
-
-                EventListener *listener = malloc(sizeof(EventListener));
-                if (IS_NULL_PTR(listener)) {
-                    fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
-                    abort();
-                }
-                linkedlist_append(&global->listeners, &listener->listeners_list_head);
-                listener->fd = -1;
-
-                listener->expires = 1;
-                listener->expiral_timestamp.tv_sec = next_timeout.tv_sec;
-                listener->expiral_timestamp.tv_nsec = next_timeout.tv_nsec;
-                listener->one_shot = 1;
-                listener->data = global;
-                listener->handler = scheduler_timeout_callback;
-
-                sys_waitevents(global);
+}
+
+static inline Context *scheduler_take_first(struct ListHead *ready_processes)
+{
+    struct ListHead *item = list_first(ready_processes);
+    list_remove(item);
+    list_init(item);
+
+    return GET_LIST_ENTRY(item, Context, processes_list_head);
+}
+
+static Context *scheduler_dequeue(GlobalContext *global)
+{
+    #ifdef AVM_ENABLE_SMP
+        if (!SMP_ATOMIC_LOAD(&global->ready_count)) {
+            return NULL;
+        }
+
+        // own queue first, then steal from the other ones
+        int count = global->schedulers_count;
+        for (int i = 0; i < count; i++) {
+            struct Scheduler *scheduler = &global->schedulers[(current_scheduler_index + i) % count];
+            if (!SMP_ATOMIC_LOAD(&scheduler->ready_count)) {
+                continue;
             }
-        } else if (list_is_empty(&global->ready_processes)) {
-            if (LIKELY(global->listeners)) {
-                sys_waitevents(global);
-            } else {
-                fprintf(stderr, "Hang detected\n");
-                abort();
+
+            Context *c = NULL;
+            SMP_MUTEX_LOCK(&scheduler->ready_lock);
+            if (!list_is_empty(&scheduler->ready_processes)) {
+                c = scheduler_take_first(&scheduler->ready_processes);
+                SMP_ATOMIC_SUB(&scheduler->ready_count, 1);
             }
+            SMP_MUTEX_UNLOCK(&scheduler->ready_lock);
+
+            if (c) {
+                SMP_ATOMIC_SUB(&global->ready_count, 1);
+                return c;
+            }
+        }
+
+        return NULL;
+    #else
+        if (list_is_empty(&global->ready_processes)) {
+            return NULL;
         }
 
-        scheduler_execute_native_handlers(global);
-    } while (list_is_empty(&global->ready_processes));
+        return scheduler_take_first(&global->ready_processes);
+    #endif
+}
+
+static Context *scheduler_dequeue_native_handler(GlobalContext *global)
+{
+    Context *c = NULL;
 
-    struct ListHead *next_ready = list_first(&global->ready_processes);
-    list_remove(next_ready);
-    list_append(&global->ready_processes, next_ready);
+    SMP_MUTEX_LOCK(&global->native_handlers_lock);
+    if (!list_is_empty(&global->ready_native_handlers)) {
+        c = scheduler_take_first(&global->ready_native_handlers);
+    }
+    SMP_MUTEX_UNLOCK(&global->native_handlers_lock);
 
-    return GET_LIST_ENTRY(next_ready, Context, processes_list_head);
+    return c;
 }
 
-Context *scheduler_next(GlobalContext *global, Context *c)
+// running time is accounted when a process starts running and when it is scheduled out, so timestamps are read
+// once for each time slice
+static inline void scheduler_account_run_time(Context *c)
 {
-    c->reductions += DEFAULT_REDUCTIONS_AMOUNT;
+    uint64_t now = scheduler_now_us();
+    uint64_t running_since = SMP_ATOMIC_LOAD(&c->stats.running_since_us);
+    SMP_ATOMIC_STORE(&c->stats.run_time_us, SMP_ATOMIC_LOAD(&c->stats.run_time_us) + (now - running_since));
+    SMP_ATOMIC_STORE(&c->stats.running_since_us, now);
+}
+
+static inline Context *scheduler_run(Context *c)
+{
+    SMP_ATOMIC_STORE(&c->stats.running_since_us, scheduler_now_us());
+    SMP_ATOMIC_STORE(&c->scheduling_state, CONTEXT_RUNNING);
+
+    return c;
+}
+
+#ifdef AVM_ENABLE_SMP
+static Context *scheduler_exit(GlobalContext *global)
+{
+    // the thread that started the schedulers returns last, so the leader outcome can be read safely
+    if (current_scheduler_index == 0) {
+        for (int i = 1; i < global->schedulers_count; i++) {
+            if (global->schedulers[i].started) {
+                pthread_join(global->schedulers[i].thread, NULL);
+                global->schedulers[i].started = 0;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int scheduler_has_ready_native_handlers(GlobalContext *global)
+{
+    SMP_MUTEX_LOCK(&global->native_handlers_lock);
+    int has_ready = !list_is_empty(&global->ready_native_handlers);
+    SMP_MUTEX_UNLOCK(&global->native_handlers_lock);
+
+    return has_ready;
+}
+
+// nothing can make a process ready anymore: all other schedulers are idle, there are no timers and the only listener
+// is the one that is used to wake up the poller
+static int scheduler_is_hung(GlobalContext *global)
+{
+    SMP_MUTEX_LOCK(&global->timers_lock);
+    int has_timers = !timer_wheel_is_empty(&global->timer_wheel) || !timer_wheel_is_empty(&global->erlang_timers_wheel);
+    SMP_MUTEX_UNLOCK(&global->timers_lock);
+
+    SMP_MUTEX_LOCK(&global->schedulers_lock);
+    int all_idle = (global->idle_schedulers == global->schedulers_count - 1) && !SMP_ATOMIC_LOAD(&global->ready_count);
+    SMP_MUTEX_UNLOCK(&global->schedulers_lock);
+
+    return all_idle && !has_timers && (global->listeners->next == global->listeners);
+}
+
+// runs native handlers and waits for events, it must be called holding poller_lock
+static void scheduler_poll(GlobalContext *global)
+{
+    SMP_ATOMIC_STORE(&global->poller_active, 1);
 
     sys_consume_pending_events(global);
+    if (!scheduler_execute_native_handlers(global)) {
+        SMP_ATOMIC_STORE(&global->polling, 1);
+
+        // schedulers that insert a timer expiring before poll_deadline wake up the poller
+        uint64_t next_event;
+        SMP_MUTEX_LOCK(&global->timers_lock);
+        int has_timers = next_timer_event(global, &next_event);
+        global->poll_deadline = has_timers ? next_event : UINT64_MAX;
+        SMP_MUTEX_UNLOCK(&global->timers_lock);
 
-    if (global->next_timeout_at.tv_sec | global->next_timeout_at.tv_nsec) {
-        make_ready_expired_contexts(global);
+        if (!SMP_ATOMIC_LOAD(&global->ready_count) && !SMP_ATOMIC_LOAD(&global->stopping)
+                && !scheduler_has_ready_native_handlers(global)) {
+            if (has_timers) {
+                scheduler_arm_timer_listener(global, next_event);
+            } else if (scheduler_is_hung(global)) {
+                fprintf(stderr, "Hang detected\n");
+                abort();
+            }
+            sys_waitevents(global);
+        }
+
+        SMP_ATOMIC_STORE(&global->polling, 0);
     }
 
-    //TODO: improve scheduling here
-    struct ListHead *item;
-    struct ListHead *tmp;
-    MUTABLE_LIST_FOR_EACH(item, tmp, &global->ready_processes) {
-        Context *next_context = GET_LIST_ENTRY(item, Context, processes_list_head);
-        if (!next_context->native_handler && (next_context != c)) {
-            return next_context;
+    SMP_ATOMIC_STORE(&global->poller_active, 0);
+}
+
+static Context *scheduler_wait_ready(GlobalContext *global)
+{
+    for (;;) {
+        if (UNLIKELY(SMP_ATOMIC_LOAD(&global->stopping))) {
+            return scheduler_exit(global);
+        }
+
+        expire_timers(global);
+
+        Context *next = scheduler_dequeue(global);
+        if (next) {
+            // make sure some other idle scheduler keeps waiting for events
+            if (!SMP_ATOMIC_LOAD(&global->poller_active) && (SMP_ATOMIC_LOAD(&global->idle_schedulers) > 0)) {
+                SMP_MUTEX_LOCK(&global->schedulers_lock);
+                pthread_cond_signal(&global->schedulers_cv);
+                SMP_MUTEX_UNLOCK(&global->schedulers_lock);
+            }
+            return scheduler_run(next);
         }
+
+        // a single idle scheduler waits for events, the other ones sleep until a process is ready
+        if (SMP_MUTEX_TRYLOCK(&global->poller_lock)) {
+            scheduler_poll(global);
+            SMP_MUTEX_UNLOCK(&global->poller_lock);
+            continue;
+        }
+
+        SMP_MUTEX_LOCK(&global->schedulers_lock);
+        SMP_ATOMIC_ADD(&global->idle_schedulers, 1);
+        if (!SMP_ATOMIC_LOAD(&global->ready_count) && !SMP_ATOMIC_LOAD(&global->stopping)
+                && SMP_ATOMIC_LOAD(&global->poller_active)) {
+            pthread_cond_wait(&global->schedulers_cv, &global->schedulers_lock);
+        }
+        SMP_ATOMIC_SUB(&global->idle_schedulers, 1);
+        SMP_MUTEX_UNLOCK(&global->schedulers_lock);
     }
+}
+#else
+static Context *scheduler_wait_ready(GlobalContext *global)
+{
+    for (;;) {
+        expire_timers(global);
+        int executed = scheduler_execute_native_handlers(global);
 
-    return c;
+        Context *next = scheduler_dequeue(global);
+        if (next) {
+            return scheduler_run(next);
+        }
+        // handlers take one message at a time and they are requeued while they have more, which no event would signal
+        if (executed) {
+            continue;
+        }
+
+        uint64_t next_event;
+        if (next_timer_event(global, &next_event)) {
+            scheduler_arm_timer_listener(global, next_event);
+            sys_waitevents(global);
+        } else if (LIKELY(global->listeners)) {
+            sys_waitevents(global);
+        } else {
+            fprintf(stderr, "Hang detected\n");
+            abort();
+        }
+    }
+}
+#endif
+
+Context *scheduler_wait(GlobalContext *global, Context *c)
+{
+    if (c) {
+        #if defined(DEBUG_PRINT_READY_PROCESSES) && !defined(AVM_ENABLE_SMP)
+            debug_print_processes_list(global->ready_processes);
+        #endif
+        // once it is waiting another scheduler might run it
+        scheduler_account_run_time(c);
+        if (!scheduler_try_wait(c)) {
+            // a message or a timeout arrived while it was running
+            if (c->jump_to_on_restore) {
+                c->saved_ip = c->jump_to_on_restore;
+                c->jump_to_on_restore = NULL;
+            }
+            return c;
+        }
+    }
+
+    return scheduler_wait_ready(global);
+}
+
+Context *scheduler_next(GlobalContext *global, Context *c)
+{
+    #ifdef AVM_ENABLE_SMP
+        if (UNLIKELY(SMP_ATOMIC_LOAD(&global->stopping))) {
+            return scheduler_exit(global);
+        }
+        // when no scheduler is idle, events and ports are handled by the schedulers that are running processes
+        if (SMP_MUTEX_TRYLOCK(&global->poller_lock)) {
+            sys_consume_pending_events(global);
+            scheduler_execute_native_handlers(global);
+            SMP_MUTEX_UNLOCK(&global->poller_lock);
+        }
+    #else
+        sys_consume_pending_events(global);
+    #endif
+
+    expire_timers(global);
+
+    Context *next = scheduler_dequeue(global);
+    if (!next) {
+        return c;
+    }
+
+    scheduler_account_run_time(c);
+    SMP_ATOMIC_STORE(&c->scheduling_state, CONTEXT_READY);
+    scheduler_enqueue(global, c);
+
+    return scheduler_run(next);
 }
 
 void scheduler_make_ready(GlobalContext *global, Context *c)
 {
-    list_remove(&c->processes_list_head);
-    list_append(&global->ready_processes, &c->processes_list_head);
+    if (scheduler_signal(c)) {
+        scheduler_enqueue(global, c);
+    }
+}
+
+void scheduler_signal_message(GlobalContext *global, Context *c)
+{
+    if (scheduler_signal(c)) {
+        // c was waiting, nobody else can change it until it is enqueued
+        if (c->jump_to_on_restore) {
+            c->saved_ip = c->jump_to_on_restore;
+            c->jump_to_on_restore = NULL;
+        }
+        scheduler_enqueue(global, c);
+    }
+}
+
+void scheduler_init_ready(Context *c)
+{
+    SMP_ATOMIC_STORE(&c->scheduling_state, CONTEXT_READY);
+    scheduler_enqueue(c->global, c);
 }
 
 void scheduler_make_waiting(GlobalContext *global, Context *c)
 {
-    list_remove(&c->processes_list_head);
-    list_append(&global->waiting_processes, &c->processes_list_head);
+    if (!scheduler_try_wait(c)) {
+        SMP_ATOMIC_STORE(&c->scheduling_state, CONTEXT_READY);
+        scheduler_enqueue(global, c);
+    }
 }
 
 void scheduler_terminate(Context *c)
 {
-    list_remove(&c->processes_list_head);
+    scheduler_account_run_time(c);
+    #ifndef AVM_ENABLE_SMP
+        // scheduler_next might have put it back on the ready queue
+        list_remove(&c->processes_list_head);
+        list_init(&c->processes_list_head);
+    #endif
     if (!c->leader) {
         context_destroy(c);
     }
 }
 
-static int make_ready_expired_contexts(GlobalContext *global)
+#ifdef AVM_ENABLE_SMP
+static int scheduler_default_count()
 {
-    struct timespec now_timestamp;
-    sys_set_timestamp_from_relative_to_abs(&now_timestamp, 2);
+    const char *schedulers = getenv("ATOMVM_SCHEDULERS");
+    long count = schedulers ? strtol(schedulers, NULL, 10) : 0;
+    if (count <= 0) {
+        count = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (count <= 0) {
+        count = 1;
+    }
+
+    return (count > MAX_SCHEDULERS) ? MAX_SCHEDULERS : count;
+}
 
-    Context *expired_ctx = scheduler_get_expired_before(global, &now_timestamp);
-    if (!expired_ctx) {
+static int scheduler_init_signal_listener(GlobalContext *global)
+{
+    if (pipe(global->signal_pipe)) {
         return 0;
     }
+    fcntl(global->signal_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(global->signal_pipe[1], F_SETFL, O_NONBLOCK);
 
-    scheduler_make_ready(global, expired_ctx);
+    EventListener *listener = malloc(sizeof(EventListener));
+    if (IS_NULL_PTR(listener)) {
+        close(global->signal_pipe[0]);
+        close(global->signal_pipe[1]);
+        return 0;
+    }
+    listener->fd = global->signal_pipe[0];
+    listener->events = EVENT_LISTENER_READ;
+    listener->expires = 0;
+    listener->one_shot = 0;
+    listener->data = global;
+    listener->handler = scheduler_signal_callback;
+    if (!sys_register_listener(global, listener)) {
+        free(listener);
+        close(global->signal_pipe[0]);
+        close(global->signal_pipe[1]);
+        return 0;
+    }
+    global->signal_listener = listener;
 
-    if (!scheduler_find_min_timeout(global, &global->next_timeout_at)) {
-        global->next_timeout_at.tv_sec = 0;
-        global->next_timeout_at.tv_nsec = 0;
+    return 1;
+}
+
+static void scheduler_signal_callback(EventListener *listener)
+{
+    GlobalContext *global = (GlobalContext *) listener->data;
+
+    char buf[16];
+    while (read(global->signal_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+    SMP_ATOMIC_STORE(&global->poll_signaled, 0);
+}
+
+static void *scheduler_thread_loop(void *arg)
+{
+    struct Scheduler *scheduler = (struct Scheduler *) arg;
+    current_scheduler_index = scheduler->index;
+
+    Context *ctx = scheduler_wait(scheduler->global, NULL);
+    if (ctx) {
+        context_execute_loop(ctx, ctx->saved_module, NULL, 0);
     }
 
+    return NULL;
+}
+#endif
+
+int scheduler_init(GlobalContext *global)
+{
+    list_init(&global->ready_native_handlers);
+    global->start_time_us = scheduler_now_us();
+
+    #ifdef AVM_ENABLE_SMP
+        int count = scheduler_default_count();
+        global->schedulers = calloc(count, sizeof(struct Scheduler));
+        if (IS_NULL_PTR(global->schedulers)) {
+            return 0;
+        }
+        for (int i = 0; i < count; i++) {
+            struct Scheduler *scheduler = &global->schedulers[i];
+            scheduler->global = global;
+            scheduler->index = i;
+            scheduler->started = 0;
+            SMP_MUTEX_INIT(&scheduler->ready_lock);
+            list_init(&scheduler->ready_processes);
+            scheduler->ready_count = 0;
+        }
+        global->schedulers_count = count;
+
+        global->ready_count = 0;
+        global->idle_schedulers = 0;
+        global->poller_active = 0;
+        global->polling = 0;
+        global->poll_signaled = 0;
+        global->poll_deadline = UINT64_MAX;
+        global->stopping = 0;
+        SMP_MUTEX_INIT(&global->timers_lock);
+        SMP_MUTEX_INIT(&global->native_handlers_lock);
+        SMP_MUTEX_INIT(&global->poller_lock);
+        SMP_MUTEX_INIT(&global->schedulers_lock);
+        pthread_cond_init(&global->schedulers_cv, NULL);
+
+        if (!scheduler_init_signal_listener(global)) {
+            free(global->schedulers);
+            return 0;
+        }
+    #else
+        list_init(&global->ready_processes);
+    #endif
+
     return 1;
 }
 
-void scheduler_set_timeout(Context *ctx, uint32_t timeout)
+void scheduler_start(GlobalContext *global, Context *leader)
 {
-    GlobalContext *glb = ctx->global;
+    SMP_ATOMIC_STORE(&leader->stats.running_since_us, scheduler_now_us());
 
-    struct timespec new_timeout;
-    sys_set_timestamp_from_relative_to_abs(&new_timeout, timeout);
-    ctx->timeout_at.tv_sec = new_timeout.tv_sec;
-    ctx->timeout_at.tv_nsec = new_timeout.tv_nsec;
+    #ifdef AVM_ENABLE_SMP
+        current_scheduler_index = 0;
+        for (int i = 1; i < global->schedulers_count; i++) {
+            struct Scheduler *scheduler = &global->schedulers[i];
+            if (UNLIKELY(pthread_create(&scheduler->thread, NULL, scheduler_thread_loop, scheduler))) {
+                fprintf(stderr, "Failed to start scheduler thread: %s:%i.\n", __FILE__, __LINE__);
+                abort();
+            }
+            scheduler->started = 1;
+        }
+    #else
+        UNUSED(global);
+    #endif
+}
+
+void scheduler_stop(GlobalContext *global)
+{
+    #ifdef AVM_ENABLE_SMP
+        SMP_ATOMIC_STORE(&global->stopping, 1);
+        SMP_MUTEX_LOCK(&global->schedulers_lock);
+        pthread_cond_broadcast(&global->schedulers_cv);
+        SMP_MUTEX_UNLOCK(&global->schedulers_lock);
+        scheduler_signal_poller(global);
+    #else
+        UNUSED(global);
+    #endif
+}
 
-    struct timespec next_timeout;
-    next_timeout.tv_sec = glb->next_timeout_at.tv_sec;
-    next_timeout.tv_nsec = glb->next_timeout_at.tv_nsec;
+void scheduler_destroy(GlobalContext *global)
+{
+    #ifdef AVM_ENABLE_SMP
+        sys_unregister_listener(global, global->signal_listener);
+        free(global->signal_listener);
+        close(global->signal_pipe[0]);
+        close(global->signal_pipe[1]);
 
-    if ((next_timeout.tv_sec == 0) && (next_timeout.tv_nsec == 0)) {
-        glb->next_timeout_at.tv_nsec = new_timeout.tv_nsec;
-        glb->next_timeout_at.tv_sec = new_timeout.tv_sec;
+        for (int i = 0; i < global->schedulers_count; i++) {
+            SMP_MUTEX_DESTROY(&global->schedulers[i].ready_lock);
+        }
+        free(global->schedulers);
 
-    } else if (before_than(&new_timeout, &next_timeout)) {
-        glb->next_timeout_at.tv_sec = new_timeout.tv_sec;
-        glb->next_timeout_at.tv_nsec = new_timeout.tv_nsec;
-    }
+        SMP_MUTEX_DESTROY(&global->timers_lock);
+        SMP_MUTEX_DESTROY(&global->native_handlers_lock);
+        SMP_MUTEX_DESTROY(&global->poller_lock);
+        SMP_MUTEX_DESTROY(&global->schedulers_lock);
+        pthread_cond_destroy(&global->schedulers_cv);
+    #else
+        UNUSED(global);
+    #endif
 }
 
-int scheduler_is_timeout_expired(const Context *ctx)
+static inline uint64_t scheduler_now_ms()
 {
-    struct timespec now_timestamp;
-    sys_set_timestamp_from_relative_to_abs(&now_timestamp, 0);
-    return before_than(&ctx->timeout_at, &now_timestamp);
+    struct timespec now;
+    sys_set_timestamp_from_relative_to_abs(&now, 0);
+
+    return ((uint64_t) now.tv_sec) * 1000 + now.tv_nsec / 1000000;
 }
 
-static void scheduler_timeout_callback(EventListener *listener)
+static inline uint64_t scheduler_now_us()
 {
-    GlobalContext *global = (GlobalContext *) listener->data;
-    linkedlist_remove(&global->listeners, &listener->listeners_list_head);
+    struct timespec now;
+    sys_set_timestamp_from_relative_to_abs(&now, 0);
+
+    return ((uint64_t) now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
 
-    make_ready_expired_contexts(global);
+uint64_t scheduler_run_time_us(const Context *c)
+{
+    uint64_t run_time = SMP_ATOMIC_LOAD(&c->stats.run_time_us);
+    if (SMP_ATOMIC_LOAD(&c->scheduling_state) & CONTEXT_RUNNING) {
+        uint64_t now = scheduler_now_us();
+        uint64_t running_since = SMP_ATOMIC_LOAD(&c->stats.running_since_us);
+        // it might have been scheduled out meanwhile
+        if (now > running_since) {
+            run_time += now - running_since;
+        }
+    }
+
+    return run_time;
+}
+
+uint64_t scheduler_uptime_us(GlobalContext *global)
+{
+    return scheduler_now_us() - global->start_time_us;
+}
+
+// timers_lock must be held
+static inline int scheduler_timer_needs_poller_wakeup(GlobalContext *global, uint64_t expiry)
+{
+    #ifdef AVM_ENABLE_SMP
+        return SMP_ATOMIC_LOAD(&global->polling) && (expiry < global->poll_deadline);
+    #else
+        UNUSED(global);
+        UNUSED(expiry);
+        return 0;
+    #endif
 }
 
-static inline int before_than(const struct timespec *a, const struct timespec *b)
+static inline void scheduler_wake_poller_for_timer(GlobalContext *global, int needs_wakeup)
 {
-    return (a->tv_sec < b->tv_sec) ||
-        ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+    #ifdef AVM_ENABLE_SMP
+        if (needs_wakeup) {
+            scheduler_signal_poller(global);
+        }
+    #else
+        UNUSED(global);
+        UNUSED(needs_wakeup);
+    #endif
 }
 
-static Context *scheduler_get_expired_before(const GlobalContext *global, const struct timespec *before_timestamp)
+static void make_ready_expired_contexts(GlobalContext *global, uint64_t now)
 {
-    struct timespec min;
-    Context *min_context = NULL;
+    struct ListHead expired;
+    list_init(&expired);
+    timer_wheel_expire(&global->timer_wheel, now, &expired);
 
     struct ListHead *item;
     struct ListHead *tmp;
-    MUTABLE_LIST_FOR_EACH(item, tmp, &global->waiting_processes) {
-        Context *context = GET_LIST_ENTRY(item, Context, processes_list_head);
-
-        if (context->timeout_at.tv_sec | context->timeout_at.tv_nsec) {
-            if (!min_context || before_than(&context->timeout_at, &min)) {
-                min.tv_sec = context->timeout_at.tv_sec;
-                min.tv_nsec = context->timeout_at.tv_nsec;
-                min_context = context;
-            }
+    MUTABLE_LIST_FOR_EACH(item, tmp, &expired) {
+        Context *ctx = GET_LIST_ENTRY(item, Context, timer.head);
+        timer_wheel_item_init(&ctx->timer);
+        scheduler_make_ready(global, ctx);
+    }
+}
+static inline term *erlang_timer_message_memory(struct ErlangTimer *timer)
+{
+    return &timer->message + 1;
+}
+
+static void erlang_timer_destroy(struct ErlangTimer *timer)
+{
+    memory_release_off_heap_binaries(timer->off_heap_binaries);
+    free(timer);
+}
+
+static inline struct ErlangTimer **erlang_timers_bucket(GlobalContext *global, uint64_t ref_ticks)
+{
+    // refs are allocated sequentially, so their lowest bits are already evenly distributed
+    return &global->erlang_timers[ref_ticks & (global->erlang_timers_capacity - 1)];
+}
+
+static struct ErlangTimer *erlang_timers_take(GlobalContext *global, uint64_t ref_ticks)
+{
+    if (IS_NULL_PTR(global->erlang_timers)) {
+        return NULL;
+    }
+
+    struct ErlangTimer **prev = erlang_timers_bucket(global, ref_ticks);
+    while (*prev) {
+        struct ErlangTimer *timer = *prev;
+        if (timer->ref_ticks == ref_ticks) {
+            *prev = timer->next;
+            return timer;
         }
+        prev = &timer->next;
     }
 
-    if (min_context && before_than(&min_context->timeout_at, before_timestamp)) {
-        return min_context;
-    } else {
+    return NULL;
+}
+
+static struct ErlangTimer *erlang_timers_find(GlobalContext *global, uint64_t ref_ticks)
+{
+    if (IS_NULL_PTR(global->erlang_timers)) {
         return NULL;
     }
+
+    struct ErlangTimer *timer = *erlang_timers_bucket(global, ref_ticks);
+    while (timer && (timer->ref_ticks != ref_ticks)) {
+        timer = timer->next;
+    }
+
+    return timer;
 }
 
-static int scheduler_find_min_timeout(const GlobalContext *global, struct timespec *found_timeout)
+static int erlang_timers_grow(GlobalContext *global)
 {
-    struct timespec min;
-    int found_first = 0;
+    int old_capacity = global->erlang_timers_capacity;
+    struct ErlangTimer **old_table = global->erlang_timers;
 
-    struct ListHead *item;
-    struct ListHead *tmp;
-    MUTABLE_LIST_FOR_EACH(item, tmp, &global->waiting_processes) {
-        Context *context = GET_LIST_ENTRY(item, Context, processes_list_head);
-
-        if (context->timeout_at.tv_sec | context->timeout_at.tv_nsec) {
-            if (!found_first || before_than(&context->timeout_at, &min)) {
-                min.tv_sec = context->timeout_at.tv_sec;
-                min.tv_nsec = context->timeout_at.tv_nsec;
-                found_first = 1;
-            }
+    int new_capacity = old_capacity ? old_capacity * 2 : ERLANG_TIMERS_INITIAL_CAPACITY;
+    struct ErlangTimer **new_table = calloc(new_capacity, sizeof(struct ErlangTimer *));
+    if (IS_NULL_PTR(new_table)) {
+        return 0;
+    }
+
+    global->erlang_timers = new_table;
+    global->erlang_timers_capacity = new_capacity;
+
+    for (int i = 0; i < old_capacity; i++) {
+        struct ErlangTimer *timer = old_table[i];
+        while (timer) {
+            struct ErlangTimer *next = timer->next;
+            struct ErlangTimer **bucket = erlang_timers_bucket(global, timer->ref_ticks);
+            timer->next = *bucket;
+            *bucket = timer;
+            timer = next;
         }
+    }
+    free(old_table);
+
+    return 1;
+}
 
+static void send_erlang_timer_message(GlobalContext *global, struct ErlangTimer *timer)
+{
+    // registered names are resolved when the timer expires, as erlang:send/2 would do
+    int local_process_id;
+    if (term_is_atom(timer->dest)) {
+        local_process_id = globalcontext_get_registered_process(global, term_to_atom_index(timer->dest));
+    } else {
+        local_process_id = term_to_local_process_id(timer->dest);
     }
 
-    if (found_first) {
-        found_timeout->tv_sec = min.tv_sec;
-        found_timeout->tv_nsec = min.tv_nsec;
+    if (local_process_id) {
+        globalcontext_send_message(global, local_process_id, timer->message);
     }
+    erlang_timer_destroy(timer);
+}
+
+// timers_lock must be held, expired timers are appended to the expired list and they must be sent once it is released
+static void take_expired_erlang_timers(GlobalContext *global, uint64_t now, struct ListHead *expired)
+{
+    timer_wheel_expire(&global->erlang_timers_wheel, now, expired);
 
-    return found_first;
+    struct ListHead *item;
+    LIST_FOR_EACH(item, expired) {
+        struct ErlangTimer *timer = GET_LIST_ENTRY(item, struct ErlangTimer, timer.head);
+        erlang_timers_take(global, timer->ref_ticks);
+    }
 }
 
-static void scheduler_execute_native_handlers(GlobalContext *global)
+static void expire_timers(GlobalContext *global)
 {
+    if (timer_wheel_is_empty(&global->timer_wheel) && timer_wheel_is_empty(&global->erlang_timers_wheel)) {
+        return;
+    }
+
+    struct ListHead expired_erlang_timers;
+    list_init(&expired_erlang_timers);
+
+    SMP_MUTEX_LOCK(&global->timers_lock);
+    uint64_t now = scheduler_now_ms();
+    if (!timer_wheel_is_empty(&global->timer_wheel)) {
+        make_ready_expired_contexts(global, now);
+    }
+    if (!timer_wheel_is_empty(&global->erlang_timers_wheel)) {
+        take_expired_erlang_timers(global, now, &expired_erlang_timers);
+    }
+    SMP_MUTEX_UNLOCK(&global->timers_lock);
+
+    // messages are copied to the destination mailbox outside of timers_lock
     struct ListHead *item;
     struct ListHead *tmp;
-    MUTABLE_LIST_FOR_EACH(item, tmp, &global->ready_processes) {
-        Context *context = GET_LIST_ENTRY(item, Context, processes_list_head);
+    MUTABLE_LIST_FOR_EACH(item, tmp, &expired_erlang_timers) {
+        send_erlang_timer_message(global, GET_LIST_ENTRY(item, struct ErlangTimer, timer.head));
+    }
+}
 
-        if (context->native_handler) {
-            context->native_handler(context);
-            scheduler_make_waiting(global, context);
-        }
+// timers_lock must be held
+static int next_timer_event(GlobalContext *global, uint64_t *next)
+{
+    uint64_t next_timeout;
+    uint64_t next_erlang_timer;
+    int has_timeouts = timer_wheel_next_event(&global->timer_wheel, &next_timeout);
+    int has_erlang_timers = timer_wheel_next_event(&global->erlang_timers_wheel, &next_erlang_timer);
+
+    if (has_erlang_timers && (!has_timeouts || (next_erlang_timer < next_timeout))) {
+        next_timeout = next_erlang_timer;
     }
+    *next = next_timeout;
+
+    return has_timeouts || has_erlang_timers;
 }
 
-int schudule_processes_count(GlobalContext *global)
+int scheduler_start_timer(GlobalContext *global, uint64_t ref_ticks, uint32_t timeout, term dest, term message)
+{
+    unsigned long estimated_mem_usage = memory_estimate_usage(message);
+    struct ErlangTimer *timer = malloc(sizeof(struct ErlangTimer) + estimated_mem_usage * sizeof(term));
+    if (IS_NULL_PTR(timer)) {
+        return 0;
+    }
+
+    term *heap_pos = erlang_timer_message_memory(timer);
+    timer->off_heap_binaries = NULL;
+    timer->message = memory_copy_term_tree(&heap_pos, message, &timer->off_heap_binaries);
+    timer->ref_ticks = ref_ticks;
+    timer->dest = dest;
+
+    SMP_MUTEX_LOCK(&global->timers_lock);
+    if ((global->erlang_timers_wheel.count >= global->erlang_timers_capacity) && !erlang_timers_grow(global)) {
+        SMP_MUTEX_UNLOCK(&global->timers_lock);
+        erlang_timer_destroy(timer);
+        return 0;
+    }
+
+    struct ErlangTimer **bucket = erlang_timers_bucket(global, ref_ticks);
+    timer->next = *bucket;
+    *bucket = timer;
+
+    // the wheel places timers that are already due on its first unprocessed tick, so it doesn't need to be current
+    uint64_t expiry = scheduler_now_ms() + timeout;
+    timer_wheel_insert(&global->erlang_timers_wheel, &timer->timer, expiry);
+    int needs_wakeup = scheduler_timer_needs_poller_wakeup(global, expiry);
+    SMP_MUTEX_UNLOCK(&global->timers_lock);
+
+    scheduler_wake_poller_for_timer(global, needs_wakeup);
+
+    return 1;
+}
+
+static inline uint32_t erlang_timer_remaining(const struct ErlangTimer *timer)
 {
-    if (!global->processes_table) {
+    uint64_t now = scheduler_now_ms();
+    return (timer->timer.expiry > now) ? (uint32_t) (timer->timer.expiry - now) : 0;
+}
+
+int scheduler_cancel_timer(GlobalContext *global, uint64_t ref_ticks, uint32_t *remaining)
+{
+    SMP_MUTEX_LOCK(&global->timers_lock);
+    struct ErlangTimer *timer = erlang_timers_take(global, ref_ticks);
+    if (IS_NULL_PTR(timer)) {
+        SMP_MUTEX_UNLOCK(&global->timers_lock);
         return 0;
     }
 
-    int count = 0;
+    *remaining = erlang_timer_remaining(timer);
+    timer_wheel_remove(&global->erlang_timers_wheel, &timer->timer);
+    SMP_MUTEX_UNLOCK(&global->timers_lock);
+
+    erlang_timer_destroy(timer);
+
+    return 1;
+}
+
+int scheduler_read_timer(GlobalContext *global, uint64_t ref_ticks, uint32_t *remaining)
+{
+    SMP_MUTEX_LOCK(&global->timers_lock);
+    struct ErlangTimer *timer = erlang_timers_find(global, ref_ticks);
+    if (!IS_NULL_PTR(timer)) {
+        *remaining = erlang_timer_remaining(timer);
+    }
+    SMP_MUTEX_UNLOCK(&global->timers_lock);
+
+    return !IS_NULL_PTR(timer);
+}
+
+void scheduler_cancel_all_timers(GlobalContext *global)
+{
+    for (int i = 0; i < global->erlang_timers_capacity; i++) {
+        struct ErlangTimer *timer = global->erlang_timers[i];
+        while (timer) {
+            struct ErlangTimer *next = timer->next;
+            timer_wheel_remove(&global->erlang_timers_wheel, &timer->timer);
+            erlang_timer_destroy(timer);
+            timer = next;
+        }
+    }
+    free(global->erlang_timers);
+    global->erlang_timers = NULL;
+    global->erlang_timers_capacity = 0;
+}
+
+void scheduler_set_timeout(Context *ctx, uint32_t timeout)
+{
+    GlobalContext *glb = ctx->global;
 
-    Context *contexts = GET_LIST_ENTRY(global->processes_table, Context, processes_list_head);
-    Context *context = contexts;
-    do {
-        context = GET_LIST_ENTRY(context->processes_list_head.next, Context, processes_list_head);
-        count++;
-    } while (context != contexts);
+    SMP_MUTEX_LOCK(&glb->timers_lock);
+    uint64_t expiry = scheduler_now_ms() + timeout;
+    ctx->waiting_timeout = 1;
+    timer_wheel_insert(&glb->timer_wheel, &ctx->timer, expiry);
+    int needs_wakeup = scheduler_timer_needs_poller_wakeup(glb, expiry);
+    SMP_MUTEX_UNLOCK(&glb->timers_lock);
+
+    scheduler_wake_poller_for_timer(glb, needs_wakeup);
+}
+
+void scheduler_cancel_timeout(Context *ctx)
+{
+    if (!ctx->waiting_timeout) {
+        return;
+    }
 
-    return count;
+    SMP_MUTEX_LOCK(&ctx->global->timers_lock);
+    ctx->waiting_timeout = 0;
+    if (timer_wheel_item_is_scheduled(&ctx->timer)) {
+        timer_wheel_remove(&ctx->global->timer_wheel, &ctx->timer);
+    }
+    SMP_MUTEX_UNLOCK(&ctx->global->timers_lock);
+}
+
+int scheduler_is_timeout_expired(const Context *ctx)
+{
+    SMP_MUTEX_LOCK(&ctx->global->timers_lock);
+    int expired = !timer_wheel_item_is_scheduled(&ctx->timer) || (ctx->timer.expiry <= scheduler_now_ms());
+    SMP_MUTEX_UNLOCK(&ctx->global->timers_lock);
+
+    return expired;
+}
+
+static void scheduler_arm_timer_listener(GlobalContext *global, uint64_t expires_at)
+{
+    EventListener *listener = global->timer_listener;
+    if (IS_NULL_PTR(listener)) {
+        listener = malloc(sizeof(EventListener));
+        if (IS_NULL_PTR(listener)) {
+            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+            abort();
+        }
+        listener->fd = -1;
+        listener->expires = 0;
+        listener->one_shot = 1;
+        listener->data = global;
+        listener->handler = scheduler_timeout_callback;
+        global->timer_listener = listener;
+    }
+
+    // platforms truncate the remaining time to milliseconds: aim at the end of the tick so they never wake up
+    // before the tick has started, which would just spin until the clock catches up
+    listener->expiral_timestamp.tv_sec = expires_at / 1000;
+    listener->expiral_timestamp.tv_nsec = (expires_at % 1000) * 1000000 + 999999;
+
+    // the same listener is reused for every wait, expires is set only while it is on the listeners list
+    if (!listener->expires) {
+        listener->expires = 1;
+        sys_register_listener(global, listener);
+    }
+}
+
+static void scheduler_timeout_callback(EventListener *listener)
+{
+    GlobalContext *global = (GlobalContext *) listener->data;
+    sys_unregister_listener(global, listener);
+    listener->expires = 0;
+
+    expire_timers(global);
+}
+
+// returns 1 if at least one native handler has been executed
+static int scheduler_execute_native_handlers(GlobalContext *global)
+{
+    struct ListHead requeued;
+    list_init(&requeued);
+    int executed = 0;
+
+    Context *context;
+    while ((context = scheduler_dequeue_native_handler(global))) {
+        scheduler_run(context);
+        if (!mailbox_is_empty(context)) {
+            context->native_handler(context);
+            executed = 1;
+        }
+
+        if (!mailbox_is_empty(context) || !scheduler_try_wait(context)) {
+            // messages that arrived while the handler was running are handled on next round
+            SMP_ATOMIC_STORE(&context->scheduling_state, CONTEXT_READY);
+            list_append(&requeued, &context->processes_list_head);
+        }
+    }
+
+    if (!list_is_empty(&requeued)) {
+        SMP_MUTEX_LOCK(&global->native_handlers_lock);
+        struct ListHead *item;
+        struct ListHead *tmp;
+        MUTABLE_LIST_FOR_EACH(item, tmp, &requeued) {
+            list_append(&global->ready_native_handlers, item);
+        }
+        SMP_MUTEX_UNLOCK(&global->native_handlers_lock);
+    }
+
+    return executed;
+}
+
+int schudule_processes_count(GlobalContext *global)
+{
+    return global->processes_count;
+}
+
+int scheduler_run_queue_length(GlobalContext *global)
+{
+    #ifdef AVM_ENABLE_SMP
+        return SMP_ATOMIC_LOAD(&global->ready_count);
+    #else
+        int count = 0;
+        struct ListHead *item;
+        LIST_FOR_EACH(item, &global->ready_processes) {
+            count++;
+        }
+
+        return count;
+    #endif
 }
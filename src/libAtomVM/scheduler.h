@@ -34,27 +34,86 @@
 #define DEFAULT_REDUCTIONS_AMOUNT 1024
 
 /**
- * @brief move a process to waiting queue and wait a ready one
+ * @brief initializes the schedulers
  *
- * @details move current process to the waiting queue, and schedule the next one or sleep until an event is received.
+ * @details initializes ready queues and, in SMP builds, scheduler threads data, their locks and the listener that is
+ * used to wake up the scheduler that is waiting for events. It is called when the global context is created.
  * @param global the global context.
- * @param c the process context.
+ * @returns 1 on success, otherwise 0.
+ */
+int scheduler_init(GlobalContext *global);
+
+/**
+ * @brief destroys the schedulers
+ *
+ * @details frees everything that has been allocated by scheduler_init, scheduler threads must have been stopped.
+ * @param global the global context.
+ */
+void scheduler_destroy(GlobalContext *global);
+
+/**
+ * @brief starts scheduler threads
+ *
+ * @details in SMP builds it starts all the scheduler threads but the current one, that becomes the first scheduler.
+ * The leader process starts running on the current thread.
+ * @param global the global context.
+ * @param leader the first process.
+ */
+void scheduler_start(GlobalContext *global, Context *leader);
+
+/**
+ * @brief stops scheduler threads
+ *
+ * @details asks all scheduler threads to stop, scheduler_wait and scheduler_next return NULL once a scheduler has
+ * been stopped. It is used when the leader process terminates.
+ * @param global the global context.
+ */
+void scheduler_stop(GlobalContext *global);
+
+/**
+ * @brief wait for a ready process
+ *
+ * @details puts current process to sleep, and schedule the next one or sleep until an event is received. Current
+ * process is returned again if it has been signaled while it was running, and in SMP builds NULL is returned when
+ * schedulers have been stopped.
+ * @param global the global context.
+ * @param c the process context, or NULL when the calling scheduler is not running any process.
+ * @returns the process that will be run.
  */
 Context *scheduler_wait(GlobalContext *global, Context *c);
 
 /**
  * @brief make sure a process is on the ready queue
  *
- * @details make a process ready again by moving it to the ready queue.
+ * @details make a waiting process ready again by moving it to a ready queue, a process that is running is flagged
+ * so it will not go to sleep on its next wait.
  * @param global the global context.
  * @param c the process context.
  */
 void scheduler_make_ready(GlobalContext *global, Context *c);
 
 /**
- * @brief just move a process to the wait queue
+ * @brief signals a process that a message has been delivered
  *
- * @details make a process waiting.
+ * @details same as scheduler_make_ready, but a waiting process resumes from its receive loop.
+ * @param global the global context.
+ * @param c the process context.
+ */
+void scheduler_signal_message(GlobalContext *global, Context *c);
+
+/**
+ * @brief schedules a new process
+ *
+ * @details moves a process that has just been created and initialized by its creator to a ready queue.
+ * @param c the new process context.
+ */
+void scheduler_init_ready(Context *c);
+
+/**
+ * @brief puts a new process to sleep
+ *
+ * @details makes a process that has just been created waiting, it is made ready when a message is delivered to it.
+ * If a message has already been delivered meanwhile the process is moved to a ready queue instead.
  * @param global the global context.
  * @param c the process context.
  */
@@ -78,16 +137,43 @@ void scheduler_terminate(Context *c);
  */
 int schudule_processes_count(GlobalContext *global);
 
+/**
+ * @brief the number of ready processes
+ *
+ * @detail counts the processes that are waiting in the ready queues to be run.
+ * @param global the global context.
+ * @returns the number of ready processes.
+ */
+int scheduler_run_queue_length(GlobalContext *global);
+
 /**
  * @brief gets next runnable process from the ready queue.
  *
  * @detail gets next runnable process from the ready queue, it may return current process if there isn't any other runnable process.
+ * In SMP builds NULL is returned when schedulers have been stopped.
  * @param global the global context.
  * @param c the current process.
  * @returns runnable process.
  */
 Context *scheduler_next(GlobalContext *global, Context *c);
 
+/**
+ * @brief gets the time spent running by a process
+ *
+ * @details the current time slice is included when the process is running.
+ * @param c the process context.
+ * @returns the running time in microseconds.
+ */
+uint64_t scheduler_run_time_us(const Context *c);
+
+/**
+ * @brief gets the time elapsed since the schedulers have been initialized
+ *
+ * @param global the global context.
+ * @returns the elapsed time in microseconds.
+ */
+uint64_t scheduler_uptime_us(GlobalContext *global);
+
 /**
  * @brief checks if a context timeout has exired.
  *
@@ -100,10 +186,64 @@ int scheduler_is_timeout_expired(const Context *ctx);
 /**
  * @brief sets context timeout
  *
- * @details set context timeout timestamp, move context to wait queue and update global next timeout timestamp.
+ * @details set context timeout timestamp and schedule it on the global timer wheel, the context will be made ready
+ * when the timeout expires.
  * @param ctx the context that will be put on sleep
  * @param timeout ammount of time to be waited in milliseconds.
  */
 void scheduler_set_timeout(Context *ctx, uint32_t timeout);
 
+/**
+ * @brief cancels context timeout
+ *
+ * @details removes a pending timeout from the global timer wheel and clears context timeout, it does nothing if
+ * there is no timeout.
+ * @param ctx the context that will not wait a timeout anymore.
+ */
+void scheduler_cancel_timeout(Context *ctx);
+
+/**
+ * @brief starts an erlang timer
+ *
+ * @details copies the message and schedules it on the global erlang timers wheel, the message is sent to dest when
+ * the timer expires. dest is resolved at expiry time, nothing is sent if it doesn't exist anymore.
+ * @param global the global context.
+ * @param ref_ticks ref ticks of the timer reference, that will be used to cancel or read the timer.
+ * @param timeout ammount of time in milliseconds before the message is sent.
+ * @param dest a local pid or a registered name atom.
+ * @param message the message that will be sent.
+ * @returns 1 if the timer has been started, 0 if there is not enough memory.
+ */
+int scheduler_start_timer(GlobalContext *global, uint64_t ref_ticks, uint32_t timeout, term dest, term message);
+
+/**
+ * @brief cancels an erlang timer
+ *
+ * @details removes a timer started with scheduler_start_timer before it expires, the lookup is O(1).
+ * @param global the global context.
+ * @param ref_ticks ref ticks of the timer reference.
+ * @param remaining set to the time in milliseconds that was left before the timer expiry.
+ * @returns 1 if the timer has been cancelled, 0 if it has already expired or it doesn't exist.
+ */
+int scheduler_cancel_timer(GlobalContext *global, uint64_t ref_ticks, uint32_t *remaining);
+
+/**
+ * @brief reads an erlang timer
+ *
+ * @details gets the time that is left before a timer started with scheduler_start_timer expires.
+ * @param global the global context.
+ * @param ref_ticks ref ticks of the timer reference.
+ * @param remaining set to the time in milliseconds that is left before the timer expiry.
+ * @returns 1 if the timer is still pending, 0 if it has already expired or it doesn't exist.
+ */
+int scheduler_read_timer(GlobalContext *global, uint64_t ref_ticks, uint32_t *remaining);
+
+/**
+ * @brief cancels all erlang timers
+ *
+ * @details removes all pending erlang timers and frees their memory, it is used when the global context is destroyed.
+ * @param global the global context.
+ */
+void scheduler_cancel_all_timers(GlobalContext *global);
+
 #endif
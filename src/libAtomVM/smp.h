@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+/**
+ * @file smp.h
+ * @brief Locks and atomics used by the SMP scheduler.
+ *
+ * @details When AVM_ENABLE_SMP is defined processes run on several scheduler threads and the structures that are
+ * shared between them are protected using POSIX threads locks and GCC atomic builtins. Otherwise all the macros
+ * in this file expand to plain operations or to nothing, so single threaded builds don't pay for them and lock
+ * fields can be left out of structs.
+ */
+
+#ifndef _SMP_H_
+#define _SMP_H_
+
+#ifdef AVM_ENABLE_SMP
+
+#include <pthread.h>
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_rwlock_t RWLock;
+typedef pthread_cond_t CondVar;
+
+#define SMP_MUTEX_INIT(mutex) pthread_mutex_init((mutex), NULL)
+#define SMP_MUTEX_DESTROY(mutex) pthread_mutex_destroy(mutex)
+#define SMP_MUTEX_LOCK(mutex) pthread_mutex_lock(mutex)
+#define SMP_MUTEX_TRYLOCK(mutex) (pthread_mutex_trylock(mutex) == 0)
+#define SMP_MUTEX_UNLOCK(mutex) pthread_mutex_unlock(mutex)
+
+#define SMP_RWLOCK_INIT(lock) pthread_rwlock_init((lock), NULL)
+#define SMP_RWLOCK_DESTROY(lock) pthread_rwlock_destroy(lock)
+#define SMP_RWLOCK_RDLOCK(lock) pthread_rwlock_rdlock(lock)
+#define SMP_RWLOCK_WRLOCK(lock) pthread_rwlock_wrlock(lock)
+#define SMP_RWLOCK_UNLOCK(lock) pthread_rwlock_unlock(lock)
+
+// atomics are sequentially consistent: scheduler wake ups rely on it to never miss an idle scheduler
+#define SMP_ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define SMP_ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_SEQ_CST)
+#define SMP_ATOMIC_CAS(ptr, expected, desired) \
+    __atomic_compare_exchange_n((ptr), (expected), (desired), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define SMP_ATOMIC_FETCH_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_SEQ_CST)
+#define SMP_ATOMIC_FETCH_SUB(ptr, value) __atomic_fetch_sub((ptr), (value), __ATOMIC_SEQ_CST)
+#define SMP_ATOMIC_ADD(ptr, value) __atomic_add_fetch((ptr), (value), __ATOMIC_SEQ_CST)
+#define SMP_ATOMIC_SUB(ptr, value) __atomic_sub_fetch((ptr), (value), __ATOMIC_SEQ_CST)
+
+#else
+
+#define SMP_MUTEX_INIT(mutex)
+#define SMP_MUTEX_DESTROY(mutex)
+#define SMP_MUTEX_LOCK(mutex)
+#define SMP_MUTEX_TRYLOCK(mutex) 1
+#define SMP_MUTEX_UNLOCK(mutex)
+
+#define SMP_RWLOCK_INIT(lock)
+#define SMP_RWLOCK_DESTROY(lock)
+#define SMP_RWLOCK_RDLOCK(lock)
+#define SMP_RWLOCK_WRLOCK(lock)
+#define SMP_RWLOCK_UNLOCK(lock)
+
+#define SMP_ATOMIC_LOAD(ptr) (*(ptr))
+#define SMP_ATOMIC_STORE(ptr, value) (*(ptr) = (value))
+#define SMP_ATOMIC_CAS(ptr, expected, desired) \
+    ((*(ptr) == *(expected)) ? (*(ptr) = (desired), 1) : (*(expected) = *(ptr), 0))
+#define SMP_ATOMIC_FETCH_ADD(ptr, value) ((*(ptr) += (value)) - (value))
+#define SMP_ATOMIC_FETCH_SUB(ptr, value) ((*(ptr) -= (value)) + (value))
+#define SMP_ATOMIC_ADD(ptr, value) (*(ptr) += (value))
+#define SMP_ATOMIC_SUB(ptr, value) (*(ptr) -= (value))
+
+#endif
+
+#endif
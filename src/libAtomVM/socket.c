@@ -37,6 +37,12 @@ const char *const send_a = "\x4" "send";
 const char *const init_a = "\x4" "init";
 const char *const bind_a = "\x4" "bind";
 const char *const recvfrom_a = "\x8" "recvfrom";
+const char *const setopts_a = "\x7" "setopts";
+const char *const connect_a = "\x7" "connect";
+const char *const listen_a = "\x6" "listen";
+const char *const accept_a = "\x6" "accept";
+const char *const recv_a = "\x4" "recv";
+const char *const close_a = "\x5" "close";
 
 
 uint32_t socket_tuple_to_addr(term addr_tuple)
@@ -81,13 +87,17 @@ static void socket_consume_mailbox(Context *ctx)
     term cmd_name = term_get_tuple_element(cmd, 0);
     if (cmd_name == context_make_atom(ctx, init_a)) {
         term params = term_get_tuple_element(cmd, 1);
-        term reply = socket_driver_do_init(ctx, params);
+        term reply = socket_driver_do_init(ctx, pid, params);
         port_send_reply(ctx, pid, ref, reply);
     } else if (cmd_name == context_make_atom(ctx, bind_a)) {
         term address = term_get_tuple_element(cmd, 1);
         term port = term_get_tuple_element(cmd, 2);
         term reply = socket_driver_do_bind(ctx, address, port);
         port_send_reply(ctx, pid, ref, reply);
+    } else if (cmd_name == context_make_atom(ctx, send_a) && (term_get_tuple_arity(cmd) == 2)) {
+        term buffer = term_get_tuple_element(cmd, 1);
+        term reply = socket_driver_do_stream_send(ctx, buffer);
+        port_send_reply(ctx, pid, ref, reply);
     } else if (cmd_name == context_make_atom(ctx, send_a)) {
         term dest_address = term_get_tuple_element(cmd, 1);
         term dest_port = term_get_tuple_element(cmd, 2);
@@ -96,11 +106,31 @@ static void socket_consume_mailbox(Context *ctx)
         port_send_reply(ctx, pid, ref, reply);
     } else if (cmd_name == context_make_atom(ctx, recvfrom_a)) {
         socket_driver_do_recvfrom(ctx, pid, ref);
+    } else if (cmd_name == context_make_atom(ctx, setopts_a)) {
+        term opts = term_get_tuple_element(cmd, 1);
+        term reply = socket_driver_do_setopts(ctx, opts);
+        port_send_reply(ctx, pid, ref, reply);
+    } else if (cmd_name == context_make_atom(ctx, connect_a)) {
+        term address = term_get_tuple_element(cmd, 1);
+        term port = term_get_tuple_element(cmd, 2);
+        socket_driver_do_connect(ctx, pid, ref, address, port);
+    } else if (cmd_name == context_make_atom(ctx, listen_a)) {
+        term backlog = term_get_tuple_element(cmd, 1);
+        term reply = socket_driver_do_listen(ctx, backlog);
+        port_send_reply(ctx, pid, ref, reply);
+    } else if (cmd_name == context_make_atom(ctx, accept_a)) {
+        socket_driver_do_accept(ctx, pid, ref);
+    } else if (cmd_name == context_make_atom(ctx, recv_a)) {
+        term length = term_get_tuple_element(cmd, 1);
+        socket_driver_do_recv(ctx, pid, ref, length);
+    } else if (cmd_name == context_make_atom(ctx, close_a)) {
+        term reply = socket_driver_do_close(ctx);
+        port_send_reply(ctx, pid, ref, reply);
     } else {
         port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, BADARG_ATOM));
     }
 
-    free(message);
+    mailbox_destroy_message(message);
     TRACE("END socket_consume_mailbox\n");
 }
 
@@ -26,9 +26,16 @@
 void *socket_driver_create_data();
 void socket_driver_delete_data(void *data);
 
-term socket_driver_do_init(Context *ctx, term params);
+term socket_driver_do_init(Context *ctx, term pid, term params);
+term socket_driver_do_setopts(Context *ctx, term opts);
 term socket_driver_do_bind(Context *ctx, term address, term port);
 term socket_driver_do_send(Context *ctx, term dest_address, term dest_port, term buffer);
 void socket_driver_do_recvfrom(Context *ctx, term pid, term ref);
+void socket_driver_do_connect(Context *ctx, term pid, term ref, term address, term port);
+term socket_driver_do_listen(Context *ctx, term backlog);
+void socket_driver_do_accept(Context *ctx, term pid, term ref);
+term socket_driver_do_stream_send(Context *ctx, term buffer);
+void socket_driver_do_recv(Context *ctx, term pid, term ref, term length);
+term socket_driver_do_close(Context *ctx);
 
 #endif
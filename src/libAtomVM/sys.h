@@ -34,6 +34,9 @@
 #include <stdint.h>
 #include <time.h>
 
+#define EVENT_LISTENER_READ 1
+#define EVENT_LISTENER_WRITE 2
+
 typedef struct EventListener EventListener;
 
 typedef void (*event_handler_t)(EventListener *listener);
@@ -47,10 +50,59 @@ struct EventListener {
     event_handler_t handler;
     void *data;
     int fd;
+    // EVENT_LISTENER_READ and EVENT_LISTENER_WRITE flags, fd listeners that don't set any wait for fd to be readable
+    int events;
 
     unsigned int one_shot : 1;
 };
 
+/**
+ * @brief initializes platform specific event handling
+ *
+ * @details called once when the global context is created, before any listener is registered.
+ * @param glb the global context.
+ * @return 1 on success, 0 otherwise.
+ */
+int sys_init_platform(GlobalContext *glb);
+
+/**
+ * @brief frees platform specific event handling resources
+ *
+ * @details called once when the global context is destroyed, after all listeners have been unregistered.
+ * @param glb the global context.
+ */
+void sys_free_platform(GlobalContext *glb);
+
+/**
+ * @brief adds a listener to the listeners list
+ *
+ * @details listeners must be added and removed only using sys_register_listener and sys_unregister_listener, so
+ * platforms can keep their own data structures in sync with the listeners list. fd and expires must be already set
+ * and they must not change while the listener is registered. There must be at most one registered listener for each fd.
+ * @param glb the global context.
+ * @param listener the listener that will be added.
+ * @returns 1 on success, 0 if the platform cannot wait for fd events, in that case listener is not added and errno is set.
+ */
+int sys_register_listener(GlobalContext *glb, EventListener *listener);
+
+/**
+ * @brief applies a change of the events a registered listener is waiting for
+ *
+ * @details listener events can be changed only while it is not registered or by calling this function after the change.
+ * @param glb the global context.
+ * @param listener the listener that has been changed.
+ */
+void sys_update_listener(GlobalContext *glb, EventListener *listener);
+
+/**
+ * @brief removes a listener from the listeners list
+ *
+ * @details it is safe to call it from a handler, also for listeners other than the one that is being handled.
+ * @param glb the global context.
+ * @param listener the listener that will be removed.
+ */
+void sys_unregister_listener(GlobalContext *glb, EventListener *listener);
+
 /**
  * @brief waits platform events
  *
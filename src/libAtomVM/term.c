@@ -21,7 +21,9 @@
 
 #include "atom.h"
 #include "context.h"
+#include "globalcontext.h"
 #include "interop.h"
+#include "map.h"
 #include "valueshashtable.h"
 
 #include <ctype.h>
@@ -34,9 +36,9 @@ void term_display(FILE *fd, term t, const Context *ctx)
             AtomString atom_string = (AtomString) valueshashtable_get_value(ctx->global->atoms_ids_table, atom_index, (unsigned long) NULL);
             fprintf(fd, "%.*s", (int) atom_string_len(atom_string), (char *) atom_string_data(atom_string));
 
-    } else if (term_is_integer(t)) {
-        long iv = term_to_int32(t);
-        fprintf(fd, "%li", iv);
+    } else if (term_is_any_integer(t)) {
+        int64_t iv = term_maybe_unbox_int64(t);
+        fprintf(fd, "%" PRId64, iv);
 
     } else if (term_is_nil(t)) {
         fprintf(fd, "[]");
@@ -123,6 +125,27 @@ void term_display(FILE *fd, term t, const Context *ctx)
         }
         fprintf(fd, ">>");
 
+    } else if (term_is_map(t)) {
+        fprintf(fd, "#{");
+
+        struct MapIterator it;
+        map_iterator_init(&it, t);
+        term key;
+        term value;
+        int display_separator = 0;
+        while (map_iterator_next(&it, &key, &value)) {
+            if (display_separator) {
+                fputc(',', fd);
+            } else {
+                display_separator = 1;
+            }
+
+            term_display(fd, key, ctx);
+            fprintf(fd, "=>");
+            term_display(fd, value, ctx);
+        }
+        fputc('}', fd);
+
     } else if (term_is_reference(t)) {
         const char *format =
 #ifdef __clang__
@@ -135,3 +158,254 @@ void term_display(FILE *fd, term t, const Context *ctx)
         fprintf(fd, "Unknown term type: %li", t);
     }
 }
+
+static int term_type_order(term t)
+{
+    if (term_is_any_integer(t)) {
+        return 0;
+    } else if (term_is_atom(t)) {
+        return 1;
+    } else if (term_is_reference(t)) {
+        return 2;
+    } else if (term_is_function(t)) {
+        return 3;
+    } else if (term_is_pid(t)) {
+        return 4;
+    } else if (term_is_tuple(t)) {
+        return 5;
+    } else if (term_is_map(t)) {
+        return 6;
+    } else if (term_is_nil(t)) {
+        return 7;
+    } else if (term_is_nonempty_list(t)) {
+        return 8;
+    } else if (term_is_binary(t)) {
+        return 9;
+    } else {
+        return 10;
+    }
+}
+
+static int term_compare_atoms(term t, term other, GlobalContext *global)
+{
+    if (!global) {
+        return (term_to_atom_index(t) < term_to_atom_index(other)) ? -1 : 1;
+    }
+
+    AtomString atom_t = globalcontext_atomstring_from_term(global, t);
+    AtomString atom_other = globalcontext_atomstring_from_term(global, other);
+    int len_t = atom_string_len(atom_t);
+    int len_other = atom_string_len(atom_other);
+
+    int cmp = memcmp(atom_string_data(atom_t), atom_string_data(atom_other), (len_t < len_other) ? len_t : len_other);
+    if (cmp) {
+        return cmp;
+    }
+
+    return len_t - len_other;
+}
+
+// pairs of terms that still have to be compared, such as the remaining elements of tuples being compared
+struct CompareFrame
+{
+    const term *t;
+    const term *other;
+    size_t count;
+};
+
+#define COMPARE_STACK_INITIAL_SIZE 16
+
+struct CompareStack
+{
+    struct CompareFrame *frames;
+    int size;
+    int capacity;
+    struct CompareFrame initial_frames[COMPARE_STACK_INITIAL_SIZE];
+};
+
+static void compare_stack_push(struct CompareStack *stack, const term *t, const term *other, size_t count)
+{
+    if (stack->size == stack->capacity) {
+        int capacity = stack->capacity * 2;
+        struct CompareFrame *frames = malloc(capacity * sizeof(struct CompareFrame));
+        if (IS_NULL_PTR(frames)) {
+            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+            abort();
+        }
+        memcpy(frames, stack->frames, stack->size * sizeof(struct CompareFrame));
+        if (stack->frames != stack->initial_frames) {
+            free(stack->frames);
+        }
+        stack->frames = frames;
+        stack->capacity = capacity;
+    }
+
+    struct CompareFrame *frame = &stack->frames[stack->size++];
+    frame->t = t;
+    frame->other = other;
+    frame->count = count;
+}
+
+static int compare_stack_pop(struct CompareStack *stack, term *t, term *other)
+{
+    while (stack->size) {
+        struct CompareFrame *frame = &stack->frames[stack->size - 1];
+        *t = *frame->t++;
+        *other = *frame->other++;
+        if (--frame->count == 0) {
+            stack->size--;
+        }
+        if (*t != *other) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int term_deep_compare(term t, term other, GlobalContext *global)
+{
+    // nested terms are compared using an explicit stack, so deeply nested terms cannot overflow the C stack
+    struct CompareStack stack;
+    stack.frames = stack.initial_frames;
+    stack.size = 0;
+    stack.capacity = COMPARE_STACK_INITIAL_SIZE;
+
+    int result = 0;
+    int compare_next = (t != other);
+    while (compare_next) {
+        int type_t = term_type_order(t);
+        int type_other = term_type_order(other);
+        if (type_t != type_other) {
+            result = (type_t < type_other) ? -1 : 1;
+            break;
+        }
+
+        switch (type_t) {
+            case 0: {
+                int64_t value_t = term_maybe_unbox_int64(t);
+                int64_t value_other = term_maybe_unbox_int64(other);
+                result = (value_t < value_other) ? -1 : (value_t > value_other);
+                break;
+            }
+
+            case 1:
+                result = term_compare_atoms(t, other, global);
+                break;
+
+            case 2: {
+                uint64_t ticks_t = term_to_ref_ticks(t);
+                uint64_t ticks_other = term_to_ref_ticks(other);
+                result = (ticks_t < ticks_other) ? -1 : (ticks_t > ticks_other);
+                break;
+            }
+
+            case 3: {
+                const term *boxed_t = term_to_const_term_ptr(t);
+                const term *boxed_other = term_to_const_term_ptr(other);
+                int t_size = term_boxed_size(t);
+                int other_size = term_boxed_size(other);
+                if (t_size != other_size) {
+                    result = (t_size < other_size) ? -1 : 1;
+                    break;
+                }
+                // module and function index first, frozen values later
+                for (int i = 1; (i <= 2) && !result; i++) {
+                    if (boxed_t[i] != boxed_other[i]) {
+                        result = (boxed_t[i] < boxed_other[i]) ? -1 : 1;
+                    }
+                }
+                if (!result && (t_size > 2)) {
+                    compare_stack_push(&stack, boxed_t + 3, boxed_other + 3, t_size - 2);
+                }
+                break;
+            }
+
+            case 4: {
+                int32_t t_pid = term_to_local_process_id(t);
+                int32_t other_pid = term_to_local_process_id(other);
+                result = (t_pid < other_pid) ? -1 : (t_pid > other_pid);
+                break;
+            }
+
+            case 5: {
+                int arity_t = term_get_tuple_arity(t);
+                int arity_other = term_get_tuple_arity(other);
+                if (arity_t != arity_other) {
+                    result = (arity_t < arity_other) ? -1 : 1;
+                } else if (arity_t) {
+                    compare_stack_push(&stack, term_to_const_term_ptr(t) + 1, term_to_const_term_ptr(other) + 1, arity_t);
+                }
+                break;
+            }
+
+            case 6: {
+                size_t t_size = map_size(t);
+                size_t other_size = map_size(other);
+                if (t_size != other_size) {
+                    result = (t_size < other_size) ? -1 : 1;
+                } else if (t_size && term_is_flatmap(t) && term_is_flatmap(other)) {
+                    // keys first, values later
+                    const term *boxed_t = term_to_const_term_ptr(t);
+                    const term *boxed_other = term_to_const_term_ptr(other);
+                    compare_stack_push(&stack, boxed_t + TERM_MAP_VALUES_INDEX, boxed_other + TERM_MAP_VALUES_INDEX, t_size);
+                    const term *keys_t = term_to_const_term_ptr(boxed_t[TERM_MAP_KEYS_INDEX]) + 1;
+                    const term *keys_other = term_to_const_term_ptr(boxed_other[TERM_MAP_KEYS_INDEX]) + 1;
+                    compare_stack_push(&stack, keys_t, keys_other, t_size);
+                } else {
+                    // hash maps have to be sorted first, they are compared by map_compare
+                    result = map_compare(t, other, global);
+                }
+                break;
+            }
+
+            case 8: {
+                // tails are compared after heads, without pushing a frame when the heads are equal immediates
+                term head_t = term_get_list_head(t);
+                term head_other = term_get_list_head(other);
+                const term *tail_t = term_get_list_ptr(t);
+                const term *tail_other = term_get_list_ptr(other);
+                if (head_t == head_other) {
+                    t = *tail_t;
+                    other = *tail_other;
+                    if (t == other) {
+                        compare_next = compare_stack_pop(&stack, &t, &other);
+                    }
+                    continue;
+                }
+                compare_stack_push(&stack, tail_t, tail_other, 1);
+                t = head_t;
+                other = head_other;
+                continue;
+            }
+
+            case 9: {
+                unsigned long len_t = term_binary_size(t);
+                unsigned long len_other = term_binary_size(other);
+                int cmp = memcmp(term_binary_data(t), term_binary_data(other), (len_t < len_other) ? len_t : len_other);
+                if (cmp) {
+                    result = cmp;
+                } else {
+                    result = (len_t < len_other) ? -1 : (len_t > len_other);
+                }
+                break;
+            }
+
+            default:
+                // nil is equal only to itself, so it never gets here
+                result = (t < other) ? -1 : 1;
+                break;
+        }
+
+        if (result) {
+            break;
+        }
+        compare_next = compare_stack_pop(&stack, &t, &other);
+    }
+
+    if (stack.frames != stack.initial_frames) {
+        free(stack.frames);
+    }
+
+    return result;
+}
@@ -27,28 +27,82 @@
 #ifndef _TERM_H_
 #define _TERM_H_
 
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "memory.h"
+#include "refc_binary.h"
 #include "utils.h"
 
 #include "term_typedef.h"
 
+struct GlobalContext;
+
 #define TERM_BOXED_VALUE_TAG 0x2
 #define TERM_INTEGER_TAG 0xF
 #define TERM_CATCH_TAG 0x1B
 
 #define TERM_BOXED_TAG_MASK 0x3F
 #define TERM_BOXED_TUPLE 0x0
+#define TERM_BOXED_BIN_MATCH_STATE 0x4
+#define TERM_BOXED_POSITIVE_INTEGER 0x8
+#define TERM_BOXED_NEGATIVE_INTEGER 0xC
 #define TERM_BOXED_REF 0x10
 #define TERM_BOXED_FUN 0x14
+#define TERM_BOXED_REFC_BINARY 0x20
 #define TERM_BOXED_HEAP_BINARY 0x24
+#define TERM_BOXED_SUB_BINARY 0x28
+#define TERM_BOXED_MAP 0x2C
+#define TERM_BOXED_HASHMAP 0x30
+#define TERM_BOXED_HASHMAP_NODE 0x34
 
 #define BINARY_HEADER_SIZE 2
 
+// refc binary handle: boxed header, size, struct RefcBinary pointer and next handle in the off-heap list
+#define REFC_BINARY_HANDLE_SIZE 4
+#define REFC_BINARY_HANDLE_REFC_INDEX 2
+#define REFC_BINARY_HANDLE_NEXT_INDEX 3
+
+// sub binary: boxed header, size, offset and parent binary term
+#define TERM_BOXED_SUB_BINARY_SIZE 4
+#define SUB_BINARY_OFFSET_INDEX 2
+#define SUB_BINARY_PARENT_INDEX 3
+
+// match state: boxed header, matched binary, current offset in bits and saved offsets (slot 0 is the start offset)
+#define TERM_BOXED_BIN_MATCH_STATE_SIZE 3
+#define BIN_MATCH_STATE_BINARY_INDEX 1
+#define BIN_MATCH_STATE_OFFSET_INDEX 2
+#define BIN_MATCH_STATE_SAVED_OFFSETS_INDEX 3
+
+// flat map: boxed header, sorted keys tuple and values in the same order
+#define TERM_MAP_KEYS_INDEX 1
+#define TERM_MAP_VALUES_INDEX 2
+
+// hash map: boxed header, size, bitmap and children, a hash map node has just the bitmap and the children.
+// Children are either [Key | Value] leaves or other nodes, a 0 bitmap marks a node made only of colliding leaves.
+#define TERM_HASHMAP_SIZE_INDEX 1
+#define TERM_HASHMAP_BITMAP_INDEX 2
+#define TERM_HASHMAP_NODE_BITMAP_INDEX 1
+
+// small integers have 4 tag bits, so 28 bits are left on 32 bits platforms and 60 bits on 64 bits platforms
+#if TERM_BITS == 32
+    #define TERM_MAX_SMALL_INT 134217727
+#elif TERM_BITS == 64
+    #define TERM_MAX_SMALL_INT 576460752303423487
+#else
+    #error "Wrong TERM_BITS define"
+#endif
+#define TERM_MIN_SMALL_INT (-TERM_MAX_SMALL_INT - 1)
+
+// integers that do not fit a small integer are boxed: header followed by an int64
+#define BOXED_INT64_SIZE (1 + sizeof(int64_t) / sizeof(term))
+
+// refs: header followed by 64 bit ticks
+#define REF_SIZE ((int) (1 + sizeof(uint64_t) / sizeof(term)))
+
 
 #define TERM_DEBUG_ASSERT(...)
 
@@ -220,7 +274,62 @@ static inline int term_is_binary(term t)
     /* boxed: 10 */
     if ((t & 0x3) == 0x2) {
         const term *boxed_value = term_to_const_term_ptr(t);
-        if ((boxed_value[0] & 0x3F) == 0x24) {
+        int boxed_tag = boxed_value[0] & 0x3F;
+        if ((boxed_tag == TERM_BOXED_HEAP_BINARY) || (boxed_tag == TERM_BOXED_REFC_BINARY) || (boxed_tag == TERM_BOXED_SUB_BINARY)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Checks if a term is a sub binary
+ *
+ * @details Returns 1 if a term is a slice of another binary, otherwise 0.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_sub_binary(term t)
+{
+    /* boxed: 10 */
+    if ((t & 0x3) == 0x2) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        if ((boxed_value[0] & 0x3F) == TERM_BOXED_SUB_BINARY) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Gets the binary referenced by a sub binary
+ *
+ * @param t a sub binary term.
+ * @return the parent binary term, that is never a sub binary.
+ */
+static inline term term_get_sub_binary_parent(term t)
+{
+    TERM_DEBUG_ASSERT(term_is_sub_binary(t));
+
+    const term *boxed_value = term_to_const_term_ptr(t);
+    return boxed_value[SUB_BINARY_PARENT_INDEX];
+}
+
+/**
+ * @brief Checks if a term is a reference counted binary
+ *
+ * @details Returns 1 if a term is a handle to a binary stored outside of the heap, otherwise 0.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_refc_binary(term t)
+{
+    /* boxed: 10 */
+    if ((t & 0x3) == 0x2) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        if ((boxed_value[0] & 0x3F) == TERM_BOXED_REFC_BINARY) {
             return 1;
         }
     }
@@ -241,6 +350,38 @@ static inline int term_is_integer(term t)
     return ((t & 0xF) == 0xF);
 }
 
+/**
+ * @brief Checks if a term is a boxed integer
+ *
+ * @details Returns 1 if a term is an integer that does not fit a small integer and it is stored on the heap.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_boxed_integer(term t)
+{
+    if (term_is_boxed(t)) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        int boxed_tag = boxed_value[0] & TERM_BOXED_TAG_MASK;
+        if ((boxed_tag == TERM_BOXED_POSITIVE_INTEGER) || (boxed_tag == TERM_BOXED_NEGATIVE_INTEGER)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Checks if a term is any integer value
+ *
+ * @details Returns 1 if a term is either a small integer or a boxed integer, otherwise 0.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_any_integer(term t)
+{
+    return term_is_integer(t) || term_is_boxed_integer(t);
+}
+
 static inline int term_is_catch_label(term t)
 {
     return (t & 0x3F) == TERM_CATCH_TAG;
@@ -316,6 +457,64 @@ static inline int term_is_function(term t)
     return 0;
 }
 
+/**
+ * @brief Checks if a term is a map
+ *
+ * @details Returns 1 if a term is either a flat map or a hash map, otherwise 0.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_map(term t)
+{
+    if (term_is_boxed(t)) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        int boxed_tag = boxed_value[0] & 0x3F;
+        if ((boxed_tag == TERM_BOXED_MAP) || (boxed_tag == TERM_BOXED_HASHMAP)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Checks if a term is a flat map
+ *
+ * @details Returns 1 if a term is a map that stores its keys in a sorted tuple, otherwise 0.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_flatmap(term t)
+{
+    if (term_is_boxed(t)) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        if ((boxed_value[0] & 0x3F) == TERM_BOXED_MAP) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Checks if a term is an inner node of a hash map
+ *
+ * @details Returns 1 if a term is a hash map node, such terms are never visible to Erlang code.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_hashmap_node(term t)
+{
+    if (term_is_boxed(t)) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        if ((boxed_value[0] & 0x3F) == TERM_BOXED_HASHMAP_NODE) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * @brief Checks if a term is a saved CP
  *
@@ -388,6 +587,59 @@ static inline int32_t term_to_int32(term t)
     return ((int32_t) t) >> 4;
 }
 
+/**
+ * @brief Term to int64
+ *
+ * @details Returns an int64 for a given term, all the bits of a term are used on 64 bits platforms.
+ * @param t the term that will be converted to int64, term type is checked.
+ * @return a int64 value.
+ */
+static inline int64_t term_to_int64(term t)
+{
+    TERM_DEBUG_ASSERT(term_is_integer(t));
+
+    return ((intptr_t) t) >> 4;
+}
+
+/**
+ * @brief Gets the value of a boxed integer
+ *
+ * @param t a boxed integer term, term type is checked.
+ * @return a int64 value.
+ */
+static inline int64_t term_unbox_int64(term t)
+{
+    TERM_DEBUG_ASSERT(term_is_boxed_integer(t));
+
+    const term *boxed_value = term_to_const_term_ptr(t);
+
+    #if TERM_BYTES == 8
+        return (int64_t) boxed_value[1];
+
+    #elif TERM_BYTES == 4
+        return (int64_t) ((((uint64_t) boxed_value[1]) << 32) | boxed_value[2]);
+
+    #else
+        #error "terms must be either 32 or 64 bit wide"
+    #endif
+}
+
+/**
+ * @brief Gets the value of any integer
+ *
+ * @details Returns an int64 for either a small integer or a boxed integer.
+ * @param t the term that will be converted to int64, term type is checked.
+ * @return a int64 value.
+ */
+static inline int64_t term_maybe_unbox_int64(term t)
+{
+    if (term_is_integer(t)) {
+        return term_to_int64(t);
+    }
+
+    return term_unbox_int64(t);
+}
+
 static inline int term_to_catch_label_and_module(term t, int *module_index)
 {
     *module_index = t >> 24;
@@ -442,10 +694,9 @@ static inline term term_from_int11(int16_t value)
 static inline term term_from_int32(int32_t value)
 {
 #if TERM_BITS == 32
-    // 268435455 == 0x0FFFFFFF
-    if (UNLIKELY((value > 268435455) || (value < -268435455))) {
-        //TODO: unimplemented on heap integer value
-        fprintf(stderr, "term_from_int32: unimplemented: term should be moved to heap.");
+    if (UNLIKELY((value > TERM_MAX_SMALL_INT) || (value < TERM_MIN_SMALL_INT))) {
+        // callers that might get such values must use term_make_maybe_boxed_int64 instead
+        fprintf(stderr, "term_from_int32: %" PRId32 " does not fit a small integer.\n", value);
         abort();
 
     } else {
@@ -462,31 +713,73 @@ static inline term term_from_int32(int32_t value)
 
 static inline term term_from_int64(int64_t value)
 {
-#if TERM_BITS == 32
-    // 268435455 == 0x0FFFFFFF
-    if (UNLIKELY((value > 268435455) || (value < -268435455))) {
-        //TODO: unimplemented on heap integer value
-        fprintf(stderr, "term_from_int64: unimplemented: term should be moved to heap.");
+    if (UNLIKELY((value > TERM_MAX_SMALL_INT) || (value < TERM_MIN_SMALL_INT))) {
+        // callers that might get such values must use term_make_maybe_boxed_int64 instead
+        fprintf(stderr, "term_from_int64: %" PRId64 " does not fit a small integer.\n", value);
         abort();
+    }
 
-    } else {
-        return (value << 4) | 0xF;
+    return (((term) value) << 4) | 0xF;
+}
+
+/**
+ * @brief Gets the heap size required by an integer
+ *
+ * @param value any int64 value.
+ * @return 0 when value fits a small integer, otherwise the number of terms used by a boxed integer.
+ */
+static inline size_t term_int64_heap_size(int64_t value)
+{
+    if ((value > TERM_MAX_SMALL_INT) || (value < TERM_MIN_SMALL_INT)) {
+        return BOXED_INT64_SIZE;
     }
 
-#elif TERM_BITS == 64
-    // 1152921504606846975 = 0x0FFFFFFFFFFFFFFF
-    if (UNLIKELY((value > 1152921504606846975) || (value < -1152921504606846975))) {
-        //TODO: unimplemented on heap integer value
-        fprintf(stderr, "unimplemented: term should be moved to heap.");
-        abort();
+    return 0;
+}
 
-    } else {
-        return (value << 4) | 0xF;
+/**
+ * @brief Initializes a boxed integer
+ *
+ * @details Initializes a memory area of BOXED_INT64_SIZE terms as a boxed integer.
+ * @param boxed_value the memory area that will be initialized.
+ * @param value the integer value, that should not fit a small integer.
+ * @return a term pointing to the boxed integer.
+ */
+static inline term term_init_boxed_int64(term *boxed_value, int64_t value)
+{
+    int boxed_tag = (value < 0) ? TERM_BOXED_NEGATIVE_INTEGER : TERM_BOXED_POSITIVE_INTEGER;
+    boxed_value[0] = ((BOXED_INT64_SIZE - 1) << 6) | boxed_tag;
+
+    #if TERM_BYTES == 8
+        boxed_value[1] = (term) value;
+
+    #elif TERM_BYTES == 4
+        boxed_value[1] = (term) (((uint64_t) value) >> 32);
+        boxed_value[2] = (term) (((uint64_t) value) & 0xFFFFFFFF);
+
+    #else
+        #error "terms must be either 32 or 64 bit wide"
+    #endif
+
+    return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+}
+
+/**
+ * @brief Term from any int64
+ *
+ * @details Returns a small integer when value fits it, otherwise a boxed integer is allocated on the heap.
+ * term_int64_heap_size(value) terms must be already available on the heap.
+ * @param value the value that will be converted to a term.
+ * @param ctx the context that owns the memory that will be allocated.
+ * @return a term that encapsulates the integer value.
+ */
+static inline term term_make_maybe_boxed_int64(int64_t value, Context *ctx)
+{
+    if ((value > TERM_MAX_SMALL_INT) || (value < TERM_MIN_SMALL_INT)) {
+        return term_init_boxed_int64(memory_heap_alloc(ctx, BOXED_INT64_SIZE), value);
     }
 
-#else
-    #error "Wrong TERM_BITS define"
-#endif
+    return (((term) value) << 4) | 0xF;
 }
 
 static inline term term_from_catch_label(unsigned int module_index, unsigned int label)
@@ -524,10 +817,56 @@ static inline int term_binary_data_size_in_terms(uint32_t size)
 #endif
 }
 
+/**
+ * @brief Gets the heap space required by a binary
+ *
+ * @details Returns the count of terms that term_create_uninitialized_binary allocates on the heap for a binary with the
+ * given size.
+ * @param size the size in bytes.
+ * @return the count of terms
+ */
+static inline int term_binary_heap_size(uint32_t size)
+{
+    if (size >= REFC_BINARY_MIN) {
+        return REFC_BINARY_HANDLE_SIZE;
+    }
+
+    return term_binary_data_size_in_terms(size) + 1;
+}
+
+/**
+ * @brief Creates an uninitialized binary
+ *
+ * @details Allocates a binary and returns a term pointing to it, binary data has to be filled by the caller.
+ * term_binary_heap_size(size) terms must be already available on the heap.
+ * @param size size of binary data buffer.
+ * @param ctx the context that owns the memory that will be allocated.
+ * @return a term pointing to the boxed binary pointer or an invalid term when off-heap allocation fails.
+ */
+static inline term term_create_uninitialized_binary(uint32_t size, Context *ctx)
+{
+    if (size >= REFC_BINARY_MIN) {
+        struct RefcBinary *refc = refc_binary_create(NULL, size);
+        if (IS_NULL_PTR(refc)) {
+            return term_invalid_term();
+        }
+        return memory_alloc_refc_binary(ctx, refc);
+    }
+
+    int size_in_terms = term_binary_data_size_in_terms(size);
+
+    term *boxed_value = memory_heap_alloc(ctx, size_in_terms + 1);
+    boxed_value[0] = (size_in_terms << 6) | TERM_BOXED_HEAP_BINARY;
+    boxed_value[1] = size;
+
+    return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+}
+
 /**
  * @brief Term from binary data
  *
- * @details Allocates a binary on the heap, and returns a term pointing to it.
+ * @details Allocates a binary on the heap, and returns a term pointing to it. Binaries that are at least REFC_BINARY_MIN
+ * bytes are stored off-heap and they are shared instead of being copied, a small handle is allocated on the heap.
  * @param data binary data.
  * @param size size of binary data buffer.
  * @param ctx the context that owns the memory that will be allocated.
@@ -535,6 +874,14 @@ static inline int term_binary_data_size_in_terms(uint32_t size)
  */
 static inline term term_from_literal_binary(const void *data, uint32_t size, Context *ctx)
 {
+    if (size >= REFC_BINARY_MIN) {
+        struct RefcBinary *refc = refc_binary_create(data, size);
+        // heap space for a heap binary has been already reserved, so it can be used as a fallback
+        if (LIKELY(refc != NULL)) {
+            return memory_alloc_refc_binary(ctx, refc);
+        }
+    }
+
     int size_in_terms = term_binary_data_size_in_terms(size);
 
     term *boxed_value = memory_heap_alloc(ctx, size_in_terms + 1);
@@ -573,22 +920,219 @@ static inline const char *term_binary_data(term t)
     TERM_DEBUG_ASSERT(term_is_binary(t));
 
     const term *boxed_value = term_to_const_term_ptr(t);
-    return (const char *) (boxed_value + 2);
+    switch (boxed_value[0] & TERM_BOXED_TAG_MASK) {
+        case TERM_BOXED_REFC_BINARY: {
+            const struct RefcBinary *refc = (const struct RefcBinary *) boxed_value[REFC_BINARY_HANDLE_REFC_INDEX];
+            return (const char *) refc->data;
+        }
+        case TERM_BOXED_SUB_BINARY:
+            // parent is never a sub binary
+            return term_binary_data(term_get_sub_binary_parent(t)) + boxed_value[SUB_BINARY_OFFSET_INDEX];
+        default:
+            return (const char *) (boxed_value + 2);
+    }
 }
 
 /**
- * @brief Get a ref term from ref ticks
+ * @brief Checks if a binary slice is small enough to be copied
  *
- * @param ref_ticks an unique uint64 value that will be used to create ref term.
+ * @details Returns 1 when a heap binary with the given size is not bigger than a sub binary, so there is no point in
+ * referencing the parent binary.
+ * @param size slice size in bytes.
+ * @return 1 if the slice should be copied, 0 otherwise.
+ */
+static inline int term_sub_binary_should_copy(uint32_t size)
+{
+    return term_binary_data_size_in_terms(size) + 1 <= TERM_BOXED_SUB_BINARY_SIZE;
+}
+
+/**
+ * @brief Creates a slice of a binary
+ *
+ * @details Returns a sub binary that references the given binary without copying its data, tiny slices are copied to a
+ * new heap binary instead. TERM_BOXED_SUB_BINARY_SIZE terms must be already available on the heap.
+ * @param binary the binary that will be sliced.
+ * @param offset slice offset in bytes.
+ * @param len slice size in bytes.
  * @param ctx the context that owns the memory that will be allocated.
- * @return a ref term created using given ref ticks.
+ * @return a binary term.
  */
-static inline term term_from_ref_ticks(uint64_t ref_ticks, Context *ctx)
+static inline term term_maybe_create_sub_binary(term binary, uint32_t offset, uint32_t len, Context *ctx)
+{
+    if (term_sub_binary_should_copy(len)) {
+        return term_from_literal_binary(term_binary_data(binary) + offset, len, ctx);
+    }
+
+    if (term_is_sub_binary(binary)) {
+        const term *boxed_value = term_to_const_term_ptr(binary);
+        offset += boxed_value[SUB_BINARY_OFFSET_INDEX];
+        binary = term_get_sub_binary_parent(binary);
+    }
+
+    term *boxed_value = memory_heap_alloc(ctx, TERM_BOXED_SUB_BINARY_SIZE);
+    boxed_value[0] = ((TERM_BOXED_SUB_BINARY_SIZE - 1) << 6) | TERM_BOXED_SUB_BINARY;
+    boxed_value[1] = len;
+    boxed_value[SUB_BINARY_OFFSET_INDEX] = offset;
+    boxed_value[SUB_BINARY_PARENT_INDEX] = binary;
+
+    return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+}
+
+/**
+ * @brief Checks if a term is a binary match state
+ *
+ * @details Returns 1 if a term is a match state created by bs_start_match instructions, otherwise 0.
+ * @param t the term that will be checked.
+ * @return 1 if check succedes, 0 otherwise.
+ */
+static inline int term_is_bin_match_state(term t)
+{
+    /* boxed: 10 */
+    if ((t & 0x3) == 0x2) {
+        const term *boxed_value = term_to_const_term_ptr(t);
+        if ((boxed_value[0] & 0x3F) == TERM_BOXED_BIN_MATCH_STATE) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Creates a binary match state
+ *
+ * @details Creates a match state that starts matching the given binary from offset, offset is also saved into every
+ * slot. TERM_BOXED_BIN_MATCH_STATE_SIZE + slots terms must be already available on the heap.
+ * @param binary the binary that will be matched.
+ * @param offset start offset in bits.
+ * @param slots number of saved offsets, including the start offset.
+ * @param ctx the context that owns the memory that will be allocated.
+ * @return a match state term.
+ */
+static inline term term_alloc_bin_match_state(term binary, size_t offset, int slots, Context *ctx)
 {
-    int ref_size = (sizeof(uint64_t) / sizeof(term));
+    term *boxed_value = memory_heap_alloc(ctx, TERM_BOXED_BIN_MATCH_STATE_SIZE + slots);
+    boxed_value[0] = ((TERM_BOXED_BIN_MATCH_STATE_SIZE - 1 + slots) << 6) | TERM_BOXED_BIN_MATCH_STATE;
+    boxed_value[BIN_MATCH_STATE_BINARY_INDEX] = binary;
+    boxed_value[BIN_MATCH_STATE_OFFSET_INDEX] = offset;
+    for (int i = 0; i < slots; i++) {
+        boxed_value[BIN_MATCH_STATE_SAVED_OFFSETS_INDEX + i] = offset;
+    }
 
-    term *boxed_value = memory_heap_alloc(ctx, ref_size + 1);
-    boxed_value[0] = (ref_size << 6) | TERM_BOXED_REF;
+    return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
+}
+
+/**
+ * @brief Gets the binary matched by a match state
+ *
+ * @param t a match state term.
+ * @return the matched binary.
+ */
+static inline term term_get_bin_match_state_binary(term t)
+{
+    TERM_DEBUG_ASSERT(term_is_bin_match_state(t));
+
+    const term *boxed_value = term_to_const_term_ptr(t);
+    return boxed_value[BIN_MATCH_STATE_BINARY_INDEX];
+}
+
+/**
+ * @brief Gets the current offset of a match state
+ *
+ * @param t a match state term.
+ * @return the current offset in bits.
+ */
+static inline size_t term_get_bin_match_state_offset(term t)
+{
+    TERM_DEBUG_ASSERT(term_is_bin_match_state(t));
+
+    const term *boxed_value = term_to_const_term_ptr(t);
+    return boxed_value[BIN_MATCH_STATE_OFFSET_INDEX];
+}
+
+/**
+ * @brief Sets the current offset of a match state
+ *
+ * @details Match states are the only boxed terms that are updated in place, they never leave the process that
+ * created them.
+ * @param t a match state term.
+ * @param offset the new offset in bits.
+ */
+static inline void term_set_bin_match_state_offset(term t, size_t offset)
+{
+    TERM_DEBUG_ASSERT(term_is_bin_match_state(t));
+
+    term *boxed_value = term_to_term_ptr(t);
+    boxed_value[BIN_MATCH_STATE_OFFSET_INDEX] = offset;
+}
+
+/**
+ * @brief Gets the number of offsets that can be saved into a match state
+ *
+ * @param t a match state term.
+ * @return the number of slots, including the start offset slot.
+ */
+static inline int term_get_bin_match_state_slots(term t)
+{
+    TERM_DEBUG_ASSERT(term_is_bin_match_state(t));
+
+    return term_boxed_size(t) + 1 - TERM_BOXED_BIN_MATCH_STATE_SIZE;
+}
+
+/**
+ * @brief Gets an offset saved into a match state
+ *
+ * @param t a match state term.
+ * @param slot the slot where the offset has been saved.
+ * @return the saved offset in bits.
+ */
+static inline size_t term_get_bin_match_state_saved_offset(term t, int slot)
+{
+    TERM_DEBUG_ASSERT(slot < term_get_bin_match_state_slots(t));
+
+    const term *boxed_value = term_to_const_term_ptr(t);
+    return boxed_value[BIN_MATCH_STATE_SAVED_OFFSETS_INDEX + slot];
+}
+
+/**
+ * @brief Saves the current offset of a match state
+ *
+ * @param t a match state term.
+ * @param slot the slot where the offset will be saved.
+ */
+static inline void term_bin_match_state_save_offset(term t, int slot)
+{
+    TERM_DEBUG_ASSERT(slot < term_get_bin_match_state_slots(t));
+
+    term *boxed_value = term_to_term_ptr(t);
+    boxed_value[BIN_MATCH_STATE_SAVED_OFFSETS_INDEX + slot] = boxed_value[BIN_MATCH_STATE_OFFSET_INDEX];
+}
+
+/**
+ * @brief Restores a saved offset of a match state
+ *
+ * @param t a match state term.
+ * @param slot the slot where the offset has been saved.
+ */
+static inline void term_bin_match_state_restore_offset(term t, int slot)
+{
+    TERM_DEBUG_ASSERT(slot < term_get_bin_match_state_slots(t));
+
+    term *boxed_value = term_to_term_ptr(t);
+    boxed_value[BIN_MATCH_STATE_OFFSET_INDEX] = boxed_value[BIN_MATCH_STATE_SAVED_OFFSETS_INDEX + slot];
+}
+
+/**
+ * @brief Initializes a ref term
+ *
+ * @details Initializes a memory area of REF_SIZE terms as a ref.
+ * @param boxed_value the memory area that will be initialized.
+ * @param ref_ticks an unique uint64 value that will be used to create ref term.
+ * @return a ref term created using given ref ticks.
+ */
+static inline term term_init_ref(term *boxed_value, uint64_t ref_ticks)
+{
+    boxed_value[0] = ((REF_SIZE - 1) << 6) | TERM_BOXED_REF;
 
     #if TERM_BYTES == 8
         boxed_value[1] = (term) ref_ticks;
@@ -604,6 +1148,18 @@ static inline term term_from_ref_ticks(uint64_t ref_ticks, Context *ctx)
     return ((term) boxed_value) | TERM_BOXED_VALUE_TAG;
 }
 
+/**
+ * @brief Get a ref term from ref ticks
+ *
+ * @param ref_ticks an unique uint64 value that will be used to create ref term.
+ * @param ctx the context that owns the memory that will be allocated.
+ * @return a ref term created using given ref ticks.
+ */
+static inline term term_from_ref_ticks(uint64_t ref_ticks, Context *ctx)
+{
+    return term_init_ref(memory_heap_alloc(ctx, REF_SIZE), ref_ticks);
+}
+
 static inline uint64_t term_to_ref_ticks(term rt)
 {
     TERM_DEBUG_ASSERT(term_is_reference(rt));
@@ -826,6 +1382,42 @@ static inline int term_list_length(term t)
     return len;
 }
 
+/**
+ * @brief Compares two terms
+ *
+ * @details Compares two terms using Erlang term order: number < atom < reference < fun < pid < tuple < map < nil <
+ * list < binary. Maps are compared by size and then by their keys and values in the order they are stored.
+ * Nested terms are compared without recursion. Use term_compare, that has a fast path for immediates.
+ * @param t the first term.
+ * @param other the second term.
+ * @param global the global context, used to order atoms by name. When NULL atoms are ordered by their index, which is
+ * faster and still a total order that is consistent with equality.
+ * @return a negative value if t < other, 0 if they are equal and a positive value if t > other.
+ */
+int term_deep_compare(term t, term other, struct GlobalContext *global);
+
+/**
+ * @brief Compares two terms
+ *
+ * @details Compares two terms using Erlang term order, see term_deep_compare. Identical terms and small integers are
+ * compared inline.
+ * @param t the first term.
+ * @param other the second term.
+ * @param global the global context, see term_deep_compare.
+ * @return a negative value if t < other, 0 if they are equal and a positive value if t > other.
+ */
+static inline int term_compare(term t, term other, struct GlobalContext *global)
+{
+    if (t == other) {
+        return 0;
+    }
+    if (term_is_integer(t) && term_is_integer(other)) {
+        return (term_to_int64(t) < term_to_int64(other)) ? -1 : 1;
+    }
+
+    return term_deep_compare(t, other, global);
+}
+
 /**
  * @brief Returns 1 if given terms are exactly equal.
  *
@@ -838,23 +1430,13 @@ static inline int term_exactly_equals(term a, term b)
 {
     if (a == b) {
         return 1;
-
-    } else if (term_is_boxed(a) && term_is_boxed(b)) {
-        const term *boxed_a = term_to_const_term_ptr(a);
-        const term *boxed_b = term_to_const_term_ptr(b);
-
-        int a_size = term_boxed_size(a);
-        int b_size = term_boxed_size(b);
-
-        if (a_size == b_size) {
-            return memcmp(boxed_a, boxed_b, (a_size + 1) * sizeof(term)) == 0;
-        } else {
-            return 0;
-        }
-    } else {
-        //TODO: we might have to perform a deep comparison
+    }
+    // different immediates are never equal: integers are boxed only when they do not fit an immediate
+    if (((a & 0x3) == 0x3) || ((b & 0x3) == 0x3)) {
         return 0;
     }
+
+    return term_deep_compare(a, b, NULL) == 0;
 }
 
 /**
@@ -867,25 +1449,8 @@ static inline int term_exactly_equals(term a, term b)
  */
 static inline int term_equals(term a, term b)
 {
-    if (a == b) {
-        return 1;
-
-    } else if (term_is_boxed(a) && term_is_boxed(b)) {
-        const term *boxed_a = term_to_const_term_ptr(a);
-        const term *boxed_b = term_to_const_term_ptr(b);
-
-        int a_size = term_boxed_size(a);
-        int b_size = term_boxed_size(b);
-
-        if (a_size == b_size) {
-            return memcmp(boxed_a, boxed_b, (a_size + 1) * sizeof(term)) == 0;
-        } else {
-            return 0;
-        }
-    } else {
-        //TODO: we might have to perform a deep comparison
-        return 0;
-    }
+    // there are no floats, so == is the same as =:=
+    return term_exactly_equals(a, b);
 }
 
 /**
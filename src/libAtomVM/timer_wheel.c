@@ -0,0 +1,198 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+#include "timer_wheel.h"
+
+#include "smp.h"
+#include "utils.h"
+
+// Level L slots are (TIMER_WHEEL_SLOTS ^ L) ticks wide: a timer is stored in the first level that can represent
+// its distance from now, and it is moved to a finer level when the wheel reaches the beginning of its slot.
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_MAX_DISTANCE ((((uint64_t) 1) << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+static inline int count_trailing_zeros(uint64_t bitmap)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bitmap);
+#else
+    int count = 0;
+    while (!(bitmap & 1)) {
+        bitmap >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// returns the distance from start of the first occupied slot, bitmap must not be 0
+static inline int next_occupied_slot(uint64_t bitmap, int start)
+{
+    uint64_t rotated = start ? (bitmap >> start) | (bitmap << (TIMER_WHEEL_SLOTS - start)) : bitmap;
+    return count_trailing_zeros(rotated);
+}
+
+static void timer_wheel_place(struct TimerWheel *tw, struct TimerWheelItem *item)
+{
+    uint64_t expiry = item->expiry;
+    if (expiry < tw->now) {
+        expiry = tw->now;
+    }
+    uint64_t distance = expiry - tw->now;
+
+    if (UNLIKELY(distance > TIMER_WHEEL_MAX_DISTANCE)) {
+        // it will be placed again when the farthest slot is reached
+        distance = TIMER_WHEEL_MAX_DISTANCE;
+        expiry = tw->now + distance;
+    }
+
+    int level = 0;
+    while ((distance >> LEVEL_SHIFT(level + 1)) != 0) {
+        level++;
+    }
+
+    int slot = (expiry >> LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK;
+    list_append(&tw->slots[level][slot], &item->head);
+    tw->occupied[level] |= ((uint64_t) 1) << slot;
+}
+
+static void timer_wheel_cascade(struct TimerWheel *tw, int level, int slot)
+{
+    struct ListHead *slot_head = &tw->slots[level][slot];
+    tw->occupied[level] &= ~(((uint64_t) 1) << slot);
+
+    struct ListHead items;
+    list_init(&items);
+    if (!list_is_empty(slot_head)) {
+        list_insert(&items, slot_head->prev, slot_head->next);
+        list_init(slot_head);
+    }
+
+    struct ListHead *item;
+    struct ListHead *tmp;
+    MUTABLE_LIST_FOR_EACH(item, tmp, &items) {
+        timer_wheel_place(tw, GET_LIST_ENTRY(item, struct TimerWheelItem, head));
+    }
+}
+
+static void timer_wheel_advance_to(struct TimerWheel *tw, uint64_t tick)
+{
+    tw->now = tick;
+
+    // coarser levels first, so their timers can land in a finer slot that is cascaded right after
+    for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+        uint64_t slot_ticks_mask = (((uint64_t) 1) << LEVEL_SHIFT(level)) - 1;
+        if ((tick & slot_ticks_mask) == 0) {
+            int slot = (tick >> LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK;
+            if (tw->occupied[level] & (((uint64_t) 1) << slot)) {
+                timer_wheel_cascade(tw, level, slot);
+            }
+        }
+    }
+}
+
+void timer_wheel_init(struct TimerWheel *tw, uint64_t now)
+{
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            list_init(&tw->slots[level][slot]);
+        }
+        tw->occupied[level] = 0;
+    }
+    tw->now = now;
+    tw->count = 0;
+}
+
+void timer_wheel_insert(struct TimerWheel *tw, struct TimerWheelItem *item, uint64_t expiry)
+{
+    item->expiry = expiry;
+    timer_wheel_place(tw, item);
+    SMP_ATOMIC_STORE(&tw->count, tw->count + 1);
+}
+
+void timer_wheel_remove(struct TimerWheel *tw, struct TimerWheelItem *item)
+{
+    struct ListHead *next = item->head.next;
+    struct ListHead *prev = item->head.prev;
+    list_remove(&item->head);
+    list_init(&item->head);
+    SMP_ATOMIC_STORE(&tw->count, tw->count - 1);
+
+    // the item was the only one in its slot: next is the slot list head
+    if (next == prev) {
+        int index = next - &tw->slots[0][0];
+        tw->occupied[index / TIMER_WHEEL_SLOTS] &= ~(((uint64_t) 1) << (index % TIMER_WHEEL_SLOTS));
+    }
+}
+
+void timer_wheel_expire(struct TimerWheel *tw, uint64_t now, struct ListHead *expired)
+{
+    while (tw->now <= now) {
+        int slot = tw->now & TIMER_WHEEL_SLOT_MASK;
+        if (tw->occupied[0] & (((uint64_t) 1) << slot)) {
+            struct ListHead *slot_head = &tw->slots[0][slot];
+            struct ListHead *item;
+            struct ListHead *tmp;
+            MUTABLE_LIST_FOR_EACH(item, tmp, slot_head) {
+                list_append(expired, item);
+                SMP_ATOMIC_STORE(&tw->count, tw->count - 1);
+            }
+            list_init(slot_head);
+            tw->occupied[0] &= ~(((uint64_t) 1) << slot);
+        }
+
+        // skip all the ticks where there is nothing to do
+        uint64_t next;
+        if (!timer_wheel_next_event(tw, &next) || (next > now + 1)) {
+            next = now + 1;
+        }
+        timer_wheel_advance_to(tw, next);
+    }
+}
+
+int timer_wheel_next_event(const struct TimerWheel *tw, uint64_t *next)
+{
+    if (tw->count == 0) {
+        return 0;
+    }
+
+    uint64_t min = UINT64_MAX;
+
+    if (tw->occupied[0]) {
+        int start = tw->now & TIMER_WHEEL_SLOT_MASK;
+        min = tw->now + next_occupied_slot(tw->occupied[0], start);
+    }
+
+    // coarser slots are serviced when the wheel reaches their first tick, the current one has already been serviced
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (tw->occupied[level]) {
+            uint64_t next_slot_index = (tw->now >> LEVEL_SHIFT(level)) + 1;
+            int start = next_slot_index & TIMER_WHEEL_SLOT_MASK;
+            uint64_t event = (next_slot_index + next_occupied_slot(tw->occupied[level], start)) << LEVEL_SHIFT(level);
+            if (event < min) {
+                min = event;
+            }
+        }
+    }
+
+    *next = min;
+    return min != UINT64_MAX;
+}
@@ -0,0 +1,123 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timing wheel.
+ *
+ * @details A hierarchical timing wheel with millisecond ticks: insertion and removal are O(1), expiring all the
+ * timers that are due only visits the wheel slots that actually contain timers.
+ */
+
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdint.h>
+
+#include "list.h"
+#include "smp.h"
+
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+struct TimerWheelItem
+{
+    struct ListHead head;
+    uint64_t expiry;
+};
+
+struct TimerWheel
+{
+    struct ListHead slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+
+    // first tick that has not been processed yet
+    uint64_t now;
+    // it is updated atomically, so timer_wheel_is_empty can be used without holding the lock that guards the wheel
+    int count;
+};
+
+/**
+ * @brief Initializes a timer wheel
+ *
+ * @details Initializes an empty timer wheel, all ticks before now are considered already processed.
+ * @param tw the timer wheel that will be initialized.
+ * @param now current timestamp in milliseconds.
+ */
+void timer_wheel_init(struct TimerWheel *tw, uint64_t now);
+
+/**
+ * @brief Inserts a timer
+ *
+ * @details Schedules the given item so it will be expired at the given timestamp, timestamps in the past expire
+ * on the next call to timer_wheel_expire.
+ * @param tw the timer wheel.
+ * @param item an item that is not already scheduled.
+ * @param expiry absolute expiry timestamp in milliseconds.
+ */
+void timer_wheel_insert(struct TimerWheel *tw, struct TimerWheelItem *item, uint64_t expiry);
+
+/**
+ * @brief Removes a timer
+ *
+ * @details Cancels a scheduled timer.
+ * @param tw the timer wheel.
+ * @param item a scheduled item.
+ */
+void timer_wheel_remove(struct TimerWheel *tw, struct TimerWheelItem *item);
+
+/**
+ * @brief Expires all due timers
+ *
+ * @details Removes from the wheel all the timers that expire at or before now and appends them to the expired list,
+ * callers should use timer_wheel_item_init on each expired item before reusing it.
+ * @param tw the timer wheel.
+ * @param now current timestamp in milliseconds.
+ * @param expired an initialized list that will receive the expired items.
+ */
+void timer_wheel_expire(struct TimerWheel *tw, uint64_t now, struct ListHead *expired);
+
+/**
+ * @brief Gets the next time the wheel needs to be serviced
+ *
+ * @details Returns the timestamp of the next tick that will either expire some timers or move them to a finer
+ * level of the wheel, it is never later than the earliest expiry.
+ * @param tw the timer wheel.
+ * @param next set to the next event timestamp in milliseconds.
+ * @returns 1 if there is at least one scheduled timer, otherwise 0.
+ */
+int timer_wheel_next_event(const struct TimerWheel *tw, uint64_t *next);
+
+static inline int timer_wheel_is_empty(const struct TimerWheel *tw)
+{
+    return SMP_ATOMIC_LOAD(&tw->count) == 0;
+}
+
+static inline void timer_wheel_item_init(struct TimerWheelItem *item)
+{
+    list_init(&item->head);
+}
+
+static inline int timer_wheel_item_is_scheduled(const struct TimerWheelItem *item)
+{
+    return item->head.next != &item->head;
+}
+
+#endif
@@ -127,12 +127,13 @@
 
 #include <stdint.h>
 
-static inline int atomvm_add_overflow(int32_t a, int32_t b, int32_t *res)
+static inline int atomvm_add_overflow(int64_t a, int64_t b, int64_t *res)
 {
-    // a and b are shifted integers
-    int32_t sum = (a >> 4) + (b >> 4);
-    *res = sum << 4;
-    return ((sum > 134217727) || (sum < -134217728));
+    if (((b > 0) && (a > INT64_MAX - b)) || ((b < 0) && (a < INT64_MIN - b))) {
+        return 1;
+    }
+    *res = a + b;
+    return 0;
 }
 #endif
 
@@ -141,12 +142,13 @@ static inline int atomvm_add_overflow(int32_t a, int32_t b, int32_t *res)
 
 #include <stdint.h>
 
-static inline int atomvm_sub_overflow(int32_t a, int32_t b, int32_t *res)
+static inline int atomvm_sub_overflow(int64_t a, int64_t b, int64_t *res)
 {
-    // a and b are shifted integers
-    int32_t diff = (a >> 4) - (b >> 4);
-    *res = diff << 4;
-    return ((diff > 134217727) || (diff < -134217728));
+    if (((b < 0) && (a > INT64_MAX + b)) || ((b > 0) && (a < INT64_MIN + b))) {
+        return 1;
+    }
+    *res = a - b;
+    return 0;
 }
 #endif
 
@@ -155,11 +157,21 @@ static inline int atomvm_sub_overflow(int32_t a, int32_t b, int32_t *res)
 
 #include <stdint.h>
 
-static inline int atomvm_mul_overflow(int32_t a, int32_t b, int32_t *res)
+static inline int atomvm_mul_overflow(int64_t a, int64_t b, int64_t *res)
 {
-    int64_t mul = (a >> 2) * (b >> 2);
-    *res = (mul << 4);
-    return ((mul > 134217727) || (mul < -134217728));
+    if ((a != 0) && (b != 0)) {
+        if (((a == -1) && (b == INT64_MIN)) || ((b == -1) && (a == INT64_MIN))) {
+            return 1;
+        }
+        if ((a != -1) && (b != -1)) {
+            int64_t max = ((a > 0) == (b > 0)) ? INT64_MAX : INT64_MIN;
+            if ((a > 0) ? ((b > 0) ? (a > max / b) : (b < max / a)) : ((b > 0) ? (a < max / b) : (a < max / b))) {
+                return 1;
+            }
+        }
+    }
+    *res = a * b;
+    return 0;
 }
 #endif
 
@@ -19,6 +19,7 @@
 
 #include "valueshashtable.h"
 
+#include "smp.h"
 #include "utils.h"
 
 #include <stdlib.h>
@@ -78,10 +79,11 @@ int valueshashtable_insert(struct ValuesHashTable *hash_table, unsigned long key
     new_node->key = key;
     new_node->value = value;
 
+    // the node is published only when it is fully initialized: in SMP builds lookups don't take any lock
     if (node) {
-        node->next = new_node;
+        SMP_ATOMIC_STORE(&node->next, new_node);
     } else {
-        hash_table->buckets[index] = new_node;
+        SMP_ATOMIC_STORE(&hash_table->buckets[index], new_node);
     }
 
     hash_table->count++;
@@ -92,13 +94,13 @@ unsigned long valueshashtable_get_value(const struct ValuesHashTable *hash_table
 {
     long index = key % hash_table->capacity;
 
-    const struct HNode *node = hash_table->buckets[index];
+    const struct HNode *node = SMP_ATOMIC_LOAD(&hash_table->buckets[index]);
     while (node) {
         if (node->key == key) {
             return node->value;
         }
 
-        node = node->next;
+        node = SMP_ATOMIC_LOAD(&node->next);
     }
 
     return default_value;
@@ -108,13 +110,13 @@ int valueshashtable_has_key(const struct ValuesHashTable *hash_table, unsigned l
 {
     long index = key % hash_table->capacity;
 
-    const struct HNode *node = hash_table->buckets[index];
+    const struct HNode *node = SMP_ATOMIC_LOAD(&hash_table->buckets[index]);
     while (node) {
         if (node->key == key) {
             return 1;
         }
 
-        node = node->next;
+        node = SMP_ATOMIC_LOAD(&node->next);
     }
 
     return 0;
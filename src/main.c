@@ -30,18 +30,51 @@
 #include "iff.h"
 #include "platforms/generic_unix/mapped_file.h"
 #include "module.h"
+#include "profiler.h"
 #include "utils.h"
 #include "term.h"
 
 static const char *ok_a = "\x2" "ok";
 
+static int write_folded_stacks(GlobalContext *glb, const char *path)
+{
+    size_t size;
+    char *folded_stacks = profiler_folded_stacks(glb, &size);
+    if (IS_NULL_PTR(folded_stacks)) {
+        fprintf(stderr, "Failed to allocate memory for profiler samples.\n");
+        return 0;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (IS_NULL_PTR(f)) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        free(folded_stacks);
+        return 0;
+    }
+    int ok = (fwrite(folded_stacks, 1, size, f) == size);
+    ok = (fclose(f) == 0) && ok;
+    free(folded_stacks);
+
+    return ok;
+}
+
 int main(int argc, char **argv)
 {
-    if (argc < 2) {
+    // --profile writes the folded stacks collected by the sampling profiler to the given file
+    const char *profile_path = NULL;
+    int beam_arg = 1;
+    if ((argc >= 3) && !strcmp(argv[1], "--profile")) {
+        profile_path = argv[2];
+        beam_arg = 3;
+    }
+
+    if (argc <= beam_arg) {
         printf("Need .beam file\n");
+        printf("Usage: %s [--profile folded_stacks_file] file.avm\n", argv[0]);
         return EXIT_FAILURE;
     }
-    MappedFile *mapped_file = mapped_file_open_beam(argv[1]);
+    const char *beam_path = argv[beam_arg];
+    MappedFile *mapped_file = mapped_file_open_beam(beam_path);
     if (IS_NULL_PTR(mapped_file)) {
         return EXIT_FAILURE;
     }
@@ -50,14 +83,14 @@ int main(int argc, char **argv)
 
     const void *startup_beam;
     uint32_t startup_beam_size;
-    const char *startup_module_name = argv[1];
+    const char *startup_module_name = beam_path;
 
     if (avmpack_is_valid(mapped_file->mapped, mapped_file->size)) {
         glb->avmpack_data = mapped_file->mapped;
         glb->avmpack_platform_data = mapped_file;
 
         if (!avmpack_find_section_by_flag(mapped_file->mapped, 1, &startup_beam, &startup_beam_size, &startup_module_name)) {
-            fprintf(stderr, "%s cannot be started.\n", argv[1]);
+            fprintf(stderr, "%s cannot be started.\n", beam_path);
             mapped_file_close(mapped_file);
             return EXIT_FAILURE;
         }
@@ -68,7 +101,7 @@ int main(int argc, char **argv)
         startup_beam_size = mapped_file->size;
 
     } else {
-        fprintf(stderr, "%s is not a BEAM file.\n", argv[1]);
+        fprintf(stderr, "%s is not a BEAM file.\n", beam_path);
         mapped_file_close(mapped_file);
         return EXIT_FAILURE;
     }
@@ -83,8 +116,19 @@ int main(int argc, char **argv)
     Context *ctx = context_new(glb);
     ctx->leader = 1;
 
+    if (profile_path && !profiler_start(glb, 0)) {
+        fprintf(stderr, "Cannot start the profiler.\n");
+        return EXIT_FAILURE;
+    }
+
     context_execute_loop(ctx, mod, "start", 0);
 
+    int profile_written = 1;
+    if (profile_path) {
+        profiler_stop(glb);
+        profile_written = write_folded_stacks(glb, profile_path);
+    }
+
     term ret_value = ctx->x[0];
     fprintf(stderr, "Return value: ");
     term_display(stderr, ret_value, ctx);
@@ -97,7 +141,7 @@ int main(int argc, char **argv)
     module_destroy(mod);
     mapped_file_close(mapped_file);
 
-    if (ok_atom == ret_value) {
+    if ((ok_atom == ret_value) && profile_written) {
         return EXIT_SUCCESS;
     } else {
         return EXIT_FAILURE;
@@ -173,7 +173,6 @@ static term gpiodriver_set_int(Context *ctx, Context *target, term msg)
         fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
         abort();
     }
-    linkedlist_append(&global->listeners, &listener->listeners_list_head);
     listener->fd = event_desc;
 
     listener->expires = 0;
@@ -182,6 +181,7 @@ static term gpiodriver_set_int(Context *ctx, Context *target, term msg)
     listener->one_shot = 0;
     listener->data = target;
     listener->handler = gpio_interrupt_callback;
+    sys_register_listener(global, listener);
 
     return OK_ATOM;
 }
@@ -220,7 +220,7 @@ static void consume_gpio_mailbox(Context *ctx)
             ret = ERROR_ATOM;
     }
 
-    free(message);
+    mailbox_destroy_message(message);
 
     mailbox_send(target, ret);
 }
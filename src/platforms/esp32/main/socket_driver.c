@@ -139,9 +139,10 @@ static void tuple_to_ip_addr(term address_tuple, ip_addr_t *out_addr)
     out_addr->u_addr.ip4.addr = htonl(socket_tuple_to_addr(address_tuple));
 }
 
-term socket_driver_do_init(Context *ctx, term params)
+term socket_driver_do_init(Context *ctx, term pid, term params)
 {
     TRACE("socket: init\n");
+    UNUSED(pid);
 
     SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
 
@@ -180,7 +181,6 @@ term socket_driver_do_init(Context *ctx, term params)
         fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
         abort();
     }
-    linkedlist_append(&global->listeners, &listener->listeners_list_head);
     listener->fd = event_descriptor;
 
     listener->expires = 0;
@@ -189,6 +189,7 @@ term socket_driver_do_init(Context *ctx, term params)
     listener->one_shot = 0;
     listener->data = ctx;
     listener->handler = socket_handling_callback;
+    sys_register_listener(global, listener);
 
     TRACE("socket: initialized\n");
 
@@ -324,3 +325,52 @@ void socket_driver_do_recvfrom(Context *ctx, term pid, term ref)
     socket_data->listener_pid = pid;
     socket_data->ref_ticks = term_to_ref_ticks(ref);
 }
+
+term socket_driver_do_setopts(Context *ctx, term opts)
+{
+    UNUSED(opts);
+
+    // active mode and buffer tuning are not available on top of netconn yet
+    return port_create_error_tuple(ctx, BADARG_ATOM);
+}
+
+// stream sockets are only implemented by the generic_unix socket driver for now
+
+void socket_driver_do_connect(Context *ctx, term pid, term ref, term address, term port)
+{
+    UNUSED(address);
+    UNUSED(port);
+
+    port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, BADARG_ATOM));
+}
+
+term socket_driver_do_listen(Context *ctx, term backlog)
+{
+    UNUSED(backlog);
+
+    return port_create_error_tuple(ctx, BADARG_ATOM);
+}
+
+void socket_driver_do_accept(Context *ctx, term pid, term ref)
+{
+    port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, BADARG_ATOM));
+}
+
+term socket_driver_do_stream_send(Context *ctx, term buffer)
+{
+    UNUSED(buffer);
+
+    return port_create_error_tuple(ctx, BADARG_ATOM);
+}
+
+void socket_driver_do_recv(Context *ctx, term pid, term ref, term length)
+{
+    UNUSED(length);
+
+    port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, BADARG_ATOM));
+}
+
+term socket_driver_do_close(Context *ctx)
+{
+    return port_create_error_tuple(ctx, BADARG_ATOM);
+}
@@ -208,7 +208,7 @@ static void spidriver_consume_mailbox(Context *ctx)
             ret = ERROR_ATOM;
     }
 
-    free(message);
+    mailbox_destroy_message(message);
 
     UNUSED(ref);
     mailbox_send(target, ret);
@@ -28,6 +28,27 @@ static const char *const bind_atom = "\x4" "bind";
 static const char *const getsockname_atom = "\xB" "getsockname";
 static const char *const recvfrom_atom = "\x8" "recvfrom";
 static const char *const sendto_atom = "\x6" "sendto";
+static const char *const setsockopt_atom = "\xA" "setsockopt";
+static const char *const active_atom = "\x6" "active";
+static const char *const once_atom = "\x4" "once";
+static const char *const buffer_atom = "\x6" "buffer";
+static const char *const recbuf_atom = "\x6" "recbuf";
+static const char *const udp_passive_atom = "\xB" "udp_passive";
+static const char *const einval_atom = "\x6" "einval";
+static const char *const connect_atom = "\x7" "connect";
+static const char *const listen_atom = "\x6" "listen";
+static const char *const accept_atom = "\x6" "accept";
+static const char *const send_atom = "\x4" "send";
+static const char *const recv_atom = "\x4" "recv";
+static const char *const packet_atom = "\x6" "packet";
+static const char *const tcp_closed_atom = "\xA" "tcp_closed";
+static const char *const tcp_error_atom = "\x9" "tcp_error";
+static const char *const tcp_passive_atom = "\xB" "tcp_passive";
+static const char *const closed_atom = "\x6" "closed";
+static const char *const epoll_ctl_atom = "\x9" "epoll_ctl";
+static const char *const packet_size_atom = "\xB" "packet_size";
+static const char *const emsgsize_atom = "\x8" "emsgsize";
+static const char *const emfile_atom = "\x6" "emfile";
 
 static const char *const sta_got_ip_atom = "\xA" "sta_got_ip";
 static const char *const sta_connected_atom = "\xD" "sta_connected";
@@ -45,6 +66,27 @@ void platform_defaultatoms_init(GlobalContext *glb)
     ok &= globalcontext_insert_atom(glb, getsockname_atom) == GETSOCKNAME_ATOM_INDEX;
     ok &= globalcontext_insert_atom(glb, recvfrom_atom) == RECVFROM_ATOM_INDEX;
     ok &= globalcontext_insert_atom(glb, sendto_atom) == SENDTO_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, setsockopt_atom) == SETSOCKOPT_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, active_atom) == ACTIVE_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, once_atom) == ONCE_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, buffer_atom) == BUFFER_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, recbuf_atom) == RECBUF_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, udp_passive_atom) == UDP_PASSIVE_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, einval_atom) == EINVAL_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, connect_atom) == CONNECT_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, listen_atom) == LISTEN_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, accept_atom) == ACCEPT_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, send_atom) == SEND_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, recv_atom) == RECV_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, packet_atom) == PACKET_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, tcp_closed_atom) == TCP_CLOSED_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, tcp_error_atom) == TCP_ERROR_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, tcp_passive_atom) == TCP_PASSIVE_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, closed_atom) == CLOSED_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, epoll_ctl_atom) == EPOLL_CTL_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, packet_size_atom) == PACKET_SIZE_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, emsgsize_atom) == EMSGSIZE_ATOM_INDEX;
+    ok &= globalcontext_insert_atom(glb, emfile_atom) == EMFILE_ATOM_INDEX;
 
     ok &= globalcontext_insert_atom(glb, sta_got_ip_atom) == STA_GOT_IP_ATOM_INDEX;
     ok &= globalcontext_insert_atom(glb, sta_connected_atom) == STA_CONNECTED_ATOM_INDEX;
@@ -31,9 +31,30 @@
 #define GETSOCKNAME_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 6)
 #define RECVFROM_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 7)
 #define SENDTO_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 8)
+#define SETSOCKOPT_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 9)
+#define ACTIVE_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 10)
+#define ONCE_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 11)
+#define BUFFER_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 12)
+#define RECBUF_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 13)
+#define UDP_PASSIVE_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 14)
+#define EINVAL_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 15)
+#define CONNECT_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 16)
+#define LISTEN_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 17)
+#define ACCEPT_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 18)
+#define SEND_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 19)
+#define RECV_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 20)
+#define PACKET_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 21)
+#define TCP_CLOSED_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 22)
+#define TCP_ERROR_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 23)
+#define TCP_PASSIVE_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 24)
+#define CLOSED_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 25)
+#define EPOLL_CTL_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 26)
+#define PACKET_SIZE_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 27)
+#define EMSGSIZE_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 28)
+#define EMFILE_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 29)
 
-#define STA_GOT_IP_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 9)
-#define STA_CONNECTED_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 10)
+#define STA_GOT_IP_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 30)
+#define STA_CONNECTED_ATOM_INDEX (PLATFORM_ATOMS_BASE_INDEX + 31)
 
 #define PROTO_ATOM term_from_atom_index(PROTO_ATOM_INDEX)
 #define UDP_ATOM term_from_atom_index(UDP_ATOM_INDEX)
@@ -44,6 +65,27 @@
 #define GETSOCKNAME_ATOM term_from_atom_index(GETSOCKNAME_ATOM_INDEX)
 #define RECVFROM_ATOM term_from_atom_index(RECVFROM_ATOM_INDEX)
 #define SENDTO_ATOM term_from_atom_index(SENDTO_ATOM_INDEX)
+#define SETSOCKOPT_ATOM term_from_atom_index(SETSOCKOPT_ATOM_INDEX)
+#define ACTIVE_ATOM term_from_atom_index(ACTIVE_ATOM_INDEX)
+#define ONCE_ATOM term_from_atom_index(ONCE_ATOM_INDEX)
+#define BUFFER_ATOM term_from_atom_index(BUFFER_ATOM_INDEX)
+#define RECBUF_ATOM term_from_atom_index(RECBUF_ATOM_INDEX)
+#define UDP_PASSIVE_ATOM term_from_atom_index(UDP_PASSIVE_ATOM_INDEX)
+#define EINVAL_ATOM term_from_atom_index(EINVAL_ATOM_INDEX)
+#define CONNECT_ATOM term_from_atom_index(CONNECT_ATOM_INDEX)
+#define LISTEN_ATOM term_from_atom_index(LISTEN_ATOM_INDEX)
+#define ACCEPT_ATOM term_from_atom_index(ACCEPT_ATOM_INDEX)
+#define SEND_ATOM term_from_atom_index(SEND_ATOM_INDEX)
+#define RECV_ATOM term_from_atom_index(RECV_ATOM_INDEX)
+#define PACKET_ATOM term_from_atom_index(PACKET_ATOM_INDEX)
+#define TCP_CLOSED_ATOM term_from_atom_index(TCP_CLOSED_ATOM_INDEX)
+#define TCP_ERROR_ATOM term_from_atom_index(TCP_ERROR_ATOM_INDEX)
+#define TCP_PASSIVE_ATOM term_from_atom_index(TCP_PASSIVE_ATOM_INDEX)
+#define CLOSED_ATOM term_from_atom_index(CLOSED_ATOM_INDEX)
+#define EPOLL_CTL_ATOM term_from_atom_index(EPOLL_CTL_ATOM_INDEX)
+#define PACKET_SIZE_ATOM term_from_atom_index(PACKET_SIZE_ATOM_INDEX)
+#define EMSGSIZE_ATOM term_from_atom_index(EMSGSIZE_ATOM_INDEX)
+#define EMFILE_ATOM term_from_atom_index(EMFILE_ATOM_INDEX)
 
 #define STA_GOT_IP_ATOM term_from_atom_index(STA_GOT_IP_ATOM_INDEX)
 #define STA_CONNECTED_ATOM term_from_atom_index(STA_CONNECTED_ATOM_INDEX)
@@ -18,6 +18,10 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
  ***************************************************************************/
 
+#ifdef HAVE_RECVMMSG
+#define _GNU_SOURCE
+#endif
+
 #include "socket.h"
 #include "socket_driver.h"
 #include "port.h"
@@ -28,6 +32,8 @@
 #include "context.h"
 #include "globalcontext.h"
 #include "interop.h"
+#include "list.h"
+#include "scheduler.h"
 #include "utils.h"
 #include "term.h"
 
@@ -38,34 +44,265 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 #include "trace.h"
 #include "sys.h"
 
 #include "platform_defaultatoms.h"
 
-#define BUFSIZE 128
+// large enough for any datagram that fits an ethernet frame
+#define DEFAULT_BUFFER_SIZE 1500
+// maximum number of datagrams read for each wakeup in active mode
+#define RECV_BATCH_SIZE 16
+#define ACTIVE_FOREVER (-1)
+// maximum length of a {packet, N} message body, the receive buffer grows up to this size
+#define DEFAULT_PACKET_SIZE (1024 * 1024)
+
+enum StreamState
+{
+    StreamIdle,
+    StreamConnecting,
+    StreamConnected,
+    StreamListening,
+    StreamClosed
+};
+
+typedef struct PendingRequest {
+    struct ListHead pending_requests_head;
+    term pid;
+    uint64_t ref_ticks;
+    size_t length;
+} PendingRequest;
 
 typedef struct SocketDriverData
 {
     int sockfd;
+    // SOCK_DGRAM or SOCK_STREAM
+    int type;
+    term owner;
+
+    // 0 when passive, ACTIVE_FOREVER for {active, true}, otherwise the count of datagrams
+    // that are still going to be delivered before switching back to passive mode
+    int active;
+    EventListener active_listener;
+
+    // passive recvfrom, recv and accept requests are served in order, using a single listener
+    struct ListHead pending_requests;
+    EventListener passive_listener;
+
+    // stream sockets use a single listener for everything, that waits for the events the current state needs
+    enum StreamState stream_state;
+    EventListener stream_listener;
+    int stream_listener_registered;
+    // size of the big endian length header of each message, set with {packet, N}
+    int packet;
+    // messages with a longer length header are refused, 0 when there is no limit
+    size_t packet_size;
+    term connect_pid;
+    uint64_t connect_ref_ticks;
+    char *recv_buffer;
+    size_t recv_len;
+    size_t recv_capacity;
+    // data that could not be written yet
+    char *send_queue;
+    size_t send_queue_len;
+    size_t send_queue_capacity;
+
+    size_t buffer_size;
+    int buffers_count;
+    char *buffers;
+
+    struct sockaddr_in addrs[RECV_BATCH_SIZE];
+    size_t lengths[RECV_BATCH_SIZE];
+#ifdef HAVE_RECVMMSG
+    struct iovec iovecs[RECV_BATCH_SIZE];
+    struct mmsghdr msgs[RECV_BATCH_SIZE];
+#endif
 } SocketDriverData;
 
+static void active_recv_callback(EventListener *listener);
+static void recvfrom_callback(EventListener *listener);
+static void stream_callback(EventListener *listener);
+static void stream_deliver(Context *ctx);
+static void stream_update_listener(Context *ctx);
+static void stream_closed(Context *ctx, int error);
 
 void *socket_driver_create_data()
 {
     struct SocketDriverData *data = calloc(1, sizeof(struct SocketDriverData));
+    if (IS_NULL_PTR(data)) {
+        return NULL;
+    }
+    data->sockfd = -1;
+    data->type = SOCK_DGRAM;
+    data->owner = term_invalid_term();
+    data->stream_state = StreamIdle;
+    data->buffer_size = DEFAULT_BUFFER_SIZE;
+    data->packet_size = DEFAULT_PACKET_SIZE;
+    list_init(&data->pending_requests);
     return (void *) data;
 }
 
 
 void socket_driver_delete_data(void *data)
 {
+    SocketDriverData *socket_data = (SocketDriverData *) data;
+    free(socket_data->buffers);
+    free(socket_data->recv_buffer);
+    free(socket_data->send_queue);
     free(data);
 }
 
+// buffers are allocated lazily: passive receives only need one of them, while active mode
+// needs one for each datagram of a batch
+static char *socket_driver_get_buffers(SocketDriverData *socket_data, int count)
+{
+    if (socket_data->buffers_count < count) {
+        char *buffers = realloc(socket_data->buffers, count * socket_data->buffer_size);
+        if (IS_NULL_PTR(buffers)) {
+            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+            abort();
+        }
+        socket_data->buffers = buffers;
+        socket_data->buffers_count = count;
+    }
+
+    return socket_data->buffers;
+}
+
+static void socket_driver_send_passive(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    // {udp_passive, Port} or {tcp_passive, Port}
+    port_ensure_available(ctx, 3);
+    term passive_atom = (socket_data->type == SOCK_STREAM) ? TCP_PASSIVE_ATOM : UDP_PASSIVE_ATOM;
+    term msg = port_create_tuple2(ctx, passive_atom, term_from_local_process_id(ctx->process_id));
+    globalcontext_send_message(ctx->global, term_to_local_process_id(socket_data->owner), msg);
+}
+
+// returns 0 and sets errno if the socket cannot be watched
+static int socket_driver_set_active(Context *ctx, int active)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+    EventListener *listener = &socket_data->active_listener;
 
-term socket_driver_do_init(Context *ctx, term params)
+    if (socket_data->type == SOCK_STREAM) {
+        socket_data->active = active;
+        stream_deliver(ctx);
+        stream_update_listener(ctx);
+        return 1;
+    }
+
+    if (active && !socket_data->active) {
+        socket_driver_get_buffers(socket_data, RECV_BATCH_SIZE);
+
+        listener->fd = socket_data->sockfd;
+        listener->expires = 0;
+        listener->one_shot = 0;
+        listener->data = ctx;
+        listener->handler = active_recv_callback;
+        if (UNLIKELY(!sys_register_listener(ctx->global, listener))) {
+            return 0;
+        }
+
+    } else if (!active && socket_data->active) {
+        sys_unregister_listener(ctx->global, listener);
+    }
+
+    socket_data->active = active;
+
+    return 1;
+}
+
+static term socket_driver_set_opts(Context *ctx, term opts)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    while (term_is_nonempty_list(opts)) {
+        term opt = term_get_list_head(opts);
+        opts = term_get_list_tail(opts);
+        if (!term_is_tuple(opt) || term_get_tuple_arity(opt) != 2) {
+            return port_create_error_tuple(ctx, BADARG_ATOM);
+        }
+        term key = term_get_tuple_element(opt, 0);
+        term value = term_get_tuple_element(opt, 1);
+
+        if (key == ACTIVE_ATOM) {
+            int active;
+            if (value == TRUE_ATOM) {
+                active = ACTIVE_FOREVER;
+            } else if (value == FALSE_ATOM) {
+                active = 0;
+            } else if (value == ONCE_ATOM) {
+                active = 1;
+            } else if (term_is_integer(value)) {
+                // like OTP {active, N} adds up to the current count
+                int32_t count = term_to_int32(value);
+                if (socket_data->active != ACTIVE_FOREVER) {
+                    count += socket_data->active;
+                }
+                active = count > 0 ? count : 0;
+            } else {
+                return port_create_error_tuple(ctx, BADARG_ATOM);
+            }
+            // epoll allows a single listener for each fd, so datagrams are received either in active mode or by
+            // recvfrom requests, as in OTP switching to active mode while a recvfrom is pending is not allowed
+            if (active && (socket_data->type == SOCK_DGRAM) && !list_is_empty(&socket_data->pending_requests)) {
+                return port_create_error_tuple(ctx, EINVAL_ATOM);
+            }
+            if (socket_data->active > 0 && active == 0 && term_is_integer(value)) {
+                socket_driver_set_active(ctx, 0);
+                socket_driver_send_passive(ctx);
+            } else if (UNLIKELY(!socket_driver_set_active(ctx, active))) {
+                return port_create_sys_error_tuple(ctx, EPOLL_CTL_ATOM, errno);
+            }
+
+        } else if (key == BUFFER_ATOM) {
+            if (!term_is_integer(value) || term_to_int32(value) <= 0) {
+                return port_create_error_tuple(ctx, BADARG_ATOM);
+            }
+            socket_data->buffer_size = term_to_int32(value);
+            int buffers_count = socket_data->buffers_count;
+            free(socket_data->buffers);
+            socket_data->buffers = NULL;
+            socket_data->buffers_count = 0;
+            if (buffers_count) {
+                socket_driver_get_buffers(socket_data, buffers_count);
+            }
+
+        } else if (key == PACKET_ATOM) {
+            if (!term_is_integer(value)) {
+                return port_create_error_tuple(ctx, BADARG_ATOM);
+            }
+            int packet = term_to_int32(value);
+            if (packet != 0 && packet != 1 && packet != 2 && packet != 4) {
+                return port_create_error_tuple(ctx, BADARG_ATOM);
+            }
+            socket_data->packet = packet;
+
+        } else if (key == PACKET_SIZE_ATOM) {
+            if (!term_is_integer(value) || term_to_int32(value) < 0) {
+                return port_create_error_tuple(ctx, BADARG_ATOM);
+            }
+            socket_data->packet_size = term_to_int32(value);
+
+        } else if (key == RECBUF_ATOM) {
+            if (!term_is_integer(value)) {
+                return port_create_error_tuple(ctx, BADARG_ATOM);
+            }
+            int size = term_to_int32(value);
+            if (setsockopt(socket_data->sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1) {
+                return port_create_sys_error_tuple(ctx, SETSOCKOPT_ATOM, errno);
+            }
+        }
+    }
+
+    return OK_ATOM;
+}
+
+term socket_driver_do_init(Context *ctx, term pid, term params)
 {
     SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
 
@@ -85,17 +322,33 @@ term socket_driver_do_init(Context *ctx, term params)
         }
         socket_data->sockfd = sockfd;
     } else if (proto == TCP_ATOM) {
-        socket_data->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd == -1) {
+            return port_create_sys_error_tuple(ctx, SOCKET_ATOM, errno);
+        }
+        socket_data->sockfd = sockfd;
+        socket_data->type = SOCK_STREAM;
     } else {
         return port_create_error_tuple(ctx, BADARG_ATOM);
     }
     if (fcntl(socket_data->sockfd, F_SETFL, O_NONBLOCK) == -1){
         return port_create_sys_error_tuple(ctx, FCNTL_ATOM, errno);
     }
+    socket_data->owner = pid;
 
-    return OK_ATOM;
+    return socket_driver_set_opts(ctx, params);
 }
 
+term socket_driver_do_setopts(Context *ctx, term opts)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if ((socket_data->sockfd == -1) || !term_is_list(opts)) {
+        return port_create_error_tuple(ctx, BADARG_ATOM);
+    }
+
+    return socket_driver_set_opts(ctx, opts);
+}
 
 term socket_driver_do_bind(Context *ctx, term address, term port)
 {
@@ -159,30 +412,149 @@ term socket_driver_do_send(Context *ctx, term dest_address, term dest_port, term
     }
 }
 
-typedef struct RecvFromData {
-    Context *ctx;
-    term pid;
-    uint64_t ref_ticks;
-} RecvFromData;
+// returns 1 if there were already other pending requests
+static int socket_driver_push_request(SocketDriverData *socket_data, term pid, term ref, size_t length)
+{
+    PendingRequest *request = (PendingRequest *) malloc(sizeof(PendingRequest));
+    if (IS_NULL_PTR(request)) {
+        fprintf(stderr, "Unable to allocate space for PendingRequest: %s:%i\n", __FILE__, __LINE__);
+        abort();
+    }
+    request->pid = pid;
+    request->ref_ticks = term_to_ref_ticks(ref);
+    request->length = length;
 
-static void recvfrom_callback(EventListener *listener)
+    int waiting = !list_is_empty(&socket_data->pending_requests);
+    list_append(&socket_data->pending_requests, &request->pending_requests_head);
+
+    return waiting;
+}
+
+static PendingRequest *socket_driver_pop_request(SocketDriverData *socket_data)
+{
+    PendingRequest *request = GET_LIST_ENTRY(list_first(&socket_data->pending_requests), PendingRequest, pending_requests_head);
+    list_remove(&request->pending_requests_head);
+
+    return request;
+}
+
+static void socket_driver_reply_request(Context *ctx, PendingRequest *request, term reply)
+{
+    term ref = term_from_ref_ticks(request->ref_ticks, ctx);
+    port_send_reply(ctx, request->pid, ref, reply);
+    free(request);
+}
+
+// reads up to max datagrams without blocking, returns how many were read or -1 on error
+static int socket_driver_recv_batch(SocketDriverData *socket_data, int max)
+{
+    char *buffers = socket_driver_get_buffers(socket_data, max);
+    size_t buffer_size = socket_data->buffer_size;
+
+#ifdef HAVE_RECVMMSG
+    for (int i = 0; i < max; i++) {
+        socket_data->iovecs[i].iov_base = buffers + i * buffer_size;
+        socket_data->iovecs[i].iov_len = buffer_size;
+        memset(&socket_data->msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+        socket_data->msgs[i].msg_hdr.msg_name = &socket_data->addrs[i];
+        socket_data->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        socket_data->msgs[i].msg_hdr.msg_iov = &socket_data->iovecs[i];
+        socket_data->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int received = recvmmsg(socket_data->sockfd, socket_data->msgs, max, MSG_DONTWAIT, NULL);
+    for (int i = 0; i < received; i++) {
+        socket_data->lengths[i] = socket_data->msgs[i].msg_len;
+    }
+
+    return received;
+#else
+    int received = 0;
+    while (received < max) {
+        socklen_t clientlen = sizeof(struct sockaddr_in);
+        ssize_t len = recvfrom(socket_data->sockfd, buffers + received * buffer_size, buffer_size, MSG_DONTWAIT,
+            (struct sockaddr *) &socket_data->addrs[received], &clientlen);
+        if (len == -1) {
+            break;
+        }
+        socket_data->lengths[received] = len;
+        received++;
+    }
+
+    return received ? received : -1;
+#endif
+}
+
+static void active_recv_callback(EventListener *listener)
 {
-    RecvFromData *recvfrom_data = (RecvFromData *) listener->data;
-    Context *ctx = recvfrom_data->ctx;
+    Context *ctx = (Context *) listener->data;
     SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
 
-    GlobalContext *global = ctx->global;
-    linkedlist_remove(&global->listeners, &listener->listeners_list_head);
+    int max = RECV_BATCH_SIZE;
+    if ((socket_data->active > 0) && (socket_data->active < max)) {
+        max = socket_data->active;
+    }
+
+    int received = socket_driver_recv_batch(socket_data, max);
+    if (received <= 0) {
+        // spurious wakeups and errors such as ICMP port unreachable are not reported to the owner
+        return;
+    }
+
+    // {udp, Port, {int,int,int,int}, int, binary} for each datagram
+    // tuple arity 5:       6
+    // tuple arity 4:       5
+    // binary:              term_binary_heap_size(len)
+    size_t needed = 0;
+    for (int i = 0; i < received; i++) {
+        needed += 11 + term_binary_heap_size(socket_data->lengths[i]);
+    }
+    port_ensure_available(ctx, needed);
+
+    int local_process_id = term_to_local_process_id(socket_data->owner);
+    term port_pid = term_from_local_process_id(ctx->process_id);
+    for (int i = 0; i < received; i++) {
+        struct sockaddr_in *clientaddr = &socket_data->addrs[i];
+        const char *buf = socket_data->buffers + i * socket_data->buffer_size;
+        term terms[5];
+        terms[0] = UDP_ATOM;
+        terms[1] = port_pid;
+        terms[2] = socket_tuple_from_addr(ctx, ntohl(clientaddr->sin_addr.s_addr));
+        terms[3] = term_from_int32(ntohs(clientaddr->sin_port));
+        terms[4] = socket_create_packet_term(ctx, buf, socket_data->lengths[i]);
+        globalcontext_send_message(ctx->global, local_process_id, port_create_tuple_n(ctx, 5, terms));
+    }
+
+    if (socket_data->active > 0) {
+        if (socket_data->active == received) {
+            socket_driver_set_active(ctx, 0);
+            port_ensure_available(ctx, 3);
+            globalcontext_send_message(ctx->global, local_process_id, port_create_tuple2(ctx, UDP_PASSIVE_ATOM, port_pid));
+        } else {
+            socket_data->active -= received;
+        }
+    }
+}
+
+static void recvfrom_callback(EventListener *listener)
+{
+    Context *ctx = (Context *) listener->data;
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
 
     struct sockaddr_in clientaddr;
     socklen_t clientlen = sizeof(clientaddr);
-    char *buf = malloc(256*sizeof(char));
-    if (UNLIKELY(!buf)) {
-        fprintf(stderr, "malloc %s:%d", __FILE__, __LINE__);
-        abort();
+    char *buf = socket_driver_get_buffers(socket_data, 1);
+
+    ssize_t len = recvfrom(socket_data->sockfd, buf, socket_data->buffer_size, MSG_DONTWAIT, (struct sockaddr *) &clientaddr, &clientlen);
+    if ((len == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+        return;
+    }
+
+    PendingRequest *request = socket_driver_pop_request(socket_data);
+    if (list_is_empty(&socket_data->pending_requests)) {
+        sys_unregister_listener(ctx->global, listener);
     }
 
-    ssize_t len = recvfrom(socket_data->sockfd, buf, BUFSIZE, 0, (struct sockaddr *) &clientaddr, &clientlen);
     if (len == -1) {
         // {Ref, {error, {SysCall, Errno}}}
         // tuple arity 2:       3
@@ -190,9 +562,9 @@ static void recvfrom_callback(EventListener *listener)
         // tuple arity 2:       3
         // ref:                 3 (max)
         port_ensure_available(ctx, 12);
-        term pid = recvfrom_data->pid;
-        term ref = term_from_ref_ticks(recvfrom_data->ref_ticks, ctx);
-        port_send_reply(ctx, pid, ref, port_create_sys_error_tuple(ctx, SENDTO_ATOM, errno));
+        term pid = request->pid;
+        term ref = term_from_ref_ticks(request->ref_ticks, ctx);
+        port_send_reply(ctx, pid, ref, port_create_sys_error_tuple(ctx, RECVFROM_ATOM, errno));
     } else {
         // {Ref, {ok, {{int,int,int,int}, int, binary}}}
         // tuple arity 2:       3
@@ -200,50 +572,652 @@ static void recvfrom_callback(EventListener *listener)
         // tuple arity 4:       5
         // tuple arity 2:       3
         // ref:                 3 (max)
-        // binary:              2 + len(binary)/WORD_SIZE + 1
-        port_ensure_available(ctx, 20 + len/(TERM_BITS/8) + 1);
-        term pid = recvfrom_data->pid;
-        term ref = term_from_ref_ticks(recvfrom_data->ref_ticks, ctx);
-        term addr = socket_tuple_from_addr(ctx, htonl(clientaddr.sin_addr.s_addr));
-        term port = term_from_int32(htons(clientaddr.sin_port));
+        // binary:              term_binary_heap_size(len)
+        port_ensure_available(ctx, 18 + term_binary_heap_size(len));
+        term pid = request->pid;
+        term ref = term_from_ref_ticks(request->ref_ticks, ctx);
+        term addr = socket_tuple_from_addr(ctx, ntohl(clientaddr.sin_addr.s_addr));
+        term port = term_from_int32(ntohs(clientaddr.sin_port));
         term packet = socket_create_packet_term(ctx, buf, len);
         term addr_port_packet = port_create_tuple3(ctx, addr, port, packet);
         term reply = port_create_ok_tuple(ctx, addr_port_packet);
         port_send_reply(ctx, pid, ref, reply);
     }
 
-    linkedlist_remove(&ctx->global->listeners, &listener->listeners_list_head);
-    free(listener);
-    free(recvfrom_data);
-    free(buf);
+    free(request);
 }
 
 void socket_driver_do_recvfrom(Context *ctx, term pid, term ref)
 {
     SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
 
-    EventListener *listener = malloc(sizeof(EventListener));
-    if (IS_NULL_PTR(listener)) {
-        fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
-        abort();
+    if (socket_data->active || (socket_data->type != SOCK_DGRAM) || (socket_data->sockfd == -1)) {
+        port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, EINVAL_ATOM));
+        return;
     }
 
-    RecvFromData *data = (RecvFromData *) malloc(sizeof(RecvFromData));
-    if (IS_NULL_PTR(data)) {
-        fprintf(stderr, "Unable to allocate space for RecvFromData: %s:%i\n", __FILE__, __LINE__);
-        abort();
+    if (socket_driver_push_request(socket_data, pid, ref, 0)) {
+        return;
     }
-    data->ctx = ctx;
-    data->pid = pid;
-    data->ref_ticks = term_to_ref_ticks(ref);
-
-    linkedlist_append(&ctx->global->listeners, &listener->listeners_list_head);
 
+    EventListener *listener = &socket_data->passive_listener;
     listener->fd = socket_data->sockfd;
     listener->expires = 0;
-    listener->expiral_timestamp.tv_sec = 60*60*24; // TODO
-    listener->expiral_timestamp.tv_nsec = 0;
     listener->one_shot = 1;
-    listener->data = data;
+    listener->data = ctx;
     listener->handler = recvfrom_callback;
+    if (UNLIKELY(!sys_register_listener(ctx->global, listener))) {
+        int error = errno;
+        // {Ref, {error, {SysCall, Errno}}}
+        port_ensure_available(ctx, 12);
+        PendingRequest *request = socket_driver_pop_request(socket_data);
+        socket_driver_reply_request(ctx, request, port_create_sys_error_tuple(ctx, EPOLL_CTL_ATOM, error));
+    }
+}
+
+//
+// Stream sockets
+//
+
+static void stream_send_to_owner(Context *ctx, term msg)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+    globalcontext_send_message(ctx->global, term_to_local_process_id(socket_data->owner), msg);
+}
+
+static void stream_update_listener(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+    EventListener *listener = &socket_data->stream_listener;
+
+    int events = 0;
+    switch (socket_data->stream_state) {
+        case StreamConnecting:
+            events = EVENT_LISTENER_WRITE;
+            break;
+        case StreamListening:
+            if (!list_is_empty(&socket_data->pending_requests)) {
+                events = EVENT_LISTENER_READ;
+            }
+            break;
+        case StreamConnected:
+            if (socket_data->send_queue_len) {
+                events |= EVENT_LISTENER_WRITE;
+            }
+            // data is read only when someone is going to receive it, otherwise it is left to TCP flow control
+            if (socket_data->active || !list_is_empty(&socket_data->pending_requests)) {
+                events |= EVENT_LISTENER_READ;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (!events) {
+        if (socket_data->stream_listener_registered) {
+            sys_unregister_listener(ctx->global, listener);
+            socket_data->stream_listener_registered = 0;
+        }
+    } else if (!socket_data->stream_listener_registered) {
+        listener->fd = socket_data->sockfd;
+        listener->events = events;
+        listener->expires = 0;
+        listener->one_shot = 0;
+        listener->data = ctx;
+        listener->handler = stream_callback;
+        if (UNLIKELY(!sys_register_listener(ctx->global, listener))) {
+            // nothing would wake up the processes that are waiting, so the socket is closed
+            int error = errno;
+            if (socket_data->stream_state == StreamConnecting) {
+                port_ensure_available(ctx, 12);
+                term ref = term_from_ref_ticks(socket_data->connect_ref_ticks, ctx);
+                port_send_reply(ctx, socket_data->connect_pid, ref, port_create_sys_error_tuple(ctx, EPOLL_CTL_ATOM, error));
+            }
+            stream_closed(ctx, error);
+            return;
+        }
+        socket_data->stream_listener_registered = 1;
+    } else if (listener->events != events) {
+        listener->events = events;
+        sys_update_listener(ctx->global, listener);
+    }
+}
+
+// the peer closed the connection or it failed: the owner or all waiting processes are notified
+static void stream_closed(Context *ctx, int error)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+    socket_data->stream_state = StreamClosed;
+    socket_data->send_queue_len = 0;
+
+    term port_pid = term_from_local_process_id(ctx->process_id);
+    if (socket_data->active) {
+        if (error) {
+            // {tcp_error, Port, {SysCall, Errno}}
+            port_ensure_available(ctx, 7);
+            term reason = port_create_tuple2(ctx, RECV_ATOM, term_from_int32(error));
+            stream_send_to_owner(ctx, port_create_tuple3(ctx, TCP_ERROR_ATOM, port_pid, reason));
+        }
+        // {tcp_closed, Port}
+        port_ensure_available(ctx, 3);
+        stream_send_to_owner(ctx, port_create_tuple2(ctx, TCP_CLOSED_ATOM, port_pid));
+    }
+
+    while (!list_is_empty(&socket_data->pending_requests)) {
+        PendingRequest *request = socket_driver_pop_request(socket_data);
+        // {Ref, {error, closed}}
+        port_ensure_available(ctx, 9);
+        socket_driver_reply_request(ctx, request, port_create_error_tuple(ctx, CLOSED_ATOM));
+    }
+}
+
+static int stream_ensure_recv_capacity(SocketDriverData *socket_data, size_t capacity)
+{
+    if (socket_data->recv_capacity < capacity) {
+        char *recv_buffer = realloc(socket_data->recv_buffer, capacity);
+        if (IS_NULL_PTR(recv_buffer)) {
+            return 0;
+        }
+        socket_data->recv_buffer = recv_buffer;
+        socket_data->recv_capacity = capacity;
+    }
+
+    return 1;
+}
+
+// how many bytes should be in the receive buffer to complete the next message
+static size_t stream_wanted_size(SocketDriverData *socket_data, size_t requested_len)
+{
+    if (socket_data->packet == 0) {
+        return requested_len ? requested_len : socket_data->buffer_size;
+    }
+    if (socket_data->recv_len < (size_t) socket_data->packet) {
+        return socket_data->packet;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < socket_data->packet; i++) {
+        len = (len << 8) | (uint8_t) socket_data->recv_buffer[i];
+    }
+
+    return socket_data->packet + len;
+}
+
+// returns 1 and sets the message offset and length when the next message has been completely received
+static int stream_next_message(SocketDriverData *socket_data, size_t requested_len, size_t *offset, size_t *len)
+{
+    if (socket_data->packet == 0) {
+        size_t wanted = requested_len ? requested_len : socket_data->recv_len;
+        if (!socket_data->recv_len || (socket_data->recv_len < wanted)) {
+            return 0;
+        }
+        *offset = 0;
+        *len = wanted;
+        return 1;
+    }
+
+    size_t wanted = stream_wanted_size(socket_data, 0);
+    if ((socket_data->recv_len < (size_t) socket_data->packet) || (socket_data->recv_len < wanted)) {
+        return 0;
+    }
+    *offset = socket_data->packet;
+    *len = wanted - socket_data->packet;
+    return 1;
+}
+
+// delivers complete messages from the receive buffer, to the owner in active mode or to processes waiting in recv
+static void stream_deliver(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+    term port_pid = term_from_local_process_id(ctx->process_id);
+
+    for (;;) {
+        size_t requested_len;
+        if (socket_data->active) {
+            requested_len = 0;
+        } else if (!list_is_empty(&socket_data->pending_requests) && (socket_data->stream_state == StreamConnected)) {
+            PendingRequest *request = GET_LIST_ENTRY(list_first(&socket_data->pending_requests), PendingRequest, pending_requests_head);
+            requested_len = request->length;
+        } else {
+            return;
+        }
+
+        size_t offset;
+        size_t len;
+        if (!stream_next_message(socket_data, requested_len, &offset, &len)) {
+            return;
+        }
+
+        // {tcp, Port, binary} or {Ref, {ok, binary}}
+        // tuple arity 3:       4
+        // tuple arity 2:       3
+        // ref:                 3 (max)
+        // binary:              term_binary_heap_size(len)
+        port_ensure_available(ctx, 10 + term_binary_heap_size(len));
+        term data = socket_create_packet_term(ctx, socket_data->recv_buffer + offset, len);
+        if (socket_data->active) {
+            stream_send_to_owner(ctx, port_create_tuple3(ctx, TCP_ATOM, port_pid, data));
+            if (socket_data->active > 0) {
+                socket_data->active--;
+                if (!socket_data->active) {
+                    socket_driver_send_passive(ctx);
+                }
+            }
+        } else {
+            PendingRequest *request = socket_driver_pop_request(socket_data);
+            socket_driver_reply_request(ctx, request, port_create_ok_tuple(ctx, data));
+        }
+
+        socket_data->recv_len -= offset + len;
+        memmove(socket_data->recv_buffer, socket_data->recv_buffer + offset + len, socket_data->recv_len);
+    }
+}
+
+// the stream cannot be resynchronized after a message that is not received, so the socket is closed
+static void stream_message_too_big(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if (socket_data->active) {
+        // {tcp_error, Port, emsgsize}
+        port_ensure_available(ctx, 4);
+        term port_pid = term_from_local_process_id(ctx->process_id);
+        stream_send_to_owner(ctx, port_create_tuple3(ctx, TCP_ERROR_ATOM, port_pid, EMSGSIZE_ATOM));
+        // {tcp_closed, Port}
+        port_ensure_available(ctx, 3);
+        stream_send_to_owner(ctx, port_create_tuple2(ctx, TCP_CLOSED_ATOM, port_pid));
+    } else {
+        // {Ref, {error, emsgsize}}
+        port_ensure_available(ctx, 9);
+        PendingRequest *request = socket_driver_pop_request(socket_data);
+        socket_driver_reply_request(ctx, request, port_create_error_tuple(ctx, EMSGSIZE_ATOM));
+    }
+
+    socket_driver_do_close(ctx);
+}
+
+static void stream_read(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    for (int i = 0; i < RECV_BATCH_SIZE; i++) {
+        if ((socket_data->stream_state != StreamConnected)
+                || (!socket_data->active && list_is_empty(&socket_data->pending_requests))) {
+            return;
+        }
+
+        size_t requested_len = 0;
+        if (!socket_data->active) {
+            PendingRequest *request = GET_LIST_ENTRY(list_first(&socket_data->pending_requests), PendingRequest, pending_requests_head);
+            requested_len = request->length;
+        }
+        size_t wanted = stream_wanted_size(socket_data, requested_len);
+        // the length header is checked before the receive buffer is grown for the message
+        if (socket_data->packet && socket_data->packet_size
+                && (wanted - socket_data->packet > socket_data->packet_size)) {
+            stream_message_too_big(ctx);
+            return;
+        }
+        if (wanted < socket_data->buffer_size) {
+            wanted = socket_data->buffer_size;
+        }
+        if (UNLIKELY(!stream_ensure_recv_capacity(socket_data, wanted))) {
+            stream_closed(ctx, ENOMEM);
+            return;
+        }
+
+        char *buf = socket_data->recv_buffer + socket_data->recv_len;
+        ssize_t len = recv(socket_data->sockfd, buf, socket_data->recv_capacity - socket_data->recv_len, 0);
+        if (len > 0) {
+            socket_data->recv_len += len;
+            stream_deliver(ctx);
+        } else if (len == 0) {
+            stream_closed(ctx, 0);
+            return;
+        } else if (errno == EINTR) {
+            continue;
+        } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            stream_closed(ctx, errno);
+            return;
+        }
+    }
+}
+
+static void stream_flush(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    while (socket_data->send_queue_len) {
+        ssize_t sent = send(socket_data->sockfd, socket_data->send_queue, socket_data->send_queue_len, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            socket_data->send_queue_len -= sent;
+            memmove(socket_data->send_queue, socket_data->send_queue + sent, socket_data->send_queue_len);
+        } else if (errno == EINTR) {
+            continue;
+        } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            stream_closed(ctx, errno);
+            return;
+        }
+    }
+}
+
+static void stream_queue(SocketDriverData *socket_data, const char *data, size_t len)
+{
+    size_t needed = socket_data->send_queue_len + len;
+    if (socket_data->send_queue_capacity < needed) {
+        char *send_queue = realloc(socket_data->send_queue, needed);
+        if (IS_NULL_PTR(send_queue)) {
+            fprintf(stderr, "Failed to allocate memory: %s:%i.\n", __FILE__, __LINE__);
+            abort();
+        }
+        socket_data->send_queue = send_queue;
+        socket_data->send_queue_capacity = needed;
+    }
+    memcpy(socket_data->send_queue + socket_data->send_queue_len, data, len);
+    socket_data->send_queue_len = needed;
+}
+
+static void stream_accept(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    while (!list_is_empty(&socket_data->pending_requests)) {
+        int fd = accept(socket_data->sockfd, NULL, NULL);
+        if (fd == -1) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return;
+            } else if ((errno == EINTR) || (errno == ECONNABORTED)) {
+                continue;
+            }
+            // {Ref, {error, {SysCall, Errno}}}
+            port_ensure_available(ctx, 12);
+            PendingRequest *request = socket_driver_pop_request(socket_data);
+            socket_driver_reply_request(ctx, request, port_create_sys_error_tuple(ctx, ACCEPT_ATOM, errno));
+            continue;
+        }
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+            close(fd);
+            port_ensure_available(ctx, 12);
+            PendingRequest *request = socket_driver_pop_request(socket_data);
+            socket_driver_reply_request(ctx, request, port_create_sys_error_tuple(ctx, FCNTL_ATOM, errno));
+            continue;
+        }
+
+        PendingRequest *request = socket_driver_pop_request(socket_data);
+
+        // the accepted socket is a new port owned by the process that called accept, it inherits listen socket options
+        Context *new_ctx = context_new(ctx->global);
+        if (IS_NULL_PTR(new_ctx)) {
+            close(fd);
+            // {Ref, {error, emfile}}
+            port_ensure_available(ctx, 9);
+            socket_driver_reply_request(ctx, request, port_create_error_tuple(ctx, EMFILE_ATOM));
+            continue;
+        }
+        socket_init(new_ctx, term_nil());
+        SocketDriverData *new_data = (SocketDriverData *) new_ctx->platform_data;
+        new_data->sockfd = fd;
+        new_data->type = SOCK_STREAM;
+        new_data->owner = request->pid;
+        new_data->stream_state = StreamConnected;
+        new_data->packet = socket_data->packet;
+        new_data->packet_size = socket_data->packet_size;
+        new_data->buffer_size = socket_data->buffer_size;
+        new_data->active = socket_data->active;
+        scheduler_make_waiting(ctx->global, new_ctx);
+
+        // {Ref, {ok, Port}}
+        port_ensure_available(ctx, 9);
+        socket_driver_reply_request(ctx, request, port_create_ok_tuple(ctx, term_from_local_process_id(new_ctx->process_id)));
+
+        stream_update_listener(new_ctx);
+    }
+}
+
+static void stream_connected(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(socket_data->sockfd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1) {
+        error = errno;
+    }
+
+    term ref = term_from_ref_ticks(socket_data->connect_ref_ticks, ctx);
+    if (error) {
+        socket_data->stream_state = StreamClosed;
+        port_ensure_available(ctx, 12);
+        port_send_reply(ctx, socket_data->connect_pid, ref, port_create_sys_error_tuple(ctx, CONNECT_ATOM, error));
+    } else {
+        socket_data->stream_state = StreamConnected;
+        port_ensure_available(ctx, 6);
+        port_send_reply(ctx, socket_data->connect_pid, ref, OK_ATOM);
+    }
+}
+
+static void stream_callback(EventListener *listener)
+{
+    Context *ctx = (Context *) listener->data;
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    switch (socket_data->stream_state) {
+        case StreamConnecting:
+            stream_connected(ctx);
+            break;
+        case StreamListening:
+            stream_accept(ctx);
+            break;
+        case StreamConnected:
+            stream_flush(ctx);
+            stream_read(ctx);
+            break;
+        default:
+            break;
+    }
+
+    stream_update_listener(ctx);
+}
+
+void socket_driver_do_connect(Context *ctx, term pid, term ref, term address, term port)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if ((socket_data->type != SOCK_STREAM) || (socket_data->stream_state != StreamIdle)
+            || !term_is_tuple(address) || (term_get_tuple_arity(address) != 4) || !term_is_integer(port)) {
+        port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, EINVAL_ATOM));
+        return;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(socket_tuple_to_addr(address));
+    addr.sin_port = htons(term_to_int32(port));
+
+    if (connect(socket_data->sockfd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        socket_data->stream_state = StreamConnected;
+        port_send_reply(ctx, pid, ref, OK_ATOM);
+    } else if (errno == EINPROGRESS) {
+        socket_data->stream_state = StreamConnecting;
+        socket_data->connect_pid = pid;
+        socket_data->connect_ref_ticks = term_to_ref_ticks(ref);
+    } else {
+        port_send_reply(ctx, pid, ref, port_create_sys_error_tuple(ctx, CONNECT_ATOM, errno));
+        return;
+    }
+
+    stream_update_listener(ctx);
+}
+
+term socket_driver_do_listen(Context *ctx, term backlog)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if ((socket_data->type != SOCK_STREAM) || (socket_data->stream_state != StreamIdle) || !term_is_integer(backlog)) {
+        return port_create_error_tuple(ctx, EINVAL_ATOM);
+    }
+    if (listen(socket_data->sockfd, term_to_int32(backlog)) == -1) {
+        return port_create_sys_error_tuple(ctx, LISTEN_ATOM, errno);
+    }
+    socket_data->stream_state = StreamListening;
+
+    return OK_ATOM;
+}
+
+void socket_driver_do_accept(Context *ctx, term pid, term ref)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if (socket_data->stream_state != StreamListening) {
+        port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, EINVAL_ATOM));
+        return;
+    }
+
+    socket_driver_push_request(socket_data, pid, ref, 0);
+    stream_accept(ctx);
+    stream_update_listener(ctx);
+}
+
+term socket_driver_do_stream_send(Context *ctx, term buffer)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if (socket_data->stream_state == StreamClosed) {
+        return port_create_error_tuple(ctx, CLOSED_ATOM);
+    } else if (socket_data->stream_state != StreamConnected) {
+        return port_create_error_tuple(ctx, EINVAL_ATOM);
+    }
+
+    const char *buf;
+    char *allocated_buf = NULL;
+    size_t len;
+    if (term_is_binary(buffer)) {
+        buf = term_binary_data(buffer);
+        len = term_binary_size(buffer);
+    } else if (term_is_list(buffer)) {
+        int ok;
+        allocated_buf = interop_list_to_string(buffer, &ok);
+        if (UNLIKELY(!ok)) {
+            return port_create_error_tuple(ctx, BADARG_ATOM);
+        }
+        buf = allocated_buf;
+        len = strlen(buf);
+    } else {
+        return port_create_error_tuple(ctx, BADARG_ATOM);
+    }
+
+    char header[4];
+    int header_len = socket_data->packet;
+    if (header_len && (header_len < 4) && (len >> (header_len * 8))) {
+        free(allocated_buf);
+        return port_create_error_tuple(ctx, BADARG_ATOM);
+    }
+    for (int i = 0; i < header_len; i++) {
+        header[i] = (len >> ((header_len - i - 1) * 8)) & 0xFF;
+    }
+
+    // data is queued behind anything that has not been sent yet, otherwise it is sent right away
+    size_t sent = 0;
+    if (!socket_data->send_queue_len) {
+        struct iovec iov[2];
+        iov[0].iov_base = header;
+        iov[0].iov_len = header_len;
+        iov[1].iov_base = (void *) buf;
+        iov[1].iov_len = len;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = header_len ? iov : iov + 1;
+        msg.msg_iovlen = header_len ? 2 : 1;
+
+        ssize_t result = sendmsg(socket_data->sockfd, &msg, MSG_NOSIGNAL);
+        if (result >= 0) {
+            sent = result;
+        } else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+            int error = errno;
+            free(allocated_buf);
+            return port_create_sys_error_tuple(ctx, SEND_ATOM, error);
+        }
+    }
+
+    if (sent < (size_t) header_len) {
+        stream_queue(socket_data, header + sent, header_len - sent);
+        stream_queue(socket_data, buf, len);
+    } else if (sent < header_len + len) {
+        stream_queue(socket_data, buf + (sent - header_len), len - (sent - header_len));
+    }
+    free(allocated_buf);
+
+    stream_update_listener(ctx);
+
+    return OK_ATOM;
+}
+
+void socket_driver_do_recv(Context *ctx, term pid, term ref, term length)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if (socket_data->stream_state == StreamClosed) {
+        port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, CLOSED_ATOM));
+        return;
+    } else if ((socket_data->stream_state != StreamConnected) || socket_data->active || !term_is_integer(length)
+            || (term_to_int32(length) < 0) || (socket_data->packet && term_to_int32(length))) {
+        port_send_reply(ctx, pid, ref, port_create_error_tuple(ctx, EINVAL_ATOM));
+        return;
+    }
+
+    socket_driver_push_request(socket_data, pid, ref, term_to_int32(length));
+    stream_deliver(ctx);
+    stream_update_listener(ctx);
+}
+
+term socket_driver_do_close(Context *ctx)
+{
+    SocketDriverData *socket_data = (SocketDriverData *) ctx->platform_data;
+
+    if (socket_data->sockfd == -1) {
+        return OK_ATOM;
+    }
+
+    if (socket_data->type == SOCK_STREAM) {
+        if (socket_data->stream_state == StreamConnecting) {
+            term ref = term_from_ref_ticks(socket_data->connect_ref_ticks, ctx);
+            port_send_reply(ctx, socket_data->connect_pid, ref, port_create_error_tuple(ctx, CLOSED_ATOM));
+        }
+        socket_data->stream_state = StreamClosed;
+        // nobody is notified about its own close in active mode
+        socket_data->active = 0;
+        stream_update_listener(ctx);
+        stream_closed(ctx, 0);
+    } else {
+        socket_driver_set_active(ctx, 0);
+        if (!list_is_empty(&socket_data->pending_requests)) {
+            sys_unregister_listener(ctx->global, &socket_data->passive_listener);
+        }
+        while (!list_is_empty(&socket_data->pending_requests)) {
+            PendingRequest *request = socket_driver_pop_request(socket_data);
+            port_ensure_available(ctx, 9);
+            socket_driver_reply_request(ctx, request, port_create_error_tuple(ctx, CLOSED_ATOM));
+        }
+    }
+
+    close(socket_data->sockfd);
+    socket_data->sockfd = -1;
+    free(socket_data->buffers);
+    socket_data->buffers = NULL;
+    socket_data->buffers_count = 0;
+    free(socket_data->recv_buffer);
+    socket_data->recv_buffer = NULL;
+    socket_data->recv_len = 0;
+    socket_data->recv_capacity = 0;
+    free(socket_data->send_queue);
+    socket_data->send_queue = NULL;
+    socket_data->send_queue_len = 0;
+    socket_data->send_queue_capacity = 0;
+
+    return OK_ATOM;
 }
@@ -45,6 +45,266 @@ static int32_t timespec_diff_to_ms(struct timespec *timespec1, struct timespec *
 #else
 #endif
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+
+// maximum number of events that are dispatched for each epoll_wait call
+#define MAX_EPOLL_EVENTS 64
+
+struct GenericUnixPlatformData
+{
+    int epoll_fd;
+    // listeners with a fd, when there are none there is no need to call epoll_wait
+    int fd_listeners;
+    // listeners with expires set, when there are none the listeners list is not scanned for timeouts
+    int timer_listeners;
+
+    // events that are being dispatched, handlers might unregister listeners that have a pending event
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int pending_events;
+};
+
+int sys_init_platform(GlobalContext *glb)
+{
+    struct GenericUnixPlatformData *platform = malloc(sizeof(struct GenericUnixPlatformData));
+    if (IS_NULL_PTR(platform)) {
+        return 0;
+    }
+    platform->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (UNLIKELY(platform->epoll_fd == -1)) {
+        free(platform);
+        return 0;
+    }
+    platform->fd_listeners = 0;
+    platform->timer_listeners = 0;
+    platform->pending_events = 0;
+    glb->platform_data = platform;
+
+    return 1;
+}
+
+void sys_free_platform(GlobalContext *glb)
+{
+    struct GenericUnixPlatformData *platform = glb->platform_data;
+    close(platform->epoll_fd);
+    free(platform);
+    glb->platform_data = NULL;
+}
+
+static inline uint32_t sys_epoll_events(EventListener *listener)
+{
+    uint32_t events = 0;
+    if (!listener->events || (listener->events & EVENT_LISTENER_READ)) {
+        events |= EPOLLIN;
+    }
+    if (listener->events & EVENT_LISTENER_WRITE) {
+        events |= EPOLLOUT;
+    }
+
+    return events;
+}
+
+int sys_register_listener(GlobalContext *glb, EventListener *listener)
+{
+    struct GenericUnixPlatformData *platform = glb->platform_data;
+
+    // fd is added first, so nothing has to be rolled back when it cannot be watched, such as when it is already there
+    if (listener->fd >= 0) {
+        // level triggered: handlers are allowed to read just part of the available data, such as a single datagram
+        struct epoll_event event;
+        event.events = sys_epoll_events(listener);
+        event.data.ptr = listener;
+        if (UNLIKELY(epoll_ctl(platform->epoll_fd, EPOLL_CTL_ADD, listener->fd, &event) == -1)) {
+            return 0;
+        }
+        platform->fd_listeners++;
+    }
+    if (listener->expires) {
+        platform->timer_listeners++;
+    }
+
+    linkedlist_append(&glb->listeners, &listener->listeners_list_head);
+
+    return 1;
+}
+
+void sys_update_listener(GlobalContext *glb, EventListener *listener)
+{
+    struct GenericUnixPlatformData *platform = glb->platform_data;
+
+    struct epoll_event event;
+    event.events = sys_epoll_events(listener);
+    event.data.ptr = listener;
+    if (UNLIKELY(epoll_ctl(platform->epoll_fd, EPOLL_CTL_MOD, listener->fd, &event) == -1)) {
+        fprintf(stderr, "Failed to modify fd %i in epoll set: %s:%i.\n", listener->fd, __FILE__, __LINE__);
+        abort();
+    }
+}
+
+void sys_unregister_listener(GlobalContext *glb, EventListener *listener)
+{
+    struct GenericUnixPlatformData *platform = glb->platform_data;
+
+    linkedlist_remove(&glb->listeners, &listener->listeners_list_head);
+
+    if (listener->expires) {
+        platform->timer_listeners--;
+    }
+    if (listener->fd >= 0) {
+        // it might fail if fd has been already closed, that also removes it from the epoll set
+        epoll_ctl(platform->epoll_fd, EPOLL_CTL_DEL, listener->fd, NULL);
+        platform->fd_listeners--;
+
+        // listener is going to be freed, so it must not be dispatched anymore
+        for (int i = 0; i < platform->pending_events; i++) {
+            if (platform->events[i].data.ptr == listener) {
+                platform->events[i].data.ptr = NULL;
+            }
+        }
+    }
+}
+
+static void sys_dispatch_events(GlobalContext *glb, int timeout_ms)
+{
+    struct GenericUnixPlatformData *platform = glb->platform_data;
+
+    int ready = epoll_wait(platform->epoll_fd, platform->events, MAX_EPOLL_EVENTS, timeout_ms);
+    if (ready <= 0) {
+        return;
+    }
+
+    platform->pending_events = ready;
+    for (int i = 0; i < ready; i++) {
+        EventListener *listener = (EventListener *) platform->events[i].data.ptr;
+        if (listener) {
+            //it is completely safe to free a listener in the callback, we are going to not use it after this call
+            listener->handler(listener);
+        }
+    }
+    platform->pending_events = 0;
+}
+
+static void sys_sleep(int timeout_ms)
+{
+    struct timespec t;
+    t.tv_sec = timeout_ms / 1000;
+    t.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+    struct timespec rem;
+    int nanosleep_result = nanosleep(&t, &rem);
+    while (nanosleep_result == -1) {
+        nanosleep_result = nanosleep(&rem, &rem);
+    }
+}
+
+extern void sys_waitevents(GlobalContext *glb)
+{
+    TRACE("sys: entered sys_waitevents.\n");
+
+    struct GenericUnixPlatformData *platform = glb->platform_data;
+    struct timespec now;
+
+    //first: find maximum allowed sleep time
+    int min_timeout = INT_MAX;
+    if (platform->timer_listeners) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        EventListener *listeners = GET_LIST_ENTRY(glb->listeners, EventListener, listeners_list_head);
+        EventListener *listener = listeners;
+        do {
+            if (listener->expires) {
+                int wait_ms = timespec_diff_to_ms(&listener->expiral_timestamp, &now);
+                if (wait_ms <= 0) {
+                    min_timeout = 0;
+                } else if (min_timeout > wait_ms) {
+                    min_timeout = wait_ms;
+                }
+            }
+            listener = GET_LIST_ENTRY(listener->listeners_list_head.next, EventListener, listeners_list_head);
+        } while (listener != listeners);
+    }
+
+    //second: use either epoll or nanosleep
+    if (platform->fd_listeners) {
+        sys_dispatch_events(glb, (min_timeout == INT_MAX) ? -1 : min_timeout);
+    } else {
+        sys_sleep(min_timeout);
+    }
+
+    //third: execute handlers for expiered timers
+    if ((min_timeout != INT_MAX) && platform->timer_listeners) {
+        EventListener *listeners = GET_LIST_ENTRY(glb->listeners, EventListener, listeners_list_head);
+        EventListener *listener = listeners;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        do {
+            EventListener *next_listener = GET_LIST_ENTRY(listener->listeners_list_head.next, EventListener, listeners_list_head);
+            if (listener->expires) {
+                int wait_ms = timespec_diff_to_ms(&listener->expiral_timestamp, &now);
+                if (wait_ms <= 0) {
+                    //it is completely safe to free a listener in the callback, we are going to not use it after this call
+                    listener->handler(listener);
+                }
+            }
+
+            listener = next_listener;
+            listeners = GET_LIST_ENTRY(glb->listeners, EventListener, listeners_list_head);
+        } while (listeners != NULL && listener != listeners);
+    }
+}
+
+void sys_consume_pending_events(GlobalContext *glb)
+{
+    struct GenericUnixPlatformData *platform = glb->platform_data;
+
+    if (platform->fd_listeners) {
+        sys_dispatch_events(glb, 0);
+    }
+}
+
+#else
+
+int sys_init_platform(GlobalContext *glb)
+{
+    UNUSED(glb);
+
+    return 1;
+}
+
+void sys_free_platform(GlobalContext *glb)
+{
+    UNUSED(glb);
+}
+
+int sys_register_listener(GlobalContext *glb, EventListener *listener)
+{
+    linkedlist_append(&glb->listeners, &listener->listeners_list_head);
+
+    return 1;
+}
+
+void sys_update_listener(GlobalContext *glb, EventListener *listener)
+{
+    UNUSED(glb);
+    UNUSED(listener);
+}
+
+void sys_unregister_listener(GlobalContext *glb, EventListener *listener)
+{
+    linkedlist_remove(&glb->listeners, &listener->listeners_list_head);
+}
+
+static inline short sys_poll_events(EventListener *listener)
+{
+    short events = 0;
+    if (!listener->events || (listener->events & EVENT_LISTENER_READ)) {
+        events |= POLLIN;
+    }
+    if (listener->events & EVENT_LISTENER_WRITE) {
+        events |= POLLOUT;
+    }
+
+    return events;
+}
+
 extern void sys_waitevents(GlobalContext *glb)
 {
     TRACE("sys: entered sys_waitevents.\n");
@@ -54,7 +314,6 @@ extern void sys_waitevents(GlobalContext *glb)
     clock_gettime(CLOCK_MONOTONIC, &now);
 
     EventListener *listeners = GET_LIST_ENTRY(listeners_list, EventListener, listeners_list_head);
-    EventListener *last_listener = GET_LIST_ENTRY(listeners_list->prev, EventListener, listeners_list_head);
 
     int min_timeout = INT_MAX;
     int count = 0;
@@ -109,11 +368,11 @@ extern void sys_waitevents(GlobalContext *glb)
         do {
             if (listener->fd >= 0) {
                 fds[poll_fd_index].fd = listener->fd;
-                fds[poll_fd_index].events = POLLIN;
+                fds[poll_fd_index].events = sys_poll_events(listener);
                 fds[poll_fd_index].revents = 0;
-            }
 
-            poll_fd_index++;
+                poll_fd_index++;
+            }
 
             listener = GET_LIST_ENTRY(listener->listeners_list_head.next, EventListener, listeners_list_head);
         } while (listener != listeners);
@@ -159,7 +418,8 @@ extern void sys_waitevents(GlobalContext *glb)
     }
 
     //third: execute handlers for expiered timers
-    if (min_timeout != INT_MAX) {
+    if ((min_timeout != INT_MAX) && glb->listeners) {
+        listeners = GET_LIST_ENTRY(glb->listeners, EventListener, listeners_list_head);
         listener = listeners;
         clock_gettime(CLOCK_MONOTONIC, &now);
         do {
@@ -175,7 +435,7 @@ extern void sys_waitevents(GlobalContext *glb)
 
             listener = next_listener;
             listeners = GET_LIST_ENTRY(glb->listeners, EventListener, listeners_list_head);
-        } while (listeners != NULL && listener != last_listener);
+        } while (listeners != NULL && listener != listeners);
     }
 }
 
@@ -188,7 +448,6 @@ void sys_consume_pending_events(GlobalContext *glb)
     }
 
     EventListener *listeners = GET_LIST_ENTRY(listeners_list, EventListener, listeners_list_head);
-    EventListener *last_listener = GET_LIST_ENTRY(listeners_list->prev, EventListener, listeners_list_head);
 
     EventListener *listener = listeners;
 
@@ -199,14 +458,14 @@ void sys_consume_pending_events(GlobalContext *glb)
         if (listener_fd >= 0) {
             fds_count++;
         }
-    } while (listeners != NULL && listener != last_listener);
+        listener = GET_LIST_ENTRY(listener->listeners_list_head.next, EventListener, listeners_list_head);
+    } while (listener != listeners);
 
     if (fds_count == 0) {
         return;
     }
 
     listeners = GET_LIST_ENTRY(listeners_list, EventListener, listeners_list_head);
-    last_listener = GET_LIST_ENTRY(listeners_list->prev, EventListener, listeners_list_head);
 
     listener = listeners;
 
@@ -217,15 +476,13 @@ void sys_consume_pending_events(GlobalContext *glb)
         int listener_fd = listener->fd;
         if (listener_fd >= 0) {
             fds[fd_index].fd = listener_fd;
-            fds[fd_index].events = POLLIN;
+            fds[fd_index].events = sys_poll_events(listener);
             fds[fd_index].revents = 0;
 
             fd_index++;
         }
-    } while (listeners != NULL && listener != last_listener);
-
-    listeners = GET_LIST_ENTRY(listeners_list, EventListener, listeners_list_head);
-    last_listener = GET_LIST_ENTRY(listeners_list->prev, EventListener, listeners_list_head);
+        listener = GET_LIST_ENTRY(listener->listeners_list_head.next, EventListener, listeners_list_head);
+    } while (listener != listeners);
 
     if (poll(fds, fd_index, 0) > 0) {
         for (int i = 0; i < fd_index; i++) {
@@ -235,13 +492,14 @@ void sys_consume_pending_events(GlobalContext *glb)
 
             int current_fd = fds[i].fd;
 
-            EventListener *listener = listeners;
-
-            if (!listener) {
+            // handlers can remove and free their listener, so the list is read again for each event
+            if (!glb->listeners) {
                 fprintf(stderr, "warning: no listeners.\n");
                 free(fds);
                 return;
             }
+            listeners = GET_LIST_ENTRY(glb->listeners, EventListener, listeners_list_head);
+            EventListener *listener = listeners;
 
             do {
                 if (listener->fd == current_fd) {
@@ -249,13 +507,15 @@ void sys_consume_pending_events(GlobalContext *glb)
                     break;
                 }
                 listener = GET_LIST_ENTRY(listener->listeners_list_head.next, EventListener, listeners_list_head);
-            } while (listeners != NULL && listener != last_listener);
+            } while (listener != listeners);
         }
     }
 
     free(fds);
 }
 
+#endif
+
 extern void sys_set_timestamp_from_relative_to_abs(struct timespec *t, int32_t millis)
 {
     if (UNLIKELY(clock_gettime(CLOCK_MONOTONIC, t))) {
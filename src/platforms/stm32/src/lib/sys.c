@@ -54,6 +54,36 @@ static int32_t timespec_diff_to_ms(struct timespec *timespec1, struct timespec *
     return (timespec1->tv_sec - timespec2->tv_sec) * 1000 + (timespec1->tv_nsec - timespec2->tv_nsec) / 1000000;
 }
 
+int sys_init_platform(GlobalContext *glb)
+{
+    UNUSED(glb);
+
+    return 1;
+}
+
+void sys_free_platform(GlobalContext *glb)
+{
+    UNUSED(glb);
+}
+
+int sys_register_listener(GlobalContext *glb, EventListener *listener)
+{
+    linkedlist_append(&glb->listeners, &listener->listeners_list_head);
+
+    return 1;
+}
+
+void sys_update_listener(GlobalContext *glb, EventListener *listener)
+{
+    UNUSED(glb);
+    UNUSED(listener);
+}
+
+void sys_unregister_listener(GlobalContext *glb, EventListener *listener)
+{
+    linkedlist_remove(&glb->listeners, &listener->listeners_list_head);
+}
+
 void sys_waitevents(GlobalContext *glb)
 {
     struct ListHead *listeners_list = glb->listeners;
@@ -0,0 +1,338 @@
+/***************************************************************************
+ *   Copyright 2019 by Davide Bettio <davide@uninstall.it>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA .        *
+ ***************************************************************************/
+
+/*
+ * Runs each benchmark module and prints a JSON object for each run on stdout, such as:
+ * {"benchmark": "bench_fib", "run": 1, "result": 196418, "wall_ms": 312.5, "reductions": 317810, ...}
+ * When AtomVM is built with AVM_ENABLE_OPCODE_COUNTERS the object also has the count of executed opcodes.
+ *
+ * Usage: avm_bench [-n runs] [benchmark ...]
+ */
+
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "context.h"
+#include "globalcontext.h"
+#include "../platforms/generic_unix/mapped_file.h"
+#include "module.h"
+#include "opcodes.h"
+#include "term.h"
+#include "utils.h"
+
+struct Benchmark
+{
+    const char *name;
+    int64_t expected_value;
+};
+
+static const struct Benchmark benchmarks[] =
+{
+    {"bench_fib", 196418},
+    {"bench_ring", 100000},
+    {"bench_tuple_list", 40400000},
+    {"bench_binary_split", 160000},
+    {"bench_proplists", 10505000},
+    {"bench_gc", 1000000},
+    {"bench_selective_receive", 2001000},
+
+    {NULL, 0}
+};
+
+struct BenchmarkStats
+{
+    uint64_t reductions;
+    unsigned long minor_gcs;
+    unsigned long major_gcs;
+};
+
+#ifdef AVM_ENABLE_OPCODE_COUNTERS
+static const char *const opcodes_names[256] =
+{
+    [OP_LABEL] = "label",
+    [OP_FUNC_INFO] = "func_info",
+    [OP_INT_CALL_END] = "int_call_end",
+    [OP_CALL] = "call",
+    [OP_CALL_LAST] = "call_last",
+    [OP_CALL_ONLY] = "call_only",
+    [OP_CALL_EXT] = "call_ext",
+    [OP_CALL_EXT_LAST] = "call_ext_last",
+    [OP_BIF0] = "bif0",
+    [OP_BIF1] = "bif1",
+    [OP_BIF2] = "bif2",
+    [OP_ALLOCATE] = "allocate",
+    [OP_ALLOCATE_HEAP] = "allocate_heap",
+    [OP_ALLOCATE_ZERO] = "allocate_zero",
+    [OP_ALLOCATE_HEAP_ZERO] = "allocate_heap_zero",
+    [OP_TEST_HEAP] = "test_heap",
+    [OP_KILL] = "kill",
+    [OP_DEALLOCATE] = "deallocate",
+    [OP_RETURN] = "return",
+    [OP_SEND] = "send",
+    [OP_REMOVE_MESSAGE] = "remove_message",
+    [OP_TIMEOUT] = "timeout",
+    [OP_LOOP_REC] = "loop_rec",
+    [OP_LOOP_REC_END] = "loop_rec_end",
+    [OP_WAIT] = "wait",
+    [OP_WAIT_TIMEOUT] = "wait_timeout",
+    [OP_IS_LT] = "is_lt",
+    [OP_IS_GE] = "is_ge",
+    [OP_IS_EQUAL] = "is_equal",
+    [OP_IS_NOT_EQUAL] = "is_not_equal",
+    [OP_IS_EQ_EXACT] = "is_eq_exact",
+    [OP_IS_NOT_EQ_EXACT] = "is_not_eq_exact",
+    [OP_IS_INTEGER] = "is_integer",
+    [OP_IS_NUMBER] = "is_number",
+    [OP_IS_ATOM] = "is_atom",
+    [OP_IS_PID] = "is_pid",
+    [OP_IS_REFERENCE] = "is_reference",
+    [OP_IS_PORT] = "is_port",
+    [OP_IS_NIL] = "is_nil",
+    [OP_IS_BINARY] = "is_binary",
+    [OP_IS_LIST] = "is_list",
+    [OP_IS_NONEMPTY_LIST] = "is_nonempty_list",
+    [OP_IS_TUPLE] = "is_tuple",
+    [OP_TEST_ARITY] = "test_arity",
+    [OP_SELECT_VAL] = "select_val",
+    [OP_SELECT_TUPLE_ARITY] = "select_tuple_arity",
+    [OP_JUMP] = "jump",
+    [OP_MOVE] = "move",
+    [OP_GET_LIST] = "get_list",
+    [OP_GET_TUPLE_ELEMENT] = "get_tuple_element",
+    [OP_SET_TUPLE_ELEMENT] = "set_tuple_element",
+    [OP_PUT_LIST] = "put_list",
+    [OP_PUT_TUPLE] = "put_tuple",
+    [OP_PUT] = "put",
+    [OP_BADMATCH] = "badmatch",
+    [OP_IF_END] = "if_end",
+    [OP_CASE_END] = "case_end",
+    [OP_CALL_FUN] = "call_fun",
+    [OP_IS_FUNCTION] = "is_function",
+    [OP_CALL_EXT_ONLY] = "call_ext_only",
+    [OP_BS_PUT_INTEGER] = "bs_put_integer",
+    [OP_BS_PUT_BINARY] = "bs_put_binary",
+    [OP_BS_PUT_STRING] = "bs_put_string",
+    [OP_MAKE_FUN2] = "make_fun2",
+    [OP_TRY] = "try",
+    [OP_TRY_END] = "try_end",
+    [OP_TRY_CASE] = "try_case",
+    [OP_TRY_CASE_END] = "try_case_end",
+    [OP_BS_INIT2] = "bs_init2",
+    [OP_BS_ADD] = "bs_add",
+    [OP_APPLY] = "apply",
+    [OP_APPLY_LAST] = "apply_last",
+    [OP_IS_BOOLEAN] = "is_boolean",
+    [OP_IS_FUNCTION2] = "is_function2",
+    [OP_BS_START_MATCH2] = "bs_start_match2",
+    [OP_BS_GET_INTEGER2] = "bs_get_integer2",
+    [OP_BS_GET_BINARY2] = "bs_get_binary2",
+    [OP_BS_SKIP_BITS2] = "bs_skip_bits2",
+    [OP_BS_TEST_TAIL2] = "bs_test_tail2",
+    [OP_BS_SAVE2] = "bs_save2",
+    [OP_BS_RESTORE2] = "bs_restore2",
+    [OP_GC_BIF1] = "gc_bif1",
+    [OP_GC_BIF2] = "gc_bif2",
+    [OP_BS_CONTEXT_TO_BINARY] = "bs_context_to_binary",
+    [OP_BS_TEST_UNIT] = "bs_test_unit",
+    [OP_BS_MATCH_STRING] = "bs_match_string",
+    [OP_BS_INIT_WRITABLE] = "bs_init_writable",
+    [OP_BS_APPEND] = "bs_append",
+    [OP_BS_PRIVATE_APPEND] = "bs_private_append",
+    [OP_TRIM] = "trim",
+    [OP_BS_INIT_BITS] = "bs_init_bits",
+    [OP_RECV_MARK] = "recv_mark",
+    [OP_RECV_SET] = "recv_set",
+    [OP_LINE] = "line",
+    [OP_PUT_MAP_ASSOC] = "put_map_assoc",
+    [OP_PUT_MAP_EXACT] = "put_map_exact",
+    [OP_IS_MAP] = "is_map",
+    [OP_HAS_MAP_FIELDS] = "has_map_fields",
+    [OP_GET_MAP_ELEMENTS] = "get_map_elements",
+    [OP_IS_TAGGED_TUPLE] = "is_tagged_tuple",
+    [OP_GET_HD] = "get_hd",
+    [OP_GET_TL] = "get_tl",
+    [OP_BS_GET_TAIL] = "bs_get_tail",
+    [OP_BS_START_MATCH3] = "bs_start_match3",
+    [OP_BS_GET_POSITION] = "bs_get_position",
+    [OP_BS_SET_POSITION] = "bs_set_position",
+};
+
+static void print_opcode_counters(GlobalContext *glb)
+{
+    printf(", \"opcodes\": {");
+    int first = 1;
+    for (int i = 0; i < 256; i++) {
+        if (glb->opcode_counters[i] == 0) {
+            continue;
+        }
+        const char *name = opcodes_names[i] ? opcodes_names[i] : "unknown";
+        printf("%s\"%s\": %" PRIu64, first ? "" : ", ", name, glb->opcode_counters[i]);
+        first = 0;
+    }
+    printf("}");
+}
+#endif
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// processes that exited are accounted in the global context, the ones that are still alive are added to them
+static void collect_stats(GlobalContext *glb, struct BenchmarkStats *stats)
+{
+    stats->reductions = glb->exited_reductions;
+    stats->minor_gcs = glb->exited_minor_gcs;
+    stats->major_gcs = glb->exited_major_gcs;
+
+    if (IS_NULL_PTR(glb->processes_table)) {
+        return;
+    }
+    Context *processes = GET_LIST_ENTRY(glb->processes_table, Context, processes_table_head);
+    Context *p = processes;
+    do {
+        stats->reductions += p->stats.reductions;
+        stats->minor_gcs += p->stats.minor_gcs;
+        stats->major_gcs += p->stats.major_gcs;
+        p = GET_LIST_ENTRY(p->processes_table_head.next, Context, processes_table_head);
+    } while (processes != p);
+}
+
+static int run_benchmark(const struct Benchmark *benchmark, int run)
+{
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "%s.beam", benchmark->name);
+
+    MappedFile *beam_file = mapped_file_open_beam(file_name);
+    if (IS_NULL_PTR(beam_file)) {
+        return 0;
+    }
+
+    GlobalContext *glb = globalcontext_new();
+    glb->avmpack_data = NULL;
+    glb->avmpack_platform_data = NULL;
+    Module *mod = module_new_from_iff_binary(glb, beam_file->mapped, beam_file->size);
+    if (IS_NULL_PTR(mod)) {
+        fprintf(stderr, "Cannot load benchmark module: %s\n", file_name);
+        globalcontext_destroy(glb);
+        mapped_file_close(beam_file);
+        return 0;
+    }
+    globalcontext_insert_module_with_filename(glb, mod, file_name);
+    Context *ctx = context_new(glb);
+    ctx->leader = 1;
+
+    double start_ms = now_ms();
+    context_execute_loop(ctx, mod, "start", 0);
+    double wall_ms = now_ms() - start_ms;
+
+    term result = ctx->x[0];
+    int64_t value = 0;
+    int valid_result = 0;
+    if (term_is_integer(result)) {
+        value = term_to_int64(result);
+        valid_result = 1;
+    } else if (term_is_boxed_integer(result)) {
+        value = term_unbox_int64(result);
+        valid_result = 1;
+    }
+
+    context_destroy(ctx);
+
+    struct BenchmarkStats stats;
+    collect_stats(glb, &stats);
+
+    printf("{\"benchmark\": \"%s\", \"run\": %i, \"result\": %" PRId64 ", \"wall_ms\": %.3f, "
+        "\"reductions\": %" PRIu64 ", \"reductions_per_s\": %.0f, \"minor_gcs\": %lu, \"major_gcs\": %lu",
+        benchmark->name, run, value, wall_ms, stats.reductions,
+        (wall_ms > 0) ? stats.reductions * 1000.0 / wall_ms : 0.0, stats.minor_gcs, stats.major_gcs);
+    #ifdef AVM_ENABLE_OPCODE_COUNTERS
+        print_opcode_counters(glb);
+    #endif
+    printf("}\n");
+    fflush(stdout);
+
+    globalcontext_destroy(glb);
+    module_destroy(mod);
+    mapped_file_close(beam_file);
+
+    if (!valid_result || (value != benchmark->expected_value)) {
+        fprintf(stderr, "Benchmark %s returned an unexpected value.\n", benchmark->name);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int is_selected(const char *name, int argc, char **argv, int first_name_arg)
+{
+    if (first_name_arg >= argc) {
+        return 1;
+    }
+
+    for (int i = first_name_arg; i < argc; i++) {
+        if (!strcmp(argv[i], name)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 1;
+    int first_name_arg = 1;
+    if ((argc >= 3) && !strcmp(argv[1], "-n")) {
+        runs = atoi(argv[2]);
+        first_name_arg = 3;
+    }
+    if (runs < 1) {
+        fprintf(stderr, "Usage: %s [-n runs] [benchmark ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (chdir(dirname(argv[0])) || chdir("benchmarks")) {
+        return EXIT_FAILURE;
+    }
+
+    int failed = 0;
+    for (const struct Benchmark *benchmark = benchmarks; benchmark->name; benchmark++) {
+        if (!is_selected(benchmark->name, argc, argv, first_name_arg)) {
+            continue;
+        }
+        for (int run = 1; run <= runs; run++) {
+            if (!run_benchmark(benchmark, run)) {
+                failed++;
+                break;
+            }
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+-module(bench_binary_split).
+-export([start/0]).
+
+-define(ITERATIONS, 20000).
+
+start() ->
+    loop(?ITERATIONS, <<"alpha,beta,gamma,delta,epsilon,zeta,eta,theta">>, 0).
+
+loop(0, _Line, Acc) ->
+    Acc;
+loop(N, Line, Acc) ->
+    loop(N - 1, Line, Acc + count_fields(Line, 0)).
+
+count_fields(Bin, Count) ->
+    case binary:split(Bin, <<",">>) of
+        [_Field, Rest] -> count_fields(Rest, Count + 1);
+        [_Last] -> Count + 1
+    end.
@@ -0,0 +1,11 @@
+-module(bench_fib).
+-export([start/0]).
+
+-define(N, 27).
+
+start() ->
+    fib(?N).
+
+fib(0) -> 0;
+fib(1) -> 1;
+fib(N) -> fib(N - 1) + fib(N - 2).
@@ -0,0 +1,28 @@
+-module(bench_gc).
+-export([start/0]).
+
+-define(ITERATIONS, 20000).
+-define(GARBAGE_LENGTH, 50).
+-define(LIVE_ITEMS, 16).
+
+start() ->
+    loop(?ITERATIONS, [], 0).
+
+% every iteration allocates a new list, only the last ?LIVE_ITEMS ones survive
+loop(0, _Live, Acc) ->
+    Acc;
+loop(N, Live, Acc) ->
+    Garbage = make_garbage(?GARBAGE_LENGTH, []),
+    loop(N - 1, take(?LIVE_ITEMS, [Garbage | Live], []), Acc + length(Garbage)).
+
+make_garbage(0, Acc) ->
+    Acc;
+make_garbage(N, Acc) ->
+    make_garbage(N - 1, [{N, N} | Acc]).
+
+take(0, _List, Acc) ->
+    Acc;
+take(_N, [], Acc) ->
+    Acc;
+take(N, [H | T], Acc) ->
+    take(N - 1, T, [H | Acc]).
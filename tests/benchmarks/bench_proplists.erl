@@ -0,0 +1,41 @@
+-module(bench_proplists).
+-export([start/0]).
+
+-define(ITERATIONS, 5000).
+-define(KEYS, 20).
+
+start() ->
+    loop(?ITERATIONS, make_proplist(?KEYS, []), 0).
+
+make_proplist(0, Acc) ->
+    [verbose | Acc];
+make_proplist(N, Acc) ->
+    make_proplist(N - 1, [{N, N * 10} | Acc]).
+
+loop(0, _PropList, Acc) ->
+    Acc;
+loop(N, PropList, Acc) ->
+    Verbose = case get_value(verbose, PropList, false) of
+        true -> 1;
+        false -> 0
+    end,
+    Sum = lookup_keys(?KEYS, PropList, 0) + Verbose + get_value(missing, PropList, 0),
+    loop(N - 1, PropList, Acc + Sum).
+
+lookup_keys(0, _PropList, Acc) ->
+    Acc;
+lookup_keys(Key, PropList, Acc) ->
+    lookup_keys(Key - 1, PropList, Acc + get_value(Key, PropList, 0)).
+
+get_value(Key, PropList, Default) ->
+    case lists:keyfind(Key, 1, PropList) of
+        {Key, Value} -> Value;
+        false -> get_atom_value(Key, PropList, Default)
+    end.
+
+get_atom_value(_Key, [], Default) ->
+    Default;
+get_atom_value(Key, [Key | _T], _Default) ->
+    true;
+get_atom_value(Key, [_H | T], Default) ->
+    get_atom_value(Key, T, Default).
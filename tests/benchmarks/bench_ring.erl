@@ -0,0 +1,35 @@
+-module(bench_ring).
+-export([start/0, node/1]).
+
+-define(PROCESSES, 1000).
+-define(LAPS, 100).
+
+start() ->
+    First = spawn_ring(?PROCESSES, self()),
+    Hops = pass(First, ?PROCESSES * ?LAPS, 0),
+    First ! stop,
+    receive
+        stop -> Hops
+    end.
+
+spawn_ring(0, Next) ->
+    Next;
+spawn_ring(N, Next) ->
+    spawn_ring(N - 1, spawn(?MODULE, node, [Next])).
+
+pass(_First, 0, Hops) ->
+    Hops;
+pass(First, Remaining, Hops) ->
+    First ! {token, 0},
+    receive
+        {token, Count} -> pass(First, Remaining - Count, Hops + Count)
+    end.
+
+node(Next) ->
+    receive
+        {token, Count} ->
+            Next ! {token, Count + 1},
+            node(Next);
+        stop ->
+            Next ! stop
+    end.
@@ -0,0 +1,34 @@
+-module(bench_selective_receive).
+-export([start/0]).
+
+-define(BACKLOG, 1000).
+-define(ITERATIONS, 2000).
+
+start() ->
+    Self = self(),
+    fill(?BACKLOG, Self),
+    Result = loop(?ITERATIONS, Self, 0),
+    flush(?BACKLOG),
+    Result.
+
+fill(0, _Self) ->
+    ok;
+fill(N, Self) ->
+    Self ! {filler, N},
+    fill(N - 1, Self).
+
+% each receive has to skip the whole backlog before finding the matching message
+loop(0, _Self, Acc) ->
+    Acc;
+loop(N, Self, Acc) ->
+    Self ! {match, N},
+    receive
+        {match, Value} -> loop(N - 1, Self, Acc + Value)
+    end.
+
+flush(0) ->
+    ok;
+flush(N) ->
+    receive
+        {filler, _} -> flush(N - 1)
+    end.
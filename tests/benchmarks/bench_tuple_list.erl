@@ -0,0 +1,25 @@
+-module(bench_tuple_list).
+-export([start/0]).
+
+-define(ITERATIONS, 2000).
+-define(LENGTH, 100).
+
+start() ->
+    loop(?ITERATIONS, 0).
+
+loop(0, Acc) ->
+    Acc;
+loop(N, Acc) ->
+    List = build_list(?LENGTH, []),
+    Tuples = [{X, X * 2, [X]} || X <- List],
+    loop(N - 1, Acc + sum(Tuples, 0)).
+
+build_list(0, Acc) ->
+    Acc;
+build_list(N, Acc) ->
+    build_list(N - 1, [N | Acc]).
+
+sum([], Acc) ->
+    Acc;
+sum([{A, B, [C]} | T], Acc) ->
+    sum(T, Acc + A + B + C).
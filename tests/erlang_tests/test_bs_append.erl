@@ -0,0 +1,35 @@
+-module(test_bs_append).
+-export([start/0]).
+
+start() ->
+    Bin = append(200, <<>>),
+    Packet = encode(258, list_to_binary("abc")),
+    Prefix = list_to_binary("xy"),
+    A = add_byte(Prefix, 1),
+    B = add_byte(A, 2),
+    C = add_byte(A, 3),
+    byte_size(Bin) + sum(Bin, 0)
+    + byte_size(Packet) + check(Packet, list_to_binary([1, 2, 3, "abc", 16#56]))
+    + check(<< <<X>> || X <- [1, 2, 3, 4] >>, list_to_binary([1, 2, 3, 4]))
+    + check(B, list_to_binary(["xy", 1, 2])) + check(C, list_to_binary(["xy", 1, 3])).
+
+append(0, Acc) ->
+    Acc;
+append(N, Acc) ->
+    append(N - 1, <<Acc/binary, N:16>>).
+
+add_byte(Bin, Byte) ->
+    <<Bin/binary, Byte>>.
+
+encode(Type, Payload) ->
+    <<Type:16, (byte_size(Payload)):8, Payload/binary, 5:4, 6:4>>.
+
+sum(<<X:16, Rest/binary>>, Acc) ->
+    sum(Rest, Acc + X);
+sum(<<>>, Acc) ->
+    Acc.
+
+check(Bin, Bin) ->
+    1;
+check(_Bin1, _Bin2) ->
+    0.
@@ -0,0 +1,35 @@
+-module(test_bs_match).
+-export([start/0]).
+
+start() ->
+    Records = list_to_binary(make_records(50, [])),
+    sum_records(Records, 0)
+    + parse_header(list_to_binary("GET /index")) + parse_header(list_to_binary("PUT /")) + parse_header(<<"HEAD">>)
+    + decode_little(list_to_binary([254, 255, 16#35]))
+    + decode_unaligned(list_to_binary([255, 0])).
+
+make_records(0, Acc) ->
+    Acc;
+make_records(N, Acc) ->
+    make_records(N - 1, [N, 3, N, N, N | Acc]).
+
+sum_records(<<_Type:8, Len:8, Payload:Len/binary, Rest/binary>>, Acc) ->
+    sum_records(Rest, Acc + byte_size(Payload) + first(Payload));
+sum_records(<<>>, Acc) ->
+    Acc.
+
+first(<<A, _/binary>>) ->
+    A.
+
+parse_header(<<"GET ", Path/binary>>) ->
+    byte_size(Path);
+parse_header(<<"PUT ", _/binary>>) ->
+    100;
+parse_header(_) ->
+    0.
+
+decode_little(<<A:16/little-signed, B:4, C:4>>) ->
+    A * 100 + B * 10 + C.
+
+decode_unaligned(<<_:3, X:10, _:3>>) ->
+    X.
@@ -0,0 +1,71 @@
+-module(test_concurrent_messages).
+-export([start/0, producer/3, relay/1]).
+
+-define(PRODUCERS, 8).
+-define(MESSAGES, 500).
+
+% every producer sends its messages both directly and through a relay, none of them must be lost and messages
+% between two processes must arrive in the order they were sent, also when schedulers run processes in parallel
+start() ->
+    Relay = spawn(?MODULE, relay, [self()]),
+    ok = spawn_producers(?PRODUCERS, self(), Relay),
+    Counters = receive_all(?PRODUCERS * ?MESSAGES * 2, init_counters(?PRODUCERS, [])),
+    Relay ! stop,
+    ok = check_counters(Counters),
+    ?PRODUCERS * ?MESSAGES * 2.
+
+spawn_producers(0, _Collector, _Relay) ->
+    ok;
+spawn_producers(N, Collector, Relay) ->
+    spawn(?MODULE, producer, [N, Collector, Relay]),
+    spawn_producers(N - 1, Collector, Relay).
+
+producer(Id, Collector, Relay) ->
+    produce(Id, Collector, Relay, 0).
+
+produce(_Id, _Collector, _Relay, ?MESSAGES) ->
+    ok;
+produce(Id, Collector, Relay, Seq) ->
+    Collector ! {direct, Id, Seq},
+    Relay ! {relayed, Id, Seq},
+    produce(Id, Collector, Relay, Seq + 1).
+
+relay(Collector) ->
+    receive
+        stop ->
+            ok;
+        Msg ->
+            Collector ! Msg,
+            relay(Collector)
+    end.
+
+receive_all(0, Counters) ->
+    Counters;
+receive_all(N, Counters) ->
+    receive
+        {Via, Id, Seq} ->
+            Seq = get_counter({Via, Id}, Counters),
+            receive_all(N - 1, set_counter({Via, Id}, Seq + 1, Counters))
+    after 5000 ->
+        {lost, N}
+    end.
+
+init_counters(0, Acc) ->
+    Acc;
+init_counters(N, Acc) ->
+    init_counters(N - 1, [{{direct, N}, 0}, {{relayed, N}, 0} | Acc]).
+
+get_counter(Key, [{Key, Value} | _T]) ->
+    Value;
+get_counter(Key, [_H | T]) ->
+    get_counter(Key, T).
+
+set_counter(Key, Value, [{Key, _Old} | T]) ->
+    [{Key, Value} | T];
+set_counter(Key, Value, [H | T]) ->
+    [H | set_counter(Key, Value, T)].
+
+check_counters([]) ->
+    ok;
+check_counters([{_Key, ?MESSAGES} | T]) ->
+    check_counters(T).
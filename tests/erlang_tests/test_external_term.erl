@@ -0,0 +1,60 @@
+-module(test_external_term).
+-export([start/0]).
+
+start() ->
+    N = 41,
+    Fun = fun(X) -> X + N end,
+    Decoded = binary_to_term(term_to_binary(Fun)),
+    round_trip({a, [1, 2, 3], {<<"b">>, -5}, 100000, 1 bsl 40, -(1 bsl 40)})
+    + round_trip([1, "abc", 1000 | tail]) * 2
+    + round_trip(#{a => 1, <<"k">> => [x], {1, 2} => #{}}) * 4
+    + round_trip(make_ref()) * 8
+    + round_trip(self()) * 16
+    + round_trip(make_binary(200, [])) * 32
+    + check(Decoded(1), 42) * 64
+    + check(term_to_binary({a, 1}), <<131, 104, 2, 119, 1, 97, 97, 1>>) * 128
+    + bad_binary(<<131, 104, 2, 200>>) * 256
+    + round_trip(make_map(40, #{})) * 512
+    + check(big_literal(), make_map(40, #{})) * 1024
+    + bad_binary(<<131, 116, 0, 0, 0, 2, 97, 1, 97, 1, 97, 1, 97, 2>>) * 2048
+    + bad_binary(list_to_binary([131, 116, 0, 0, 0, 40 | duplicated_keys(39, [97, 0, 97, 7])])) * 4096.
+
+round_trip(Term) ->
+    check(binary_to_term(term_to_binary(Term)), Term).
+
+make_binary(0, Acc) ->
+    list_to_binary(Acc);
+make_binary(N, Acc) ->
+    make_binary(N - 1, [N rem 256 | Acc]).
+
+make_map(0, Acc) ->
+    Acc;
+make_map(N, Acc) ->
+    make_map(N - 1, Acc#{N - 1 => N - 1}).
+
+% maps with more than 32 keys are hash maps also when they are literals
+big_literal() ->
+    #{
+        0 => 0, 1 => 1, 2 => 2, 3 => 3, 4 => 4, 5 => 5, 6 => 6, 7 => 7, 8 => 8, 9 => 9,
+        10 => 10, 11 => 11, 12 => 12, 13 => 13, 14 => 14, 15 => 15, 16 => 16, 17 => 17, 18 => 18, 19 => 19,
+        20 => 20, 21 => 21, 22 => 22, 23 => 23, 24 => 24, 25 => 25, 26 => 26, 27 => 27, 28 => 28, 29 => 29,
+        30 => 30, 31 => 31, 32 => 32, 33 => 33, 34 => 34, 35 => 35, 36 => 36, 37 => 37, 38 => 38, 39 => 39
+    }.
+
+% small integer keys from 0 to N - 1, followed by the entries in Acc
+duplicated_keys(0, Acc) ->
+    Acc;
+duplicated_keys(N, Acc) ->
+    duplicated_keys(N - 1, [97, N - 1, 97, N - 1 | Acc]).
+
+bad_binary(Binary) ->
+    try binary_to_term(Binary) of
+        _Any -> 0
+    catch
+        error:badarg -> 1
+    end.
+
+check(Value, Value) ->
+    1;
+check(_Value, _Expected) ->
+    0.
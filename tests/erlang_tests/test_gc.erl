@@ -0,0 +1,85 @@
+-module(test_gc).
+-export([start/0, loop/1]).
+
+start() ->
+    ok = test_nested(20),
+    Self = self(),
+    Pid = spawn(?MODULE, loop, [Self]), receive ok -> ok end,
+    {garbage_collection, GC} = process_info(Pid, garbage_collection),
+    0 = get_value(minor_gcs, GC),
+    0 = get_value(major_gcs, GC),
+    Pid ! {Self, grow, 200},
+    receive done -> ok end,
+    {garbage_collection, GC2} = process_info(Pid, garbage_collection),
+    assert(get_value(minor_gcs, GC2) + get_value(major_gcs, GC2) > 0),
+    Pid ! {Self, stop},
+    receive X -> X end.
+
+loop(Pid) ->
+    Pid ! ok,
+    loop(undefined, []).
+
+loop(undefined, Accum) ->
+    receive
+        {Pid, grow, N} ->
+            L = make_list(N, []),
+            Pid ! done,
+            loop(undefined, [L | Accum]);
+        {Pid, stop} ->
+            Pid ! length(Accum)
+    end.
+
+make_list(0, Acc) ->
+    Acc;
+make_list(N, Acc) ->
+    make_list(N - 1, [{N, N * 2} | Acc]).
+
+% a structure with tuples, lists, heap binaries, refc binaries and sub binaries is checked after it has survived a
+% minor collection, after it has been promoted to the old heap and after a major collection
+test_nested(N) ->
+    Nested = make_nested(N),
+    Nested = make_nested(N),
+    wait_gc(gc_counts()),
+    Nested = make_nested(N),
+    wait_gc(gc_counts()),
+    Nested = make_nested(N),
+    {_Minor, Major} = gc_counts(),
+    true = erlang:garbage_collect(),
+    {_Minor2, Major2} = gc_counts(),
+    assert(Major2 > Major),
+    Nested = make_nested(N),
+    ok.
+
+make_nested(0) ->
+    [];
+make_nested(N) ->
+    Big = list_to_binary(make_bytes(100, N)),
+    Small = integer_to_binary(N),
+    Sub = binary:part(Big, 10, 50),
+    [{N, {Small, [Big, Sub]}, [N * 2, {Sub}]} | make_nested(N - 1)].
+
+make_bytes(0, _Byte) ->
+    [];
+make_bytes(N, Byte) ->
+    [(N + Byte) rem 256 | make_bytes(N - 1, Byte)].
+
+gc_counts() ->
+    {garbage_collection, GC} = process_info(self(), garbage_collection),
+    {get_value(minor_gcs, GC), get_value(major_gcs, GC)}.
+
+% allocates garbage until a collection has been performed
+wait_gc(Counts) ->
+    make_list(100, []),
+    case gc_counts() of
+        Counts ->
+            wait_gc(Counts);
+        _ ->
+            ok
+    end.
+
+get_value(Key, [{Key, Value} | _T]) ->
+    Value;
+get_value(Key, [_H | T]) ->
+    get_value(Key, T).
+
+assert(true) -> ok.
@@ -0,0 +1,75 @@
+-module(test_heap_growth).
+-export([start/0, worker/1]).
+
+start() ->
+    ok = test_strategy(minimum),
+    ok = test_strategy(doubling),
+    ok = test_strategy(fibonacci),
+    1.
+
+test_strategy(Strategy) ->
+    Pid = spawn_opt(?MODULE, worker, [self()], [{heap_growth, Strategy}]),
+    {garbage_collection, GC} = process_info(Pid, garbage_collection),
+    Strategy = get_value(heap_growth, GC),
+    {memory, Memory0} = process_info(Pid, memory),
+
+    % 5000 cons cells and 2-tuples, 5 words each, are kept alive by the worker
+    Pid ! {self(), grow, 5000},
+    receive grown -> ok end,
+    {heap_size, HeapSize1} = process_info(Pid, heap_size),
+    {memory, Memory1} = process_info(Pid, memory),
+    assert(HeapSize1 >= 5000 * 5),
+    assert(Memory1 > Memory0),
+
+    % the list is dropped, the heap is shrunk by the next major collections
+    Pid ! {self(), shrink, Memory1},
+    shrunk = receive Reply -> Reply end,
+    {heap_size, HeapSize2} = process_info(Pid, heap_size),
+    {memory, Memory2} = process_info(Pid, memory),
+    assert(HeapSize2 < HeapSize1),
+    assert(Memory2 < Memory1),
+
+    Pid ! {self(), stop},
+    receive
+        {stopped, 0} -> ok
+    end.
+
+worker(Pid) ->
+    loop(Pid, []).
+
+loop(Pid, Data) ->
+    receive
+        {Pid, grow, N} ->
+            L = make_list(N, []),
+            Pid ! grown,
+            loop(Pid, L);
+        {Pid, shrink, Memory} ->
+            shrink(Pid, Memory, 10000);
+        {Pid, stop} ->
+            Pid ! {stopped, length(Data)}
+    end.
+
+% short lived garbage triggers collections until the heap is smaller than Memory
+shrink(Pid, _Memory, 0) ->
+    Pid ! not_shrunk;
+shrink(Pid, Memory, N) ->
+    make_list(100, []),
+    case process_info(self(), memory) of
+        {memory, M} when M < Memory ->
+            Pid ! shrunk,
+            loop(Pid, []);
+        _ ->
+            shrink(Pid, Memory, N - 1)
+    end.
+
+make_list(0, Acc) ->
+    Acc;
+make_list(N, Acc) ->
+    make_list(N - 1, [{N, N} | Acc]).
+
+get_value(Key, [{Key, Value} | _T]) ->
+    Value;
+get_value(Key, [_H | T]) ->
+    get_value(Key, T).
+
+assert(true) -> ok.
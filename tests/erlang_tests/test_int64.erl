@@ -0,0 +1,32 @@
+-module(test_int64).
+-export([start/0, id/1]).
+
+start() ->
+    Big = fact(id(20), 1),
+    Parsed = list_to_integer(integer_to_list(Big)),
+    <<Decoded:64/signed>> = <<(-Big):64/signed>>,
+    Max = id(16#7FFFFFFFFFFFFFFF),
+    (Big div fact(id(18), 1))
+    + check(Parsed =:= Big) + check(Decoded =:= -Big)
+    + check(Big > id(1 bsl 60)) + check(-Big < id(-(1 bsl 60)))
+    + (Max bsr 61) + safe_add(Max, 1) + ((Big band 16#FFFF0000) bsr 16).
+
+fact(0, Acc) ->
+    Acc;
+fact(N, Acc) ->
+    fact(N - 1, Acc * N).
+
+safe_add(A, B) ->
+    try id(A) + id(B) of
+        Any -> Any
+    catch
+        error:overflow -> 1000
+    end.
+
+check(true) ->
+    1;
+check(false) ->
+    0.
+
+id(I) ->
+    I.
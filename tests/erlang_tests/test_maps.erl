@@ -0,0 +1,39 @@
+-module(test_maps).
+-export([start/0]).
+
+start() ->
+    Small = #{a => 1, b => 2},
+    Updated = Small#{b := 20, c => 3},
+    #{a := A, b := B, c := C} = Updated,
+    Big = build(1, 100, #{}),
+    Half = remove(51, 100, Big),
+    FromList = maps:from_list(pairs(100, [])),
+    A + B + C + map_size(Big) + sum(100, Big, 0) + check(FromList, Big)
+    + map_size(Half) + check(maps:merge(Half, Big), Big) + maps:get(70, Half, 7)
+    + length(maps:keys(Big)).
+
+build(N, Max, Map) when N > Max ->
+    Map;
+build(N, Max, Map) ->
+    build(N + 1, Max, Map#{N => N * 2}).
+
+remove(N, Max, Map) when N > Max ->
+    Map;
+remove(N, Max, Map) ->
+    remove(N + 1, Max, maps:remove(N, Map)).
+
+pairs(0, Acc) ->
+    Acc;
+pairs(N, Acc) ->
+    pairs(N - 1, [{N, N * 2} | Acc]).
+
+sum(0, _Map, Acc) ->
+    Acc;
+sum(N, Map, Acc) ->
+    #{N := Value} = Map,
+    sum(N - 1, Map, Acc + Value).
+
+check(Map, Map) ->
+    1;
+check(_Map1, _Map2) ->
+    0.
@@ -0,0 +1,39 @@
+-module(test_maps_atom_keys).
+-export([start/0]).
+
+start() ->
+    % atoms are created at runtime, so their order in the atom table is not alphabetical
+    Zebra = list_to_atom("test_zebra"),
+    Apple = list_to_atom("test_apple"),
+    Mango = list_to_atom("test_mango"),
+    Map = maps:from_list([{Zebra, 1}, {Apple, 2}, {Mango, 3}]),
+    ["test_apple", "test_mango", "test_zebra"] = atoms_to_lists(maps:keys(Map)),
+    [{Apple, 2}, {Mango, 3}, {Zebra, 1}] = maps:to_list(Map),
+    Map = maps:put(Apple, 2, maps:put(Zebra, 1, #{Mango => 3})),
+    3 = maps:get(Mango, Map),
+    0 = map_size(maps:remove(Apple, maps:remove(Mango, maps:remove(Zebra, Map)))),
+
+    % maps with the same size are compared by their keys in term order, and then by their values in key order
+    true = #{Apple => 1, Mango => 1} < #{Apple => 1, Zebra => 1},
+    true = #{Apple => 1, Zebra => 2} < #{Apple => 2, Zebra => 1},
+    Big1 = maps:from_list(numbered_atoms(1, 33)),
+    Big2 = maps:put(numbered_atom(0), 0, maps:remove(numbered_atom(1), Big1)),
+    true = Big2 < Big1,
+
+    [V1, V2, V3] = maps:values(Map),
+    V1 * 100 + V2 * 10 + V3.
+
+atoms_to_lists([]) ->
+    [];
+atoms_to_lists([H | T]) ->
+    [atom_to_list(H) | atoms_to_lists(T)].
+
+% atoms are created from the first one
+numbered_atoms(N, Max) when N > Max ->
+    [];
+numbered_atoms(N, Max) ->
+    Atom = numbered_atom(N),
+    [{Atom, N} | numbered_atoms(N + 1, Max)].
+
+numbered_atom(N) ->
+    list_to_atom("test_key_" ++ integer_to_list(N)).
@@ -0,0 +1,46 @@
+-module(test_message_fragments).
+-export([start/0, forwarder/1, worker/2]).
+
+start() ->
+    Self = self(),
+    Workers = [spawn(?MODULE, worker, [Self, 0]) || _ <- [1, 2, 3]],
+    Forwarder = spawn(?MODULE, forwarder, [Workers]),
+    send_packets(Forwarder, 500),
+    Forwarder ! stop,
+    collect(Workers, 0).
+
+send_packets(_Forwarder, 0) ->
+    ok;
+send_packets(Forwarder, N) ->
+    Forwarder ! {packet, N, [N, {N}], <<N:16, "payload">>},
+    send_packets(Forwarder, N - 1).
+
+forwarder(Workers) ->
+    receive
+        {packet, _N, _List, _Bin} = Packet ->
+            forward(Workers, Packet),
+            forwarder(Workers);
+        stop ->
+            forward(Workers, stop)
+    end.
+
+forward([], _Message) ->
+    ok;
+forward([Worker | Tail], Message) ->
+    Worker ! Message,
+    forward(Tail, Message).
+
+worker(Parent, Acc) ->
+    receive
+        {packet, N, [N, {N}], <<N:16, "payload">>} ->
+            worker(Parent, Acc + N);
+        stop ->
+            Parent ! {self(), Acc}
+    end.
+
+collect([], Acc) ->
+    Acc;
+collect([Worker | Tail], Acc) ->
+    receive
+        {Worker, Sum} -> collect(Tail, Acc + Sum)
+    end.
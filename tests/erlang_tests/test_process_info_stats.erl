@@ -0,0 +1,88 @@
+-module(test_process_info_stats).
+-export([start/0, loop/1]).
+
+start() ->
+    Self = self(),
+    Pid = spawn(?MODULE, loop, [Self]), receive ready -> ok end,
+    test_items(Pid, Self) + test_list(Pid) + test_default(Pid) + test_badarg(Pid) +
+        test_statistics() + test_dead(Pid, Self).
+
+test_items(Pid, Self) ->
+    {messages_sent, Sent} = process_info(Pid, messages_sent),
+    {messages_received, Received} = process_info(Pid, messages_received),
+    {reductions, Reductions} = process_info(Pid, reductions),
+    Pid ! {Self, ping}, receive pong -> ok end,
+    {messages_sent, Sent2} = process_info(Pid, messages_sent),
+    {messages_received, Received2} = process_info(Pid, messages_received),
+    {reductions, Reductions2} = process_info(Pid, reductions),
+    {run_time, RunTime} = process_info(Pid, run_time),
+    {status, waiting} = process_info(Pid, status),
+    {current_function, {?MODULE, loop, 1}} = process_info(Pid, current_function),
+    {current_function, {erlang, process_info, 2}} = process_info(self(), current_function),
+    {status, running} = process_info(self(), status),
+    bool_to_n(Sent2 =:= Sent + 1) + bool_to_n(Received2 =:= Received + 1) +
+        bool_to_n(Reductions2 > Reductions) + bool_to_n(is_integer(RunTime) andalso RunTime >= 0).
+
+test_list(Pid) ->
+    [{status, waiting}, {message_queue_len, 0}, {messages_sent, _}] =
+        process_info(Pid, [status, message_queue_len, messages_sent]),
+    [] = process_info(Pid, []),
+    10.
+
+test_default(Pid) ->
+    Info = process_info(Pid),
+    Keys = [K || {K, _V} <- Info],
+    [current_function, status, message_queue_len, heap_size, stack_size, reductions,
+        memory, garbage_collection, messages_sent, messages_received, run_time] = Keys,
+    20.
+
+test_badarg(Pid) ->
+    bool_to_n(raises_badarg(fun() -> process_info(Pid, [status | foo]) end)) +
+        bool_to_n(raises_badarg(fun() -> process_info(Pid, [status, not_an_item]) end)) +
+        bool_to_n(raises_badarg(fun() -> process_info(foo) end)) +
+        bool_to_n(raises_badarg(fun() -> erlang:statistics(not_a_statistic) end)).
+
+test_statistics() ->
+    {Reductions, _} = erlang:statistics(reductions),
+    {Reductions2, SinceLast} = erlang:statistics(reductions),
+    {RunTime, _} = erlang:statistics(runtime),
+    {WallClock, _} = erlang:statistics(wall_clock),
+    RunQueue = erlang:statistics(run_queue),
+    bool_to_n(Reductions2 >= Reductions andalso SinceLast =:= Reductions2 - Reductions) * 100 +
+        bool_to_n(is_integer(RunTime) andalso is_integer(WallClock)) * 100 +
+        bool_to_n(is_integer(RunQueue) andalso RunQueue >= 0) * 100.
+
+test_dead(Pid, Self) ->
+    Pid ! {Self, stop}, receive stopped -> ok end,
+    wait_exit(Pid),
+    undefined = process_info(Pid),
+    undefined = process_info(Pid, [status]),
+    1000.
+
+wait_exit(Pid) ->
+    case process_info(Pid, status) of
+        undefined -> ok;
+        _ -> receive after 1 -> wait_exit(Pid) end
+    end.
+
+raises_badarg(Fun) ->
+    try Fun() of
+        _ -> false
+    catch
+        error:badarg -> true
+    end.
+
+loop(undefined) ->
+    receive
+        {Pid, stop} ->
+            Pid ! stopped;
+        {Pid, ping} ->
+            Pid ! pong,
+            loop(undefined)
+    end;
+loop(Pid) ->
+    Pid ! ready,
+    loop(undefined).
+
+bool_to_n(true) -> 1;
+bool_to_n(false) -> 0.
@@ -0,0 +1,92 @@
+-module(test_process_table).
+-export([start/0, worker/1]).
+
+start() ->
+    Pids = spawn_workers(200, []),
+    Dead = hd(Pids),
+    register(table_first, Dead),
+    Sum = ask_all(Pids, 0),
+    sleep(50),
+    NewPids = spawn_workers(200, []),
+    Dead ! {self(), ping},
+    Stale = check(not is_process_alive(Dead)) + check(whereis(table_first) =:= undefined),
+    [First, Second | Others] = NewPids,
+    register(table_last, First),
+    % a name is not replaced, a process has just one name and must be alive
+    badarg = register_error(table_last, Second),
+    badarg = register_error(table_other, First),
+    badarg = register_error(table_dead, Dead),
+    badarg = register_error(undefined, Second),
+    Registered = check(whereis(table_last) =:= First),
+    ok = register_all([Second | Others], 2),
+    % names of exited processes are removed, the other ones must still be found
+    {Exiting, Alive} = split(100, NewPids, []),
+    Sum2 = ask_all(Exiting, 0),
+    sleep(50),
+    undefined = whereis(table_last),
+    0 = count_registered(Exiting, 1, 0),
+    100 = count_registered(Alive, 101, 0),
+    Sum3 = ask_all(Alive, 0),
+    Sum + Sum2 + Sum3 + Stale * 100000 + Registered * 1000000.
+
+spawn_workers(0, Acc) ->
+    Acc;
+spawn_workers(N, Acc) ->
+    Pid = spawn(?MODULE, worker, [N]),
+    spawn_workers(N - 1, [Pid | Acc]).
+
+worker(N) ->
+    receive
+        {Pid, ping} ->
+            Pid ! {self(), N}
+    end.
+
+register_all([], _N) ->
+    ok;
+register_all([Pid | Tail], N) ->
+    register(worker_name(N), Pid),
+    register_all(Tail, N + 1).
+
+register_error(Name, Pid) ->
+    try register(Name, Pid) of
+        _ -> ok
+    catch
+        error:Reason -> Reason
+    end.
+
+count_registered([], _N, Acc) ->
+    Acc;
+count_registered([Pid | Tail], N, Acc) ->
+    count_registered(Tail, N + 1, Acc + check(whereis(worker_name(N)) =:= Pid)).
+
+worker_name(N) ->
+    list_to_atom("table_worker_" ++ integer_to_list(N)).
+
+split(0, Tail, Acc) ->
+    {lists_reverse(Acc, []), Tail};
+split(N, [H | T], Acc) ->
+    split(N - 1, T, [H | Acc]).
+
+lists_reverse([], Acc) ->
+    Acc;
+lists_reverse([H | T], Acc) ->
+    lists_reverse(T, [H | Acc]).
+
+ask_all([], Acc) ->
+    Acc;
+ask_all([Pid | Tail], Acc) ->
+    Pid ! {self(), ping},
+    receive
+        {Pid, N} ->
+            ask_all(Tail, Acc + N)
+    end.
+
+check(true) ->
+    1;
+check(false) ->
+    0.
+
+sleep(MSecs) ->
+    receive
+        after MSecs -> ok
+    end.
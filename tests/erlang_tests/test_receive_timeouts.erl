@@ -0,0 +1,48 @@
+-module(test_receive_timeouts).
+-export([start/0, sleeper/2]).
+
+start() ->
+    spawn_sleepers(self(), 50),
+    InOrder = collect(50, -1, 0),
+    InOrder + cancelled_timeout() * 100.
+
+spawn_sleepers(_Parent, 0) ->
+    ok;
+spawn_sleepers(Parent, N) ->
+    spawn(?MODULE, sleeper, [Parent, ((N * 37) rem 50) * 10]),
+    spawn_sleepers(Parent, N - 1).
+
+sleeper(Parent, T) ->
+    receive
+        after T -> Parent ! {slept, T}
+    end.
+
+collect(0, _Last, InOrder) ->
+    InOrder;
+collect(N, Last, InOrder) ->
+    receive
+        {slept, T} when T > Last ->
+            collect(N - 1, T, InOrder + 1);
+        {slept, T} ->
+            collect(N - 1, T, InOrder)
+    end.
+
+cancelled_timeout() ->
+    Self = self(),
+    spawn(fun() -> receive after 10 -> Self ! hello end end),
+    Received =
+        receive
+            hello -> 1
+            after 1000 -> 0
+        end,
+    T0 = erlang:system_time(millisecond),
+    receive
+        after 50 -> ok
+    end,
+    Elapsed = erlang:system_time(millisecond) - T0,
+    Received * check(Elapsed >= 50 andalso Elapsed < 500).
+
+check(true) ->
+    1;
+check(false) ->
+    0.
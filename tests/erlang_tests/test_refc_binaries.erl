@@ -0,0 +1,124 @@
+-module(test_refc_binaries).
+-export([start/0, loop/0, keeper/2, producer/3]).
+
+-define(BIG_SIZE, 50000).
+
+start() ->
+    Bin = list_to_binary(make_list(200, [])),
+    Pid = spawn(?MODULE, loop, []),
+    Pid ! {self(), Bin},
+    Echo = receive X -> X end,
+    Bin2 = binary:part(Echo, 100, 100),
+    Pid ! {self(), Bin2},
+    Echo2 = receive Y -> Y end,
+    Pid ! stop,
+    ok = shared(make_binary(?BIG_SIZE), 3),
+    ok = sub_binary_keeps_parent(),
+    check(Echo, Bin) + check(Echo2, list_to_binary(lists_seq(100, 199))) + byte_size(Echo2).
+
+loop() ->
+    receive
+        {Pid, Bin} ->
+            Pid ! Bin,
+            loop();
+        stop ->
+            ok
+    end.
+
+% every process keeps the same big binary, none of them has a copy of it on its heap
+shared(Bin, N) ->
+    Keepers = spawn_keepers(N, []),
+    ok = send_all(Keepers, {keep, Bin}),
+    ok = stop_all(Keepers).
+
+spawn_keepers(0, Acc) ->
+    Acc;
+spawn_keepers(N, Acc) ->
+    Pid = spawn(?MODULE, keeper, [self(), undefined]),
+    {memory, Memory} = process_info(Pid, memory),
+    spawn_keepers(N - 1, [{Pid, Memory} | Acc]).
+
+send_all([], _Msg) ->
+    ok;
+send_all([{Pid, Memory0} | T], {keep, Bin} = Msg) ->
+    Pid ! Msg,
+    receive
+        {kept, Pid} -> ok
+    end,
+    {memory, Memory1} = process_info(Pid, memory),
+    true = Memory1 - Memory0 < byte_size(Bin) div 4,
+    send_all(T, Msg).
+
+stop_all([]) ->
+    ok;
+stop_all([{Pid, _Memory} | T]) ->
+    Pid ! stop,
+    stop_all(T).
+
+% the keeper holds just a slice of a binary created by a process that is gone, that must survive collections
+sub_binary_keeps_parent() ->
+    Keeper = spawn(?MODULE, keeper, [self(), undefined]),
+    {memory, Memory0} = process_info(Keeper, memory),
+    Producer = spawn(?MODULE, producer, [self(), Keeper, ?BIG_SIZE]),
+    receive
+        {produced, Producer} -> ok
+    end,
+    receive
+        {kept, Keeper} -> ok
+    end,
+    Keeper ! gc,
+    receive
+        {collected, Keeper} -> ok
+    end,
+    true = erlang:garbage_collect(),
+    {memory, Memory1} = process_info(Keeper, memory),
+    true = Memory1 - Memory0 < ?BIG_SIZE div 4,
+    Keeper ! {get, self()},
+    Slice =
+        receive
+            {Keeper, Kept} -> Kept
+        end,
+    Keeper ! stop,
+    1 = check(Slice, list_to_binary(lists_seq(1000, 1999))),
+    ok.
+
+producer(Parent, Keeper, Size) ->
+    Keeper ! {slice, make_binary(Size)},
+    Parent ! {produced, self()}.
+
+keeper(Parent, Kept) ->
+    receive
+        {keep, Bin} ->
+            Parent ! {kept, self()},
+            keeper(Parent, Bin);
+        {slice, Bin} ->
+            Parent ! {kept, self()},
+            keeper(Parent, binary:part(Bin, 1000, 1000));
+        gc ->
+            true = erlang:garbage_collect(),
+            Parent ! {collected, self()},
+            keeper(Parent, Kept);
+        {get, Pid} ->
+            Pid ! {self(), Kept},
+            keeper(Parent, Kept);
+        stop ->
+            ok
+    end.
+
+make_binary(Size) ->
+    list_to_binary(make_list(Size, [])).
+
+make_list(0, Acc) ->
+    Acc;
+make_list(N, Acc) ->
+    make_list(N - 1, [(N - 1) rem 256 | Acc]).
+
+lists_seq(From, To) when From > To ->
+    [];
+lists_seq(From, To) ->
+    [From rem 256 | lists_seq(From + 1, To)].
+
+check(Bin, Bin) ->
+    1;
+check(_Bin1, _Bin2) ->
+    0.
@@ -0,0 +1,45 @@
+-module(test_selective_receive).
+-export([start/0]).
+
+start() ->
+    send_junk(self(), 1000),
+    self() ! b,
+    self() ! a,
+    First =
+        receive
+            a -> 1
+        end,
+    Second =
+        receive
+            b -> 2
+        end,
+    Calls = calls(100, 0),
+    Timeout =
+        receive
+            nothing -> 0
+            after 0 -> 1
+        end,
+    {message_queue_len, Len} = erlang:process_info(self(), message_queue_len),
+    Junk = drain(0),
+    First + Second * 10 + Timeout * 100 + Calls * 1000 + Len + Junk.
+
+send_junk(_Pid, 0) ->
+    ok;
+send_junk(Pid, N) ->
+    Pid ! junk,
+    send_junk(Pid, N - 1).
+
+calls(0, Acc) ->
+    Acc;
+calls(N, Acc) ->
+    Ref = make_ref(),
+    self() ! {Ref, 1},
+    receive
+        {Ref, Value} -> calls(N - 1, Acc + Value)
+    end.
+
+drain(N) ->
+    receive
+        junk -> drain(N + 1)
+        after 0 -> N
+    end.
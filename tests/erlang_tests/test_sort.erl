@@ -0,0 +1,34 @@
+-module(test_sort).
+-export([start/0]).
+
+start() ->
+    Sorted = lists:sort([{b, 2}, a, [1], <<"x">>, 3, {a, 1}, [], 1, b, {a}]),
+    Keys = lists:keysort(2, [{c, 3}, {a, 1}, {b, 2}, {d, 1}]),
+    Unique = lists:usort([3, 1, 2, 3, 1, {x, [y]}, {x, [y]}]),
+    check(Sorted, [1, 3, a, b, {a}, {a, 1}, {b, 2}, [], [1], <<"x">>])
+    + check(Keys, [{a, 1}, {d, 1}, {b, 2}, {c, 3}]) * 2
+    + check(Unique, [1, 2, 3, {x, [y]}]) * 4
+    + check(lists:keyfind(b, 1, Keys), {b, 2}) * 8
+    + check(lists:keyfind(z, 1, Keys), false) * 16
+    + check(lists:sort(down(1, 1000, [])), up(1000, [])) * 32
+    + less([1, {2, [3]}], [1, {2, [4]}]) * 64.
+
+down(N, Max, Acc) when N > Max ->
+    Acc;
+down(N, Max, Acc) ->
+    down(N + 1, Max, [N | Acc]).
+
+up(0, Acc) ->
+    Acc;
+up(N, Acc) ->
+    up(N - 1, [N | Acc]).
+
+check(Value, Value) ->
+    1;
+check(_Value, _Expected) ->
+    0.
+
+less(A, B) when A < B ->
+    1;
+less(_A, _B) ->
+    0.
@@ -0,0 +1,46 @@
+-module(test_sub_binaries).
+-export([start/0, loop/0]).
+
+start() ->
+    Bin = list_to_binary(make_list(256, [])),
+    Parts = make_parts(Bin, 100, []),
+    [Tok, Rest] = binary:split(Bin, <<200>>),
+    Pid = spawn(?MODULE, loop, []),
+    Pid ! {self(), Rest},
+    Rest2 = receive X -> X end,
+    Pid ! stop,
+    check(Tok, list_to_binary(make_list(200, []))) + check(Rest2, <<201, 202, 203, 204, 205, 206, 207, 208, 209, 210,
+        211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225, 226, 227, 228, 229, 230, 231, 232, 233,
+        234, 235, 236, 237, 238, 239, 240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255>>)
+    + sum_sizes(Parts, 0).
+
+loop() ->
+    receive
+        {Pid, Bin} ->
+            Pid ! Bin,
+            loop();
+        stop ->
+            ok
+    end.
+
+make_parts(_Bin, 0, Acc) ->
+    Acc;
+make_parts(Bin, N, Acc) ->
+    Part = binary:part(Bin, N, 100),
+    N = binary:at(Part, 0),
+    make_parts(Bin, N - 1, [Part | Acc]).
+
+sum_sizes([], Acc) ->
+    Acc;
+sum_sizes([H | T], Acc) ->
+    sum_sizes(T, Acc + byte_size(H)).
+
+make_list(0, Acc) ->
+    Acc;
+make_list(N, Acc) ->
+    make_list(N - 1, [N - 1 | Acc]).
+
+check(Bin, Bin) ->
+    1;
+check(_Bin1, _Bin2) ->
+    0.
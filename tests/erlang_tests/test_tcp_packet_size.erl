@@ -0,0 +1,45 @@
+-module(test_tcp_packet_size).
+-export([start/0]).
+
+start() ->
+    Listen = open_port({spawn, "socket"}, []),
+    ok = call(Listen, {init, [{proto, tcp}, {packet, 4}, {packet_size, 100}]}),
+    {ok, Port} = call(Listen, {bind, {127, 0, 0, 1}, 0}),
+    ok = call(Listen, {listen, 5}),
+    AcceptRef = erlang:make_ref(),
+    Listen ! {self(), AcceptRef, {accept}},
+    Client = open_port({spawn, "socket"}, []),
+    ok = call(Client, {init, [{proto, tcp}]}),
+    ok = call(Client, {connect, {127, 0, 0, 1}, Port}),
+    Server =
+        receive
+            {AcceptRef, {ok, S}} ->
+                S
+        end,
+    {ok, _} = send(Client, <<0, 0, 0, 5, "hello">>),
+    {ok, <<"hello">>} = call(Server, {recv, 0, 0}),
+    % the length header is over packet_size, so the message is refused and the socket is closed
+    Rejected = 256,
+    {ok, _} = send(Client, <<Rejected:32, "hello">>),
+    {error, emsgsize} = call(Server, {recv, 0, 0}),
+    {error, closed} = call(Server, {recv, 0, 0}),
+    {error, closed} = call(Client, {recv, 0, 0}),
+    ok = call(Client, {close}),
+    ok = call(Listen, {close}),
+    Rejected.
+
+send(Socket, Data) ->
+    case call(Socket, {send, Data}) of
+        ok ->
+            {ok, byte_size(Data)};
+        Error ->
+            Error
+    end.
+
+call(Socket, Msg) ->
+    Ref = erlang:make_ref(),
+    Socket ! {self(), Ref, Msg},
+    receive
+        {Ref, Ret} ->
+            Ret
+    end.
@@ -0,0 +1,60 @@
+-module(test_timers).
+-export([start/0]).
+
+start() ->
+    send_timers(self(), 50),
+    InOrder = collect(50, -1, 0),
+    Checks = start_timer_message() + read_and_cancel() + registered_dest() + cancelled_is_not_sent(),
+    InOrder + Checks * 100.
+
+send_timers(_Dest, 0) ->
+    ok;
+send_timers(Dest, N) ->
+    T = ((N * 37) rem 50) * 10,
+    erlang:send_after(T, Dest, {fired, T}),
+    send_timers(Dest, N - 1).
+
+collect(0, _Last, InOrder) ->
+    InOrder;
+collect(N, Last, InOrder) ->
+    receive
+        {fired, T} when T > Last ->
+            collect(N - 1, T, InOrder + 1);
+        {fired, T} ->
+            collect(N - 1, T, InOrder)
+    end.
+
+start_timer_message() ->
+    Ref = erlang:start_timer(10, self(), {hello, [1, 2, 3]}),
+    receive
+        {timeout, Ref, {hello, [1, 2, 3]}} -> 1
+        after 1000 -> 0
+    end.
+
+read_and_cancel() ->
+    Ref = erlang:start_timer(60000, self(), never),
+    Left = erlang:read_timer(Ref),
+    Cancelled = erlang:cancel_timer(Ref),
+    check(Left =< 60000 andalso Cancelled =< Left andalso Cancelled > 59000 andalso
+          erlang:read_timer(Ref) =:= false andalso erlang:cancel_timer(Ref) =:= false).
+
+registered_dest() ->
+    erlang:register(test_timers_main, self()),
+    erlang:send_after(10, test_timers_main, by_name),
+    receive
+        by_name -> 1
+        after 1000 -> 0
+    end.
+
+cancelled_is_not_sent() ->
+    Ref = erlang:send_after(10, self(), cancelled),
+    Cancelled = erlang:cancel_timer(Ref),
+    receive
+        cancelled -> 0
+        after 50 -> check(is_integer(Cancelled))
+    end.
+
+check(true) ->
+    1;
+check(false) ->
+    0.
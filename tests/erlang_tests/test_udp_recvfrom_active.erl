@@ -0,0 +1,33 @@
+-module(test_udp_recvfrom_active).
+-export([start/0]).
+
+start() ->
+    Socket = open_port({spawn, "socket"}, []),
+    ok = call(Socket, {init, [{proto, udp}]}),
+    {ok, Port} = call(Socket, {bind, {127, 0, 0, 1}, 0}),
+    RecvRef = erlang:make_ref(),
+    Socket ! {self(), RecvRef, {recvfrom, 0, 0}},
+    {error, einval} = call(Socket, {setopts, [{active, true}]}),
+    {ok, 5} = call(Socket, {send, {127, 0, 0, 1}, Port, <<"hello">>}),
+    Passive =
+        receive
+            {RecvRef, {ok, {_Address, Port, Packet}}} ->
+                byte_size(Packet)
+        end,
+    ok = call(Socket, {setopts, [{active, true}]}),
+    {ok, 6} = call(Socket, {send, {127, 0, 0, 1}, Port, <<"world!">>}),
+    Active =
+        receive
+            {udp, Socket, _Address2, Port, Packet2} ->
+                byte_size(Packet2)
+        end,
+    ok = call(Socket, {close}),
+    Passive * 10 + Active.
+
+call(Socket, Msg) ->
+    Ref = erlang:make_ref(),
+    Socket ! {self(), Ref, Msg},
+    receive
+        {Ref, Ret} ->
+            Ret
+    end.
@@ -12,17 +12,17 @@ test() ->
 -include("etest.hrl").
 
 test_start_timer() ->
-    ?ASSERT_MATCH(timer_manager:get_timer_refs(), []),
     timer_manager:start_timer(100, self(), test_start_timer),
     wait_for_timeout(test_start_timer, 5000).
 
 test_cancel_timer() ->
-    ?ASSERT_MATCH(timer_manager:get_timer_refs(), []),
     TimerRef = timer_manager:start_timer(60000, self(), test_cancel_timer),
-    ?ASSERT_MATCH(timer_manager:get_timer_refs(), [TimerRef]),
-    timer_manager:cancel_timer(TimerRef),
-    %?TIMER:sleep(100),
-    ?ASSERT_MATCH(timer_manager:get_timer_refs(), []),
+    Remaining = timer_manager:read_timer(TimerRef),
+    ?ASSERT_TRUE(Remaining > 0 andalso Remaining =< 60000),
+    Cancelled = timer_manager:cancel_timer(TimerRef),
+    ?ASSERT_TRUE(Cancelled > 0 andalso Cancelled =< Remaining),
+    ?ASSERT_MATCH(timer_manager:read_timer(TimerRef), false),
+    ?ASSERT_MATCH(timer_manager:cancel_timer(TimerRef), false),
     ok.
 
 test_send_after() ->
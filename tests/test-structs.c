@@ -21,6 +21,7 @@
 #include <stdlib.h>
 
 #include "atomshashtable.h"
+#include "timer_wheel.h"
 #include "valueshashtable.h"
 #include "utils.h"
 
@@ -138,6 +139,82 @@ void test_valueshashtable()
     }
 }
 
+#define TIMER_WHEEL_TEST_ITEMS 2000
+
+void test_timer_wheel()
+{
+    static struct TimerWheel tw;
+    static struct TimerWheelItem items[TIMER_WHEEL_TEST_ITEMS];
+    static int expired_flags[TIMER_WHEEL_TEST_ITEMS];
+
+    uint64_t start = 1000000;
+    timer_wheel_init(&tw, start);
+    assert(timer_wheel_is_empty(&tw));
+
+    uint64_t seed = 12345;
+    uint64_t min_expiry = UINT64_MAX;
+    for (int i = 0; i < TIMER_WHEEL_TEST_ITEMS; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t distance;
+        switch (i % 4) {
+            case 0: distance = (seed >> 33) % 64; break;
+            case 1: distance = (seed >> 33) % 5000; break;
+            case 2: distance = (seed >> 33) % 500000; break;
+            default: distance = (seed >> 33) % 40000000; break;
+        }
+        timer_wheel_item_init(&items[i]);
+        timer_wheel_insert(&tw, &items[i], start - 10 + distance);
+        assert(timer_wheel_item_is_scheduled(&items[i]));
+        if (i % 7 == 0) {
+            timer_wheel_remove(&tw, &items[i]);
+            assert(!timer_wheel_item_is_scheduled(&items[i]));
+            expired_flags[i] = 1;
+        } else if (items[i].expiry < min_expiry) {
+            min_expiry = items[i].expiry;
+        }
+    }
+
+    uint64_t next;
+    assert(timer_wheel_next_event(&tw, &next));
+    assert(next <= (min_expiry > start ? min_expiry : start));
+
+    uint64_t now = start;
+    while (!timer_wheel_is_empty(&tw)) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        now += (seed >> 33) % 100000;
+
+        struct ListHead expired;
+        list_init(&expired);
+        timer_wheel_expire(&tw, now, &expired);
+
+        struct ListHead *item;
+        struct ListHead *tmp;
+        MUTABLE_LIST_FOR_EACH(item, tmp, &expired) {
+            struct TimerWheelItem *timer = GET_LIST_ENTRY(item, struct TimerWheelItem, head);
+            assert(timer->expiry <= now);
+            int index = timer - items;
+            assert(!expired_flags[index]);
+            expired_flags[index] = 1;
+            timer_wheel_item_init(timer);
+        }
+
+        for (int i = 0; i < TIMER_WHEEL_TEST_ITEMS; i++) {
+            assert(expired_flags[i] || (items[i].expiry > now));
+        }
+
+        if (timer_wheel_next_event(&tw, &next)) {
+            assert(next > now);
+            for (int i = 0; i < TIMER_WHEEL_TEST_ITEMS; i++) {
+                assert(expired_flags[i] || (items[i].expiry >= next));
+            }
+        }
+    }
+
+    for (int i = 0; i < TIMER_WHEEL_TEST_ITEMS; i++) {
+        assert(expired_flags[i]);
+    }
+}
+
 int main(int argc, char **argv)
 {
     UNUSED(argc);
@@ -145,6 +222,7 @@ int main(int argc, char **argv)
 
     test_atomshashtable();
     test_valueshashtable();
+    test_timer_wheel();
 
     return EXIT_SUCCESS;
 }
@@ -18,6 +18,7 @@
  ***************************************************************************/
 
 #include <assert.h>
+#include <inttypes.h>
 #include <libgen.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -158,6 +159,8 @@ struct Test tests[] =
     {"test_func_info2.beam", 1},
     {"test_func_info3.beam", 120},
     {"test_process_info.beam", 0},
+    {"test_gc.beam", 1},
+    {"test_heap_growth.beam", 1},
     {"test_min_heap_size.beam", 0},
     {"test_system_info.beam", 0},
     {"test_funs0.beam", 20},
@@ -255,18 +258,36 @@ struct Test tests[] =
     {"test_atom_to_binary.beam", 1},
 
     {"test_binary_part.beam", 12},
+    {"test_refc_binaries.beam", 102},
+    {"test_sub_binaries.beam", 10002},
     {"test_binary_split.beam", 16},
-
-    {"plusone.beam", 67108863},
+    {"test_bs_match.beam", 2358},
+    {"test_bs_append.beam", 20511},
+    {"test_maps.beam", 10383},
+    {"test_int64.beam", 34847},
+    {"test_process_table.beam", 1240200},
+    {"test_receive_timeouts.beam", 150},
+    {"test_timers.beam", 450},
+    {"test_selective_receive.beam", 102121},
+    {"test_message_fragments.beam", 375750},
+    {"test_sort.beam", 127},
+    {"test_external_term.beam", 8191},
+    {"test_process_info_stats.beam", 1338},
+    {"test_udp_recvfrom_active.beam", 56},
+    {"test_tcp_packet_size.beam", 256},
+    {"test_maps_atom_keys.beam", 231},
+    {"test_concurrent_messages.beam", 8000},
+
+    {"plusone.beam", 134217728},
     {"plusone2.beam", 1},
-    {"minusone.beam", -67108864},
+    {"minusone.beam", -134217729},
     {"minusone2.beam", -16},
-    {"int28mul.beam", 22369621},
-    {"int28mulneg.beam", -44739242},
-    {"int28mulneg2.beam", 134217724},
-    {"negdiv.beam", -134217718},
-    {"absovf.beam", -134217718},
-    {"negovf.beam", -134217718},
+    {"int28mul.beam", 134217728},
+    {"int28mulneg.beam", -268435456},
+    {"int28mulneg2.beam", 268435448},
+    {"negdiv.beam", 134217728},
+    {"absovf.beam", 134217728},
+    {"negovf.beam", 134217728},
 
     //TEST CRASHES HERE: {"memlimit.beam", 0},
 
@@ -303,9 +324,10 @@ int test_modules_execution()
 
         context_execute_loop(ctx, mod, "start", 0);
 
-        int32_t value = term_to_int32(ctx->x[0]);
+        term result = ctx->x[0];
+        int64_t value = term_is_boxed_integer(result) ? term_unbox_int64(result) : term_to_int32(result);
         if (value != test->expected_value) {
-            fprintf(stderr, "\x1b[1;31mFailed test module %s, got value: %i\x1b[0m\n", test->test_file, value);
+            fprintf(stderr, "\x1b[1;31mFailed test module %s, got value: %" PRId64 "\x1b[0m\n", test->test_file, value);
             failed_tests++;
         }
 